@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "coverage.h"
+#include "disassembler.h"
+
+Coverage* coverage_create(void) {
+  return calloc(1, sizeof(Coverage));
+}
+
+void coverage_destroy(Coverage* cov) {
+  free(cov);
+}
+
+// Coverage totals for one routine (or the whole image).
+typedef struct RoutineStats {
+  int instructions;
+  int executed_instructions;
+  int bytes;
+  int executed_bytes;
+  int data_read_bytes;
+} RoutineStats;
+
+static double percent(int part, int whole) {
+  return whole ? 100.0 * part / whole : 0.0;
+}
+
+static void print_stats(FILE* out, const char* label, uint16_t start, const RoutineStats* st) {
+  fprintf(out, "%04x  %-32s %5d/%-5d instr %6.1f%%  %5d/%-5d bytes %6.1f%%  %5d data\n",
+          start, label,
+          st->executed_instructions, st->instructions,
+          percent(st->executed_instructions, st->instructions),
+          st->executed_bytes, st->bytes, percent(st->executed_bytes, st->bytes),
+          st->data_read_bytes);
+}
+
+void coverage_write_report(FILE* out, const Coverage* cov, const uint8_t* memory,
+                           uint32_t size, const SymbolTable* symbols) {
+  int symbol_count = symbols ? symbols->count : 0;
+  RoutineStats* per_symbol = calloc(symbol_count + 1, sizeof(RoutineStats));
+  RoutineStats total = {0};
+  if (per_symbol == NULL) {
+    return;
+  }
+
+  // disassembler takes a non-const buffer; give it a padded copy so the last
+  // instruction can read its operands past the end of the image
+  unsigned char* code = calloc((size_t)size + 3, 1);
+  if (code == NULL) {
+    free(per_symbol);
+    return;
+  }
+  memcpy(code, memory, size);
+
+  // Annotated listing. Marker column:
+  //   X = executed, R = read as data, * = both, blank = never touched
+  fprintf(out, "; Coverage listing: X executed, R read as data, * both\n");
+  uint32_t pc = 0;
+  while (pc < size) {
+    const Symbol* sym = symbols ? symbols_lookup(symbols, pc) : NULL;
+    if (sym != NULL && sym->address == pc) {
+      fprintf(out, "\n%s:\n", sym->name);
+    }
+
+    bool executed = coverage_test(cov->executed, pc);
+    int length = instruction8080Length(code[pc]);
+    if (pc + length > size) {
+      length = size - pc;
+    }
+    // The sweep resyncs at every executed address. A byte that was never
+    // executed is listed as a data byte if it was only ever read as data, or
+    // if the instruction it would start runs over an executed opcode; the
+    // operand bytes of real code then line up.
+    bool data_only = false;
+    if (!executed) {
+      data_only = coverage_test(cov->read, pc);
+      for (int i = 1; i < length && !data_only; i++) {
+        data_only = coverage_test(cov->executed, pc + i);
+      }
+    }
+
+    bool read = false;
+    if (data_only) {
+      length = 1;
+      read = coverage_test(cov->read, pc);
+      fprintf(out, "%s%04x %02x       DB     #$%02x\n", read ? "R  " : "   ", pc, code[pc], code[pc]);
+    } else {
+      for (int i = 0; i < length; i++) {
+        read |= coverage_test(cov->read, pc + i);
+      }
+      fputs(executed && read ? "*  " : executed ? "X  " : read ? "R  " : "   ", out);
+      disassemble8080OpToFile(out, code, pc);
+    }
+
+    // attribute to routine (index symbol_count collects code before the first symbol)
+    int index = symbol_count;
+    if (sym != NULL) {
+      index = (int)(sym - symbols->symbols);
+    }
+    RoutineStats* st = &per_symbol[index];
+    RoutineStats* all[2] = { st, &total };
+    for (int k = 0; k < 2; k++) {
+      all[k]->instructions++;
+      all[k]->bytes += length;
+      if (executed) {
+        all[k]->executed_instructions++;
+        all[k]->executed_bytes += length;
+      }
+      for (int i = 0; i < length; i++) {
+        all[k]->data_read_bytes += coverage_test(cov->read, pc + i);
+      }
+    }
+
+    pc += length;
+  }
+
+  // Per-routine summary
+  fprintf(out, "\n; Summary per routine\n");
+  if (per_symbol[symbol_count].instructions > 0) {
+    print_stats(out, "(before first symbol)", 0, &per_symbol[symbol_count]);
+  }
+  for (int i = 0; i < symbol_count; i++) {
+    if (per_symbol[i].instructions > 0) {
+      print_stats(out, symbols->symbols[i].name, symbols->symbols[i].address, &per_symbol[i]);
+    }
+  }
+  fprintf(out, "\n");
+  print_stats(out, "TOTAL", 0, &total);
+
+  free(code);
+  free(per_symbol);
+}
@@ -0,0 +1,39 @@
+#ifndef COVERAGE_H
+#define COVERAGE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "symbols.h"
+
+// Guest code coverage: one bit per address for opcodes executed and one bit
+// per address for bytes read as data. The core marks bits when
+// State8080.coverage is non-NULL, which costs a branch and an OR per access.
+
+#define COVERAGE_BITMAP_BYTES (0x10000 / 8)
+
+typedef struct Coverage {
+  uint8_t executed[COVERAGE_BITMAP_BYTES];  // opcode fetched at this address
+  uint8_t read[COVERAGE_BITMAP_BYTES];      // byte read as data (loads, stack pops)
+} Coverage;
+
+static inline void coverage_mark(uint8_t* bitmap, uint16_t address) {
+  bitmap[address >> 3] |= (uint8_t)(1 << (address & 7));
+}
+
+static inline bool coverage_test(const uint8_t* bitmap, uint16_t address) {
+  return (bitmap[address >> 3] >> (address & 7)) & 1;
+}
+
+// allocates a cleared coverage map, NULL on failure
+Coverage* coverage_create(void);
+
+void coverage_destroy(Coverage* cov);
+
+// writes an annotated disassembly of memory[0, size) (size up to 64KB)
+// followed by a per-routine summary; symbols may be NULL
+void coverage_write_report(FILE* out, const Coverage* cov, const uint8_t* memory,
+                           uint32_t size, const SymbolTable* symbols);
+
+#endif  // COVERAGE_H
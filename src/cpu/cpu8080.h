@@ -0,0 +1,102 @@
+#ifndef CPU8080_H
+#define CPU8080_H
+
+#include <stdint.h>
+
+#include "machine_io.h"
+
+struct Coverage;
+struct IrqProfile;
+struct PageTable;
+
+#define MEMORY_SIZE 0x10000 // 64KB (8080 has 16-bit memory bus)
+
+// The core reaches memory through a table of 256-byte pages so machines can
+// share pages copy-on-write (see src/memory/pages.h).
+#define MEM_PAGE_SHIFT 8
+#define MEM_PAGE_SIZE  (1 << MEM_PAGE_SHIFT)
+#define MEM_PAGE_MASK  (MEM_PAGE_SIZE - 1)
+#define MEM_PAGES      (MEMORY_SIZE >> MEM_PAGE_SHIFT)
+
+// structure for 8080 processor condition flags (status bits)
+typedef struct ConditionCodes {
+  uint8_t   z:1;    // zero
+  uint8_t   s:1;    // sign
+  uint8_t   p:1;    // parity
+  uint8_t   cy:1;   // carry
+  uint8_t   ac:1;   // auxillary carry
+  uint8_t   pad:3;  // unused bits 
+} ConditionCodes;
+
+// structure for 8080 CPU register state
+typedef struct State8080 {
+  uint8_t   a;                    // accumulator
+  uint8_t   b;                    // general purpose registers (b through l)
+  uint8_t   c;
+  uint8_t   d;
+  uint8_t   e;
+  uint8_t   h;
+  uint8_t   l;
+  uint16_t  sp;                   // stack pointer
+  uint16_t  pc;                   // program counter
+  uint8_t   *memory;              // flat 64KB memory, NULL when pages are shared
+  struct    ConditionCodes  cc;   // flag register
+  uint8_t   int_enable;           // interrupt enable 
+  struct    Coverage *coverage;   // optional coverage bitmaps (NULL = off)
+  struct    IrqProfile *irq_profile; // optional interrupt timing (NULL = off)
+  struct    PageTable *pages;     // owner of the pages when shared (NULL = flat memory)
+  uint8_t   *read_map[MEM_PAGES];  // page used for loads and opcode fetch
+  uint8_t   *write_map[MEM_PAGES]; // page used for stores; NULL = copy (or drop) on write
+  uint8_t   fault;                // CPU_FAULT_*, set when execution stops; pc stays on the opcode
+} State8080;
+
+// values of State8080.fault
+enum {
+  CPU_FAULT_NONE = 0,
+  CPU_FAULT_UNIMPLEMENTED,        // an opcode the core does not implement
+  CPU_FAULT_HALT,                 // HLT: the guest stopped itself
+};
+
+// reads a byte without touching coverage, for tools and tracing
+static inline uint8_t cpu_peek(const State8080* state, uint16_t address) {
+  return state->read_map[address >> MEM_PAGE_SHIFT][address & MEM_PAGE_MASK];
+}
+
+// packs the condition codes the way PUSH PSW stores them: S Z 0 AC 0 P 1 CY
+static inline uint8_t cpu_flags_byte(const ConditionCodes* cc) {
+  return 0x02 | (cc->s << 7) | (cc->z << 6) | (cc->ac << 4) | (cc->p << 2) | cc->cy;
+}
+
+// inverse of cpu_flags_byte (POP PSW)
+static inline void cpu_set_flags_byte(ConditionCodes* cc, uint8_t f) {
+  cc->s  = (f >> 7) & 1;
+  cc->z  = (f >> 6) & 1;
+  cc->ac = (f >> 4) & 1;
+  cc->p  = (f >> 2) & 1;
+  cc->cy = f & 1;
+}
+
+// prints registers, stack pointer, program counter and flags to stdout
+void print_state_code(State8080 *state);
+
+// returns 1 for even parity, 0 for odd parity
+int parity(uint8_t num);
+
+// sets the Zero, Sign and Parity flags from an 8-bit result
+void set_zsp_flags(State8080* state, uint8_t result);
+
+// executes the instruction at state->pc and returns the clock cycles it used.
+// HLT and opcodes the core does not implement set state->fault and leave pc
+// where it is, so callers check the flag when convenient (e.g. once a frame).
+int Emulate8080Op(State8080* state, MachineState* machine);
+
+// base cycle count for an opcode (conditional CALL/RET: not-taken count)
+int opcode_cycles(uint8_t opcode);
+
+// pushes a 16-bit value onto the stack
+void push_pc(State8080* state, uint16_t pc);
+
+// performs RST interrupt_num if interrupts are enabled and the CPU has not stopped
+void generateInterrupt(State8080* state, int interrupt_num);
+
+#endif  // CPU8080_H
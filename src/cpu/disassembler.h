@@ -1,6 +1,12 @@
 #ifndef DISASSEMBLER_H
 #define DISASSEMBLER_H
 
+#include <stdio.h>
+
 int disassembled8080Op(unsigned char *codebuffer, int pc);
 
-#endif
\ No newline at end of file
+int disassemble8080OpToFile(FILE *out, unsigned char *codebuffer, int pc);
+
+int instruction8080Length(unsigned char opcode);
+
+#endif
@@ -0,0 +1,118 @@
+// Interrupt latency and service-time histograms (see irq_profile.h).
+
+#include <string.h>
+
+#include "irq_profile.h"
+#include "log.h"
+
+void irq_profile_init(IrqProfile* profile, const uint64_t* clock, uint32_t budget) {
+  memset(profile, 0, sizeof(*profile));
+  profile->clock = clock;
+  profile->budget = budget;
+}
+
+static void histogram_add(IrqHistogram* h, uint64_t cycles, uint64_t start) {
+  int bucket = cycles == 0 ? 0 : 64 - __builtin_clzll(cycles);
+  h->buckets[bucket < IRQ_BUCKETS ? bucket : IRQ_BUCKETS - 1]++;
+  h->count++;
+  h->total += cycles;
+  if (cycles > h->max) {
+    h->max = cycles;
+    h->max_at = start;
+  }
+}
+
+void irq_profile_request(IrqProfile* profile, int vector, bool enabled, uint16_t sp) {
+  uint64_t now = *profile->clock;
+  vector &= IRQ_VECTORS - 1;
+  IrqVector* v = &profile->vectors[vector];
+  v->requests++;
+  if (!enabled) {
+    // the first of repeated misses is the one that has waited longest
+    v->missed++;
+    if (!(profile->waiting & (1 << vector))) {
+      profile->waiting |= (uint8_t)(1 << vector);
+      profile->waiting_since[vector] = now;
+    }
+    return;
+  }
+  v->accepted++;
+  histogram_add(&v->latency, 0, now);
+  if (profile->depth == IRQ_MAX_NESTING) {
+    // a guest that never returns from its routines; forget the oldest
+    memmove(&profile->active[0], &profile->active[1], sizeof(profile->active[0]) * (IRQ_MAX_NESTING - 1));
+    profile->depth--;
+  }
+  profile->active[profile->depth].sp = sp;
+  profile->active[profile->depth].vector = (uint8_t)vector;
+  profile->active[profile->depth].start = now;
+  profile->depth++;
+}
+
+void irq_profile_enable(IrqProfile* profile) {
+  if (profile->waiting == 0) {
+    return;
+  }
+  uint64_t now = *profile->clock;
+  for (int vector = 0; vector < IRQ_VECTORS; vector++) {
+    if (profile->waiting & (1 << vector)) {
+      uint64_t since = profile->waiting_since[vector];
+      histogram_add(&profile->vectors[vector].latency, now - since, since);
+    }
+  }
+  profile->waiting = 0;
+}
+
+void irq_profile_return(IrqProfile* profile, uint16_t sp, int cycles) {
+  // routines whose return address is already below the stack pointer left
+  // some other way (a guest resetting SP, say)
+  while (profile->depth > 0 && profile->active[profile->depth - 1].sp < sp) {
+    profile->depth--;
+  }
+  if (profile->depth == 0 || profile->active[profile->depth - 1].sp != sp) {
+    return;                              // an ordinary subroutine return
+  }
+  profile->depth--;
+  int vector = profile->active[profile->depth].vector;
+  uint64_t start = profile->active[profile->depth].start;
+  uint64_t service = *profile->clock + cycles - start;
+  IrqVector* v = &profile->vectors[vector];
+  histogram_add(&v->service, service, start);
+  if (service > profile->budget) {
+    v->over_budget++;
+    LOG(LOG_INFO, "RST %d routine ran %llu cycles from cycle %llu, over the %u-cycle budget", vector,
+        (unsigned long long)service, (unsigned long long)start, profile->budget);
+  }
+}
+
+static void write_histogram(FILE* fp, const char* name, const IrqHistogram* h) {
+  fprintf(fp, "      \"%s\": { \"count\": %llu, \"mean\": %.1f, \"max\": %llu, \"max_at_cycle\": %llu, \"buckets\": [",
+          name, (unsigned long long)h->count, h->count != 0 ? (double)h->total / h->count : 0.0,
+          (unsigned long long)h->max, (unsigned long long)h->max_at);
+  // trailing empty buckets are left out
+  int used = IRQ_BUCKETS;
+  while (used > 0 && h->buckets[used - 1] == 0) {
+    used--;
+  }
+  for (int i = 0; i < used; i++) {
+    fprintf(fp, "%s%llu", i != 0 ? ", " : "", (unsigned long long)h->buckets[i]);
+  }
+  fprintf(fp, "] }");
+}
+
+void irq_profile_write_json(FILE* fp, const IrqProfile* profile) {
+  for (int vector = 0; vector < IRQ_VECTORS; vector++) {
+    const IrqVector* v = &profile->vectors[vector];
+    if (v->requests == 0) {
+      continue;
+    }
+    fprintf(fp, ",\n    \"rst%d\": {\n", vector);
+    fprintf(fp, "      \"requests\": %llu, \"accepted\": %llu, \"missed\": %llu, \"over_budget\": %llu,\n",
+            (unsigned long long)v->requests, (unsigned long long)v->accepted,
+            (unsigned long long)v->missed, (unsigned long long)v->over_budget);
+    write_histogram(fp, "latency", &v->latency);
+    fprintf(fp, ",\n");
+    write_histogram(fp, "service", &v->service);
+    fprintf(fp, "\n    }");
+  }
+}
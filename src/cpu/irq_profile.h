@@ -0,0 +1,76 @@
+#ifndef IRQ_PROFILE_H
+#define IRQ_PROFILE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Interrupt timing per RST vector: how long each request waited to be
+// accepted and how long its service routine ran, as histograms of CPU
+// cycles. The core reports requests (generateInterrupt), EI and returns
+// when State8080.irq_profile is non-NULL, which costs a branch per
+// instruction.
+//
+// The core does not hold a request the CPU cannot take: one that arrives
+// while interrupts are disabled is dropped, as it always has been here.
+// Such a request counts as missed, and its latency is the time until the
+// guest's next EI, when the CPU would have taken it had the line stayed
+// up. A routine runs from acceptance to the end of the RET that pops the
+// address the interrupt pushed (nested interrupts are followed by stack
+// pointer).
+
+#define IRQ_VECTORS      8
+#define IRQ_BUCKETS      24    // bucket 0: 0 cycles; bucket i: 2^(i-1) .. 2^i - 1; the last is open
+#define IRQ_MAX_NESTING  8
+
+typedef struct IrqHistogram {
+  uint64_t count;
+  uint64_t total;               // cycles, for the mean
+  uint64_t max;
+  uint64_t max_at;              // the clock when the longest one started
+  uint64_t buckets[IRQ_BUCKETS];
+} IrqHistogram;
+
+typedef struct IrqVector {
+  uint64_t     requests;
+  uint64_t     accepted;
+  uint64_t     missed;          // requested with interrupts disabled
+  uint64_t     over_budget;     // routines that ran longer than the budget
+  IrqHistogram latency;         // request to acceptance (or to EI, when missed)
+  IrqHistogram service;         // acceptance to the end of the returning RET
+} IrqVector;
+
+typedef struct IrqProfile {
+  const uint64_t* clock;        // the caller's cycle count, current before each instruction
+  uint32_t        budget;       // cycles between interrupts
+  IrqVector       vectors[IRQ_VECTORS];
+  int             depth;        // routines running, innermost last
+  struct {
+    uint16_t sp;                // where the interrupt pushed the return address
+    uint8_t  vector;
+    uint64_t start;
+  } active[IRQ_MAX_NESTING];
+  uint8_t         waiting;      // missed requests, a bit per vector, until the next EI
+  uint64_t        waiting_since[IRQ_VECTORS];
+} IrqProfile;
+
+// clears profile; clock is read at every event, budget is the cycles
+// between one interrupt and the next (a routine that runs longer delays
+// the next one's work)
+void irq_profile_init(IrqProfile* profile, const uint64_t* clock, uint32_t budget);
+
+// a request for RST vector; taken if enabled, in which case the return
+// address has been pushed at sp
+void irq_profile_request(IrqProfile* profile, int vector, bool enabled, uint16_t sp);
+
+// the guest executed EI
+void irq_profile_enable(IrqProfile* profile);
+
+// a RET (cycles long) popped the address at sp
+void irq_profile_return(IrqProfile* profile, uint16_t sp, int cycles);
+
+// writes each vector that was requested as a member of a JSON object,
+// after a comma (, "rst1": { ... }), indented for the --stats report
+void irq_profile_write_json(FILE* fp, const IrqProfile* profile);
+
+#endif  // IRQ_PROFILE_H
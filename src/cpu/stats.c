@@ -0,0 +1,69 @@
+#include <stdio.h>
+
+#include "stats.h"
+
+// 8080 clock of the Space Invaders board, for the emulated-time figures.
+#define STATS_CPU_HZ 2000000.0
+
+// Writes s as a JSON string (NULL becomes null).
+static void write_string(FILE* fp, const char* s) {
+  if (s == NULL) {
+    fputs("null", fp);
+    return;
+  }
+  fputc('"', fp);
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+    if (c == '"' || c == '\\') {
+      fprintf(fp, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(fp, "\\u%04x", c);
+    } else {
+      fputc(c, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+bool stats_write_json(const char* path, const RunStats* stats) {
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    return false;
+  }
+
+  double emulated = stats->cycles / STATS_CPU_HZ;
+  fprintf(fp, "{\n  \"version\": 1,\n  \"rom\": ");
+  write_string(fp, stats->rom);
+  fprintf(fp, ",\n  \"exit_reason\": ");
+  write_string(fp, stats->exit_reason);
+  fprintf(fp, ",\n  \"exit_code\": %d,\n  \"until\": ", stats->exit_code);
+  write_string(fp, stats->until);
+  if (stats->until != NULL) {
+    fprintf(fp, ",\n  \"until_value\": %lld", (long long)stats->until_value);
+  }
+  fprintf(fp, ",\n  \"headless\": %s,\n", stats->headless ? "true" : "false");
+  fprintf(fp, "  \"frames\": %llu,\n  \"cycles\": %llu,\n  \"instructions\": %llu,\n",
+          (unsigned long long)stats->frames, (unsigned long long)stats->cycles,
+          (unsigned long long)stats->instructions);
+  fprintf(fp, "  \"emulated_seconds\": %.6f,\n  \"wall_seconds\": %.6f,\n", emulated, stats->wall_seconds);
+  fprintf(fp, "  \"cpu_seconds\": %.6f,\n  \"cpu_utilization\": %.4f,\n  \"late_frames\": %llu,\n",
+          stats->cpu_seconds, stats->wall_seconds > 0 ? stats->cpu_seconds / stats->wall_seconds : 0.0,
+          (unsigned long long)stats->late_frames);
+  if (stats->crt_threads > 0) {
+    fprintf(fp, "  \"crt_filter\": { \"threads\": %d, \"frames\": %llu, \"mean_ms\": %.4f, \"max_ms\": %.4f, "
+            "\"decay_ms\": %.4f, \"compose_ms\": %.4f },\n",
+            stats->crt_threads, (unsigned long long)stats->crt_frames, stats->crt_mean_ms,
+            stats->crt_max_ms, stats->crt_decay_ms, stats->crt_compose_ms);
+  }
+  if (stats->interrupts != NULL) {
+    fprintf(fp, "  \"interrupts\": {\n    \"budget_cycles\": %u", stats->interrupts->budget);
+    irq_profile_write_json(fp, stats->interrupts);
+    fprintf(fp, "\n  },\n");
+  }
+  fprintf(fp, "  \"speed\": %.3f,\n  \"mips\": %.3f\n}\n",
+          stats->wall_seconds > 0 ? emulated / stats->wall_seconds : 0.0,
+          stats->wall_seconds > 0 ? stats->instructions / stats->wall_seconds / 1e6 : 0.0);
+
+  bool ok = !ferror(fp);
+  return fclose(fp) == 0 && ok;
+}
@@ -0,0 +1,37 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "irq_profile.h"
+
+// End-of-run statistics for batch jobs, written as one JSON object so a
+// driver script can read why and where a run stopped without parsing logs.
+
+typedef struct RunStats {
+  const char* rom;
+  const char* exit_reason;     // "until", "hook", "frame_limit", "quit", "fault", "guest_exit"
+  int         exit_code;
+  const char* until;           // text of the --until condition that held, or NULL
+  int64_t     until_value;     // its value at that vblank
+  uint64_t    frames;          // completed frames (RST 2 interrupts)
+  uint64_t    cycles;
+  uint64_t    instructions;
+  double      wall_seconds;
+  double      cpu_seconds;     // host user + system time
+  uint64_t    late_frames;     // real-time frames that missed their deadline
+  int         crt_threads;     // --crt filter threads, 0 without the filter
+  uint64_t    crt_frames;      // frames it filtered
+  double      crt_mean_ms;     // its time per frame,
+  double      crt_max_ms;      // slowest frame,
+  double      crt_decay_ms;    // and the per-frame time of each pass
+  double      crt_compose_ms;
+  const IrqProfile* interrupts; // interrupt timing, or NULL
+  bool        headless;
+} RunStats;
+
+// Writes stats to path as JSON. Returns false (with errno set) on I/O errors.
+bool stats_write_json(const char* path, const RunStats* stats);
+
+#endif // STATS_H
@@ -0,0 +1,85 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "symbols.h"
+
+static int compare_symbols(const void* a, const void* b) {
+  const Symbol* x = a;
+  const Symbol* y = b;
+  return (int)x->address - (int)y->address;
+}
+
+bool symbols_load(SymbolTable* table, const char* path) {
+  FILE* fp = fopen(path, "r");
+  if (fp == NULL) {
+    return false;
+  }
+
+  table->count = 0;
+  table->symbols = NULL;
+  int capacity = 0;
+
+  char line[256];
+  while (fgets(line, sizeof(line), fp) != NULL) {
+    char* p = line + strspn(line, " \t");
+    if (*p == '#' || *p == ';' || *p == '\n' || *p == '\0') {
+      continue;
+    }
+
+    unsigned int address;
+    char name[sizeof(((Symbol*)0)->name)];
+    if (sscanf(p, "%x %47s", &address, name) != 2 || address > 0xffff) {
+      continue;  // skip malformed lines rather than failing the whole file
+    }
+
+    if (table->count == capacity) {
+      capacity = capacity ? capacity * 2 : 64;
+      Symbol* grown = realloc(table->symbols, capacity * sizeof(Symbol));
+      if (grown == NULL) {
+        fclose(fp);
+        symbols_free(table);
+        return false;
+      }
+      table->symbols = grown;
+    }
+    table->symbols[table->count].address = (uint16_t)address;
+    snprintf(table->symbols[table->count].name, sizeof(name), "%s", name);
+    table->count++;
+  }
+  fclose(fp);
+
+  qsort(table->symbols, table->count, sizeof(Symbol), compare_symbols);
+  return true;
+}
+
+void symbols_free(SymbolTable* table) {
+  free(table->symbols);
+  table->symbols = NULL;
+  table->count = 0;
+}
+
+const Symbol* symbols_lookup(const SymbolTable* table, uint16_t address) {
+  // binary search for the last symbol with symbol->address <= address
+  int lo = 0, hi = table->count - 1;
+  const Symbol* found = NULL;
+  while (lo <= hi) {
+    int mid = (lo + hi) / 2;
+    if (table->symbols[mid].address <= address) {
+      found = &table->symbols[mid];
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+const Symbol* symbols_find(const SymbolTable* table, const char* name) {
+  for (int i = 0; i < table->count; i++) {
+    if (strcmp(table->symbols[i].name, name) == 0) {
+      return &table->symbols[i];
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,32 @@
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Guest symbol table loaded from a text file with one "ADDRESS NAME" pair
+// per line, address in hex (e.g. "0x0010 ScanLine224" or "0010 ScanLine224").
+// Blank lines and lines starting with '#' or ';' are ignored.
+
+typedef struct Symbol {
+  uint16_t address;
+  char     name[48];
+} Symbol;
+
+typedef struct SymbolTable {
+  int     count;
+  Symbol* symbols;   // sorted by address
+} SymbolTable;
+
+// loads a symbol file; returns false if the file cannot be read
+bool symbols_load(SymbolTable* table, const char* path);
+
+void symbols_free(SymbolTable* table);
+
+// returns the symbol at or before address, or NULL if there is none
+const Symbol* symbols_lookup(const SymbolTable* table, uint16_t address);
+
+// returns the symbol with the given name, or NULL
+const Symbol* symbols_find(const SymbolTable* table, const char* name);
+
+#endif  // SYMBOLS_H
@@ -0,0 +1,338 @@
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace.h"
+#include "disassembler.h"
+#include "lz4block.h"
+
+#define BLOCK_BYTES (TRACE_BLOCK_RECORDS * sizeof(TraceRecord))
+
+// the index lives next to the trace as <path>.idx
+static char* index_path(const char* path) {
+  size_t len = strlen(path);
+  char* idx = malloc(len + sizeof(".idx"));
+  if (idx != NULL) {
+    memcpy(idx, path, len);
+    memcpy(idx + len, ".idx", sizeof(".idx"));
+  }
+  return idx;
+}
+
+TraceWriter* trace_open(const char* path, bool compress) {
+  TraceWriter* tw = calloc(1, sizeof(TraceWriter));
+  char* idx = index_path(path);
+  if (tw == NULL || idx == NULL) {
+    goto fail;
+  }
+  tw->compress = compress;
+  if (compress && (tw->scratch = malloc(LZ4_BOUND(BLOCK_BYTES))) == NULL) {
+    goto fail;
+  }
+
+  tw->fp = fopen(path, "wb");
+  tw->index_fp = fopen(idx, "wb");
+  if (tw->fp == NULL || tw->index_fp == NULL) {
+    goto fail;
+  }
+
+  TraceHeader header = {
+    .version = compress ? TRACE_VERSION_LZ4 : TRACE_VERSION,
+    .record_size = sizeof(TraceRecord),
+  };
+  memcpy(header.magic, TRACE_MAGIC, sizeof(header.magic));
+  TraceIndexHeader index_header = {
+    .version = TRACE_INDEX_VERSION,
+    .entry_size = sizeof(TraceIndexEntry),
+  };
+  memcpy(index_header.magic, TRACE_INDEX_MAGIC, sizeof(index_header.magic));
+  if (fwrite(&header, sizeof(header), 1, tw->fp) != 1 ||
+      fwrite(&index_header, sizeof(index_header), 1, tw->index_fp) != 1) {
+    goto fail;
+  }
+  tw->offset = sizeof(header);
+  free(idx);
+  return tw;
+
+fail:
+  if (tw != NULL) {
+    if (tw->fp != NULL) fclose(tw->fp);
+    if (tw->index_fp != NULL) fclose(tw->index_fp);
+    free(tw->scratch);
+    free(tw);
+  }
+  free(idx);
+  return NULL;
+}
+
+bool trace_flush(TraceWriter* tw) {
+  if (tw->count == 0) {
+    return !tw->failed;
+  }
+  if (tw->failed) {
+    // the file already has a gap; more blocks would only be misplaced
+    tw->count = 0;
+    return false;
+  }
+
+  TraceIndexEntry entry = {
+    .first_record = tw->records,
+    .cycle = tw->block_cycle,
+    .frame = tw->block_frame,
+    .records = tw->count,
+  };
+  const void* data = tw->buffer;
+  uint32_t size = tw->count * sizeof(TraceRecord);
+  bool ok = true;
+
+  if (tw->compress) {
+    // a block LZ4 cannot shrink is stored raw; readers tell by its size
+    int packed = lz4_compress((const uint8_t*)tw->buffer, size, tw->scratch,
+                              LZ4_BOUND(BLOCK_BYTES));
+    if (packed > 0 && (uint32_t)packed < size) {
+      data = tw->scratch;
+      size = packed;
+    }
+    TraceBlockHeader block = { .records = tw->count, .stored_size = size };
+    ok = fwrite(&block, sizeof(block), 1, tw->fp) == 1;
+    tw->offset += sizeof(block);
+  }
+
+  entry.offset = tw->offset;
+  entry.stored_size = size;
+  ok = ok && fwrite(data, 1, size, tw->fp) == size;
+  ok = ok && fwrite(&entry, sizeof(entry), 1, tw->index_fp) == 1;
+
+  tw->offset += size;
+  tw->records += tw->count;
+  tw->count = 0;
+  tw->failed = !ok;
+  return ok;
+}
+
+bool trace_close(TraceWriter* tw) {
+  if (tw == NULL) {
+    return true;
+  }
+  bool ok = trace_flush(tw);
+  ok = fclose(tw->fp) == 0 && ok;
+  ok = fclose(tw->index_fp) == 0 && ok;
+  free(tw->scratch);
+  free(tw);
+  return ok;
+}
+
+bool trace_header_valid(const TraceHeader* header) {
+  return memcmp(header->magic, TRACE_MAGIC, sizeof(header->magic)) == 0 &&
+         (header->version == TRACE_VERSION || header->version == TRACE_VERSION_LZ4) &&
+         header->record_size == sizeof(TraceRecord);
+}
+
+int trace_record_cycles(const TraceRecord* r, const TraceRecord* next) {
+  uint8_t op = r->opcode[0];
+  int cycles = opcode_cycles(op);
+  if (next == NULL) {
+    return cycles;
+  }
+
+  // A taken RET pops 2 bytes; a taken CALL pushes 2 and lands on its target.
+  // Checking the target as well keeps an interrupt after a not-taken CALL
+  // (which also pushes) from being counted as taken.
+  if ((op & 0xC7) == 0xC0 && next->sp == (uint16_t)(r->sp + 2)) {
+    cycles += 6;
+  } else if ((op & 0xC7) == 0xC4 && next->sp == (uint16_t)(r->sp - 2) &&
+             next->pc == (r->opcode[2] << 8 | r->opcode[1])) {
+    cycles += 6;
+  }
+  return cycles;
+}
+
+void trace_print_record(FILE* out, uint64_t index, const TraceRecord* r) {
+  // the disassembler indexes a code buffer by pc, so place the bytes there
+  static unsigned char code[MEMORY_SIZE + 2];
+  code[r->pc] = r->opcode[0];
+  code[r->pc + 1] = r->opcode[1];
+  code[r->pc + 2] = r->opcode[2];
+
+  fprintf(out, "#%-12llu A:%02x B:%02x C:%02x D:%02x E:%02x H:%02x L:%02x SP:%04x "
+               "%c%c%c%c%c %s  ",
+          (unsigned long long)index, r->a, r->b, r->c, r->d, r->e, r->h, r->l, r->sp,
+          (r->f & 0x80) ? 'S' : '-', (r->f & 0x40) ? 'Z' : '-', (r->f & 0x10) ? 'A' : '-',
+          (r->f & 0x04) ? 'P' : '-', (r->f & 0x01) ? 'C' : '-',
+          r->int_enable ? "EI" : "DI");
+  disassemble8080OpToFile(out, code, r->pc);
+}
+
+// ---------------------------------------------------------------------------
+// Reader
+// ---------------------------------------------------------------------------
+
+static bool map_index(TraceReader* tr, const char* path) {
+  char* idx = index_path(path);
+  if (idx == NULL) {
+    return false;
+  }
+  int fd = open(idx, O_RDONLY);
+  if (fd < 0) {
+    fprintf(stderr, "%s: cannot open trace index\n", idx);
+    free(idx);
+    return false;
+  }
+
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(TraceIndexHeader);
+  if (ok) {
+    tr->index_map_size = st.st_size;
+    tr->index_map = mmap(NULL, tr->index_map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ok = tr->index_map != MAP_FAILED;
+    if (!ok) {
+      tr->index_map = NULL;
+    }
+  }
+  close(fd);
+
+  const TraceIndexHeader* header = tr->index_map;
+  ok = ok && memcmp(header->magic, TRACE_INDEX_MAGIC, sizeof(header->magic)) == 0 &&
+       header->version == TRACE_INDEX_VERSION &&
+       header->entry_size == sizeof(TraceIndexEntry);
+  if (!ok) {
+    fprintf(stderr, "%s: not a trace index\n", idx);
+    free(idx);
+    return false;
+  }
+  free(idx);
+
+  tr->index = (const TraceIndexEntry*)(header + 1);
+  tr->blocks = (tr->index_map_size - sizeof(*header)) / sizeof(TraceIndexEntry);
+  if (tr->blocks > 0) {
+    const TraceIndexEntry* last = &tr->index[tr->blocks - 1];
+    tr->records = last->first_record + last->records;
+  }
+  return true;
+}
+
+TraceReader* trace_reader_open(const char* path) {
+  TraceReader* tr = calloc(1, sizeof(TraceReader));
+  if (tr == NULL) {
+    return NULL;
+  }
+  tr->cached_block = -1;
+  tr->fd = open(path, O_RDONLY);
+  if (tr->fd < 0) {
+    perror(path);
+    free(tr);
+    return NULL;
+  }
+
+  if (pread(tr->fd, &tr->header, sizeof(tr->header), 0) != sizeof(tr->header) ||
+      !trace_header_valid(&tr->header)) {
+    fprintf(stderr, "%s: not a trace file\n", path);
+    trace_reader_close(tr);
+    return NULL;
+  }
+  tr->block = malloc(BLOCK_BYTES);
+  if (tr->header.version == TRACE_VERSION_LZ4) {
+    tr->scratch = malloc(LZ4_BOUND(BLOCK_BYTES));
+  }
+  if (tr->block == NULL || (tr->header.version == TRACE_VERSION_LZ4 && tr->scratch == NULL) ||
+      !map_index(tr, path)) {
+    trace_reader_close(tr);
+    return NULL;
+  }
+  return tr;
+}
+
+void trace_reader_close(TraceReader* tr) {
+  if (tr == NULL) {
+    return;
+  }
+  if (tr->index_map != NULL) {
+    munmap(tr->index_map, tr->index_map_size);
+  }
+  if (tr->fd >= 0) {
+    close(tr->fd);
+  }
+  free(tr->block);
+  free(tr->scratch);
+  free(tr);
+}
+
+// The index is sorted by record, cycle and frame alike, so all three lookups
+// are the same binary search over a different 64-bit field: find the last
+// block whose field is <= target.
+static int64_t find_last_le(const TraceReader* tr, size_t field, uint64_t target) {
+  int64_t lo = 0, hi = (int64_t)tr->blocks - 1, found = -1;
+  while (lo <= hi) {
+    int64_t mid = lo + (hi - lo) / 2;
+    uint64_t key;
+    memcpy(&key, (const char*)&tr->index[mid] + field, sizeof(key));
+    if (key <= target) {
+      found = mid;
+      lo = mid + 1;
+    } else {
+      hi = mid - 1;
+    }
+  }
+  return found;
+}
+
+int64_t trace_reader_find_record(const TraceReader* tr, uint64_t record) {
+  if (record >= tr->records) {
+    return -1;
+  }
+  return find_last_le(tr, offsetof(TraceIndexEntry, first_record), record);
+}
+
+int64_t trace_reader_find_cycle(const TraceReader* tr, uint64_t cycle) {
+  return find_last_le(tr, offsetof(TraceIndexEntry, cycle), cycle);
+}
+
+int64_t trace_reader_find_frame(const TraceReader* tr, uint64_t frame) {
+  // blocks never span frames, so the first block of a frame is the one
+  // after the last block of the previous frame
+  int64_t block = frame == 0 ? 0 : find_last_le(tr, offsetof(TraceIndexEntry, frame), frame - 1) + 1;
+  if (block < 0 || (uint64_t)block >= tr->blocks || tr->index[block].frame != frame) {
+    return -1;
+  }
+  return block;
+}
+
+const TraceRecord* trace_reader_block(TraceReader* tr, int64_t block) {
+  if (block < 0 || (uint64_t)block >= tr->blocks) {
+    return NULL;
+  }
+  if (block == tr->cached_block) {
+    return tr->block;
+  }
+
+  const TraceIndexEntry* e = &tr->index[block];
+  size_t bytes = (size_t)e->records * sizeof(TraceRecord);
+  if (e->records > TRACE_BLOCK_RECORDS) {
+    return NULL;
+  }
+
+  if (tr->header.version == TRACE_VERSION) {
+    if (e->stored_size != bytes ||
+        pread(tr->fd, tr->block, bytes, e->offset) != (ssize_t)bytes) {
+      return NULL;
+    }
+  } else if (e->stored_size == bytes) {
+    // stored raw: LZ4 could not shrink it
+    if (pread(tr->fd, tr->block, bytes, e->offset) != (ssize_t)bytes) {
+      return NULL;
+    }
+  } else {
+    if (e->stored_size > LZ4_BOUND(BLOCK_BYTES) ||
+        pread(tr->fd, tr->scratch, e->stored_size, e->offset) != (ssize_t)e->stored_size ||
+        lz4_decompress(tr->scratch, e->stored_size, (uint8_t*)tr->block, BLOCK_BYTES) != (int)bytes) {
+      return NULL;
+    }
+  }
+  tr->cached_block = block;
+  return tr->block;
+}
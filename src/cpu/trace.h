@@ -0,0 +1,170 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu8080.h"
+
+// Binary execution trace: a small header followed by one fixed-size record
+// per executed instruction, holding the CPU state *before* the instruction.
+//
+// Records are written in blocks of up to TRACE_BLOCK_RECORDS; a block never
+// spans a frame boundary. Each block gets an entry in a sidecar index file
+// (<trace>.idx) with the cycle and frame it starts at and where it is stored,
+// so readers can seek to a frame or cycle and decode only that block.
+//
+// Version 1 traces store blocks raw and back to back, so the records can be
+// mmap'd and indexed directly (tracediff). Version 2 traces store each block
+// LZ4-compressed behind a small block header; a block that LZ4 cannot shrink
+// is stored raw, and its stored size is then exactly records *
+// sizeof(TraceRecord).
+
+#define TRACE_MAGIC         "8080TRCE"
+#define TRACE_VERSION       1     // raw records
+#define TRACE_VERSION_LZ4   2     // LZ4-compressed blocks
+#define TRACE_INDEX_MAGIC   "8080TIDX"
+#define TRACE_INDEX_VERSION 1
+#define TRACE_BLOCK_RECORDS 4096
+
+typedef struct TraceHeader {
+  char     magic[8];       // TRACE_MAGIC, not NUL terminated
+  uint32_t version;        // TRACE_VERSION or TRACE_VERSION_LZ4
+  uint32_t record_size;    // sizeof(TraceRecord)
+} TraceHeader;
+
+typedef struct TraceRecord {
+  uint16_t pc;
+  uint16_t sp;
+  uint8_t  a, f, b, c, d, e, h, l;   // f packed as S Z 0 AC 0 P 1 CY
+  uint8_t  opcode[3];                // instruction bytes at pc
+  uint8_t  int_enable;
+} TraceRecord;
+
+// In version 2 traces each compressed block is preceded by this header.
+typedef struct TraceBlockHeader {
+  uint32_t records;
+  uint32_t stored_size;    // compressed bytes that follow (raw if equal to the records' size)
+} TraceBlockHeader;
+
+typedef struct TraceIndexHeader {
+  char     magic[8];       // TRACE_INDEX_MAGIC
+  uint32_t version;        // TRACE_INDEX_VERSION
+  uint32_t entry_size;     // sizeof(TraceIndexEntry)
+} TraceIndexHeader;
+
+// One entry per block, in file order.
+typedef struct TraceIndexEntry {
+  uint64_t first_record;   // index of the block's first record in the trace
+  uint64_t cycle;          // machine cycle counter before the first record
+  uint64_t frame;          // frame counter (all records in the block share it)
+  uint64_t offset;         // file offset of the block's record data
+  uint32_t records;        // records in the block
+  uint32_t stored_size;    // bytes stored at offset (compressed size for v2)
+} TraceIndexEntry;
+
+_Static_assert(sizeof(TraceRecord) == 16, "trace records must stay 16 bytes");
+_Static_assert(sizeof(TraceHeader) == 16, "trace header must stay 16 bytes");
+_Static_assert(sizeof(TraceIndexEntry) == 40, "index entries must stay 40 bytes");
+
+typedef struct TraceWriter {
+  FILE*       fp;
+  FILE*       index_fp;
+  bool        compress;
+  uint64_t    records;                       // records written so far
+  uint64_t    offset;                        // current end of the trace file
+  uint64_t    block_cycle;                   // cycle/frame at the start of the buffered block
+  uint64_t    block_frame;
+  int         count;                         // records waiting in buffer
+  bool        failed;                        // a write failed; later blocks are dropped
+  uint8_t*    scratch;                       // compression output (v2 only)
+  TraceRecord buffer[TRACE_BLOCK_RECORDS];
+} TraceWriter;
+
+// creates path and path.idx and writes their headers; returns NULL on failure
+TraceWriter* trace_open(const char* path, bool compress);
+
+// writes the buffered block and its index entry; returns false if this or
+// an earlier write failed (trace_record flushes too and leaves it in failed)
+bool trace_flush(TraceWriter* tw);
+
+// flushes and closes the trace; returns false if any write failed
+bool trace_close(TraceWriter* tw);
+
+// appends the current CPU state (call before executing the instruction);
+// cycle and frame are the machine counters at that point
+static inline void trace_record(TraceWriter* tw, const State8080* state,
+                                uint64_t cycle, uint64_t frame) {
+  // a new frame always starts a new block so frame seeks are exact
+  if (tw->count > 0 && frame != tw->block_frame) {
+    trace_flush(tw);
+  }
+  if (tw->count == 0) {
+    tw->block_cycle = cycle;
+    tw->block_frame = frame;
+  }
+
+  TraceRecord* r = &tw->buffer[tw->count];
+  r->pc = state->pc;
+  r->sp = state->sp;
+  r->a = state->a;
+  r->f = cpu_flags_byte(&state->cc);
+  r->b = state->b;
+  r->c = state->c;
+  r->d = state->d;
+  r->e = state->e;
+  r->h = state->h;
+  r->l = state->l;
+  r->opcode[0] = cpu_peek(state, state->pc);
+  r->opcode[1] = cpu_peek(state, (uint16_t)(state->pc + 1));
+  r->opcode[2] = cpu_peek(state, (uint16_t)(state->pc + 2));
+  r->int_enable = state->int_enable;
+  if (++tw->count == TRACE_BLOCK_RECORDS) {
+    trace_flush(tw);
+  }
+}
+
+// Checks that a mapped file starts with a valid trace header.
+bool trace_header_valid(const TraceHeader* header);
+
+// Returns the cycles the recorded instruction took. next is the following
+// record (or NULL); it tells whether a conditional CALL/RET was taken.
+int trace_record_cycles(const TraceRecord* r, const TraceRecord* next);
+
+// Prints one record as registers, flags and the disassembled instruction.
+void trace_print_record(FILE* out, uint64_t index, const TraceRecord* r);
+
+// ---------------------------------------------------------------------------
+// Random-access reader
+// ---------------------------------------------------------------------------
+
+typedef struct TraceReader {
+  int                    fd;
+  TraceHeader            header;
+  const TraceIndexEntry* index;          // mmap'd entries
+  uint64_t               blocks;
+  uint64_t               records;        // total records in the trace
+  void*                  index_map;
+  size_t                 index_map_size;
+  int64_t                cached_block;   // block currently decoded, -1 if none
+  TraceRecord*           block;          // decoded records of cached_block
+  uint8_t*               scratch;        // compressed bytes (v2 only)
+} TraceReader;
+
+// Opens path and its index. Returns NULL (with a message on stderr) on failure.
+TraceReader* trace_reader_open(const char* path);
+
+void trace_reader_close(TraceReader* tr);
+
+// Returns the block containing the given record / cycle, or the first block
+// of the given frame; -1 if out of range.
+int64_t trace_reader_find_record(const TraceReader* tr, uint64_t record);
+int64_t trace_reader_find_cycle(const TraceReader* tr, uint64_t cycle);
+int64_t trace_reader_find_frame(const TraceReader* tr, uint64_t frame);
+
+// Decodes one block and returns its records (valid until the next call).
+// Returns NULL on an I/O or decompression error.
+const TraceRecord* trace_reader_block(TraceReader* tr, int64_t block);
+
+#endif  // TRACE_H
@@ -0,0 +1,334 @@
+// Space Invaders Emulator - CRT Filter
+//
+// Phosphor persistence, glow and raster lines for flat-panel displays (see
+// crt_filter.h). A frame takes two passes over the 224x256 screen:
+//
+//   decay:   level = max(lit ? 255 : 0, level * CRT_DECAY / 256), then
+//            spread = level blurred across the row, 1 2 1
+//   compose: glow = level + spread blurred down the column (1 2 1) *
+//            CRT_BLOOM / 256, tinted by the overlay, and each pixel widened
+//            to CRT_SCALE output pixels through the raster line's profile;
+//            the output row is then repeated CRT_SCALE times
+//
+// The monitor is mounted on its side, so its raster lines run down the
+// screen: the profile darkens the edges of each screen column, and the
+// rows of a pixel's block are equal.
+//
+// Every pass works on 8 pixels at a time in GCC vector types (one SSE2 or
+// NEON register of 16-bit lanes). The level and spread rows are padded with
+// PAD zero pixels at both ends, and spread with a zero row above and below,
+// so the blurs read their neighbours without edge cases: off the screen
+// there is no phosphor. Threads split the screen into bands of rows; compose
+// reads spread from the neighbouring bands, so all threads meet at a
+// barrier between the passes.
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "crt_filter.h"
+#include "render.h"
+
+typedef uint16_t Lanes __attribute__((vector_size(16)));    // 8 pixels' values
+typedef uint8_t  Bytes __attribute__((vector_size(8)));     // 8 pixels' indices
+typedef uint32_t Words __attribute__((vector_size(32)));    // 8 ARGB pixels
+
+#define LANES   8
+#define PAD     LANES
+#define STRIDE  (RENDER_WIDTH + 2 * PAD)
+
+// brightness across a raster line, of 256: dimmer at its edges, where the
+// next line's gap begins
+static const uint16_t scanline[CRT_SCALE] = { 112, 224, 256, 224, 112 };
+
+static inline Lanes load(const uint16_t *p)
+{
+    Lanes v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static inline void store(uint16_t *p, Lanes v)
+{
+    memcpy(p, &v, sizeof(v));
+}
+
+static inline Lanes max_lanes(Lanes a, Lanes b)
+{
+    Lanes a_larger = (Lanes)(a > b);
+    return (a & a_larger) | (b & ~a_larger);
+}
+
+static inline Lanes min_lanes(Lanes a, Lanes b)
+{
+    Lanes a_smaller = (Lanes)(a < b);
+    return (a & a_smaller) | (b & ~a_smaller);
+}
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// ---------------------------------------------------------------------------
+// The passes
+// ---------------------------------------------------------------------------
+
+static void decay_row(CrtFilter *filter, int y)
+{
+    const uint8_t *in = filter->indices + y * RENDER_WIDTH;
+    uint16_t *level = filter->level + y * STRIDE + PAD;
+    uint16_t *spread = filter->spread + (y + 1) * STRIDE + PAD;
+
+    for (int x = 0; x < RENDER_WIDTH; x += LANES)
+    {
+        Bytes index;
+        memcpy(&index, in + x, sizeof(index));
+        Lanes lit = (Lanes)(__builtin_convertvector(index, Lanes) != 0) & 255;
+        store(level + x, max_lanes(lit, (load(level + x) * CRT_DECAY) >> 8));
+    }
+    for (int x = 0; x < RENDER_WIDTH; x += LANES)
+    {
+        store(spread + x, (load(level + x - 1) + 2 * load(level + x) + load(level + x + 1)) >> 2);
+    }
+}
+
+static void compose_row(CrtFilter *filter, int y)
+{
+    const uint16_t *level = filter->level + y * STRIDE + PAD;
+    const uint16_t *above = filter->spread + y * STRIDE + PAD;
+    const uint16_t *middle = above + STRIDE;
+    const uint16_t *below = middle + STRIDE;
+    const uint16_t *tint_r = filter->tint[0] + y * RENDER_WIDTH;
+    const uint16_t *tint_g = filter->tint[1] + y * RENDER_WIDTH;
+    const uint16_t *tint_b = filter->tint[2] + y * RENDER_WIDTH;
+
+    // the row's pixels for each position across a raster line
+    uint32_t line[CRT_SCALE][RENDER_WIDTH];
+    for (int x = 0; x < RENDER_WIDTH; x += LANES)
+    {
+        Lanes bloom = (load(above + x) + 2 * load(middle + x) + load(below + x)) >> 2;
+        Lanes glow = min_lanes(load(level + x) + ((bloom * CRT_BLOOM) >> 8), (Lanes){0} + 255);
+        Lanes r = (glow * load(tint_r + x)) >> 8;
+        Lanes g = (glow * load(tint_g + x)) >> 8;
+        Lanes b = (glow * load(tint_b + x)) >> 8;
+        for (int k = 0; k < CRT_SCALE; k++)
+        {
+            Words pixel = 0xFF000000u
+                        | __builtin_convertvector((r * scanline[k]) >> 8, Words) << 16
+                        | __builtin_convertvector((g * scanline[k]) >> 8, Words) << 8
+                        | __builtin_convertvector((b * scanline[k]) >> 8, Words);
+            memcpy(&line[k][x], &pixel, sizeof(pixel));
+        }
+    }
+
+    uint32_t *out = filter->pixels + (size_t)y * CRT_SCALE * filter->pitch;
+    for (int x = 0; x < RENDER_WIDTH; x++)
+    {
+        for (int k = 0; k < CRT_SCALE; k++)
+        {
+            out[x * CRT_SCALE + k] = line[k][x];
+        }
+    }
+    for (int i = 1; i < CRT_SCALE; i++)
+    {
+        memcpy(out + (size_t)i * filter->pitch, out, CRT_WIDTH * sizeof(uint32_t));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Threads
+// ---------------------------------------------------------------------------
+
+static int band_first(const CrtFilter *filter, int band)
+{
+    return band * RENDER_HEIGHT / filter->threads;
+}
+
+static void decay_band(CrtFilter *filter, int band)
+{
+    for (int y = band_first(filter, band); y < band_first(filter, band + 1); y++)
+    {
+        decay_row(filter, y);
+    }
+}
+
+static void compose_band(CrtFilter *filter, int band)
+{
+    for (int y = band_first(filter, band); y < band_first(filter, band + 1); y++)
+    {
+        compose_row(filter, y);
+    }
+}
+
+// returns once every thread has called it
+static void barrier(CrtFilter *filter)
+{
+    if (filter->threads == 1)
+    {
+        return;
+    }
+    pthread_mutex_lock(&filter->lock);
+    uint64_t phase = filter->phase;
+    if (++filter->waiting == filter->threads)
+    {
+        filter->waiting = 0;
+        filter->phase++;
+        pthread_cond_broadcast(&filter->arrived);
+    }
+    else
+    {
+        while (filter->phase == phase)
+        {
+            pthread_cond_wait(&filter->arrived, &filter->lock);
+        }
+    }
+    pthread_mutex_unlock(&filter->lock);
+}
+
+// Filters band 1, 2, ... of every frame; the caller's thread does band 0.
+static void *worker_main(void *arg)
+{
+    CrtFilter *filter = arg;
+    pthread_mutex_lock(&filter->lock);
+    int band = ++filter->bands_taken;
+    uint64_t seen = 0;
+    for (;;)
+    {
+        while (filter->generation == seen && !filter->stopping)
+        {
+            pthread_cond_wait(&filter->start, &filter->lock);
+        }
+        if (filter->stopping)
+        {
+            break;
+        }
+        seen = filter->generation;
+        pthread_mutex_unlock(&filter->lock);
+
+        decay_band(filter, band);
+        barrier(filter);
+        compose_band(filter, band);
+        barrier(filter);
+
+        pthread_mutex_lock(&filter->lock);
+    }
+    pthread_mutex_unlock(&filter->lock);
+    return NULL;
+}
+
+bool crt_open(CrtFilter *filter, int threads)
+{
+    memset(filter, 0, sizeof(*filter));
+    if (threads < 1 || threads > CRT_MAX_THREADS)
+    {
+        return false;
+    }
+    filter->threads = 1;
+    filter->level = calloc((size_t)RENDER_HEIGHT * STRIDE, sizeof(uint16_t));
+    filter->spread = calloc((size_t)(RENDER_HEIGHT + 2) * STRIDE, sizeof(uint16_t));
+    uint8_t *overlay = malloc(RENDER_WIDTH * RENDER_HEIGHT);
+    bool ok = filter->level != NULL && filter->spread != NULL && overlay != NULL;
+    for (int c = 0; c < 3; c++)
+    {
+        filter->tint[c] = malloc(RENDER_WIDTH * RENDER_HEIGHT * sizeof(uint16_t));
+        ok = ok && filter->tint[c] != NULL;
+    }
+    if (!ok)
+    {
+        free(overlay);
+        crt_close(filter);
+        return false;
+    }
+
+    // the overlay's colour at each pixel is the colour of a lit screen
+    uint8_t lit[VRAM_BYTES];
+    memset(lit, 0xFF, sizeof(lit));
+    render_vram_index8(lit, overlay);
+    for (int i = 0; i < RENDER_WIDTH * RENDER_HEIGHT; i++)
+    {
+        uint32_t colour = render_overlay_palette[overlay[i]];
+        filter->tint[0][i] = (colour >> 16) & 0xFF;
+        filter->tint[1][i] = (colour >> 8) & 0xFF;
+        filter->tint[2][i] = colour & 0xFF;
+    }
+    free(overlay);
+
+    pthread_mutex_init(&filter->lock, NULL);
+    pthread_cond_init(&filter->start, NULL);
+    pthread_cond_init(&filter->arrived, NULL);
+    filter->started = true;
+    for (int i = 0; i < threads - 1; i++)
+    {
+        if (pthread_create(&filter->workers[i], NULL, worker_main, filter) != 0)
+        {
+            crt_close(filter);
+            return false;
+        }
+        filter->threads++;
+    }
+    return true;
+}
+
+void crt_filter(CrtFilter *filter, const uint8_t *indices, uint32_t *pixels, int pitch)
+{
+    int64_t start = now_ns();
+    filter->indices = indices;
+    filter->pixels = pixels;
+    filter->pitch = pitch;
+    if (filter->threads > 1)
+    {
+        pthread_mutex_lock(&filter->lock);
+        filter->generation++;
+        pthread_cond_broadcast(&filter->start);
+        pthread_mutex_unlock(&filter->lock);
+    }
+
+    decay_band(filter, 0);
+    barrier(filter);
+    int64_t decayed = now_ns();
+    compose_band(filter, 0);
+    barrier(filter);
+    int64_t end = now_ns();
+
+    CrtTimes *times = &filter->times;
+    times->frames++;
+    times->total_ns += end - start;
+    times->decay_ns += decayed - start;
+    times->compose_ns += end - decayed;
+    if (end - start > times->max_ns)
+    {
+        times->max_ns = end - start;
+    }
+}
+
+void crt_close(CrtFilter *filter)
+{
+    if (filter->started)
+    {
+        pthread_mutex_lock(&filter->lock);
+        filter->stopping = true;
+        pthread_cond_broadcast(&filter->start);
+        pthread_mutex_unlock(&filter->lock);
+        for (int i = 0; i < filter->threads - 1; i++)
+        {
+            pthread_join(filter->workers[i], NULL);
+        }
+        pthread_mutex_destroy(&filter->lock);
+        pthread_cond_destroy(&filter->start);
+        pthread_cond_destroy(&filter->arrived);
+        filter->started = false;
+    }
+    free(filter->level);
+    free(filter->spread);
+    for (int c = 0; c < 3; c++)
+    {
+        free(filter->tint[c]);
+        filter->tint[c] = NULL;
+    }
+    filter->level = filter->spread = NULL;
+}
@@ -0,0 +1,73 @@
+#ifndef CRT_FILTER_H
+#define CRT_FILTER_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+
+// SDL-free CRT post-process for flat-panel displays, run on the CPU. Each
+// screen pixel is a spot of phosphor that the beam lights fully and that
+// then fades by a fixed share every frame, so objects the game draws on
+// alternate frames stay visible as they did on the cabinet. A blur of the
+// phosphor is added back as glow, the overlay's colours tint the result
+// and every pixel becomes a CRT_SCALE x CRT_SCALE block crossed by the
+// raster line's profile. The rows are split between a pool of threads.
+
+#define CRT_SCALE          5       // output pixels per screen pixel, per axis
+#define CRT_WIDTH          (RENDER_WIDTH * CRT_SCALE)      // 1120
+#define CRT_HEIGHT         (RENDER_HEIGHT * CRT_SCALE)     // 1280
+#define CRT_MAX_THREADS    16
+#define CRT_DEFAULT_THREADS 4
+#define CRT_DECAY          128     // phosphor left after a frame, of 256
+#define CRT_BLOOM          112     // blurred phosphor added as glow, of 256
+
+// Filter timings, for the frame rate report.
+typedef struct CrtTimes
+{
+    uint64_t frames;
+    int64_t  total_ns;
+    int64_t  max_ns;               // slowest frame
+    int64_t  decay_ns;             // phosphor decay and the blur across rows
+    int64_t  compose_ns;           // blur down columns, tint and scale into the output
+} CrtTimes;
+
+typedef struct CrtFilter
+{
+    int             threads;       // the caller's thread and threads - 1 workers
+    uint16_t*       level;         // phosphor brightness, 0..255 (padded rows, see crt_filter.c)
+    uint16_t*       spread;        // level blurred along each row (padded)
+    uint16_t*       tint[3];       // overlay colour of every screen pixel: red, green, blue
+    // the frame being filtered
+    const uint8_t*  indices;
+    uint32_t*       pixels;
+    int             pitch;
+    // worker pool: a frame starts when generation changes; phase counts
+    // the barriers every thread passes between and after the two passes
+    pthread_t       workers[CRT_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  arrived;
+    bool            started;       // the lock and conditions exist
+    bool            stopping;
+    int             bands_taken;   // by workers, numbered from 1
+    uint64_t        generation;
+    uint64_t        phase;
+    int             waiting;       // threads at the current barrier
+    CrtTimes        times;
+} CrtFilter;
+
+// allocates the buffers and starts threads - 1 workers (1 to
+// CRT_MAX_THREADS); false if either fails
+bool crt_open(CrtFilter* filter, int threads);
+
+// advances the phosphor by one frame of 8bpp overlay indices (see
+// render_vram_index8) and writes the CRT_WIDTH x CRT_HEIGHT ARGB8888 image
+// to pixels; pitch is the length of a destination row in pixels
+void crt_filter(CrtFilter* filter, const uint8_t* indices, uint32_t* pixels, int pitch);
+
+// stops the workers and frees the buffers
+void crt_close(CrtFilter* filter);
+
+#endif  // CRT_FILTER_H
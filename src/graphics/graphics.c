@@ -14,11 +14,22 @@
 #include <stdbool.h> 
 
 #include "cpu.h"
+#include "crt_filter.h"
+#include "graphics.h"
+#include "render.h"
 
 // SDL (Window, Renderer, Texture) pointers
 static SDL_Window *window = NULL;     // graphics window
 static SDL_Renderer *renderer = NULL; // drawer
-static SDL_Texture *texture = NULL;   // framebuffer
+static SDL_Texture *texture = NULL;   // display copy of the framebuffer
+static SDL_Texture *crt_texture = NULL; // the CRT filter's output, when it is on
+
+// 8bpp indexed framebuffer (overlay palette); expanded to the texture's
+// 32-bit pixels only when it is uploaded
+static uint8_t framebuffer[RENDER_WIDTH * RENDER_HEIGHT];
+
+// optional post-process: phosphor persistence, glow and raster lines
+static CrtFilter crt;
 
 // screen size constants
 static const int SCREEN_WIDTH = 224;
@@ -26,8 +37,7 @@ static const int SCREEN_HEIGHT = 256;
 static const int WINDOW_SCALE = 5; // scaling factor for screen dimensions
 
 // vram constants
-static const int VRAM_START = 0x2400; // space invaders vram starts at memory address 0x2400
-static const int VRAM_SIZE = 7168;    // (224 pixels * 256 pixels) / 8 bits = 7168 bytes
+static const int VRAM_START = VRAM_BASE; // space invaders vram starts at memory address 0x2400
 
 // initializes graphics (vidoe subsystem)
 // returns true if initalization successful
@@ -85,6 +95,12 @@ bool graphics_init(void)
 // free video subsystem allocated memory
 void graphics_cleanup(void)
 {
+    if (crt_texture)
+    {
+        SDL_DestroyTexture(crt_texture);
+        crt_texture = NULL;
+        crt_close(&crt);
+    }
     SDL_DestroyTexture(texture);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
@@ -93,52 +109,92 @@ void graphics_cleanup(void)
 // draw graphics based on memory (vram)
 void graphics_draw(uint8_t *memory)
 {
-    uint32_t *pixels = NULL; // pixel buffer
+    graphics_draw_columns(memory, 0, SCREEN_WIDTH);
+}
+
+// draw a slice of columns: the video lines the beam has finished
+void graphics_draw_columns(uint8_t *memory, int first, int count)
+{
+    uint32_t *pixels = NULL; // pixel buffer (the slice's top left pixel)
     int pitch = 0;           // LockTexture computes row pitch
+    SDL_Rect slice = {first, 0, count, SCREEN_HEIGHT};
+
+    // expand 1bpp vram (at 0x2400) into the indexed framebuffer
+    render_vram_index8_columns(&memory[VRAM_START], framebuffer, first, count);
+
+    // the filter redraws the whole screen from the framebuffer
+    if (crt_texture)
+    {
+        if (SDL_LockTexture(crt_texture, NULL, (void **)&pixels, &pitch) != 0)
+        {
+            fprintf(stderr, "Could not lock texture: %s\n", SDL_GetError());
+            return;
+        }
+        crt_filter(&crt, framebuffer, pixels, pitch / (int)sizeof(uint32_t));
+        SDL_UnlockTexture(crt_texture);
+        graphics_present();
+        return;
+    }
 
     // SDL library function to lock the texture and point to pixel buffer
-    if (SDL_LockTexture(texture, NULL, (void **)&pixels, &pitch) != 0)
+    if (SDL_LockTexture(texture, &slice, (void **)&pixels, &pitch) != 0)
     {
         fprintf(stderr, "Could not lock texture: %s\n", SDL_GetError());
+        return;
     }
 
-    // pointer to memory parameter
-    unsigned char *vram = &memory[VRAM_START]; // vram starts at 0x2400
+    // palette lookup straight into the texture
+    render_index8_to_argb_columns(framebuffer, render_overlay_palette, pixels,
+                                  pitch / (int)sizeof(uint32_t), first, count);
 
-    // iterate over vram
-    for (int i = 0; i < VRAM_SIZE; i++)
-    {
-        unsigned char byte = vram[i];
+    // unlock and render
+    SDL_UnlockTexture(texture);
+    graphics_present();
+}
 
-        // vram (x,y) = (256,224); screen(x,y) = (224,256)
-        // bytes run right horizontally (x) then down vertically (y) in 8 bit chunks
-        // determine the starting (x,y) coordinate of current byte
-        int x = (i % 32) * 8; // 32 bytes per row
-        int y = i / 32;
+// copy the texture to the window and show it
+void graphics_present(void)
+{
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, crt_texture ? crt_texture : texture, NULL, NULL);
+    SDL_RenderPresent(renderer);
+}
 
-        // iterate through each bit/pixel in current byte
-        for (int bit = 0; bit < 8; bit++)
-        {
-            // shift current bit to LSB position and set black or white
-            uint32_t color = ((byte >> bit) & 1) ? 0xFFFFFFFF : 0xFF000000;
-
-            // 90 degree rotation counterclockwise
-            int x_rotated = y;
-            int y_rotated = 255 - (x + bit); // 0 is top left corner in SDL
-
-            // check boundaries and set pixel color
-            if (x_rotated < SCREEN_WIDTH && y_rotated < SCREEN_HEIGHT)
-            {
-                // convert coordinates to pixel buffer index position
-                pixels[y_rotated * SCREEN_WIDTH + x_rotated] = color;
-            }
-        }
+// switch waiting for vsync on present (SDL 2.0.18 and later)
+bool graphics_set_vsync(bool on)
+{
+    if (SDL_RenderSetVSync(renderer, on ? 1 : 0) != 0)
+    {
+        fprintf(stderr, "Could not set vsync: %s\n", SDL_GetError());
+        return false;
+    }
+    return true;
+}
+
+// switch to the CRT filter's full-size texture
+bool graphics_set_crt(int threads)
+{
+    if (!crt_open(&crt, threads))
+    {
+        fprintf(stderr, "Could not start the CRT filter\n");
+        return false;
     }
+    crt_texture = SDL_CreateTexture(renderer,
+                                    SDL_PIXELFORMAT_ARGB8888,
+                                    SDL_TEXTUREACCESS_STREAMING,
+                                    CRT_WIDTH, CRT_HEIGHT);
+    if (!crt_texture)
+    {
+        fprintf(stderr, "Could not create texture: %s\n", SDL_GetError());
+        crt_close(&crt);
+        return false;
+    }
+    // one texture pixel per window pixel at the window's initial size
+    SDL_RenderSetLogicalSize(renderer, CRT_WIDTH, CRT_HEIGHT);
+    return true;
+}
 
-        // unlock and render
-        SDL_UnlockTexture(texture);
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, NULL, NULL);
-        SDL_RenderPresent(renderer);
-    
+const CrtTimes *graphics_crt_times(void)
+{
+    return crt_texture ? &crt.times : NULL;
 }
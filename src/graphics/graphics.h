@@ -1,18 +1,39 @@
-#ifndef GRAPHICS_H
-#define GRAPHICS_H
-
-#include <stdbool.h>
-
-// CPU header state (defined in cpu header)
-struct State8080;  
-
-// initializes sdl graphics (window, renderer, texture) 
-bool graphics_init(void);
-
-// cleans up sdl resources
-void graphics_cleanup(void);
-
-// render 8080 vram to screen
-void graphics_draw(uint8_t* memory);
-
+#ifndef GRAPHICS_H
+#define GRAPHICS_H
+
+#include <stdbool.h>
+
+#include "crt_filter.h"
+
+// CPU header state (defined in cpu header)
+struct State8080;  
+
+// initializes sdl graphics (window, renderer, texture) 
+bool graphics_init(void);
+
+// cleans up sdl resources
+void graphics_cleanup(void);
+
+// render 8080 vram to screen
+void graphics_draw(uint8_t* memory);
+
+// render only screen columns first .. first + count - 1 (multiples of 8),
+// keeping the rest of the previous image, and present
+void graphics_draw_columns(uint8_t* memory, int first, int count);
+
+// present the current image again
+void graphics_present(void);
+
+// make presents wait for the display's vsync, or not; false if the
+// renderer cannot switch
+bool graphics_set_vsync(bool on);
+
+// run every frame through the CRT filter (crt_filter.h) on threads
+// threads and show its CRT_WIDTH x CRT_HEIGHT output; false if the filter
+// or its texture cannot be created
+bool graphics_set_crt(int threads);
+
+// the CRT filter's timings so far, or NULL when it is off
+const CrtTimes* graphics_crt_times(void);
+
 #endif  // GRAPHICS_H
\ No newline at end of file
@@ -0,0 +1,212 @@
+// Space Invaders Emulator - Observation Kernels
+//
+// Turns 1bpp vram into the small grayscale images learning agents train
+// on, without ever expanding it to one byte per pixel.
+//
+// A screen column is one 32-byte vram row, and screen rows are its bits
+// (row r is bit 255 - r; see render_vram_argb). A box's columns are first
+// added bitwise into bit planes (a carry-save counter per pixel row), so
+// every output row of one output column is then counted from the same few
+// words: the lit pixels of a box are the planes' popcounts below the bit
+// of its top row minus those below the bit of the next box's top row,
+// weighted by plane. Neighbouring boxes share bounds, so each bound is
+// counted once.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "observe.h"
+#include "render.h"
+
+bool observe_plan(ObservePlan *plan, int x, int y, int width, int height,
+                  int out_width, int out_height)
+{
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > RENDER_WIDTH || y + height > RENDER_HEIGHT)
+    {
+        return false;
+    }
+    if (out_width <= 0 || out_height <= 0 || out_width > width || out_height > height ||
+        (width + out_width - 1) / out_width > OBSERVE_MAX_BOX ||
+        (height + out_height - 1) / out_height > OBSERVE_MAX_BOX)
+    {
+        return false;
+    }
+    plan->width = out_width;
+    plan->height = out_height;
+
+    for (int i = 0; i <= out_width; i++)
+    {
+        plan->col_first[i] = (uint8_t)(x + i * width / out_width);
+    }
+    // boxes are either narrow (width / out_width columns) or one wider
+    int narrow = width / out_width;
+    for (int i = 0; i < out_width; i++)
+    {
+        plan->box_wide[i] = (uint8_t)(plan->col_first[i + 1] - plan->col_first[i] > narrow);
+    }
+
+    int widest = (width + out_width - 1) / out_width;
+    plan->planes = 0;
+    while (widest >> plan->planes)
+    {
+        plan->planes++;
+    }
+
+    for (int i = 0; i <= out_height; i++)
+    {
+        // bound i is the top of box row i, screen row y + i * height / out_height
+        int row = y + i * height / out_height;
+        int bit = RENDER_HEIGHT - row;
+        plan->bound_word[i] = (uint8_t)(bit / 64);
+        plan->bound_mask[i] = (1ULL << (bit % 64)) - 1;
+        if (i < out_height)
+        {
+            int box_height = y + (i + 1) * height / out_height - row;
+            for (int wide = 0; wide < 2; wide++)
+            {
+                uint32_t area = (uint32_t)((narrow + wide) * box_height);
+                plan->scale[wide][i] = ((255u << 16) + area / 2) / area;
+            }
+        }
+    }
+    return true;
+}
+
+// Weighted count of a box column's pixels below bound i.
+static inline __attribute__((always_inline))
+uint32_t bound_count(const ObservePlan *plan, int i, uint64_t plane[][5], const uint32_t *below,
+                     int planes)
+{
+    int w = plan->bound_word[i];
+    uint64_t mask = plan->bound_mask[i];
+    uint32_t count = below[w];
+    for (int p = 0; p < planes; p++)
+    {
+        count += (uint32_t)__builtin_popcountll(plane[p][w] & mask) << p;
+    }
+    return count;
+}
+
+// The filter proper, for a known number of planes so the loops over them
+// unroll. Compiled twice on x86: once for any CPU and once with the POPCNT
+// instruction, which turns each popcount into one instruction instead of a
+// bit-twiddling sequence.
+static inline __attribute__((always_inline))
+void downscale(const ObservePlan *plan, const uint8_t *vram, uint8_t *out, int planes)
+{
+    uint64_t plane[OBSERVE_PLANES][5];  // a fifth, empty word for bound 256
+    uint32_t below[5];                  // weighted count in the words before each
+
+    for (int ox = 0; ox < plan->width; ox++)
+    {
+        for (int p = 0; p < planes; p++)
+        {
+            plane[p][0] = plane[p][1] = plane[p][2] = plane[p][3] = plane[p][4] = 0;
+        }
+        for (int col = plan->col_first[ox]; col < plan->col_first[ox + 1]; col++)
+        {
+            uint64_t words[4];
+            memcpy(words, vram + col * 32, 32);
+            for (int w = 0; w < 4; w++)
+            {
+                uint64_t carry = words[w];
+                for (int p = 0; p < planes; p++)
+                {
+                    uint64_t next = plane[p][w] & carry;
+                    plane[p][w] ^= carry;
+                    carry = next;
+                }
+            }
+        }
+        below[0] = 0;
+        for (int w = 0; w < 4; w++)
+        {
+            uint32_t count = 0;
+            for (int p = 0; p < planes; p++)
+            {
+                count += (uint32_t)__builtin_popcountll(plane[p][w]) << p;
+            }
+            below[w + 1] = below[w] + count;
+        }
+
+        // weighted count below each bound; a box is the difference of two
+        const uint32_t *scale = plan->scale[plan->box_wide[ox]];
+        uint8_t *dst = out + ox;
+        uint32_t upper = bound_count(plan, 0, plane, below, planes);
+        for (int oy = 0; oy < plan->height; oy++)
+        {
+            uint32_t lower = bound_count(plan, oy + 1, plane, below, planes);
+            *dst = (uint8_t)(((upper - lower) * scale[oy] + 0x8000) >> 16);
+            dst += plan->width;
+            upper = lower;
+        }
+    }
+}
+
+// Boxes up to 3 and 7 columns wide (crops up to 3 and 7 times the output
+// width) get their own copies; wider ones count all planes.
+#define DOWNSCALE_VARIANTS(plan, vram, out)         \
+    switch ((plan)->planes)                         \
+    {                                               \
+    case 1: downscale(plan, vram, out, 1); break;   \
+    case 2: downscale(plan, vram, out, 2); break;   \
+    case 3: downscale(plan, vram, out, 3); break;   \
+    default: downscale(plan, vram, out, OBSERVE_PLANES); break; \
+    }
+
+static void downscale_generic(const ObservePlan *plan, const uint8_t *vram, uint8_t *out)
+{
+    DOWNSCALE_VARIANTS(plan, vram, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+__attribute__((target("popcnt")))
+static void downscale_popcnt(const ObservePlan *plan, const uint8_t *vram, uint8_t *out)
+{
+    DOWNSCALE_VARIANTS(plan, vram, out);
+}
+#endif
+
+void observe_downscale(const ObservePlan *plan, const uint8_t *vram, uint8_t *out)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    if (__builtin_cpu_supports("popcnt"))
+    {
+        downscale_popcnt(plan, vram, out);
+        return;
+    }
+#endif
+    downscale_generic(plan, vram, out);
+}
+
+void observe_ring_init(ObserveRing *ring, uint8_t *buffer, uint32_t image_bytes, uint32_t depth)
+{
+    ring->buffer = buffer;
+    ring->image_bytes = image_bytes;
+    ring->depth = depth;
+    ring->count = 0;
+}
+
+void observe_push(ObserveRing *ring, const ObservePlan *plan, const uint8_t *vram)
+{
+    size_t half = (size_t)ring->image_bytes * ring->depth;
+    uint8_t *image = ring->buffer + (ring->count % ring->depth) * ring->image_bytes;
+    observe_downscale(plan, vram, image);
+    memcpy(image + half, image, ring->image_bytes);
+
+    // nothing older yet: the first image stands in for the whole stack
+    if (ring->count == 0)
+    {
+        for (uint32_t i = 1; i < 2 * ring->depth; i++)
+        {
+            memcpy(ring->buffer + i * ring->image_bytes, image, ring->image_bytes);
+        }
+    }
+    ring->count++;
+}
+
+const uint8_t *observe_stack(const ObserveRing *ring)
+{
+    return ring->buffer + (ring->count % ring->depth) * ring->image_bytes;
+}
@@ -0,0 +1,67 @@
+#ifndef OBSERVE_H
+#define OBSERVE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// SDL-free observation kernels for learning agents: crop the rotated
+// 224x256 screen, box-filter it down to a small grayscale image straight
+// from 1bpp vram, and keep the last few images stacked.
+
+#define OBSERVE_WIDTH      84      // the usual agent input: 84x84, 4 frames
+#define OBSERVE_HEIGHT     84
+#define OBSERVE_DEPTH      4
+#define OBSERVE_MAX_SIDE   256     // output sides are at most the screen's
+#define OBSERVE_MAX_BOX    64      // source pixels per output pixel, per axis
+#define OBSERVE_PLANES     7       // bits of a count of OBSERVE_MAX_BOX columns
+#define OBSERVE_MAX_DEPTH  16
+
+// Precomputed box filter for one crop and output size. Boxes tile the
+// crop, so output row i spans vram bits bound[i + 1] .. bound[i] - 1 of
+// every column (screen rows run against the bits).
+typedef struct ObservePlan
+{
+    int      width;                // output size
+    int      height;
+    int      planes;               // bit planes to count a box's columns
+    uint8_t  col_first[OBSERVE_MAX_SIDE + 1];    // vram rows (screen columns) per output column
+    uint8_t  box_wide[OBSERVE_MAX_SIDE];         // 1 if a column's boxes are the wider kind
+    uint8_t  bound_word[OBSERVE_MAX_SIDE + 1];   // 64-bit word of the vram row a bound is in
+    uint64_t bound_mask[OBSERVE_MAX_SIDE + 1];   // bits of that word below the bound
+    uint32_t scale[2][OBSERVE_MAX_SIDE];         // 255 / box area per row, 16.16 fixed point
+} ObservePlan;
+
+// plans a crop of the screen (x, y, width, height in screen pixels,
+// 224x256 with the top left at 0,0) scaled down to out_width x out_height;
+// false if the crop is off the screen, an output side is larger than the
+// crop's, or a box would span more than OBSERVE_MAX_BOX pixels
+bool observe_plan(ObservePlan* plan, int x, int y, int width, int height,
+                  int out_width, int out_height);
+
+// writes the plan's width x height grayscale image of vram (7168 bytes
+// starting at VRAM_BASE): each byte is the share of lit pixels in its box,
+// 0..255, rows top to bottom
+void observe_downscale(const ObservePlan* plan, const uint8_t* vram, uint8_t* out);
+
+// Ring of stacked observations in caller-provided memory. Every image is
+// stored twice, depth slots apart, so the newest depth images are always
+// contiguous, oldest first: observe_stack hands them out without copying.
+typedef struct ObserveRing
+{
+    uint8_t* buffer;               // OBSERVE_RING_BYTES(image_bytes, depth)
+    uint32_t image_bytes;
+    uint32_t depth;
+    uint64_t count;                // images pushed
+} ObserveRing;
+
+#define OBSERVE_RING_BYTES(image_bytes, depth) (2 * (size_t)(image_bytes) * (depth))
+
+void observe_ring_init(ObserveRing* ring, uint8_t* buffer, uint32_t image_bytes, uint32_t depth);
+
+// downscales vram into the ring; the first image fills the whole stack
+void observe_push(ObserveRing* ring, const ObservePlan* plan, const uint8_t* vram);
+
+// the newest depth images, oldest first (depth * image_bytes bytes)
+const uint8_t* observe_stack(const ObserveRing* ring);
+
+#endif  // OBSERVE_H
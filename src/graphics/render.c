@@ -0,0 +1,135 @@
+// Space Invaders Emulator - Pixel Kernels
+//
+// Converts the 1bpp video memory into display pixels. Kept free of SDL so
+// headless tools can use it; graphics.c copies the result into a texture.
+//
+// The display path goes through an 8bpp indexed framebuffer: the rotation
+// and overlay are applied while writing one byte per pixel, and the
+// indices become 32-bit colours only when copied into the texture.
+
+#include <stdint.h>
+#include <string.h>
+
+#include "render.h"
+
+// expand vram into rotated ARGB pixels
+void render_vram_argb(const uint8_t *vram, uint32_t *pixels)
+{
+    // iterate over vram
+    for (int i = 0; i < VRAM_BYTES; i++)
+    {
+        uint8_t byte = vram[i];
+
+        // vram (x,y) = (256,224); screen(x,y) = (224,256)
+        // bytes run right horizontally (x) then down vertically (y) in 8 bit chunks
+        // determine the starting (x,y) coordinate of current byte
+        int x = (i % 32) * 8; // 32 bytes per row
+        int y = i / 32;
+
+        // iterate through each bit/pixel in current byte
+        for (int bit = 0; bit < 8; bit++)
+        {
+            // shift current bit to LSB position and set black or white
+            uint32_t color = ((byte >> bit) & 1) ? 0xFFFFFFFF : 0xFF000000;
+
+            // 90 degree rotation counterclockwise
+            int x_rotated = y;
+            int y_rotated = 255 - (x + bit); // 0 is top left corner in SDL
+
+            // convert coordinates to pixel buffer index position
+            pixels[y_rotated * RENDER_WIDTH + x_rotated] = color;
+        }
+    }
+}
+
+// overlay bands, in rows of the rotated 224x256 screen; every boundary is
+// a multiple of 8, so each vram byte column lies inside one band
+#define OVERLAY_RED_TOP       32
+#define OVERLAY_RED_BOTTOM    64
+#define OVERLAY_GREEN_TOP     184
+#define OVERLAY_GREEN_BOTTOM  240
+#define OVERLAY_LIVES_LEFT    16   // below the green band only the reserve
+#define OVERLAY_LIVES_RIGHT   134  // ships (left part) are green
+
+const uint32_t render_overlay_palette[RENDER_PALETTE_SIZE] = {
+    [RENDER_BLACK] = 0xFF000000,
+    [RENDER_WHITE] = 0xFFFFFFFF,
+    [RENDER_RED]   = 0xFFFF2020,
+    [RENDER_GREEN] = 0xFF20FF20,
+};
+
+// index of lit pixels at a screen position
+static inline uint8_t overlay_index(int row, int col)
+{
+    if (row >= OVERLAY_RED_TOP && row < OVERLAY_RED_BOTTOM)
+    {
+        return RENDER_RED;
+    }
+    if (row >= OVERLAY_GREEN_TOP && row < OVERLAY_GREEN_BOTTOM)
+    {
+        return RENDER_GREEN;
+    }
+    if (row >= OVERLAY_GREEN_BOTTOM && col >= OVERLAY_LIVES_LEFT && col < OVERLAY_LIVES_RIGHT)
+    {
+        return RENDER_GREEN;
+    }
+    return RENDER_WHITE;
+}
+
+// expand vram into rotated palette indices
+void render_vram_index8(const uint8_t *vram, uint8_t *indices)
+{
+    render_vram_index8_columns(vram, indices, 0, RENDER_WIDTH);
+}
+
+void render_vram_index8_columns(const uint8_t *vram, uint8_t *indices, int first, int count)
+{
+    // Screen row r is vram x = 255 - r (see render_vram_argb), so a band
+    // of 8 rows comes from one vram byte per column. Gather the bytes of 8
+    // columns into a word; each row's 8 pixels are then one bit of every
+    // byte, shifted down and widened to a byte mask, and land with a single
+    // 64-bit store (byte i of the word is column col + i on the little-endian
+    // hosts this builds for).
+    const uint64_t ones = 0x0101010101010101ULL;
+    for (int band = 0; band < RENDER_HEIGHT / 8; band++)
+    {
+        const uint8_t *column = vram + 31 - band;
+        uint8_t *out = indices + band * 8 * RENDER_WIDTH;
+        for (int col = first; col < first + count; col += 8)
+        {
+            uint64_t bytes = 0;
+            uint64_t lit = 0;
+            for (int i = 0; i < 8; i++)
+            {
+                bytes |= (uint64_t)column[(col + i) * 32] << (8 * i);
+                lit |= (uint64_t)overlay_index(band * 8, col + i) << (8 * i);
+            }
+            for (int bit = 0; bit < 8; bit++)
+            {
+                uint64_t row = (((bytes >> (7 - bit)) & ones) * 0xFF) & lit;
+                memcpy(out + bit * RENDER_WIDTH + col, &row, sizeof(row));
+            }
+        }
+    }
+}
+
+// look up each index in the palette; the only 32-bit pass, and sequential
+void render_index8_to_argb(const uint8_t *indices, const uint32_t *palette,
+                           uint32_t *pixels, int pitch)
+{
+    render_index8_to_argb_columns(indices, palette, pixels, pitch, 0, RENDER_WIDTH);
+}
+
+void render_index8_to_argb_columns(const uint8_t *indices, const uint32_t *palette,
+                                   uint32_t *pixels, int pitch, int first, int count)
+{
+    for (int row = 0; row < RENDER_HEIGHT; row++)
+    {
+        const uint8_t *in = indices + row * RENDER_WIDTH + first;
+        uint32_t *out = pixels + row * pitch;
+        for (int col = 0; col < count; col++)
+        {
+            out[col] = palette[in[col]];
+        }
+    }
+}
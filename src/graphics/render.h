@@ -0,0 +1,49 @@
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdint.h>
+
+// SDL-free pixel kernels shared by the display, benchmarks and tools.
+
+#define RENDER_WIDTH  224      // screen is rotated: 224 wide
+#define RENDER_HEIGHT 256      // by 256 high
+#define VRAM_BASE     0x2400   // space invaders vram starts at memory address 0x2400
+#define VRAM_BYTES    7168     // (224 pixels * 256 pixels) / 8 bits = 7168 bytes
+
+// palette indices of the 8bpp framebuffer: unlit, and lit under each part
+// of the cabinet's colour overlay (strips of gel over a monochrome monitor)
+enum {
+    RENDER_BLACK,
+    RENDER_WHITE,
+    RENDER_RED,              // band at the top, where the saucer flies
+    RENDER_GREEN,            // shields, player and the reserve ships
+    RENDER_PALETTE_SIZE
+};
+
+// ARGB8888 colours of the overlay palette
+extern const uint32_t render_overlay_palette[RENDER_PALETTE_SIZE];
+
+// expands 1bpp vram (7168 bytes starting at VRAM_BASE) into a
+// RENDER_WIDTH x RENDER_HEIGHT ARGB8888 buffer, rotated for display
+// (monochrome, no overlay)
+void render_vram_argb(const uint8_t* vram, uint32_t* pixels);
+
+// expands 1bpp vram into a RENDER_WIDTH x RENDER_HEIGHT buffer of palette
+// indices, rotated and coloured by the overlay: a quarter of the bytes of
+// the ARGB buffer, written in order
+void render_vram_index8(const uint8_t* vram, uint8_t* indices);
+
+// converts 8bpp indices to ARGB8888 through palette; pitch is the length
+// of a destination row in pixels (textures may pad their rows)
+void render_index8_to_argb(const uint8_t* indices, const uint32_t* palette,
+                           uint32_t* pixels, int pitch);
+
+// the same for screen columns first .. first + count - 1 only: the video
+// lines the machine's beam draws in that order, so a slice of columns is
+// final once the beam has passed it. first and count are multiples of 8;
+// pixels points at column first of the top row (a locked texture rect)
+void render_vram_index8_columns(const uint8_t* vram, uint8_t* indices, int first, int count);
+void render_index8_to_argb_columns(const uint8_t* indices, const uint32_t* palette,
+                                   uint32_t* pixels, int pitch, int first, int count);
+
+#endif  // RENDER_H
@@ -0,0 +1,212 @@
+// Space Invaders Emulator - Terminal Renderer
+//
+// Draws vram as text for instances with no display. Each character cell
+// covers a block of pixels, taken straight from vram: a screen column is
+// one 32-byte vram row and screen rows are its bits, top row in the high
+// bit of the last byte (see render_vram_argb), so a braille cell's four
+// rows are one nibble of one byte in each of its two columns, and a
+// half-block cell's two rows are a bit pair.
+//
+// The grid the terminal shows is kept, and an update sends only the cells
+// that differ, jumping to them with "ESC [ row ; col H". Short runs of
+// unchanged cells between changes are rewritten instead, which is shorter
+// than the jump.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "render.h"
+#include "term_render.h"
+
+#define TERM_MAX_SKIP   2          // unchanged cells rewritten rather than jumped over
+#define TERM_MAX_CELL   16         // worst-case bytes per cell: a jump and a glyph
+
+// braille dots of a cell's left and right column, indexed by the column's
+// nibble (bit 3 is the top row); U+2800 + dots is the character
+static uint8_t braille_left[16];
+static uint8_t braille_right[16];
+
+static void init_braille(void)
+{
+    static const uint8_t left_dots[4] = { 0x01, 0x02, 0x04, 0x40 };
+    static const uint8_t right_dots[4] = { 0x08, 0x10, 0x20, 0x80 };
+    for (int nibble = 0; nibble < 16; nibble++)
+    {
+        braille_left[nibble] = braille_right[nibble] = 0;
+        for (int row = 0; row < 4; row++)
+        {
+            if (nibble & (8 >> row))
+            {
+                braille_left[nibble] |= left_dots[row];
+                braille_right[nibble] |= right_dots[row];
+            }
+        }
+    }
+}
+
+bool term_parse_glyphs(const char *name, TermGlyphs *glyphs)
+{
+    if (strcmp(name, "braille") == 0)
+    {
+        *glyphs = TERM_BRAILLE;
+        return true;
+    }
+    if (strcmp(name, "halfblock") == 0)
+    {
+        *glyphs = TERM_HALF_BLOCK;
+        return true;
+    }
+    return false;
+}
+
+bool term_open(TermRender *term, FILE *out, TermGlyphs glyphs, int max_fps)
+{
+    memset(term, 0, sizeof(*term));
+    term->out = out;
+    term->glyphs = glyphs;
+    term->cols = glyphs == TERM_BRAILLE ? RENDER_WIDTH / 2 : RENDER_WIDTH;
+    term->rows = glyphs == TERM_BRAILLE ? RENDER_HEIGHT / 4 : RENDER_HEIGHT / 2;
+    term->interval_ns = 1000000000LL / (max_fps > 0 ? max_fps : TERM_DEFAULT_FPS);
+    term->capacity = (size_t)term->rows * term->cols * TERM_MAX_CELL + 64;
+    term->buffer = malloc(term->capacity);
+    if (term->buffer == NULL)
+    {
+        return false;
+    }
+    init_braille();
+
+    struct winsize size;
+    if (ioctl(fileno(out), TIOCGWINSZ, &size) == 0 && (size.ws_col < term->cols || size.ws_row < term->rows))
+    {
+        LOG(LOG_WARN, "terminal is %dx%d, the screen needs %dx%d; shrink the font or use --term braille",
+            size.ws_col, size.ws_row, term->cols, term->rows);
+    }
+    // alternate screen, cursor hidden, cleared
+    fputs("\x1b[?1049h\x1b[?25l\x1b[2J", out);
+    fflush(out);
+    return true;
+}
+
+// dot pattern of every cell of one grid row
+static void compute_row(const TermRender *term, const uint8_t *vram, int row, uint8_t *cells)
+{
+    if (term->glyphs == TERM_BRAILLE)
+    {
+        int byte = 31 - row / 2;
+        int shift = row & 1 ? 0 : 4;
+        for (int col = 0; col < term->cols; col++)
+        {
+            const uint8_t *left = vram + 2 * col * 32;
+            cells[col] = braille_left[(left[byte] >> shift) & 15] | braille_right[(left[32 + byte] >> shift) & 15];
+        }
+    }
+    else
+    {
+        int byte = 31 - row / 4;
+        int shift = 6 - 2 * (row & 3);
+        for (int col = 0; col < term->cols; col++)
+        {
+            cells[col] = (vram[col * 32 + byte] >> shift) & 3;   // bit 1 top, bit 0 bottom
+        }
+    }
+}
+
+static char *put_glyph(const TermRender *term, char *p, uint8_t cell)
+{
+    if (cell == 0)
+    {
+        *p++ = ' ';
+    }
+    else if (term->glyphs == TERM_BRAILLE)
+    {
+        // U+2800 + dots in UTF-8
+        *p++ = (char)0xe2;
+        *p++ = (char)(0xa0 | cell >> 6);
+        *p++ = (char)(0x80 | (cell & 0x3f));
+    }
+    else
+    {
+        // lower half, upper half or full block: U+2584, U+2580, U+2588
+        static const uint8_t blocks[4] = { 0, 0x84, 0x80, 0x88 };
+        *p++ = (char)0xe2;
+        *p++ = (char)0x96;
+        *p++ = (char)blocks[cell];
+    }
+    return p;
+}
+
+void term_draw(TermRender *term, const uint8_t *vram, int64_t now_ns)
+{
+    if (now_ns < term->next_ns)
+    {
+        return;
+    }
+    term->next_ns = now_ns + term->interval_ns;
+    bool full = !term->drawn || now_ns >= term->keyframe_ns;
+    if (full)
+    {
+        term->keyframe_ns = now_ns + TERM_KEYFRAME_SECONDS * 1000000000LL;
+    }
+
+    char *p = term->buffer;
+    int cursor_row = -1;           // where the terminal's cursor is after our output
+    int cursor_col = -1;
+    for (int row = 0; row < term->rows; row++)
+    {
+        uint8_t cells[TERM_MAX_COLS];
+        compute_row(term, vram, row, cells);
+        uint8_t *shown = term->cells[row];
+        if (!full && memcmp(cells, shown, term->cols) == 0)
+        {
+            continue;
+        }
+        for (int col = 0; col < term->cols; col++)
+        {
+            if (!full && cells[col] == shown[col])
+            {
+                continue;
+            }
+            if (row == cursor_row && col - cursor_col <= TERM_MAX_SKIP)
+            {
+                // the cells in between are unchanged, so shown holds them
+                for (int c = cursor_col; c < col; c++)
+                {
+                    p = put_glyph(term, p, shown[c]);
+                }
+            }
+            else
+            {
+                p += sprintf(p, "\x1b[%d;%dH", row + 1, col + 1);
+            }
+            p = put_glyph(term, p, cells[col]);
+            shown[col] = cells[col];
+            cursor_row = row;
+            cursor_col = col + 1;
+        }
+    }
+    term->drawn = true;
+    term->updates++;
+    if (p != term->buffer)
+    {
+        fwrite(term->buffer, 1, (size_t)(p - term->buffer), term->out);
+        fflush(term->out);
+        term->bytes += (uint64_t)(p - term->buffer);
+    }
+}
+
+void term_close(TermRender *term)
+{
+    if (term->buffer == NULL)
+    {
+        return;
+    }
+    fputs("\x1b[?25h\x1b[?1049l", term->out);
+    fflush(term->out);
+    free(term->buffer);
+    term->buffer = NULL;
+}
@@ -0,0 +1,56 @@
+#ifndef TERM_RENDER_H
+#define TERM_RENDER_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// SDL-free display for headless instances: draws vram into a terminal
+// (over SSH, say) with Unicode characters. Only the character cells that
+// changed since the last update are sent, each reached with a cursor
+// motion escape, and updates are capped to a few per second, so a mostly
+// still screen costs a few hundred bytes a second.
+
+typedef enum TermGlyphs
+{
+    TERM_BRAILLE,                  // 2x4 pixels a cell: 112x64 cells
+    TERM_HALF_BLOCK,               // 1x2 pixels a cell: 224x128 cells
+} TermGlyphs;
+
+#define TERM_MAX_COLS          224
+#define TERM_MAX_ROWS          128
+#define TERM_DEFAULT_FPS       10
+#define TERM_KEYFRAME_SECONDS  10  // redraw every cell this often, repairing stray output
+
+typedef struct TermRender
+{
+    FILE*      out;
+    TermGlyphs glyphs;
+    int        cols;               // grid size in cells
+    int        rows;
+    int64_t    interval_ns;        // minimum time between updates
+    int64_t    next_ns;            // earliest time of the next update
+    int64_t    keyframe_ns;        // next full redraw
+    bool       drawn;              // cells holds what the terminal shows
+    uint8_t    cells[TERM_MAX_ROWS][TERM_MAX_COLS];  // dot pattern of each cell
+    char*      buffer;             // one update's output
+    size_t     capacity;
+    uint64_t   updates;
+    uint64_t   bytes;              // sent, escapes included
+} TermRender;
+
+// parses "braille" or "halfblock"
+bool term_parse_glyphs(const char* name, TermGlyphs* glyphs);
+
+// switches out (a terminal) to its alternate screen with the cursor hidden;
+// false if out of memory
+bool term_open(TermRender* term, FILE* out, TermGlyphs glyphs, int max_fps);
+
+// draws vram (7168 bytes starting at VRAM_BASE) unless the last update was
+// less than 1 / max_fps seconds before now_ns (CLOCK_MONOTONIC)
+void term_draw(TermRender* term, const uint8_t* vram, int64_t now_ns);
+
+// restores the terminal's screen and cursor and frees the buffer
+void term_close(TermRender* term);
+
+#endif  // TERM_RENDER_H
@@ -0,0 +1,271 @@
+// In src/io/beam_race.c
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "beam_race.h"
+#include "log.h"
+
+#define RASTER_MIN_SAMPLES  8
+#define RASTER_MIN_PERIOD   2000000     // 500 Hz
+#define RASTER_MAX_PERIOD   50000000    // 20 Hz
+
+int64_t race_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int compare_int64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a;
+    int64_t y = *(const int64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// Least-squares line through the kept samples: time = offset + period *
+// refresh, time relative to the first sample. Returns false if the kept
+// samples do not determine one.
+static bool fit_line(const double* time, const double* refresh, const bool* keep, int count,
+                     double* period, double* offset) {
+    double n = 0, sum_k = 0, sum_t = 0, sum_kk = 0, sum_kt = 0;
+    for (int i = 0; i < count; i++) {
+        if (keep[i]) {
+            n++;
+            sum_k += refresh[i];
+            sum_t += time[i];
+            sum_kk += refresh[i] * refresh[i];
+            sum_kt += refresh[i] * time[i];
+        }
+    }
+    double denominator = n * sum_kk - sum_k * sum_k;
+    if (denominator <= 0) {
+        return false;
+    }
+    *period = (n * sum_kt - sum_k * sum_t) / denominator;
+    *offset = (sum_t - *period * sum_k) / n;
+    return true;
+}
+
+bool raster_fit(RasterClock* clock, const int64_t* vsync_ns, int count) {
+    if (count < RASTER_MIN_SAMPLES) {
+        return false;
+    }
+    if (count > RACE_CALIBRATION_FRAMES) {
+        count = RACE_CALIBRATION_FRAMES;
+    }
+    // A present can miss a refresh, so number the samples by counting the
+    // median intervals in each gap rather than by position.
+    int64_t gaps[RACE_CALIBRATION_FRAMES];
+    for (int i = 1; i < count; i++) {
+        gaps[i - 1] = vsync_ns[i] - vsync_ns[i - 1];
+    }
+    qsort(gaps, count - 1, sizeof(gaps[0]), compare_int64);
+    int64_t median = gaps[(count - 1) / 2];
+    if (median < RASTER_MIN_PERIOD || median > RASTER_MAX_PERIOD) {
+        return false;
+    }
+    double time[RACE_CALIBRATION_FRAMES];
+    double refresh[RACE_CALIBRATION_FRAMES];
+    bool keep[RACE_CALIBRATION_FRAMES];
+    for (int i = 0; i < count; i++) {
+        time[i] = (double)(vsync_ns[i] - vsync_ns[0]);
+        refresh[i] = i == 0 ? 0 : refresh[i - 1] +
+                     (double)((vsync_ns[i] - vsync_ns[i - 1] + median / 2) / median);
+        keep[i] = true;
+    }
+
+    // A present that returned late (the thread was not scheduled at once)
+    // is a bad sample, not a bad display: fit, drop the samples far off the
+    // line, and fit the rest again. Too many dropped means no steady
+    // refresh.
+    double period, offset;
+    if (!fit_line(time, refresh, keep, count, &period, &offset)) {
+        return false;
+    }
+    int kept = 0;
+    for (int i = 0; i < count; i++) {
+        double residual = fabs(time[i] - (offset + period * refresh[i]));
+        keep[i] = residual <= RACE_MAX_JITTER_NS;
+        kept += keep[i];
+    }
+    if (kept < count - count / 4 || !fit_line(time, refresh, keep, count, &period, &offset)) {
+        return false;
+    }
+    double worst = 0;
+    for (int i = 0; i < count; i++) {
+        double residual = fabs(time[i] - (offset + period * refresh[i]));
+        if (keep[i] && residual > worst) {
+            worst = residual;
+        }
+    }
+    clock->period_ns = (int64_t)period;
+    clock->vsync_ns = vsync_ns[0] + (int64_t)(offset + period * refresh[count - 1]);
+    clock->jitter_ns = (int64_t)worst;
+    return clock->jitter_ns <= RACE_MAX_JITTER_NS;
+}
+
+// Time since the last vsync at or before t_ns.
+static int64_t raster_phase(const RasterClock* clock, int64_t t_ns) {
+    int64_t phase = (t_ns - clock->vsync_ns) % clock->period_ns;
+    return phase < 0 ? phase + clock->period_ns : phase;
+}
+
+double raster_position(const RasterClock* clock, int64_t t_ns) {
+    return (double)raster_phase(clock, t_ns) / clock->period_ns;
+}
+
+int64_t raster_time_at(const RasterClock* clock, int64_t t_ns, double position) {
+    int64_t offset = (int64_t)(position * clock->period_ns);
+    int64_t wait = offset - raster_phase(clock, t_ns);
+    return t_ns + (wait < 0 ? wait + clock->period_ns : wait);
+}
+
+static void fall_back(BeamRace* race, const char* reason) {
+    if (race->racing) {
+        race->racing = false;
+        race->fallback = reason;
+        LOG(LOG_WARN, "beam racing off, presenting whole frames: %s", reason);
+    }
+}
+
+void race_start(BeamRace* race, const int64_t* vsync_ns, int count, int64_t frame_period_ns) {
+    *race = (BeamRace){0};
+    if (!raster_fit(&race->clock, vsync_ns, count)) {
+        race->fallback = "vsync timing is unreliable";
+        LOG(LOG_WARN, "beam racing off, presenting whole frames: %s", race->fallback);
+        return;
+    }
+    race->calibrated = true;
+    double ratio = (double)race->clock.period_ns / frame_period_ns;
+    LOG(LOG_INFO, "host refresh %.3f Hz, vsync jitter %.2f ms",
+        1e9 / race->clock.period_ns, race->clock.jitter_ns / 1e6);
+    if (ratio < 1 - RACE_RATE_TOLERANCE || ratio > 1 + RACE_RATE_TOLERANCE) {
+        race->fallback = "host refresh rate is not the game's";
+        LOG(LOG_WARN, "beam racing off, presenting whole frames: %s (%.2f Hz)",
+            race->fallback, 1e9 / race->clock.period_ns);
+        return;
+    }
+    race->racing = true;
+}
+
+void race_wait(BeamRace* race, int slice) {
+    double position = (double)slice / RACE_SLICES;
+    int64_t now = race_now_ns();
+    int64_t start = raster_time_at(&race->clock, now + RACE_LEAD_NS, position) - RACE_LEAD_NS;
+
+    // Just missed: waiting for the next refresh would cost a whole period,
+    // so run late instead. After a vsync'd present that is expected.
+    bool resampled = race->resampled;
+    race->resampled = false;
+    if (start - now > race->clock.period_ns - race->clock.period_ns / 4) {
+        if (resampled) {
+            return;
+        }
+        race->late_slices++;
+        if (++race->misses >= RACE_MAX_MISSES) {
+            fall_back(race, "slices keep missing the beam");
+        }
+        return;
+    }
+    race->misses = 0;
+    struct timespec ts = { .tv_sec = start / 1000000000, .tv_nsec = start % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+}
+
+void race_ready(BeamRace* race, int slice) {
+    race->ready_ns[slice] = race_now_ns();
+}
+
+static void add_latency(RaceLatency* latency, int64_t ns) {
+    latency->total_ns += ns;
+    latency->count++;
+    if (ns > latency->max_ns) {
+        latency->max_ns = ns;
+    }
+}
+
+void race_presented(BeamRace* race, int first, int last, int64_t start_ns, int64_t end_ns) {
+    if (!race->calibrated) {
+        return;
+    }
+    for (int slice = first; slice <= last; slice++) {
+        int64_t visible = raster_time_at(&race->clock, end_ns, (double)slice / RACE_SLICES);
+        add_latency(&race->latency[slice], visible - race->ready_ns[slice]);
+        add_latency(&race->window[slice], visible - race->ready_ns[slice]);
+        race->slices++;
+    }
+    // Racing needs presents that return at once; one that waited for the
+    // display has already cost more than racing saves.
+    if (race->racing && end_ns - start_ns > race->clock.period_ns / 4) {
+        fall_back(race, "presents wait for vsync");
+    }
+}
+
+void race_vsync(BeamRace* race, int64_t vsync_ns) {
+    if (!race->calibrated) {
+        return;
+    }
+    race->resampled = true;
+    RasterClock* clock = &race->clock;
+    int64_t refreshes = (vsync_ns - clock->vsync_ns + clock->period_ns / 2) / clock->period_ns;
+    if (refreshes <= 0) {
+        return;
+    }
+    int64_t predicted = clock->vsync_ns + refreshes * clock->period_ns;
+    int64_t residual = vsync_ns - predicted;
+    if (residual > RACE_MAX_JITTER_NS || residual < -RACE_MAX_JITTER_NS) {
+        // A late wake-up misplaces one sample; a run of them means the
+        // model is wrong, so start again from here.
+        if (++race->bad_vsyncs >= RACE_MAX_BAD_VSYNCS) {
+            fall_back(race, "vsync timing is unstable");
+            clock->vsync_ns = vsync_ns;
+            race->bad_vsyncs = 0;
+        }
+        return;
+    }
+    // Move a quarter of the way toward the observation: the phase directly,
+    // the period by the error spread over the refreshes since the anchor.
+    race->bad_vsyncs = 0;
+    clock->vsync_ns = predicted + residual / 4;
+    clock->period_ns += residual / (4 * refreshes);
+}
+
+static double mean_ms(const RaceLatency* latency) {
+    return latency->count != 0 ? latency->total_ns / 1e6 / latency->count : 0.0;
+}
+
+void race_log(BeamRace* race) {
+    if (!race->calibrated || race->window[0].count == 0) {
+        return;
+    }
+    LOG(LOG_INFO, "%s latency: first half %.2f ms (max %.2f), second half %.2f ms (max %.2f)",
+        race->racing ? "beam racing" : "whole-frame",
+        mean_ms(&race->window[0]), race->window[0].max_ns / 1e6,
+        mean_ms(&race->window[1]), race->window[1].max_ns / 1e6);
+    for (int slice = 0; slice < RACE_SLICES; slice++) {
+        race->window[slice] = (RaceLatency){0};
+    }
+}
+
+void race_report(const BeamRace* race) {
+    printf("Display: %s", race->racing ? "beam racing" : "whole frames");
+    if (race->fallback != NULL) {
+        printf(" (%s)", race->fallback);
+    }
+    if (!race->calibrated) {
+        printf("; latency not measured\n");
+        return;
+    }
+    printf("; host %.2f Hz; latency first half %.2f ms (max %.2f), second half %.2f ms (max %.2f)",
+           1e9 / race->clock.period_ns,
+           mean_ms(&race->latency[0]), race->latency[0].max_ns / 1e6,
+           mean_ms(&race->latency[1]), race->latency[1].max_ns / 1e6);
+    if (race->late_slices != 0) {
+        printf("; %llu slices late", (unsigned long long)race->late_slices);
+    }
+    printf("\n");
+}
@@ -0,0 +1,109 @@
+// In src/io/beam_race.h
+
+#ifndef BEAM_RACE_H
+#define BEAM_RACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// Beam racing: presenting each half of the emulated frame as soon as it is
+// emulated, just ahead of the host display's scanout, instead of the whole
+// frame after RST 2.
+//
+// SDL does not expose the host raster, so a RasterClock predicts it from
+// vsync timestamps: the times at which presents with vsync on return. A
+// least-squares fit over a calibration burst gives the refresh period and
+// phase; one vsync'd present a second keeps the phase from drifting. The
+// beam's position is then the fraction of the period since the last vsync.
+//
+// The emulator's first half-frame (the video lines done by RST 1) is
+// emulated RACE_LEAD_NS before the host beam starts a refresh and is
+// presented at once; the second half is emulated and presented the same
+// lead before the host beam reaches mid-screen. Emulation is thereby
+// locked to the host refresh, so racing needs a host rate within
+// RACE_RATE_TOLERANCE of the game's 60 Hz. It falls back to whole-frame
+// presentation (the FramePacer schedule) when calibration is too noisy,
+// when presents block (the driver or compositor forces vsync), or when
+// slices keep missing the beam.
+//
+// Both modes measure latency: from the moment a slice's lines are final in
+// emulation to the moment the host beam reaches the slice's part of the
+// display after it was presented.
+
+#define RACE_SLICES             2
+#define RACE_CALIBRATION_FRAMES 32
+#define RACE_WARMUP_FRAMES      4          // presents that only fill the swap chain
+#define RACE_LEAD_NS            2000000    // emulate and present a slice in this time
+#define RACE_MAX_JITTER_NS      1000000    // worst vsync timestamp error accepted
+#define RACE_RATE_TOLERANCE     0.02
+#define RACE_MAX_MISSES         8          // consecutive late slices before falling back
+#define RACE_MAX_BAD_VSYNCS     3          // consecutive off-prediction vsyncs before falling back
+
+// Host refresh model fitted to vsync timestamps (CLOCK_MONOTONIC).
+typedef struct RasterClock {
+    int64_t period_ns;
+    int64_t vsync_ns;          // a vsync: the beam at the top of the display
+    int64_t jitter_ns;         // worst residual of the fit
+} RasterClock;
+
+typedef struct RaceLatency {
+    int64_t  total_ns;
+    int64_t  max_ns;
+    uint64_t count;
+} RaceLatency;
+
+typedef struct BeamRace {
+    RasterClock clock;
+    bool        calibrated;    // clock is usable for latency measurement
+    bool        racing;        // present slices; false = whole frames
+    const char* fallback;      // why racing stopped, or NULL
+    int         misses;        // consecutive slices that started late
+    int         bad_vsyncs;    // consecutive vsyncs far from the prediction
+    bool        resampled;     // a vsync'd present just held up the next slice
+    int64_t     ready_ns[RACE_SLICES];      // when each slice's lines were final
+    uint64_t    slices;
+    uint64_t    late_slices;
+    RaceLatency latency[RACE_SLICES];       // whole run
+    RaceLatency window[RACE_SLICES];        // since the last log line
+} BeamRace;
+
+int64_t race_now_ns(void);
+
+// Fits clock to count vsync timestamps, ignoring up to a quarter that came
+// back late. Returns false if there are too few, or the rest are further
+// than RACE_MAX_JITTER_NS from a steady refresh.
+bool raster_fit(RasterClock* clock, const int64_t* vsync_ns, int count);
+
+// Fraction of the refresh (0 = top of the display) the beam is at.
+double raster_position(const RasterClock* clock, int64_t t_ns);
+
+// First time at or after t_ns that the beam reaches position.
+int64_t raster_time_at(const RasterClock* clock, int64_t t_ns, double position);
+
+// Calibrates from a burst of vsync timestamps and decides whether to race
+// against a game running at frame_period_ns. Logs the outcome.
+void race_start(BeamRace* race, const int64_t* vsync_ns, int count, int64_t frame_period_ns);
+
+// Sleeps until slice should be emulated (RACE_LEAD_NS before the beam
+// reaches it). A slice that is already late starts at once.
+void race_wait(BeamRace* race, int slice);
+
+// Notes that slice's lines are final in emulation.
+void race_ready(BeamRace* race, int slice);
+
+// Accounts a present of slices first..last that started at start_ns and
+// returned at end_ns: records each one's latency and falls back to whole
+// frames if the present blocked.
+void race_presented(BeamRace* race, int first, int last, int64_t start_ns, int64_t end_ns);
+
+// Feeds the return time of a present made with vsync on, to keep the
+// clock's phase and period on track.
+void race_vsync(BeamRace* race, int64_t vsync_ns);
+
+// Logs the mean latency of each slice since the previous call.
+void race_log(BeamRace* race);
+
+// Prints the run's latency summary.
+void race_report(const BeamRace* race);
+
+#endif // BEAM_RACE_H
@@ -0,0 +1,56 @@
+// In src/io/frame_pacer.c
+
+#include <errno.h>
+#include <time.h>
+
+#include "frame_pacer.h"
+
+// The controller moves 1/8 of the way to each new wake-up error, and never
+// aims more than 2 ms early.
+#define PACER_GAIN_SHIFT 3
+#define PACER_MAX_EARLY  2000000
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+void pacer_init(FramePacer* pacer, int64_t period_ns) {
+    *pacer = (FramePacer){ .period_ns = period_ns, .next_ns = now_ns() + period_ns };
+}
+
+void pacer_wait(FramePacer* pacer) {
+    int64_t deadline = pacer->next_ns;
+    int64_t now = now_ns();
+    pacer->frames++;
+
+    if (now >= deadline) {
+        pacer->late_frames++;
+        if (now - deadline > PACER_MAX_LAG_FRAMES * pacer->period_ns) {
+            pacer->resyncs++;
+            pacer->next_ns = now + pacer->period_ns;
+        } else {
+            pacer->next_ns = deadline + pacer->period_ns;
+        }
+        return;
+    }
+
+    int64_t target = deadline - pacer->early_ns;
+    struct timespec ts = { .tv_sec = target / 1000000000, .tv_nsec = target % 1000000000 };
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+    }
+
+    // error > 0: woke after the deadline, so aim earlier next time
+    int64_t error = now_ns() - deadline;
+    pacer->early_ns += error >> PACER_GAIN_SHIFT;
+    if (pacer->early_ns < 0) {
+        pacer->early_ns = 0;
+    } else if (pacer->early_ns > PACER_MAX_EARLY) {
+        pacer->early_ns = PACER_MAX_EARLY;
+    }
+    if (error > pacer->max_error_ns) {
+        pacer->max_error_ns = error;
+    }
+    pacer->next_ns = deadline + pacer->period_ns;
+}
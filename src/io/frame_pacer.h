@@ -0,0 +1,38 @@
+// In src/io/frame_pacer.h
+
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <stdint.h>
+
+// Real-time frame pacing without busy-waiting.
+//
+// Deadlines are absolute (start + n * period on CLOCK_MONOTONIC), so sleep
+// and emulation jitter never accumulate into drift. The thread sleeps with
+// clock_nanosleep(TIMER_ABSTIME); since the kernel wakes it a little late,
+// a controller tracks the average wake-up error and aims that much early,
+// centring wake-ups on the deadlines. A frame that finishes after its
+// deadline is counted late and the next one starts at once; after falling
+// more than PACER_MAX_LAG_FRAMES behind (a stalled window, a debugger), the
+// schedule restarts from now instead of racing to catch up.
+
+#define PACER_MAX_LAG_FRAMES 4
+
+typedef struct FramePacer {
+    int64_t  period_ns;
+    int64_t  next_ns;          // deadline of the frame being waited for
+    int64_t  early_ns;         // how early the controller aims
+    uint64_t frames;
+    uint64_t late_frames;      // frames that missed their deadline
+    uint64_t resyncs;          // schedule restarts after falling far behind
+    int64_t  max_error_ns;     // worst wake-up error seen (positive = late)
+} FramePacer;
+
+// Starts a schedule with the given period; the first deadline is one
+// period from now.
+void pacer_init(FramePacer* pacer, int64_t period_ns);
+
+// Sleeps until the current frame's deadline, then advances to the next.
+void pacer_wait(FramePacer* pacer);
+
+#endif // FRAME_PACER_H
@@ -0,0 +1,159 @@
+// In src/io/screenshot.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "log.h"
+#include "png.h"
+#include "screenshot.h"
+
+static int bit_depth(const ScreenshotQueue* queue) {
+    return queue->overlay ? 2 : 1;
+}
+
+// Packs the screen, each pixel scale x scale, into image's rows.
+static void pack_pixels(const ScreenshotQueue* queue, const PngImage* image, int scale) {
+    int depth = image->bit_depth;
+    size_t row_bytes = PNG_ROW_BYTES(image->width, depth) - 1;
+    for (int y = 0; y < image->height; y++) {
+        uint8_t* row = png_row(image, y);
+        if (y % scale != 0) {
+            memcpy(row, png_row(image, y - 1), row_bytes);   // a repeated row
+            continue;
+        }
+        const uint8_t* src = queue->indices + (y / scale) * RENDER_WIDTH;
+        memset(row, 0, row_bytes);
+        for (int x = 0; x < image->width; x++) {
+            unsigned value = src[x / scale];
+            if (!queue->overlay) {
+                value = value != RENDER_BLACK;
+            }
+            int bit = x * depth;
+            row[bit / 8] |= (uint8_t)(value << (8 - depth - bit % 8));
+        }
+    }
+}
+
+static bool write_png(ScreenshotQueue* queue, const char* stem, int scale) {
+    char path[SCREENSHOT_PATH_MAX + 16];
+    if (scale == 1) {
+        snprintf(path, sizeof(path), "%s.png", stem);
+    } else {
+        snprintf(path, sizeof(path), "%s-x%d.png", stem, scale);
+    }
+    PngImage image = {
+        .width = RENDER_WIDTH * scale,
+        .height = RENDER_HEIGHT * scale,
+        .bit_depth = bit_depth(queue),
+        .palette = queue->overlay ? render_overlay_palette : NULL,
+        .colors = RENDER_PALETTE_SIZE,
+        .scanlines = queue->scanlines,
+    };
+    pack_pixels(queue, &image, scale);
+    size_t size = png_encode(&image, queue->file, queue->file_capacity);
+
+    FILE* fp = fopen(path, "wb");
+    bool ok = fp != NULL && fwrite(queue->file, 1, size, fp) == size;
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        LOG(LOG_WARN, "cannot write screenshot %s", path);
+    }
+    pthread_mutex_lock(&queue->lock);
+    if (ok) {
+        queue->written++;
+    } else {
+        queue->failed++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return ok;
+}
+
+// Encodes slots as they are filled. A slot stays the encoder's until head
+// moves past it, so it is read without the lock.
+static void* encoder_main(void* arg) {
+    ScreenshotQueue* queue = arg;
+    pthread_mutex_lock(&queue->lock);
+    for (;;) {
+        while (queue->head == queue->tail && !queue->stopping) {
+            pthread_cond_wait(&queue->queued, &queue->lock);
+        }
+        if (queue->head == queue->tail) {
+            break;
+        }
+        const ScreenshotSlot* slot = &queue->slots[queue->head % SCREENSHOT_QUEUE_SLOTS];
+        pthread_mutex_unlock(&queue->lock);
+
+        render_vram_index8(slot->vram, queue->indices);
+        write_png(queue, slot->stem, 1);
+        if (queue->scale > 1) {
+            write_png(queue, slot->stem, queue->scale);
+        }
+
+        pthread_mutex_lock(&queue->lock);
+        queue->head++;
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return NULL;
+}
+
+bool screenshot_start(ScreenshotQueue* queue, int scale, bool overlay) {
+    memset(queue, 0, sizeof(*queue));
+    queue->scale = scale;
+    queue->overlay = overlay;
+    int width = RENDER_WIDTH * scale;
+    int height = RENDER_HEIGHT * scale;
+    queue->indices = malloc(RENDER_WIDTH * RENDER_HEIGHT);
+    queue->scanlines = malloc(PNG_SCANLINE_BYTES(width, height, bit_depth(queue)));
+    queue->file_capacity = PNG_BOUND(width, height, bit_depth(queue));
+    queue->file = malloc(queue->file_capacity);
+    if (queue->indices == NULL || queue->scanlines == NULL || queue->file == NULL) {
+        screenshot_stop(queue);
+        return false;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->queued, NULL);
+    if (pthread_create(&queue->thread, NULL, encoder_main, queue) != 0) {
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->queued);
+        screenshot_stop(queue);
+        return false;
+    }
+    queue->started = true;
+    return true;
+}
+
+bool screenshot_capture(ScreenshotQueue* queue, const uint8_t* vram, const char* stem) {
+    pthread_mutex_lock(&queue->lock);
+    if (queue->tail - queue->head == SCREENSHOT_QUEUE_SLOTS) {
+        queue->dropped++;
+        pthread_mutex_unlock(&queue->lock);
+        return false;
+    }
+    ScreenshotSlot* slot = &queue->slots[queue->tail % SCREENSHOT_QUEUE_SLOTS];
+    snprintf(slot->stem, sizeof(slot->stem), "%s", stem);
+    memcpy(slot->vram, vram, VRAM_BYTES);
+    queue->tail++;
+    pthread_cond_signal(&queue->queued);
+    pthread_mutex_unlock(&queue->lock);
+    return true;
+}
+
+void screenshot_stop(ScreenshotQueue* queue) {
+    if (queue->started) {
+        pthread_mutex_lock(&queue->lock);
+        queue->stopping = true;
+        pthread_cond_signal(&queue->queued);
+        pthread_mutex_unlock(&queue->lock);
+        pthread_join(queue->thread, NULL);
+        pthread_mutex_destroy(&queue->lock);
+        pthread_cond_destroy(&queue->queued);
+        queue->started = false;
+    }
+    free(queue->indices);
+    free(queue->scanlines);
+    free(queue->file);
+    queue->indices = queue->scanlines = queue->file = NULL;
+}
@@ -0,0 +1,59 @@
+// In src/io/screenshot.h
+
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "render.h"
+
+// Screenshots without stalling emulation: the emulation thread only copies
+// the 7 KB of vram into a queue slot; a background thread rotates it,
+// encodes it as a PNG (1-bit grayscale, or 2-bit with the cabinet's
+// overlay colours) and writes the file, plus an optional upscaled copy.
+// A capture that finds the queue full is dropped and counted.
+
+#define SCREENSHOT_QUEUE_SLOTS 16
+#define SCREENSHOT_PATH_MAX    256
+#define SCREENSHOT_MAX_SCALE   8
+
+typedef struct ScreenshotSlot {
+    char    stem[SCREENSHOT_PATH_MAX];     // path without ".png"
+    uint8_t vram[VRAM_BYTES];
+} ScreenshotSlot;
+
+typedef struct ScreenshotQueue {
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  queued;                // a slot was filled, or stopping
+    bool            started;
+    bool            stopping;
+    int             scale;                 // also write an upscaled copy when > 1
+    bool            overlay;               // colour by the overlay instead of black and white
+    uint64_t        head;                  // next slot to encode
+    uint64_t        tail;                  // next slot to fill
+    ScreenshotSlot  slots[SCREENSHOT_QUEUE_SLOTS];
+    uint8_t*        indices;               // encoder buffers: the screen as overlay palette indices,
+    uint8_t*        scanlines;             // the PNG's rows,
+    uint8_t*        file;                  // and the file, sized for the largest image
+    size_t          file_capacity;
+    uint64_t        written;               // files, upscaled copies included
+    uint64_t        failed;
+    uint64_t        dropped;
+} ScreenshotQueue;
+
+// Starts the encoder thread. scale is 1 (no upscaled copy) to
+// SCREENSHOT_MAX_SCALE. Returns false if the thread or its buffers cannot
+// be created.
+bool screenshot_start(ScreenshotQueue* queue, int scale, bool overlay);
+
+// Queues vram (7168 bytes starting at VRAM_BASE) to be written to
+// stem.png (and stem-xN.png). Returns false if the queue is full.
+bool screenshot_capture(ScreenshotQueue* queue, const uint8_t* vram, const char* stem);
+
+// Writes what is still queued and stops the thread.
+void screenshot_stop(ScreenshotQueue* queue);
+
+#endif // SCREENSHOT_H
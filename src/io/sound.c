@@ -2,11 +2,15 @@
 
 #include <SDL_mixer.h>
 #include <stdio.h>
+#include "log.h"
 #include "sound.h"
 
 // An array to hold sound chunks.
 static Mix_Chunk* sounds[SOUND_MAX] = {NULL};
 
+// Set once the mixer is open; headless runs never open it and stay silent.
+static bool audio_open = false;
+
 // A corresponding array of sound file paths.
 static const char* sound_files[SOUND_MAX] = {
     "sounds/ufo_highpitch.wav",
@@ -26,6 +30,7 @@ bool sound_init(void) {
         fprintf(stderr, "SDL_mixer could not initialize! Mix_Error: %s\n", Mix_GetError());
         return false;
     }
+    audio_open = true;
 
     // Load each sound file.
     for (int i = 0; i < SOUND_MAX; i++) {
@@ -41,7 +46,7 @@ bool sound_init(void) {
 
 void sound_play(SoundID id) {
     // check if the ID is valid.
-    if (id >= SOUND_MAX) {
+    if (id >= SOUND_MAX || !audio_open) {
         return;
     }
 
@@ -49,8 +54,8 @@ void sound_play(SoundID id) {
     if (sounds[id] != NULL) {
         Mix_PlayChannel(-1, sounds[id], 0);
     } else {
-        // Sound is not loaded (it failed in sound_init), print a debug message instead.
-        printf("DEBUG: Sound not loaded for ID %d (%s)\n", id, sound_files[id]);
+        // Sound is not loaded (it failed in sound_init), log a debug message instead.
+        LOG(LOG_DEBUG, "Sound not loaded for ID %d (%s)", id, sound_files[id]);
     }
 }
 
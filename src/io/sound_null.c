@@ -0,0 +1,17 @@
+// In src/io/sound_null.c
+
+// Silent implementation of the sound interface for headless tools
+// (test runners, benchmarks) that link the CPU core without SDL_mixer.
+
+#include "sound.h"
+
+bool sound_init(void) {
+    return true;
+}
+
+void sound_play(SoundID id) {
+    (void)id;
+}
+
+void sound_cleanup(void) {
+}
@@ -0,0 +1,141 @@
+// In src/machine/bootcache.c
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bootcache.h"
+#include "crc32.h"
+#include "machine.h"
+#include "pages.h"
+
+#define BOOTCACHE_MAGIC   0x43423849      // "I8BC"
+#define BOOTCACHE_VERSION 2               // 2: interrupts on machine_interrupt_cycle
+
+// On-disk layout: fixed fields, then all 64KB of guest memory. The CRC
+// covers everything except itself.
+typedef struct BootCacheFile {
+    uint32_t     magic;
+    uint32_t     version;
+    BootCacheKey key;
+    uint32_t     crc;
+    uint8_t      a, b, c, d, e, h, l, flags;
+    uint16_t     sp, pc;
+    uint8_t      int_enable, port1, port2, shift_offset;
+    uint16_t     shift_register;
+    uint16_t     reserved[3];
+    BootCounters counters;
+    uint8_t      memory[MEMORY_SIZE];
+} BootCacheFile;
+
+_Static_assert(offsetof(BootCacheFile, counters) == 48, "BootCacheFile has no padding");
+
+static uint32_t file_crc(const BootCacheFile* file) {
+    size_t head = offsetof(BootCacheFile, crc);
+    uint32_t crc = crc32(file, head);
+    return crc32_update(crc, (const uint8_t*)file + head + sizeof(file->crc),
+                        sizeof(*file) - head - sizeof(file->crc));
+}
+
+BootCacheKey bootcache_key(const uint8_t* rom, uint32_t rom_size, uint32_t boot_frames,
+                           const MachineState* io) {
+    const uint32_t profile[] = {
+        BOOTCACHE_VERSION, boot_frames, io->port1, io->port2,
+        CPU_CLOCK_HZ, CYCLES_PER_HALF_FRAME,
+    };
+    return (BootCacheKey){
+        .rom_crc = crc32(rom, rom_size),
+        .rom_size = rom_size,
+        .profile = crc32(profile, sizeof(profile)),
+    };
+}
+
+bool bootcache_load(const char* path, const BootCacheKey* key, State8080* cpu,
+                    MachineState* io, BootCounters* counters) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size != sizeof(BootCacheFile)) {
+        close(fd);
+        return false;
+    }
+    const BootCacheFile* file = mmap(NULL, sizeof(BootCacheFile), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED) {
+        return false;
+    }
+
+    bool ok = file->magic == BOOTCACHE_MAGIC && file->version == BOOTCACHE_VERSION &&
+              memcmp(&file->key, key, sizeof(*key)) == 0 && file->crc == file_crc(file);
+    if (ok) {
+        cpu->a = file->a; cpu->b = file->b; cpu->c = file->c; cpu->d = file->d;
+        cpu->e = file->e; cpu->h = file->h; cpu->l = file->l;
+        cpu_set_flags_byte(&cpu->cc, file->flags);
+        cpu->sp = file->sp;
+        cpu->pc = file->pc;
+        cpu->int_enable = file->int_enable;
+        cpu->fault = 0;
+        io->port1 = file->port1;
+        io->port2 = file->port2;
+        io->shift_register = file->shift_register;
+        io->shift_offset = file->shift_offset;
+        *counters = file->counters;
+        pages_write(cpu, 0, file->memory, MEMORY_SIZE);
+    }
+    munmap((void*)file, sizeof(BootCacheFile));
+    return ok;
+}
+
+bool bootcache_save(const char* path, const BootCacheKey* key, const State8080* cpu,
+                    const MachineState* io, const BootCounters* counters) {
+    BootCacheFile* file = calloc(1, sizeof(BootCacheFile));
+    if (file == NULL) {
+        return false;
+    }
+    file->magic = BOOTCACHE_MAGIC;
+    file->version = BOOTCACHE_VERSION;
+    file->key = *key;
+    file->a = cpu->a; file->b = cpu->b; file->c = cpu->c; file->d = cpu->d;
+    file->e = cpu->e; file->h = cpu->h; file->l = cpu->l;
+    file->flags = cpu_flags_byte(&cpu->cc);
+    file->sp = cpu->sp;
+    file->pc = cpu->pc;
+    file->int_enable = cpu->int_enable;
+    file->port1 = io->port1;
+    file->port2 = io->port2;
+    file->shift_register = io->shift_register;
+    file->shift_offset = io->shift_offset;
+    file->counters = *counters;
+    pages_read(cpu, 0, file->memory, MEMORY_SIZE);
+    file->crc = file_crc(file);
+
+    // Write a temporary file and rename it over the old cache, so a reader
+    // never sees a half-written one.
+    char tmp[4096];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) {
+        free(file);
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    FILE* fp = fopen(tmp, "wb");
+    bool ok = fp != NULL && fwrite(file, sizeof(*file), 1, fp) == 1;
+    if (fp != NULL && fclose(fp) != 0) {
+        ok = false;
+    }
+    ok = ok && rename(tmp, path) == 0;
+    if (!ok) {
+        int saved = errno;
+        unlink(tmp);
+        errno = saved;
+    }
+    free(file);
+    return ok;
+}
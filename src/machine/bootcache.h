@@ -0,0 +1,54 @@
+// In src/machine/bootcache.h
+
+#ifndef BOOTCACHE_H
+#define BOOTCACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "cpu8080.h"
+#include "machine_io.h"
+
+// Boot-state cache: the complete machine state a fixed number of frames
+// after power-on, saved to disk so later runs can start from there instead
+// of emulating the boot again.
+//
+// A cache file only matches the ROM and settings that produced it. Its key
+// is the ROM's CRC-32 and size plus a profile hash of everything else that
+// shapes the boot (snapshot frame, initial port values, frame timing, file
+// version). A cache with a different key, or one that is truncated or
+// corrupt, is ignored and the caller boots normally.
+
+#define BOOTCACHE_DEFAULT_FRAMES 120   // boot and self-test are over; attract mode is up
+
+typedef struct BootCacheKey {
+    uint32_t rom_crc;
+    uint32_t rom_size;
+    uint32_t profile;
+} BootCacheKey;
+
+// Run counters saved with the state.
+typedef struct BootCounters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frame;
+    uint64_t next_interrupt_cycle;     // when the next RST 1 is due
+} BootCounters;
+
+// Builds the key for a ROM image booted for boot_frames frames from the
+// given power-on port values.
+BootCacheKey bootcache_key(const uint8_t* rom, uint32_t rom_size, uint32_t boot_frames,
+                           const MachineState* io);
+
+// Loads a cache file (through mmap) into cpu, io and counters. Returns false,
+// leaving them untouched, if the file is missing, damaged or keyed
+// differently.
+bool bootcache_load(const char* path, const BootCacheKey* key, State8080* cpu,
+                    MachineState* io, BootCounters* counters);
+
+// Writes the state to path, atomically replacing any older cache. Returns
+// false (with errno set) on I/O errors.
+bool bootcache_save(const char* path, const BootCacheKey* key, const State8080* cpu,
+                    const MachineState* io, const BootCounters* counters);
+
+#endif // BOOTCACHE_H
@@ -0,0 +1,747 @@
+// In src/machine/hook.c
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdarg.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hook.h"
+#include "movie.h"
+#include "pages.h"
+
+// Constants live in registers loaded by hook_reset, so no instruction
+// materializes them, and a comparison feeding an "if" becomes one
+// compare-and-branch. Each builtin variable has its own opcode.
+enum {
+    H_RET, H_JMP, H_JZ,
+    H_JLT, H_JLE, H_JGT, H_JGE, H_JEQ, H_JNE,     // jump if x OP y
+    H_MOV,
+    H_FRAME, H_CYCLES, H_PC, H_SP, H_A, H_B, H_C, H_D, H_E, H_H, H_L, H_PORT1, H_PORT2,
+    H_PEEK8, H_PEEK16, H_BCD16, H_POKE,
+    H_PRESS, H_RELEASE, H_LOG, H_STOP, H_SCREENSHOT,
+    H_NEG, H_NOT, H_BNOT,
+    H_MUL, H_DIV, H_MOD, H_ADD, H_SUB, H_SHL, H_SHR,
+    H_LT, H_LE, H_GT, H_GE, H_EQ, H_NE,
+    H_AND, H_XOR, H_OR, H_LAND, H_LOR,
+};
+
+static const struct { const char* name; uint8_t op; } builtins[] = {
+    { "frame", H_FRAME }, { "cycles", H_CYCLES }, { "pc", H_PC }, { "sp", H_SP },
+    { "a", H_A }, { "b", H_B }, { "c", H_C }, { "d", H_D },
+    { "e", H_E }, { "h", H_H }, { "l", H_L },
+    { "port1", H_PORT1 }, { "port2", H_PORT2 },
+};
+#define BUILTIN_COUNT (int)(sizeof(builtins) / sizeof(builtins[0]))
+
+// Same operators and precedence as RAM expressions.
+static const struct { const char* text; int precedence; uint8_t op; } binary_ops[] = {
+    { "||", 1, H_LOR }, { "&&", 2, H_LAND },
+    { "==", 6, H_EQ },  { "!=", 6, H_NE },
+    { "<=", 7, H_LE },  { ">=", 7, H_GE },  { "<<", 8, H_SHL }, { ">>", 8, H_SHR },
+    { "|", 3, H_OR },   { "^", 4, H_XOR },  { "&", 5, H_AND },
+    { "<", 7, H_LT },   { ">", 7, H_GT },
+    { "+", 9, H_ADD },  { "-", 9, H_SUB },
+    { "*", 10, H_MUL }, { "/", 10, H_DIV }, { "%", 10, H_MOD },
+};
+#define BINARY_OP_COUNT (int)(sizeof(binary_ops) / sizeof(binary_ops[0]))
+
+static const char* const keywords[] = {
+    "var", "on", "if", "then", "else", "end", "press", "release", "log", "stop", "screenshot", "w", "bcd",
+};
+
+#define MAX_BLOCKS 16
+
+typedef struct Compiler {
+    HookProgram* prog;
+    const char*  p;               // position in the current line
+    int          line;
+    int          temp;            // next free temporary register
+    int          block_jump[MAX_BLOCKS];   // pending jump of each open if/else
+    bool         block_else[MAX_BLOCKS];
+    int          blocks;
+    bool         in_hook;
+    char*        error;
+    size_t       error_size;
+    bool         failed;
+} Compiler;
+
+static void fail(Compiler* c, const char* format, ...) {
+    if (c->failed) {
+        return;
+    }
+    char message[96];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    snprintf(c->error, c->error_size, "line %d: %s", c->line, message);
+    c->failed = true;
+}
+
+static int emit(Compiler* c, uint8_t op, int a, int b, int cc, int32_t imm) {
+    HookProgram* prog = c->prog;
+    if (prog->code_count == HOOK_MAX_CODE) {
+        fail(c, "script too long");
+        return 0;
+    }
+    prog->code[prog->code_count] = (HookIns){ .op = op, .a = a, .b = b, .c = cc, .imm = imm };
+    return prog->code_count++;
+}
+
+static int alloc_temp(Compiler* c) {
+    if (c->temp >= c->prog->const_base) {
+        fail(c, "expression too complex");
+        return c->prog->const_base - 1;
+    }
+    return c->temp++;
+}
+
+static void skip_space(Compiler* c) {
+    while (*c->p == ' ' || *c->p == '\t' || *c->p == '\r') {
+        c->p++;
+    }
+}
+
+static bool accept(Compiler* c, char ch) {
+    skip_space(c);
+    if (*c->p == ch) {
+        c->p++;
+        return true;
+    }
+    return false;
+}
+
+static bool at_end(Compiler* c) {
+    skip_space(c);
+    return *c->p == '\0' || *c->p == '\n' || *c->p == '#';
+}
+
+// Reads an identifier; returns its length (0 if there is none).
+static size_t read_word(Compiler* c, const char** word) {
+    skip_space(c);
+    *word = c->p;
+    if (!isalpha((unsigned char)*c->p) && *c->p != '_') {
+        return 0;
+    }
+    while (isalnum((unsigned char)*c->p) || *c->p == '_') {
+        c->p++;
+    }
+    return c->p - *word;
+}
+
+static bool word_is(const char* word, size_t len, const char* text) {
+    return strlen(text) == len && strncmp(word, text, len) == 0;
+}
+
+static bool read_number(Compiler* c, int64_t* value) {
+    skip_space(c);
+    const char* start = c->p;
+    bool negative = *c->p == '-';
+    if (negative) {
+        c->p++;
+    }
+    if (!isdigit((unsigned char)*c->p)) {
+        c->p = start;
+        return false;
+    }
+    char* end;
+    bool hex = c->p[0] == '0' && (c->p[1] == 'x' || c->p[1] == 'X');
+    uint64_t magnitude = strtoull(c->p, &end, hex ? 16 : 10);
+    c->p = end;
+    *value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+static int find_var(const HookProgram* prog, const char* word, size_t len) {
+    for (int i = 0; i < prog->var_count; i++) {
+        if (word_is(word, len, prog->var_names[i])) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// ---------------------------------------------------------------------------
+// Expressions. Each returns the register holding its value: a variable's own
+// register, or the lowest free temporary (so temporaries behave as a stack).
+// ---------------------------------------------------------------------------
+
+static int parse_binary(Compiler* c, int min_precedence);
+
+// Returns the register holding value, allocating one from the top.
+static int constant_register(Compiler* c, int64_t value) {
+    HookProgram* prog = c->prog;
+    for (int i = prog->const_base; i < HOOK_REGISTERS; i++) {
+        if (prog->reg_init[i] == value) {
+            return i;
+        }
+    }
+    if (prog->const_base <= c->temp) {
+        fail(c, "too many constants");
+        return HOOK_REGISTERS - 1;
+    }
+    prog->reg_init[--prog->const_base] = value;
+    return prog->const_base;
+}
+
+// Parses "EXPR]" and emits op on it.
+static int parse_bracket(Compiler* c, uint8_t op) {
+    int base = c->temp;
+    int addr = parse_binary(c, 1);
+    if (!accept(c, ']')) {
+        fail(c, "expected ']'");
+    }
+    c->temp = base;
+    int dst = alloc_temp(c);
+    emit(c, op, dst, addr, 0, 0);
+    return dst;
+}
+
+static int parse_unary(Compiler* c) {
+    skip_space(c);
+    char ch = *c->p;
+    int base = c->temp;
+
+    if (ch == '-' || ch == '!' || ch == '~') {
+        c->p++;
+        int src = parse_unary(c);
+        c->temp = base;
+        int dst = alloc_temp(c);
+        emit(c, ch == '-' ? H_NEG : ch == '!' ? H_NOT : H_BNOT, dst, src, 0, 0);
+        return dst;
+    }
+    if (ch == '(') {
+        c->p++;
+        int r = parse_binary(c, 1);
+        if (!accept(c, ')')) {
+            fail(c, "expected ')'");
+        }
+        return r;
+    }
+    if (ch == '[') {
+        c->p++;
+        return parse_bracket(c, H_PEEK8);
+    }
+    if (isdigit((unsigned char)ch)) {
+        int64_t value;
+        read_number(c, &value);
+        return constant_register(c, value);
+    }
+
+    const char* word;
+    size_t len = read_word(c, &word);
+    if (len == 0) {
+        fail(c, ch && ch != '\n' && ch != '#' ? "unexpected character '%c'" : "expression expected", ch);
+        return base;
+    }
+    if (word_is(word, len, "w") && accept(c, '[')) {
+        return parse_bracket(c, H_PEEK16);
+    }
+    if (word_is(word, len, "bcd") && accept(c, '[')) {
+        return parse_bracket(c, H_BCD16);
+    }
+    int var = find_var(c->prog, word, len);
+    if (var >= 0) {
+        return var;
+    }
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        if (word_is(word, len, builtins[i].name)) {
+            int dst = alloc_temp(c);
+            emit(c, builtins[i].op, dst, 0, 0, 0);
+            return dst;
+        }
+    }
+    fail(c, "unknown name '%.*s'", (int)len, word);
+    return base;
+}
+
+// Precedence climbing, all operators left-associative.
+static int parse_binary(Compiler* c, int min_precedence) {
+    int base = c->temp;
+    int left = parse_unary(c);
+    while (!c->failed) {
+        skip_space(c);
+        int match = -1;
+        for (int i = 0; i < BINARY_OP_COUNT; i++) {
+            if (strncmp(c->p, binary_ops[i].text, strlen(binary_ops[i].text)) == 0) {
+                match = i;
+                break;
+            }
+        }
+        if (match < 0 || binary_ops[match].precedence < min_precedence) {
+            break;
+        }
+        c->p += strlen(binary_ops[match].text);
+        int right = parse_binary(c, binary_ops[match].precedence + 1);
+        c->temp = base;
+        int dst = alloc_temp(c);
+        emit(c, binary_ops[match].op, dst, left, right, 0);
+        left = dst;
+    }
+    return left;
+}
+
+// Parses an expression whose value is needed only until the next statement.
+static int parse_expression(Compiler* c) {
+    c->temp = c->prog->var_count;
+    return parse_binary(c, 1);
+}
+
+// ---------------------------------------------------------------------------
+// Statements
+// ---------------------------------------------------------------------------
+
+static void parse_statement(Compiler* c);
+
+static void parse_assignment(Compiler* c, int var) {
+    if (!accept(c, '=')) {
+        fail(c, "expected '='");
+        return;
+    }
+    int r = parse_expression(c);
+    HookProgram* prog = c->prog;
+    if (r >= prog->var_count && prog->code_count > 0 && prog->code[prog->code_count - 1].a == r) {
+        // the expression's last instruction can write the variable directly
+        prog->code[prog->code_count - 1].a = var;
+    } else {
+        emit(c, H_MOV, var, r, 0, 0);
+    }
+}
+
+static void parse_poke(Compiler* c) {
+    c->temp = c->prog->var_count;
+    int addr = parse_binary(c, 1);
+    if (!accept(c, ']')) {
+        fail(c, "expected ']'");
+    }
+    if (!accept(c, '=')) {
+        fail(c, "expected '='");
+    }
+    int value = parse_binary(c, 1);
+    emit(c, H_POKE, addr, value, 0, 0);
+}
+
+static void parse_inputs(Compiler* c, uint8_t op) {
+    skip_space(c);
+    size_t len = strspn(c->p, "abcdefghijklmnopqrstuvwxyz0123456789+");
+    MovieFrame inputs;
+    if (!movie_parse_inputs(c->p, len, &inputs)) {
+        fail(c, "unknown inputs '%.*s'", (int)len, c->p);
+        return;
+    }
+    c->p += len;
+    emit(c, op, 0, 0, 0, inputs.port1 | inputs.port2 << 8);
+}
+
+// Stores a quoted label in the string table; returns its offset, or -1.
+static int parse_label(Compiler* c) {
+    HookProgram* prog = c->prog;
+    if (!accept(c, '"')) {
+        fail(c, "expected a quoted label");
+        return -1;
+    }
+    const char* end = strchr(c->p, '"');
+    const char* newline = strchr(c->p, '\n');
+    if (end == NULL || (newline != NULL && newline < end)) {
+        fail(c, "unterminated label");
+        return -1;
+    }
+    size_t len = end - c->p;
+    if (prog->string_bytes + len + 1 > HOOK_STRING_BYTES) {
+        fail(c, "too many labels");
+        return -1;
+    }
+    int offset = prog->string_bytes;
+    memcpy(prog->strings + offset, c->p, len);
+    prog->strings[offset + len] = '\0';
+    prog->string_bytes += len + 1;
+    c->p = end + 1;
+    return offset;
+}
+
+static void parse_log(Compiler* c) {
+    int offset = parse_label(c);
+    if (offset < 0) {
+        return;
+    }
+    int r = parse_expression(c);
+    emit(c, H_LOG, r, 0, 0, offset);
+}
+
+// Emits the jump taken when cond is false. A comparison that was just
+// computed into cond is turned into the opposite compare-and-branch.
+static int emit_branch_if_false(Compiler* c, int cond) {
+    static const struct { uint8_t compare; uint8_t jump; } inverse[] = {
+        { H_LT, H_JGE }, { H_LE, H_JGT }, { H_GT, H_JLE },
+        { H_GE, H_JLT }, { H_EQ, H_JNE }, { H_NE, H_JEQ },
+    };
+    HookProgram* prog = c->prog;
+    if (cond >= prog->var_count && prog->code_count > 0) {
+        HookIns* last = &prog->code[prog->code_count - 1];
+        for (size_t i = 0; i < sizeof(inverse) / sizeof(inverse[0]); i++) {
+            if (last->op == inverse[i].compare && last->a == cond) {
+                last->op = inverse[i].jump;
+                last->a = 0;
+                return prog->code_count - 1;
+            }
+        }
+    }
+    return emit(c, H_JZ, 0, cond, 0, 0);
+}
+
+static void parse_if(Compiler* c) {
+    int cond = parse_expression(c);
+    int jump = emit_branch_if_false(c, cond);
+    const char* word;
+    const char* save = c->p;
+    size_t len = read_word(c, &word);
+    if (word_is(word, len, "then")) {
+        // a one-line if takes a simple statement, not another block
+        const char* next;
+        const char* rest = c->p;
+        size_t next_len = read_word(c, &next);
+        c->p = rest;
+        if (word_is(next, next_len, "if") || word_is(next, next_len, "else") || word_is(next, next_len, "end")) {
+            fail(c, "'%.*s' after 'then'", (int)next_len, next);
+            return;
+        }
+        parse_statement(c);
+        c->prog->code[jump].imm = c->prog->code_count;
+        return;
+    }
+    c->p = save;
+    if (!at_end(c)) {
+        fail(c, "expected 'then' or end of line");
+        return;
+    }
+    if (c->blocks == MAX_BLOCKS) {
+        fail(c, "ifs nested too deeply");
+        return;
+    }
+    c->block_jump[c->blocks] = jump;
+    c->block_else[c->blocks] = false;
+    c->blocks++;
+}
+
+static void parse_statement(Compiler* c) {
+    HookProgram* prog = c->prog;
+    if (!c->in_hook) {
+        fail(c, "statement outside a hook (add 'on vblank' or 'on pc ADDRESS')");
+        return;
+    }
+    if (accept(c, '[')) {
+        parse_poke(c);
+        return;
+    }
+    const char* word;
+    size_t len = read_word(c, &word);
+    if (len == 0) {
+        fail(c, "statement expected");
+    } else if (word_is(word, len, "if")) {
+        parse_if(c);
+    } else if (word_is(word, len, "else")) {
+        if (c->blocks == 0 || c->block_else[c->blocks - 1]) {
+            fail(c, "'else' without 'if'");
+            return;
+        }
+        int jump = emit(c, H_JMP, 0, 0, 0, 0);
+        prog->code[c->block_jump[c->blocks - 1]].imm = prog->code_count;
+        c->block_jump[c->blocks - 1] = jump;
+        c->block_else[c->blocks - 1] = true;
+    } else if (word_is(word, len, "end")) {
+        if (c->blocks == 0) {
+            fail(c, "'end' without 'if'");
+            return;
+        }
+        prog->code[c->block_jump[--c->blocks]].imm = prog->code_count;
+    } else if (word_is(word, len, "press")) {
+        parse_inputs(c, H_PRESS);
+    } else if (word_is(word, len, "release")) {
+        parse_inputs(c, H_RELEASE);
+    } else if (word_is(word, len, "log")) {
+        parse_log(c);
+    } else if (word_is(word, len, "stop")) {
+        emit(c, H_STOP, 0, 0, 0, 0);
+    } else if (word_is(word, len, "screenshot")) {
+        int offset = parse_label(c);
+        if (offset >= 0) {
+            emit(c, H_SCREENSHOT, 0, 0, 0, offset);
+        }
+    } else {
+        int var = find_var(prog, word, len);
+        if (var < 0) {
+            fail(c, "unknown statement or variable '%.*s'", (int)len, word);
+            return;
+        }
+        parse_assignment(c, var);
+    }
+}
+
+static bool is_reserved(const char* word, size_t len) {
+    for (size_t i = 0; i < sizeof(keywords) / sizeof(keywords[0]); i++) {
+        if (word_is(word, len, keywords[i])) {
+            return true;
+        }
+    }
+    for (int i = 0; i < BUILTIN_COUNT; i++) {
+        if (word_is(word, len, builtins[i].name)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void parse_var(Compiler* c) {
+    HookProgram* prog = c->prog;
+    if (c->in_hook) {
+        fail(c, "'var' must come before the first hook");
+        return;
+    }
+    do {
+        const char* word;
+        size_t len = read_word(c, &word);
+        if (len == 0 || len >= HOOK_NAME_LENGTH) {
+            fail(c, "variable name expected");
+            return;
+        }
+        if (is_reserved(word, len) || find_var(prog, word, len) >= 0) {
+            fail(c, "'%.*s' is already defined", (int)len, word);
+            return;
+        }
+        if (prog->var_count == HOOK_MAX_VARS) {
+            fail(c, "too many variables");
+            return;
+        }
+        int64_t init = 0;
+        if (accept(c, '=') && !read_number(c, &init)) {
+            fail(c, "number expected");
+            return;
+        }
+        memcpy(prog->var_names[prog->var_count], word, len);
+        prog->var_names[prog->var_count][len] = '\0';
+        prog->reg_init[prog->var_count++] = init;
+    } while (accept(c, ','));
+}
+
+// Closes the current hook section.
+static void end_hook(Compiler* c) {
+    if (!c->in_hook) {
+        return;
+    }
+    if (c->blocks > 0) {
+        fail(c, "missing 'end'");
+    }
+    emit(c, H_RET, 0, 0, 0, 0);
+    c->in_hook = false;
+}
+
+static void parse_on(Compiler* c) {
+    HookProgram* prog = c->prog;
+    end_hook(c);
+    const char* word;
+    size_t len = read_word(c, &word);
+    if (word_is(word, len, "vblank")) {
+        if (prog->vblank_entry >= 0) {
+            fail(c, "second 'on vblank'");
+            return;
+        }
+        prog->vblank_entry = prog->code_count;
+    } else if (word_is(word, len, "pc")) {
+        int64_t address;
+        if (!read_number(c, &address) || address < 0 || address > 0xffff) {
+            fail(c, "address expected");
+            return;
+        }
+        if (hook_breakpoint(prog, (uint16_t)address)) {
+            fail(c, "second hook at 0x%04x", (unsigned)address);
+            return;
+        }
+        if (prog->pc_count == HOOK_MAX_PC_HOOKS) {
+            fail(c, "too many pc hooks");
+            return;
+        }
+        prog->pc_address[prog->pc_count] = (uint16_t)address;
+        prog->pc_entry[prog->pc_count++] = prog->code_count;
+        prog->pc_bitmap[address >> 3] |= (uint8_t)(1 << (address & 7));
+    } else {
+        fail(c, "expected 'on vblank' or 'on pc ADDRESS'");
+        return;
+    }
+    c->in_hook = true;
+}
+
+bool hook_compile(HookProgram* prog, const char* text, char* error, size_t error_size) {
+    memset(prog, 0, sizeof(*prog));
+    prog->vblank_entry = -1;
+    prog->const_base = HOOK_REGISTERS;
+    prog->log = stdout;
+
+    Compiler c = { .prog = prog, .p = text, .error = error, .error_size = error_size };
+    for (c.line = 1; !c.failed && *c.p != '\0'; c.line++) {
+        if (!at_end(&c)) {
+            const char* save = c.p;
+            const char* word;
+            size_t len = read_word(&c, &word);
+            if (word_is(word, len, "var")) {
+                parse_var(&c);
+            } else if (word_is(word, len, "on")) {
+                parse_on(&c);
+            } else {
+                c.p = save;
+                parse_statement(&c);
+            }
+            if (!c.failed && !at_end(&c)) {
+                int len = (int)strcspn(c.p, "\r\n");
+                fail(&c, "unexpected text '%.*s'", len < 20 ? len : 20, c.p);
+            }
+        }
+        const char* newline = strchr(c.p, '\n');
+        c.p = newline != NULL ? newline + 1 : c.p + strlen(c.p);
+    }
+    end_hook(&c);
+    if (!c.failed && prog->vblank_entry < 0 && prog->pc_count == 0) {
+        fail(&c, "no hooks defined");
+    }
+    hook_reset(prog);
+    return !c.failed;
+}
+
+bool hook_load(HookProgram* prog, const char* path, char* error, size_t error_size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return false;
+    }
+    fseek(fp, 0L, SEEK_END);
+    long size = ftell(fp);
+    fseek(fp, 0L, SEEK_SET);
+    char* text = size >= 0 ? malloc(size + 1) : NULL;
+    if (text == NULL) {
+        fclose(fp);
+        snprintf(error, error_size, "%s: cannot read", path);
+        return false;
+    }
+    size_t n = fread(text, 1, size, fp);
+    fclose(fp);
+    text[n] = '\0';
+    bool ok = hook_compile(prog, text, error, error_size);
+    free(text);
+    return ok;
+}
+
+void hook_reset(HookProgram* prog) {
+    memcpy(prog->regs, prog->reg_init, sizeof(prog->regs));
+    prog->stopped = false;
+    prog->screenshot = NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Interpreter
+// ---------------------------------------------------------------------------
+
+static int64_t bcd_byte(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0f);
+}
+
+static void run(HookProgram* prog, int entry, const HookEnv* env) {
+    int64_t* r = prog->regs;
+    const HookIns* code = prog->code;
+    const State8080* cpu = env->cpu;
+    prog->calls++;
+
+    for (int i = entry;; i++) {
+        const HookIns* ins = &code[i];
+        int64_t x = r[ins->b];
+        int64_t y = r[ins->c];
+        switch (ins->op) {
+            case H_RET:   return;
+            case H_JMP:   i = ins->imm - 1; break;
+            case H_JZ:    if (x == 0) i = ins->imm - 1; break;
+            case H_JLT:   if (x < y) i = ins->imm - 1; break;
+            case H_JLE:   if (x <= y) i = ins->imm - 1; break;
+            case H_JGT:   if (x > y) i = ins->imm - 1; break;
+            case H_JGE:   if (x >= y) i = ins->imm - 1; break;
+            case H_JEQ:   if (x == y) i = ins->imm - 1; break;
+            case H_JNE:   if (x != y) i = ins->imm - 1; break;
+            case H_MOV:   r[ins->a] = x; break;
+            case H_FRAME:  r[ins->a] = (int64_t)env->frame; break;
+            case H_CYCLES: r[ins->a] = (int64_t)env->cycles; break;
+            case H_PC:     r[ins->a] = cpu->pc; break;
+            case H_SP:     r[ins->a] = cpu->sp; break;
+            case H_A:      r[ins->a] = cpu->a; break;
+            case H_B:      r[ins->a] = cpu->b; break;
+            case H_C:      r[ins->a] = cpu->c; break;
+            case H_D:      r[ins->a] = cpu->d; break;
+            case H_E:      r[ins->a] = cpu->e; break;
+            case H_H:      r[ins->a] = cpu->h; break;
+            case H_L:      r[ins->a] = cpu->l; break;
+            case H_PORT1:  r[ins->a] = env->io->port1; break;
+            case H_PORT2:  r[ins->a] = env->io->port2; break;
+            case H_PEEK8:
+                r[ins->a] = cpu_peek(cpu, (uint16_t)x);
+                break;
+            case H_PEEK16:
+                r[ins->a] = cpu_peek(cpu, (uint16_t)x) | (cpu_peek(cpu, (uint16_t)(x + 1)) << 8);
+                break;
+            case H_BCD16:
+                r[ins->a] = bcd_byte(cpu_peek(cpu, (uint16_t)(x + 1))) * 100 + bcd_byte(cpu_peek(cpu, (uint16_t)x));
+                break;
+            case H_POKE: {
+                uint8_t value = (uint8_t)x;
+                pages_write(env->cpu, (uint16_t)r[ins->a], &value, 1);
+                break;
+            }
+            case H_PRESS:
+                env->io->port1 |= ins->imm & MOVIE_PORT1_INPUTS;
+                env->io->port2 |= (ins->imm >> 8) & MOVIE_PORT2_INPUTS;
+                break;
+            case H_RELEASE:
+                env->io->port1 &= ~(ins->imm & MOVIE_PORT1_INPUTS);
+                env->io->port2 &= ~((ins->imm >> 8) & MOVIE_PORT2_INPUTS);
+                break;
+            case H_LOG:
+                fprintf(prog->log, "frame %llu: %s %lld\n", (unsigned long long)env->frame,
+                        prog->strings + ins->imm, (long long)r[ins->a]);
+                break;
+            case H_STOP: prog->stopped = true; break;
+            case H_SCREENSHOT: prog->screenshot = prog->strings + ins->imm; break;
+            case H_NEG:  r[ins->a] = (int64_t)(0 - (uint64_t)x); break;
+            case H_NOT:  r[ins->a] = !x; break;
+            case H_BNOT: r[ins->a] = ~x; break;
+            case H_MUL:  r[ins->a] = (int64_t)((uint64_t)x * (uint64_t)y); break;
+            case H_DIV:  r[ins->a] = y == 0 ? 0 : y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y; break;
+            case H_MOD:  r[ins->a] = (y == 0 || y == -1) ? 0 : x % y; break;
+            case H_ADD:  r[ins->a] = (int64_t)((uint64_t)x + (uint64_t)y); break;
+            case H_SUB:  r[ins->a] = (int64_t)((uint64_t)x - (uint64_t)y); break;
+            case H_SHL:  r[ins->a] = (int64_t)((uint64_t)x << (y & 63)); break;
+            case H_SHR:  r[ins->a] = x >> (y & 63); break;
+            case H_LT:   r[ins->a] = x < y; break;
+            case H_LE:   r[ins->a] = x <= y; break;
+            case H_GT:   r[ins->a] = x > y; break;
+            case H_GE:   r[ins->a] = x >= y; break;
+            case H_EQ:   r[ins->a] = x == y; break;
+            case H_NE:   r[ins->a] = x != y; break;
+            case H_AND:  r[ins->a] = x & y; break;
+            case H_XOR:  r[ins->a] = x ^ y; break;
+            case H_OR:   r[ins->a] = x | y; break;
+            case H_LAND: r[ins->a] = x && y; break;
+            default:     r[ins->a] = x || y; break;
+        }
+    }
+}
+
+void hook_run_vblank(HookProgram* prog, const HookEnv* env) {
+    if (prog->vblank_entry >= 0) {
+        run(prog, prog->vblank_entry, env);
+    }
+}
+
+void hook_run_pc(HookProgram* prog, const HookEnv* env) {
+    for (int i = 0; i < prog->pc_count; i++) {
+        if (prog->pc_address[i] == env->cpu->pc) {
+            run(prog, prog->pc_entry[i], env);
+            return;
+        }
+    }
+}
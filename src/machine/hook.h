@@ -0,0 +1,118 @@
+// In src/machine/hook.h
+
+#ifndef HOOK_H
+#define HOOK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu8080.h"
+#include "machine_io.h"
+
+// Per-frame hooks: small scripts compiled to a register bytecode and run at
+// every vblank and before the instructions at chosen PC addresses. They read
+// and write guest RAM and the input ports directly, keep variables across
+// calls, log values and can ask the run to stop.
+//
+// A HookProgram is one fixed-size block: compiling fills it in and running
+// it never allocates. Jumps only go forward, so every hook call finishes.
+//
+// Script syntax, one statement per line, '#' starts a comment:
+//
+//   var NAME [= NUMBER], ...     variables, kept across calls (default 0)
+//   on vblank                    statements below run at each vblank
+//   on pc ADDRESS                ... or before the instruction at ADDRESS
+//
+//   NAME = EXPR                  assign a variable
+//   [EXPR] = EXPR                store a byte in guest memory
+//   press INPUTS                 hold inputs, e.g. "press left+fire"
+//   release INPUTS               let them go (names as in movie_parse_inputs)
+//   log "TEXT" EXPR              print "frame N: TEXT VALUE" to the log
+//   stop                         ask the run to stop
+//   screenshot "LABEL"           ask for a screenshot named after LABEL
+//   if EXPR then STATEMENT
+//   if EXPR ... [else ...] end
+//
+// Expressions are RAM expressions (see ramexpr.h) that may also use the
+// script's variables and port1/port2 (current input bits).
+//
+// Example:
+//
+//   var shots
+//   on vblank
+//     if frame % 8 == 0 then press fire
+//     if frame % 8 == 4 then release fire
+//     if bcd[0x20f8] >= 1000
+//       log "score" bcd[0x20f8]
+//       stop
+//     end
+//   on pc 0x05e3
+//     shots = shots + 1
+
+#define HOOK_MAX_CODE     1024
+#define HOOK_REGISTERS    128    // variables, then temporaries; constants from the top
+#define HOOK_MAX_VARS     32
+#define HOOK_MAX_PC_HOOKS 16
+#define HOOK_STRING_BYTES 1024
+#define HOOK_NAME_LENGTH  24
+
+typedef struct HookIns {
+    uint8_t op;
+    uint8_t a, b, c;    // register operands
+    int32_t imm;        // jump target, input bits or log label
+} HookIns;
+
+typedef struct HookProgram {
+    HookIns   code[HOOK_MAX_CODE];
+    int       code_count;
+    int64_t   regs[HOOK_REGISTERS];
+    int64_t   reg_init[HOOK_REGISTERS];     // variable initial values and constants
+    int       const_base;                   // lowest constant register
+    char      var_names[HOOK_MAX_VARS][HOOK_NAME_LENGTH];
+    int       var_count;
+    int       vblank_entry;                 // -1 when there is no vblank hook
+    uint16_t  pc_address[HOOK_MAX_PC_HOOKS];
+    int       pc_entry[HOOK_MAX_PC_HOOKS];
+    int       pc_count;
+    uint8_t   pc_bitmap[0x10000 / 8];       // addresses with a PC hook
+    char      strings[HOOK_STRING_BYTES];   // log and screenshot labels
+    int       string_bytes;
+    FILE*     log;                          // log output, stdout by default
+    bool      stopped;                      // set by "stop"
+    const char* screenshot;                 // label of a pending "screenshot", or NULL
+    uint64_t  calls;                        // hook invocations so far
+} HookProgram;
+
+// What a hook runs against: a CPU with its ports and counters.
+typedef struct HookEnv {
+    State8080*    cpu;
+    MachineState* io;
+    uint64_t      frame;
+    uint64_t      cycles;
+} HookEnv;
+
+// Compiles a script into prog (which may be large; allocate it on the heap).
+// On failure returns false and writes "line N: message" to error.
+bool hook_compile(HookProgram* prog, const char* text, char* error, size_t error_size);
+
+// Reads and compiles a script file. Returns false with a message in error.
+bool hook_load(HookProgram* prog, const char* path, char* error, size_t error_size);
+
+// Puts variables back to their initial values and clears the stop flag
+// and any pending screenshot.
+void hook_reset(HookProgram* prog);
+
+// Runs the vblank hook, if any.
+void hook_run_vblank(HookProgram* prog, const HookEnv* env);
+
+// True when a PC hook is set at pc; costs one bit test.
+static inline bool hook_breakpoint(const HookProgram* prog, uint16_t pc) {
+    return (prog->pc_bitmap[pc >> 3] >> (pc & 7)) & 1;
+}
+
+// Runs the PC hook for env->cpu->pc (call when hook_breakpoint is true).
+void hook_run_pc(HookProgram* prog, const HookEnv* env);
+
+#endif // HOOK_H
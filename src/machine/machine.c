@@ -0,0 +1,133 @@
+// In src/machine/machine.c
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "machine.h"
+#include "pages.h"
+
+Machine* machine_create(void) {
+    Machine* m = calloc(1, sizeof(Machine));
+    if (m == NULL) {
+        return NULL;
+    }
+
+    if (!pages_create(&m->cpu)) {
+        free(m);
+        return NULL;
+    }
+
+    // Port 1 bit 3 is always 1 on the cabinet.
+    m->io.port1 = 0x08;
+    m->io.port2 = 0x00;
+    return m;
+}
+
+Machine* machine_fork(Machine* parent) {
+    // Every field is set below, so skip calloc's clearing of the page maps.
+    Machine* child = malloc(sizeof(Machine));
+    if (child == NULL) {
+        return NULL;
+    }
+    // registers and flags: the State8080 fields ahead of the page maps,
+    // which pages_fork fills in
+    memcpy(&child->cpu, &parent->cpu, offsetof(State8080, pages));
+    child->io = parent->io;
+    child->cycles = parent->cycles;
+    child->instructions = parent->instructions;
+    child->frame = parent->frame;
+    child->trace = NULL;
+    child->hooks = NULL;
+    child->cpu.coverage = NULL;
+    child->cpu.irq_profile = NULL;
+    child->cpu.fault = parent->cpu.fault;    // after the page maps, not copied above
+    pages_fork(&parent->cpu, &child->cpu);
+    return child;
+}
+
+void machine_destroy(Machine* m) {
+    if (m == NULL) {
+        return;
+    }
+    pages_release(&m->cpu);
+    free(m);
+}
+
+void machine_reset(Machine* m) {
+    State8080* cpu = &m->cpu;
+    cpu->a = cpu->b = cpu->c = cpu->d = cpu->e = cpu->h = cpu->l = 0;
+    cpu->sp = 0;
+    cpu->pc = 0;
+    memset(&cpu->cc, 0, sizeof(cpu->cc));
+    cpu->int_enable = 0;
+    cpu->fault = 0;
+
+    memset(&m->io, 0, sizeof(m->io));
+    m->io.port1 = 0x08;
+    m->cycles = 0;
+    m->instructions = 0;
+    m->frame = 0;
+}
+
+void machine_read_memory(const Machine* m, uint16_t address, void* dst, size_t size) {
+    pages_read(&m->cpu, address, dst, size);
+}
+
+void machine_write_memory(Machine* m, uint16_t address, const void* src, size_t size) {
+    pages_write(&m->cpu, address, src, size);
+}
+
+bool machine_load_rom(Machine* m, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    uint8_t* image = malloc(MEMORY_SIZE);
+    if (image == NULL) {
+        fclose(fp);
+        return false;
+    }
+    size_t bytes_read = fread(image, 1, MEMORY_SIZE, fp);
+    fclose(fp);
+    bool ok = bytes_read > 0 && pages_map_rom(&m->cpu, image, bytes_read);
+    free(image);
+    return ok;
+}
+
+static HookEnv hook_env(Machine* m) {
+    return (HookEnv){ .cpu = &m->cpu, .io = &m->io, .frame = m->frame, .cycles = m->cycles };
+}
+
+// Runs until the cycle counter reaches target.
+static void run_until(Machine* m, uint64_t target) {
+    while (m->cycles < target) {
+        if (m->hooks != NULL && hook_breakpoint(m->hooks, m->cpu.pc)) {
+            HookEnv env = hook_env(m);
+            hook_run_pc(m->hooks, &env);
+        }
+        if (m->trace != NULL) {
+            trace_record(m->trace, &m->cpu, m->cycles, m->frame);
+        }
+        m->cycles += Emulate8080Op(&m->cpu, &m->io);
+        m->instructions++;
+    }
+}
+
+void machine_run_cycles(Machine* m, uint64_t cycles) {
+    run_until(m, m->cycles + cycles);
+}
+
+void machine_run_frame(Machine* m) {
+    run_until(m, machine_interrupt_cycle(m->frame, 0));
+    generateInterrupt(&m->cpu, 1);
+
+    run_until(m, machine_interrupt_cycle(m->frame, 1));
+    generateInterrupt(&m->cpu, 2);
+
+    m->frame++;
+    if (m->hooks != NULL) {
+        HookEnv env = hook_env(m);
+        hook_run_vblank(m->hooks, &env);
+    }
+}
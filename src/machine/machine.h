@@ -0,0 +1,77 @@
+// In src/machine/machine.h
+
+#ifndef MACHINE_H
+#define MACHINE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu8080.h"
+#include "hook.h"
+#include "machine_io.h"
+#include "trace.h"
+
+// Space Invaders runs the 8080 at 2 MHz and the display at 60 Hz.
+// The video hardware raises RST 1 at mid-screen and RST 2 at vblank.
+#define CPU_CLOCK_HZ          2000000
+#define FRAMES_PER_SECOND     60
+#define CYCLES_PER_FRAME      (CPU_CLOCK_HZ / FRAMES_PER_SECOND)
+#define CYCLES_PER_HALF_FRAME (CYCLES_PER_FRAME / 2)
+
+// Cycle count at which frame's RST 1 (half 0) or RST 2 (half 1) is raised.
+// The targets are absolute, so instruction overshoot does not drift; every
+// loop that raises the interrupts (machine_run_frame, the emulator shell,
+// replay_verify) uses this so their runs agree cycle for cycle.
+static inline uint64_t machine_interrupt_cycle(uint64_t frame, int half) {
+    return frame * CYCLES_PER_FRAME + (half == 0 ? CYCLES_PER_HALF_FRAME : CYCLES_PER_FRAME);
+}
+
+// One complete emulated cabinet: CPU, memory and I/O hardware.
+// Headless tools step it in whole frames without SDL.
+typedef struct Machine {
+    State8080    cpu;
+    MachineState io;
+    uint64_t     cycles;        // clock cycles executed since creation
+    uint64_t     instructions;  // instructions executed since creation
+    uint64_t     frame;         // completed frames (RST 2 interrupts)
+    TraceWriter* trace;         // optional instruction trace (NULL = off)
+    HookProgram* hooks;         // optional vblank/PC hooks (NULL = off)
+} Machine;
+
+// Allocates a machine with zeroed 64KB memory and power-on port values.
+// Memory is paged (cpu.memory is NULL); use machine_read_memory and
+// machine_write_memory for bulk access. Pages are only allocated when first
+// written. Returns NULL if allocation fails.
+Machine* machine_create(void);
+
+// Creates a child that continues from parent's exact state. Memory pages are
+// shared copy-on-write, so the fork itself copies no guest memory and the
+// child only pays for pages either side writes afterwards. The child has no
+// trace, coverage, interrupt profile or hooks attached. Returns NULL if allocation fails.
+Machine* machine_fork(Machine* parent);
+
+// Frees the machine and drops its references to shared pages.
+void machine_destroy(Machine* m);
+
+// Clears registers, ports and counters; memory is left as it is.
+void machine_reset(Machine* m);
+
+// Bulk copies between guest memory and a buffer (addresses wrap at 64KB).
+void machine_read_memory(const Machine* m, uint16_t address, void* dst, size_t size);
+void machine_write_memory(Machine* m, uint16_t address, const void* src, size_t size);
+
+// Loads a ROM image at address 0 as read-only pages: stores there are
+// dropped, and forks share the pages instead of copying them. Returns false
+// if the file cannot be read.
+bool machine_load_rom(Machine* m, const char* path);
+
+// Executes instructions until at least the given number of cycles has run.
+void machine_run_cycles(Machine* m, uint64_t cycles);
+
+// Runs one video frame: half a frame, RST 1, the other half, RST 2.
+// Hooks, if attached, run at their PC addresses and after RST 2; check
+// m->hooks->stopped to honour a script's "stop".
+void machine_run_frame(Machine* m);
+
+#endif // MACHINE_H
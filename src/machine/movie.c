@@ -0,0 +1,102 @@
+// In src/machine/movie.c
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "movie.h"
+
+typedef struct MovieHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t frames;
+} MovieHeader;
+
+void movie_free(Movie* movie) {
+    free(movie->frames);
+    movie->frames = NULL;
+    movie->count = 0;
+    movie->capacity = 0;
+}
+
+bool movie_append(Movie* movie, MovieFrame frame) {
+    if (movie->count == movie->capacity) {
+        uint32_t capacity = movie->capacity ? movie->capacity * 2 : 1024;
+        MovieFrame* frames = realloc(movie->frames, capacity * sizeof(MovieFrame));
+        if (frames == NULL) {
+            return false;
+        }
+        movie->frames = frames;
+        movie->capacity = capacity;
+    }
+    movie->frames[movie->count++] = frame;
+    return true;
+}
+
+bool movie_parse_inputs(const char* text, size_t len, MovieFrame* frame) {
+    static const struct { const char* name; uint8_t port1; uint8_t port2; } inputs[] = {
+        { "coin", 0x01, 0 }, { "start2", 0x02, 0 }, { "start1", 0x04, 0 },
+        { "fire", 0x10, 0 }, { "left", 0x20, 0 },   { "right", 0x40, 0 },
+        { "p2fire", 0, 0x10 }, { "p2left", 0, 0x20 }, { "p2right", 0, 0x40 },
+    };
+    *frame = (MovieFrame){ 0, 0 };
+    if (len == 4 && strncmp(text, "none", 4) == 0) {
+        return true;
+    }
+    const char* end = text + len;
+    while (text < end) {
+        const char* plus = memchr(text, '+', end - text);
+        size_t n = (plus != NULL ? plus : end) - text;
+        bool found = false;
+        for (size_t i = 0; i < sizeof(inputs) / sizeof(inputs[0]); i++) {
+            if (strlen(inputs[i].name) == n && strncmp(text, inputs[i].name, n) == 0) {
+                frame->port1 |= inputs[i].port1;
+                frame->port2 |= inputs[i].port2;
+                found = true;
+            }
+        }
+        if (!found || (plus != NULL && plus + 1 == end)) {
+            return false;
+        }
+        text += n + (plus != NULL);
+    }
+    return len > 0;
+}
+
+bool movie_save(const Movie* movie, const char* path) {
+    FILE* fp = fopen(path, "wb");
+    if (fp == NULL) {
+        return false;
+    }
+    MovieHeader header = { .version = MOVIE_VERSION, .frames = movie->count };
+    memcpy(header.magic, MOVIE_MAGIC, sizeof(header.magic));
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1 &&
+              fwrite(movie->frames, sizeof(MovieFrame), movie->count, fp) == movie->count;
+    return fclose(fp) == 0 && ok;
+}
+
+bool movie_load(Movie* movie, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+    movie_free(movie);
+
+    MovieHeader header;
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+              memcmp(header.magic, MOVIE_MAGIC, sizeof(header.magic)) == 0 &&
+              header.version == MOVIE_VERSION;
+    if (ok && header.frames > 0) {
+        movie->frames = malloc((size_t)header.frames * sizeof(MovieFrame));
+        ok = movie->frames != NULL &&
+             fread(movie->frames, sizeof(MovieFrame), header.frames, fp) == header.frames;
+        movie->count = movie->capacity = ok ? header.frames : 0;
+    }
+    fclose(fp);
+    if (!ok) {
+        movie_free(movie);
+        errno = EINVAL;
+    }
+    return ok;
+}
@@ -0,0 +1,61 @@
+// In src/machine/movie.h
+
+#ifndef MOVIE_H
+#define MOVIE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine_io.h"
+
+// Input movies: the cabinet inputs held during each frame, starting from
+// power-on. Playing one back with machine_run_frame reproduces the run
+// exactly, since the machine is deterministic.
+//
+// File format (little-endian): an 8-byte MOVIE_MAGIC, a uint32 version, a
+// uint32 frame count, then two bytes per frame (port 1 and port 2 input
+// bits).
+
+#define MOVIE_MAGIC   "8080MOVI"
+#define MOVIE_VERSION 1
+
+// Input bits a movie drives. Port 1 bit 3 is always 1 and port 2's low
+// bits are DIP switches, so those are left alone.
+#define MOVIE_PORT1_INPUTS 0x77   // coin, P2 start, P1 start, P1 fire/left/right
+#define MOVIE_PORT2_INPUTS 0x70   // P2 fire/left/right
+
+typedef struct MovieFrame {
+    uint8_t port1;
+    uint8_t port2;
+} MovieFrame;
+
+typedef struct Movie {
+    uint32_t    count;
+    uint32_t    capacity;
+    MovieFrame* frames;
+} Movie;
+
+// Frees the frames and empties the movie (a zeroed Movie is empty).
+void movie_free(Movie* movie);
+
+// Appends one frame. Returns false if allocation fails.
+bool movie_append(Movie* movie, MovieFrame frame);
+
+// Returns false (with errno set) if the file cannot be written or read, or
+// is not a movie.
+bool movie_save(const Movie* movie, const char* path);
+bool movie_load(Movie* movie, const char* path);
+
+// Parses the first len characters of text, input names joined with '+'
+// ("left+fire"), into input bits. Names: coin start1 start2 fire left right
+// p2fire p2left p2right, or "none" alone. Returns false on an unknown name.
+bool movie_parse_inputs(const char* text, size_t len, MovieFrame* frame);
+
+// Sets the input ports for the coming frame.
+static inline void movie_apply(MachineState* io, MovieFrame frame) {
+    io->port1 = (io->port1 & ~MOVIE_PORT1_INPUTS) | (frame.port1 & MOVIE_PORT1_INPUTS);
+    io->port2 = (io->port2 & ~MOVIE_PORT2_INPUTS) | (frame.port2 & MOVIE_PORT2_INPUTS);
+}
+
+#endif // MOVIE_H
@@ -0,0 +1,131 @@
+// In src/machine/nvram.c
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "nvram.h"
+#include "pages.h"
+
+#define NVRAM_MAGIC 0x314d564e      // "NVM1"
+
+typedef struct NvramSlot {
+    uint32_t magic;
+    uint32_t sequence;
+    uint16_t address;
+    uint16_t size;
+    uint32_t crc;                   // over sequence, range and data
+    uint8_t  data[];
+} NvramSlot;
+
+static uint32_t slot_crc(const NvramSlot* slot) {
+    uint32_t crc = crc32(&slot->sequence, sizeof(slot->sequence));
+    crc = crc32_update(crc, &slot->address, sizeof(slot->address));
+    crc = crc32_update(crc, &slot->size, sizeof(slot->size));
+    return crc32_update(crc, slot->data, slot->size);
+}
+
+static inline NvramSlot* slot_at(const Nvram* nv, int index) {
+    return (NvramSlot*)(nv->map + (size_t)index * nv->slot_bytes);
+}
+
+static bool slot_valid(const Nvram* nv, const NvramSlot* slot) {
+    return slot->magic == NVRAM_MAGIC && slot->address == nv->address &&
+           slot->size == nv->size && slot->crc == slot_crc(slot);
+}
+
+bool nvram_open(Nvram* nv, const char* path, uint16_t address, uint16_t size,
+                char* error, size_t error_size) {
+    memset(nv, 0, sizeof(*nv));
+    nv->fd = -1;
+    nv->current = -1;
+    nv->address = address;
+    nv->size = size;
+    nv->slot_bytes = (size_t)sysconf(_SC_PAGESIZE);
+
+    if (size == 0 || size > NVRAM_MAX_SIZE || (uint32_t)address + size > 0x10000) {
+        snprintf(error, error_size, "invalid range 0x%04x:%u", address, size);
+        return false;
+    }
+
+    nv->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (nv->fd < 0) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    size_t file_bytes = 2 * nv->slot_bytes;
+    if (fstat(nv->fd, &st) != 0 ||
+        ((size_t)st.st_size < file_bytes && ftruncate(nv->fd, (off_t)file_bytes) != 0)) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        close(nv->fd);
+        return false;
+    }
+    nv->map = mmap(NULL, file_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, nv->fd, 0);
+    if (nv->map == MAP_FAILED) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        nv->map = NULL;
+        close(nv->fd);
+        return false;
+    }
+
+    // The newest intact slot is current; a torn or foreign slot is ignored.
+    for (int i = 0; i < 2; i++) {
+        const NvramSlot* slot = slot_at(nv, i);
+        if (slot_valid(nv, slot) && (nv->current < 0 || (int32_t)(slot->sequence - nv->sequence) > 0)) {
+            nv->current = i;
+            nv->sequence = slot->sequence;
+        }
+    }
+    return true;
+}
+
+void nvram_restore(Nvram* nv, State8080* state) {
+    if (nv->current >= 0) {
+        pages_write(state, nv->address, slot_at(nv, nv->current)->data, nv->size);
+    }
+    nv->restored = true;
+}
+
+bool nvram_commit(Nvram* nv, const State8080* state) {
+    if (!nv->restored) {
+        return true;
+    }
+    uint8_t bytes[NVRAM_MAX_SIZE];
+    pages_read(state, nv->address, bytes, nv->size);
+    if (nv->current >= 0 && memcmp(bytes, slot_at(nv, nv->current)->data, nv->size) == 0) {
+        return true;
+    }
+
+    int next = nv->current == 0 ? 1 : 0;
+    NvramSlot* slot = slot_at(nv, next);
+    slot->magic = NVRAM_MAGIC;
+    slot->sequence = nv->sequence + 1;
+    slot->address = nv->address;
+    slot->size = nv->size;
+    memcpy(slot->data, bytes, nv->size);
+    slot->crc = slot_crc(slot);
+    if (msync(slot, nv->slot_bytes, MS_SYNC) != 0) {
+        return false;
+    }
+    nv->current = next;
+    nv->sequence = slot->sequence;
+    nv->commits++;
+    return true;
+}
+
+void nvram_close(Nvram* nv) {
+    if (nv->map != NULL) {
+        munmap(nv->map, 2 * nv->slot_bytes);
+        nv->map = NULL;
+    }
+    if (nv->fd >= 0) {
+        close(nv->fd);
+        nv->fd = -1;
+    }
+}
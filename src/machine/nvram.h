@@ -0,0 +1,54 @@
+// In src/machine/nvram.h
+
+#ifndef NVRAM_H
+#define NVRAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu8080.h"
+
+// Battery-backed RAM emulation: a range of guest RAM (the Space Invaders
+// high score by default) kept in a file across runs.
+//
+// The file is mmap'd MAP_SHARED and holds two slots, each on its own host
+// page: {magic, sequence number, range, CRC-32} followed by the bytes. A
+// commit writes the slot that is not current and msyncs that page, so the
+// last good copy is never touched; after a crash or power cut the newest
+// slot whose CRC checks out wins. Restoring is one copy out of the mapping,
+// and checking for changes is a compare of the range against it.
+
+#define NVRAM_DEFAULT_ADDRESS 0x20f4    // high score, BCD, low byte first
+#define NVRAM_DEFAULT_SIZE    2
+#define NVRAM_MAX_SIZE        256
+
+typedef struct Nvram {
+    int       fd;
+    uint8_t*  map;              // both slots
+    size_t    slot_bytes;       // one host page
+    uint16_t  address;
+    uint16_t  size;
+    int       current;          // slot holding the newest good copy, -1 if none
+    uint32_t  sequence;         // its sequence number
+    bool      restored;         // guest RAM has been loaded from the file
+    uint64_t  commits;
+} Nvram;
+
+// Opens (creating if needed) the file backing size bytes (at most
+// NVRAM_MAX_SIZE) at address.
+// Returns false with a message in error.
+bool nvram_open(Nvram* nv, const char* path, uint16_t address, uint16_t size,
+                char* error, size_t error_size);
+
+// Copies the saved bytes, if any, into guest memory. Call once the game has
+// initialized its RAM; nvram_commit does nothing before this.
+void nvram_restore(Nvram* nv, State8080* state);
+
+// Saves the range if it differs from the file. Returns false on I/O errors.
+bool nvram_commit(Nvram* nv, const State8080* state);
+
+// Unmaps and closes the file (commit first to keep the latest values).
+void nvram_close(Nvram* nv);
+
+#endif // NVRAM_H
@@ -0,0 +1,255 @@
+// In src/machine/ramexpr.c
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ramexpr.h"
+
+enum {
+    RX_PUSH, RX_PEEK8, RX_PEEK16, RX_BCD16, RX_VAR,
+    RX_NEG, RX_NOT, RX_BNOT,
+    RX_MUL, RX_DIV, RX_MOD, RX_ADD, RX_SUB, RX_SHL, RX_SHR,
+    RX_LT, RX_LE, RX_GT, RX_GE, RX_EQ, RX_NE,
+    RX_AND, RX_XOR, RX_OR, RX_LAND, RX_LOR,
+};
+
+// operands of RX_VAR
+enum { VAR_FRAME, VAR_CYCLES, VAR_PC, VAR_SP, VAR_A, VAR_B, VAR_C, VAR_D, VAR_E, VAR_H, VAR_L };
+
+static const struct { const char* name; int var; } variables[] = {
+    { "frame", VAR_FRAME }, { "cycles", VAR_CYCLES }, { "pc", VAR_PC }, { "sp", VAR_SP },
+    { "a", VAR_A }, { "b", VAR_B }, { "c", VAR_C }, { "d", VAR_D },
+    { "e", VAR_E }, { "h", VAR_H }, { "l", VAR_L },
+};
+
+// Binary operators, longest spelling first so "<=" is not read as "<".
+static const struct { const char* text; int precedence; uint8_t op; } binary_ops[] = {
+    { "||", 1, RX_LOR }, { "&&", 2, RX_LAND },
+    { "==", 6, RX_EQ },  { "!=", 6, RX_NE },
+    { "<=", 7, RX_LE },  { ">=", 7, RX_GE },  { "<<", 8, RX_SHL }, { ">>", 8, RX_SHR },
+    { "|", 3, RX_OR },   { "^", 4, RX_XOR },  { "&", 5, RX_AND },
+    { "<", 7, RX_LT },   { ">", 7, RX_GT },
+    { "+", 9, RX_ADD },  { "-", 9, RX_SUB },
+    { "*", 10, RX_MUL }, { "/", 10, RX_DIV }, { "%", 10, RX_MOD },
+};
+#define BINARY_OP_COUNT (int)(sizeof(binary_ops) / sizeof(binary_ops[0]))
+
+typedef struct Parser {
+    const char* text;
+    const char* p;
+    RamExpr*    expr;
+    int         depth;        // stack depth at this point of the program
+    char*       error;
+    size_t      error_size;
+    bool        failed;
+} Parser;
+
+static void fail(Parser* ps, const char* message) {
+    if (!ps->failed) {
+        snprintf(ps->error, ps->error_size, "%s at position %d", message, (int)(ps->p - ps->text));
+        ps->failed = true;
+    }
+}
+
+// Appends one instruction; delta is its effect on the stack depth.
+static void emit(Parser* ps, uint8_t op, int64_t value, int delta) {
+    if (ps->expr->count == RAMEXPR_MAX_OPS) {
+        fail(ps, "expression too long");
+        return;
+    }
+    ps->depth += delta;
+    if (ps->depth > RAMEXPR_MAX_DEPTH) {
+        fail(ps, "expression nested too deeply");
+        return;
+    }
+    ps->expr->code[ps->expr->count++] = (RamExprOp){ .op = op, .value = value };
+}
+
+static void skip_space(Parser* ps) {
+    while (isspace((unsigned char)*ps->p)) {
+        ps->p++;
+    }
+}
+
+static bool accept(Parser* ps, char c) {
+    skip_space(ps);
+    if (*ps->p == c) {
+        ps->p++;
+        return true;
+    }
+    return false;
+}
+
+static void parse_binary(Parser* ps, int min_precedence);
+
+static void parse_bracket(Parser* ps, uint8_t op) {
+    parse_binary(ps, 1);
+    if (!accept(ps, ']')) {
+        fail(ps, "expected ']'");
+    }
+    emit(ps, op, 0, 0);
+}
+
+static void parse_unary(Parser* ps) {
+    skip_space(ps);
+    const char* start = ps->p;
+    char c = *ps->p;
+
+    if (c == '-' || c == '!' || c == '~') {
+        ps->p++;
+        parse_unary(ps);
+        emit(ps, c == '-' ? RX_NEG : c == '!' ? RX_NOT : RX_BNOT, 0, 0);
+    } else if (c == '(') {
+        ps->p++;
+        parse_binary(ps, 1);
+        if (!accept(ps, ')')) {
+            fail(ps, "expected ')'");
+        }
+    } else if (c == '[') {
+        ps->p++;
+        parse_bracket(ps, RX_PEEK8);
+    } else if (isdigit((unsigned char)c)) {
+        char* end;
+        bool hex = c == '0' && (ps->p[1] == 'x' || ps->p[1] == 'X');
+        int64_t value = strtoll(ps->p, &end, hex ? 16 : 10);
+        ps->p = end;
+        emit(ps, RX_PUSH, value, 1);
+    } else if (isalpha((unsigned char)c) || c == '_') {
+        while (isalnum((unsigned char)*ps->p) || *ps->p == '_') {
+            ps->p++;
+        }
+        size_t len = ps->p - start;
+        if (len == 1 && *start == 'w' && accept(ps, '[')) {
+            parse_bracket(ps, RX_PEEK16);
+            return;
+        }
+        if (len == 3 && strncmp(start, "bcd", 3) == 0 && accept(ps, '[')) {
+            parse_bracket(ps, RX_BCD16);
+            return;
+        }
+        for (size_t i = 0; i < sizeof(variables) / sizeof(variables[0]); i++) {
+            if (strlen(variables[i].name) == len && strncmp(start, variables[i].name, len) == 0) {
+                emit(ps, RX_VAR, variables[i].var, 1);
+                return;
+            }
+        }
+        ps->p = start;
+        fail(ps, "unknown name");
+    } else {
+        fail(ps, c ? "unexpected character" : "unexpected end of expression");
+    }
+}
+
+// Precedence climbing: parses operators binding at least as tightly as
+// min_precedence, all left-associative.
+static void parse_binary(Parser* ps, int min_precedence) {
+    parse_unary(ps);
+    while (!ps->failed) {
+        skip_space(ps);
+        int match = -1;
+        for (int i = 0; i < BINARY_OP_COUNT; i++) {
+            size_t len = strlen(binary_ops[i].text);
+            if (strncmp(ps->p, binary_ops[i].text, len) == 0) {
+                match = i;
+                break;
+            }
+        }
+        if (match < 0 || binary_ops[match].precedence < min_precedence) {
+            return;
+        }
+        ps->p += strlen(binary_ops[match].text);
+        parse_binary(ps, binary_ops[match].precedence + 1);
+        emit(ps, binary_ops[match].op, 0, -1);
+    }
+}
+
+bool ramexpr_compile(RamExpr* expr, const char* text, char* error, size_t error_size) {
+    Parser ps = { .text = text, .p = text, .expr = expr, .error = error, .error_size = error_size };
+    expr->count = 0;
+    parse_binary(&ps, 1);
+    skip_space(&ps);
+    if (!ps.failed && *ps.p != '\0') {
+        fail(&ps, "unexpected text");
+    }
+    return !ps.failed;
+}
+
+static int64_t bcd_byte(uint8_t v) {
+    return (v >> 4) * 10 + (v & 0x0f);
+}
+
+int64_t ramexpr_eval_state(const RamExpr* expr, const State8080* cpu, uint64_t frame, uint64_t cycles) {
+    int64_t stack[RAMEXPR_MAX_DEPTH];
+    int sp = 0;
+
+    for (int i = 0; i < expr->count; i++) {
+        const RamExprOp* ins = &expr->code[i];
+        int64_t x, y;
+        switch (ins->op) {
+            case RX_PUSH:
+                stack[sp++] = ins->value;
+                break;
+            case RX_PEEK8:
+                stack[sp - 1] = cpu_peek(cpu, (uint16_t)stack[sp - 1]);
+                break;
+            case RX_PEEK16: {
+                uint16_t addr = (uint16_t)stack[sp - 1];
+                stack[sp - 1] = cpu_peek(cpu, addr) | (cpu_peek(cpu, (uint16_t)(addr + 1)) << 8);
+                break;
+            }
+            case RX_BCD16: {
+                uint16_t addr = (uint16_t)stack[sp - 1];
+                stack[sp - 1] = bcd_byte(cpu_peek(cpu, (uint16_t)(addr + 1))) * 100 +
+                                bcd_byte(cpu_peek(cpu, addr));
+                break;
+            }
+            case RX_VAR:
+                switch (ins->value) {
+                    case VAR_FRAME:  x = (int64_t)frame; break;
+                    case VAR_CYCLES: x = (int64_t)cycles; break;
+                    case VAR_PC:     x = cpu->pc; break;
+                    case VAR_SP:     x = cpu->sp; break;
+                    case VAR_A:      x = cpu->a; break;
+                    case VAR_B:      x = cpu->b; break;
+                    case VAR_C:      x = cpu->c; break;
+                    case VAR_D:      x = cpu->d; break;
+                    case VAR_E:      x = cpu->e; break;
+                    case VAR_H:      x = cpu->h; break;
+                    default:         x = cpu->l; break;
+                }
+                stack[sp++] = x;
+                break;
+            case RX_NEG:  stack[sp - 1] = (int64_t)(0 - (uint64_t)stack[sp - 1]); break;
+            case RX_NOT:  stack[sp - 1] = !stack[sp - 1]; break;
+            case RX_BNOT: stack[sp - 1] = ~stack[sp - 1]; break;
+            default:
+                y = stack[--sp];
+                x = stack[sp - 1];
+                switch (ins->op) {
+                    case RX_MUL:  x = (int64_t)((uint64_t)x * (uint64_t)y); break;
+                    case RX_DIV:  x = y == 0 ? 0 : y == -1 ? (int64_t)(0 - (uint64_t)x) : x / y; break;
+                    case RX_MOD:  x = (y == 0 || y == -1) ? 0 : x % y; break;
+                    case RX_ADD:  x = (int64_t)((uint64_t)x + (uint64_t)y); break;
+                    case RX_SUB:  x = (int64_t)((uint64_t)x - (uint64_t)y); break;
+                    case RX_SHL:  x = (int64_t)((uint64_t)x << (y & 63)); break;
+                    case RX_SHR:  x = x >> (y & 63); break;
+                    case RX_LT:   x = x < y; break;
+                    case RX_LE:   x = x <= y; break;
+                    case RX_GT:   x = x > y; break;
+                    case RX_GE:   x = x >= y; break;
+                    case RX_EQ:   x = x == y; break;
+                    case RX_NE:   x = x != y; break;
+                    case RX_AND:  x = x & y; break;
+                    case RX_XOR:  x = x ^ y; break;
+                    case RX_OR:   x = x | y; break;
+                    case RX_LAND: x = x && y; break;
+                    default:      x = x || y; break;
+                }
+                stack[sp - 1] = x;
+                break;
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : 0;
+}
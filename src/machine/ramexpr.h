@@ -0,0 +1,57 @@
+// In src/machine/ramexpr.h
+
+#ifndef RAMEXPR_H
+#define RAMEXPR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// RAM expressions: small integer expressions over guest memory, registers
+// and counters, compiled once to a stack bytecode and evaluated cheaply
+// (e.g. every frame). Used as search objectives and as exit conditions.
+//
+// Syntax (C precedence and operators, 64-bit signed arithmetic):
+//   123  0x20f8                  integer constants
+//   [addr]                       byte at addr
+//   w[addr]                      little-endian 16-bit word at addr
+//   bcd[addr]                    4-digit BCD number stored little-endian at
+//                                addr (Space Invaders scores), 0..9999
+//   frame cycles pc sp a b c d e h l
+//   - ! ~   * / %   + -   << >>   < <= > >=   == !=   &  ^  |  &&  ||
+//   ( )
+// addr may itself be an expression; it wraps at 64KB. Arithmetic wraps,
+// division or modulo by zero yields 0, and comparisons and logical
+// operators yield 0 or 1.
+//
+// Example: "bcd[0x20f8] >= 1000 || frame >= 36000"
+
+#define RAMEXPR_MAX_OPS   128
+#define RAMEXPR_MAX_DEPTH 32
+
+typedef struct RamExprOp {
+    uint8_t op;
+    int64_t value;    // constant for the push op
+} RamExprOp;
+
+typedef struct RamExpr {
+    int       count;
+    RamExprOp code[RAMEXPR_MAX_OPS];
+} RamExpr;
+
+// Compiles text into expr. On failure returns false and writes a message
+// (with the character position) to error.
+bool ramexpr_compile(RamExpr* expr, const char* text, char* error, size_t error_size);
+
+// Evaluates a compiled expression against a CPU and its frame/cycle
+// counters (for front-ends that drive a State8080 directly).
+int64_t ramexpr_eval_state(const RamExpr* expr, const State8080* cpu, uint64_t frame, uint64_t cycles);
+
+// Evaluates a compiled expression against the machine's current state.
+static inline int64_t ramexpr_eval(const RamExpr* expr, const Machine* m) {
+    return ramexpr_eval_state(expr, &m->cpu, m->frame, m->cycles);
+}
+
+#endif // RAMEXPR_H
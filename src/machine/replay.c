@@ -0,0 +1,302 @@
+// In src/machine/replay.c
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "lz4block.h"
+#include "pages.h"
+#include "replay.h"
+
+#define SCRATCH_BYTES (MEMORY_SIZE + LZ4_BOUND(MEMORY_SIZE))
+
+// ---------------------------------------------------------------------------
+// State hash
+// ---------------------------------------------------------------------------
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t hash_round(uint64_t lane, const uint8_t* p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return rotl64(lane ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+}
+
+uint64_t replay_hash(const State8080* state, const MachineState* io) {
+    uint64_t regs = (uint64_t)state->a << 56 | (uint64_t)state->b << 48 | (uint64_t)state->c << 40 |
+                    (uint64_t)state->d << 32 | (uint64_t)state->e << 24 | (uint64_t)state->h << 16 |
+                    (uint64_t)state->l << 8 | cpu_flags_byte(&state->cc);
+    uint64_t more = (uint64_t)state->sp << 48 | (uint64_t)state->pc << 32 |
+                    (uint64_t)io->shift_register << 16 | (uint64_t)io->port1 << 8 | io->port2;
+    uint64_t l0 = 0x9e3779b97f4a7c15ULL ^ regs;
+    uint64_t l1 = 0xc2b2ae3d27d4eb4fULL ^ more;
+    uint64_t l2 = 0x165667b19e3779f9ULL ^ ((uint64_t)io->shift_offset << 8 | state->int_enable);
+    uint64_t l3 = 0x27d4eb2f165667c5ULL;
+
+    // Straight from the page maps: flat and paged memory hash alike.
+    for (unsigned address = REPLAY_RAM_ADDRESS; address < REPLAY_RAM_ADDRESS + REPLAY_RAM_SIZE;
+         address += MEM_PAGE_SIZE) {
+        const uint8_t* p = state->read_map[address >> MEM_PAGE_SHIFT];
+        for (unsigned i = 0; i < MEM_PAGE_SIZE; i += 32) {
+            l0 = hash_round(l0, p + i);
+            l1 = hash_round(l1, p + i + 8);
+            l2 = hash_round(l2, p + i + 16);
+            l3 = hash_round(l3, p + i + 24);
+        }
+    }
+    return mix64(l0 ^ rotl64(l1, 23) ^ rotl64(l2, 41) ^ rotl64(l3, 7));
+}
+
+// ---------------------------------------------------------------------------
+// Recording
+// ---------------------------------------------------------------------------
+
+static uint32_t keyframe_crc(const ReplayKeyframe* record, const uint8_t* memory) {
+    ReplayKeyframe copy = *record;
+    copy.crc = 0;
+    return crc32_update(crc32(&copy, sizeof(copy)), memory, record->memory_size);
+}
+
+static void write_bytes(ReplayWriter* w, const void* data, size_t size) {
+    if (!w->failed && fwrite(data, size, 1, w->fp) != 1) {
+        w->failed = true;
+    }
+}
+
+static void write_keyframe(ReplayWriter* w, const State8080* state, const MachineState* io,
+                           const ReplayCounters* counters, bool resync) {
+    uint8_t* image = w->scratch;
+    uint8_t* packed = w->scratch + MEMORY_SIZE;
+    pages_read(state, 0, image, MEMORY_SIZE);
+    int size = lz4_compress(image, MEMORY_SIZE, packed, LZ4_BOUND(MEMORY_SIZE));
+
+    ReplayKeyframe k = {
+        .tag = REPLAY_TAG_KEYFRAME, .resync = resync,
+        .a = state->a, .b = state->b, .c = state->c, .d = state->d,
+        .e = state->e, .h = state->h, .l = state->l,
+        .flags = cpu_flags_byte(&state->cc),
+        .int_enable = state->int_enable,
+        .port1 = io->port1, .port2 = io->port2, .shift_offset = io->shift_offset,
+        .sp = state->sp, .pc = state->pc, .shift_register = io->shift_register,
+        .memory_size = (uint32_t)size,
+        .cycles = counters->cycles, .instructions = counters->instructions,
+        .frame = counters->frame,
+        .hash = replay_hash(state, io),
+    };
+    k.crc = keyframe_crc(&k, packed);
+    write_bytes(w, &k, sizeof(k));
+    write_bytes(w, packed, size);
+    w->keyframes++;
+}
+
+bool replay_open(ReplayWriter* w, const char* path, uint32_t keyframe_interval,
+                 uint32_t rom_size, const State8080* state, const MachineState* io,
+                 const ReplayCounters* counters) {
+    memset(w, 0, sizeof(*w));
+    w->keyframe_interval = keyframe_interval > 0 ? keyframe_interval : REPLAY_DEFAULT_KEYFRAME_INTERVAL;
+    w->start_frame = counters->frame;
+    w->scratch = malloc(SCRATCH_BYTES);
+    if (w->scratch == NULL) {
+        return false;
+    }
+    w->fp = fopen(path, "wb");
+    if (w->fp == NULL) {
+        free(w->scratch);
+        return false;
+    }
+
+    ReplayHeader header = {
+        .version = REPLAY_VERSION,
+        .keyframe_interval = w->keyframe_interval,
+        .rom_size = rom_size,
+        .start_frame = counters->frame,
+    };
+    memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    pages_read(state, 0, w->scratch, rom_size < MEMORY_SIZE ? rom_size : MEMORY_SIZE);
+    header.rom_crc = crc32(w->scratch, rom_size < MEMORY_SIZE ? rom_size : MEMORY_SIZE);
+    write_bytes(w, &header, sizeof(header));
+    write_keyframe(w, state, io, counters, false);
+
+    w->pending = (ReplayFrame){ .tag = REPLAY_TAG_FRAME };
+    if (w->failed) {
+        int saved = errno;
+        replay_close(w);
+        errno = saved;
+        return false;
+    }
+    return true;
+}
+
+void replay_input(ReplayWriter* w, int interrupt, const MachineState* io) {
+    int half = interrupt == 1 ? 0 : 1;
+    w->pending.port1[half] = io->port1;
+    w->pending.port2[half] = io->port2;
+}
+
+void replay_frame(ReplayWriter* w, const State8080* state, const MachineState* io,
+                  const ReplayCounters* counters, bool resync) {
+    w->pending.hash = replay_hash(state, io);
+    write_bytes(w, &w->pending, sizeof(w->pending));
+    w->frames++;
+    if (resync || (counters->frame - w->start_frame) % w->keyframe_interval == 0) {
+        write_keyframe(w, state, io, counters, resync);
+    }
+}
+
+bool replay_close(ReplayWriter* w) {
+    if (w->fp == NULL) {
+        return true;
+    }
+    bool ok = !w->failed;
+    if (fclose(w->fp) != 0) {
+        ok = false;
+    }
+    w->fp = NULL;
+    free(w->scratch);
+    w->scratch = NULL;
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+// Verification
+// ---------------------------------------------------------------------------
+
+bool replay_load(Replay* r, const char* path, char* error, size_t error_size) {
+    memset(r, 0, sizeof(*r));
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(ReplayHeader)) {
+        snprintf(error, error_size, "%s: not a replay file", path);
+        close(fd);
+        return false;
+    }
+    r->map_size = st.st_size;
+    r->map = mmap(NULL, r->map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (r->map == MAP_FAILED) {
+        r->map = NULL;
+        snprintf(error, error_size, "%s: %s", path, strerror(errno));
+        return false;
+    }
+
+    const uint8_t* data = r->map;
+    memcpy(&r->header, data, sizeof(r->header));
+    if (memcmp(r->header.magic, REPLAY_MAGIC, sizeof(r->header.magic)) != 0 ||
+        r->header.version != REPLAY_VERSION || r->header.rom_size > MEMORY_SIZE) {
+        snprintf(error, error_size, "%s: not a replay file (or a different version)", path);
+        replay_free(r);
+        return false;
+    }
+
+    // Index the records. Every frame takes 16 bytes, which bounds the
+    // arrays; keyframes are copied out since records are not aligned.
+    size_t max_records = (r->map_size - sizeof(ReplayHeader)) / sizeof(ReplayFrame) + 1;
+    r->frames = malloc(max_records * sizeof(ReplayFrame));
+    size_t keyframe_capacity = 64;
+    r->keyframes = malloc(keyframe_capacity * sizeof(ReplayKeyframeRef));
+    if (r->frames == NULL || r->keyframes == NULL) {
+        snprintf(error, error_size, "out of memory");
+        replay_free(r);
+        return false;
+    }
+
+    size_t offset = sizeof(ReplayHeader);
+    while (offset < r->map_size) {
+        size_t left = r->map_size - offset;
+        if (data[offset] == REPLAY_TAG_FRAME && left >= sizeof(ReplayFrame) && r->keyframe_count > 0) {
+            memcpy(&r->frames[r->frame_count++], data + offset, sizeof(ReplayFrame));
+            offset += sizeof(ReplayFrame);
+            continue;
+        }
+        ReplayKeyframe k;
+        if (data[offset] != REPLAY_TAG_KEYFRAME || left < sizeof(k)) {
+            break;
+        }
+        memcpy(&k, data + offset, sizeof(k));
+        if (k.memory_size > left - sizeof(k)) {
+            break;
+        }
+        if (r->keyframe_count == keyframe_capacity) {
+            keyframe_capacity *= 2;
+            ReplayKeyframeRef* grown = realloc(r->keyframes, keyframe_capacity * sizeof(ReplayKeyframeRef));
+            if (grown == NULL) {
+                snprintf(error, error_size, "out of memory");
+                replay_free(r);
+                return false;
+            }
+            r->keyframes = grown;
+        }
+        r->keyframes[r->keyframe_count++] = (ReplayKeyframeRef){
+            .record = k,
+            .memory = data + offset + sizeof(k),
+            .first_frame = r->frame_count,
+        };
+        offset += sizeof(k) + k.memory_size;
+    }
+    r->truncated = offset < r->map_size;
+
+    if (r->keyframe_count == 0) {
+        snprintf(error, error_size, "%s: no keyframe", path);
+        replay_free(r);
+        return false;
+    }
+    return true;
+}
+
+void replay_free(Replay* r) {
+    if (r->map != NULL) {
+        munmap(r->map, r->map_size);
+    }
+    free(r->frames);
+    free(r->keyframes);
+    memset(r, 0, sizeof(*r));
+}
+
+bool replay_keyframe_memory(const Replay* r, uint32_t index, uint8_t* image) {
+    const ReplayKeyframeRef* k = &r->keyframes[index];
+    return keyframe_crc(&k->record, k->memory) == k->record.crc &&
+           lz4_decompress(k->memory, (int)k->record.memory_size, image, MEMORY_SIZE) == MEMORY_SIZE;
+}
+
+void replay_restore(const Replay* r, uint32_t index, const uint8_t* image,
+                    State8080* state, MachineState* io, ReplayCounters* counters) {
+    const ReplayKeyframe* k = &r->keyframes[index].record;
+    state->a = k->a; state->b = k->b; state->c = k->c; state->d = k->d;
+    state->e = k->e; state->h = k->h; state->l = k->l;
+    cpu_set_flags_byte(&state->cc, k->flags);
+    state->sp = k->sp;
+    state->pc = k->pc;
+    state->int_enable = k->int_enable;
+    state->fault = 0;
+    io->port1 = k->port1;
+    io->port2 = k->port2;
+    io->shift_register = k->shift_register;
+    io->shift_offset = k->shift_offset;
+    *counters = (ReplayCounters){ k->cycles, k->instructions, k->frame };
+
+    for (unsigned i = 0; i < MEM_PAGES; i++) {
+        const uint8_t* page = image + (i << MEM_PAGE_SHIFT);
+        if (memcmp(state->read_map[i], page, MEM_PAGE_SIZE) != 0) {
+            pages_write(state, (uint16_t)(i << MEM_PAGE_SHIFT), page, MEM_PAGE_SIZE);
+        }
+    }
+}
@@ -0,0 +1,157 @@
+// In src/machine/replay.h
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "cpu8080.h"
+#include "machine_io.h"
+
+// Verified replays: a recording of a run that carries what is needed to
+// check it.
+//
+// For every frame the recorder stores the input ports latched at its two
+// interrupts and a 64-bit hash of the machine state after the frame
+// (registers, ports and the 8KB of RAM). Every keyframe_interval frames it
+// also stores a keyframe: the complete state, memory LZ4-compressed. A
+// verifier can start at each keyframe independently, replay the frames up
+// to the next one and compare hashes as it goes, so segments run in
+// parallel and a mismatch names the first frame that differs. The last
+// frame of a segment must reproduce the next keyframe's hash, which chains
+// the segments together.
+//
+// A keyframe marked resync follows a change made from outside the machine
+// (the shell loading --nvram bytes): the frame it closes is not expected to
+// replay, and the chain restarts from it.
+//
+// File layout (host byte order, like the other on-disk formats here): a
+// ReplayHeader, then records in the order they happened, each starting
+// with its tag byte. The first record is the keyframe of the starting
+// state. A file cut short by a crash loads up to its last whole record.
+
+#define REPLAY_MAGIC   "8080RPLY"
+#define REPLAY_VERSION 1
+
+#define REPLAY_DEFAULT_KEYFRAME_INTERVAL 600    // 10 s of play
+#define REPLAY_RAM_ADDRESS 0x2000               // hashed every frame
+#define REPLAY_RAM_SIZE    0x2000
+
+enum {
+    REPLAY_TAG_FRAME    = 'F',
+    REPLAY_TAG_KEYFRAME = 'K',
+};
+
+typedef struct ReplayHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t keyframe_interval;
+    uint32_t rom_size;          // bytes at address 0 mapped read-only
+    uint32_t rom_crc;
+    uint64_t start_frame;       // frame counter of the first keyframe
+} ReplayHeader;
+
+typedef struct ReplayFrame {
+    uint8_t  tag;               // REPLAY_TAG_FRAME
+    uint8_t  port1[2];          // latched before RST 1 and before RST 2
+    uint8_t  port2[2];
+    uint8_t  reserved[3];
+    uint64_t hash;              // state after the frame
+} ReplayFrame;
+
+typedef struct ReplayKeyframe {
+    uint8_t  tag;               // REPLAY_TAG_KEYFRAME
+    uint8_t  resync;
+    uint8_t  a, b, c, d, e, h, l, flags;
+    uint8_t  int_enable, port1, port2, shift_offset;
+    uint16_t sp, pc, shift_register;
+    uint32_t memory_size;       // compressed memory bytes that follow
+    uint32_t crc;               // over this record (crc = 0) and the memory
+    uint32_t reserved;
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frame;
+    uint64_t hash;              // replay_hash of the state
+} ReplayKeyframe;
+
+_Static_assert(sizeof(ReplayFrame) == 16, "ReplayFrame has no padding");
+_Static_assert(sizeof(ReplayKeyframe) == 64, "ReplayKeyframe has no padding");
+
+typedef struct ReplayCounters {
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frame;
+} ReplayCounters;
+
+// Hash of the registers, ports and RAM compared frame by frame.
+uint64_t replay_hash(const State8080* state, const MachineState* io);
+
+// --- Recording ---
+
+typedef struct ReplayWriter {
+    FILE*        fp;
+    uint32_t     keyframe_interval;
+    uint64_t     start_frame;
+    ReplayFrame  pending;       // frame being played
+    uint64_t     frames;
+    uint32_t     keyframes;
+    uint8_t*     scratch;       // memory image and its compressed form
+    bool         failed;        // a write failed; reported by replay_close
+} ReplayWriter;
+
+// Creates path and writes the header and a keyframe of the current state.
+// rom_size is the read-only part of memory. Returns false (with errno set)
+// on I/O errors.
+bool replay_open(ReplayWriter* w, const char* path, uint32_t keyframe_interval,
+                 uint32_t rom_size, const State8080* state, const MachineState* io,
+                 const ReplayCounters* counters);
+
+// Notes the input ports just before interrupt 1 or 2 is raised.
+void replay_input(ReplayWriter* w, int interrupt, const MachineState* io);
+
+// Records the frame that just ended (call after the vblank's work), and a
+// keyframe if one is due or resync is set.
+void replay_frame(ReplayWriter* w, const State8080* state, const MachineState* io,
+                  const ReplayCounters* counters, bool resync);
+
+// Closes the file. Returns false if any write failed.
+bool replay_close(ReplayWriter* w);
+
+// --- Verification ---
+
+typedef struct ReplayKeyframeRef {
+    ReplayKeyframe record;
+    const uint8_t* memory;      // compressed, inside the mapping
+    uint64_t       first_frame; // index in frames of the frame after it
+} ReplayKeyframeRef;
+
+typedef struct Replay {
+    void*              map;
+    size_t             map_size;
+    ReplayHeader       header;
+    ReplayFrame*       frames;  // frames[i] ends frame start_frame + i + 1
+    uint64_t           frame_count;
+    ReplayKeyframeRef* keyframes;
+    uint32_t           keyframe_count;
+    bool               truncated;   // the file ended inside a record
+} Replay;
+
+// Maps and indexes a recording. Returns false with a message in error.
+bool replay_load(Replay* r, const char* path, char* error, size_t error_size);
+
+void replay_free(Replay* r);
+
+// Decompresses keyframe index into image (MEMORY_SIZE bytes). Returns false
+// if it fails its CRC.
+bool replay_keyframe_memory(const Replay* r, uint32_t index, uint8_t* image);
+
+// Puts keyframe index into state, io and counters, image being its memory
+// from replay_keyframe_memory. Only pages that differ from state's current
+// memory are written, so a fresh fork keeps sharing the rest.
+void replay_restore(const Replay* r, uint32_t index, const uint8_t* image,
+                    State8080* state, MachineState* io, ReplayCounters* counters);
+
+#endif // REPLAY_H
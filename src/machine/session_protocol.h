@@ -0,0 +1,118 @@
+// In src/machine/session_protocol.h
+
+#ifndef SESSION_PROTOCOL_H
+#define SESSION_PROTOCOL_H
+
+#include <stdint.h>
+
+// Wire protocol of the session server (src/tools/session_server_main.c).
+//
+// Clients connect to a Unix stream socket and send requests; each request
+// gets exactly one response, in order. Requests may be pipelined. Every
+// message is a 16-byte header followed by `length` payload bytes, all
+// little-endian. `tag` is echoed back unchanged so a client can match
+// responses to requests.
+//
+// Sessions are independent machines, booted from the server's ROM. Any
+// connection may use any session; requests for one session are serialized.
+//
+//   op               request payload                 response payload
+//   CREATE           -                               -   (header.session = new id)
+//   DESTROY          -                               -
+//   FORK             -                               -   (new session continuing this one)
+//   STEP             SessionStep                     SessionStepResult
+//   READ_RAM         SessionRange                    `size` bytes
+//   WRITE_RAM        uint16 address, then bytes      -   (stores to ROM are ignored)
+//   READ_FRAME       -                               SESSION_FRAME_BYTES of 1bpp VRAM
+//   SAVE_STATE       -                               uint32 snapshot id
+//   LOAD_STATE       uint32 snapshot id              -
+//   OBSERVE          SessionObserve                  depth * out_width * out_height bytes
+//
+// Snapshots live in one deduplicating store shared by all sessions, so a
+// state saved from one session can be loaded into any other.
+//
+// OBSERVE returns the session's last `depth` observations, oldest first:
+// grayscale out_width x out_height images, each byte the share of lit
+// pixels in its box of the crop (0..255), rows top to bottom; the stack
+// must fit in SESSION_MAX_PAYLOAD. The first
+// OBSERVE (or one with a different crop, size or depth) starts the stack
+// from the current screen, repeated; from then on every STEP adds its
+// last frame, and LOAD_STATE starts it again from the loaded screen. A
+// fork inherits its parent's stack.
+//
+// A guest that executes HLT or an opcode the emulator does not implement
+// stops there: STEP runs no further frames and answers SESSION_HALTED,
+// as does every later STEP. The session can still be read, written,
+// forked, saved, or restored from a snapshot taken before it stopped.
+
+#define SESSION_PROTOCOL_VERSION 3
+#define SESSION_MAX_PAYLOAD      (65536 + 16)
+#define SESSION_FRAME_BYTES      7168          // VRAM at 0x2400, 1 bit per pixel
+#define SESSION_MAX_STEP_FRAMES  36000         // ten minutes of emulated time per request
+
+enum {
+    SESSION_OP_CREATE = 1,
+    SESSION_OP_DESTROY,
+    SESSION_OP_FORK,
+    SESSION_OP_STEP,
+    SESSION_OP_READ_RAM,
+    SESSION_OP_WRITE_RAM,
+    SESSION_OP_READ_FRAME,
+    SESSION_OP_SAVE_STATE,
+    SESSION_OP_LOAD_STATE,
+    SESSION_OP_OBSERVE,
+};
+
+enum {
+    SESSION_OK = 0,
+    SESSION_BAD_REQUEST,      // unknown op or malformed payload
+    SESSION_NO_SESSION,       // unknown or destroyed session id
+    SESSION_LIMIT,            // too many sessions
+    SESSION_NO_MEMORY,
+    SESSION_NO_STATE,         // unknown snapshot id
+    SESSION_HALTED,           // the guest stopped (HLT or an unimplemented opcode)
+};
+
+typedef struct SessionHeader {
+    uint32_t length;          // payload bytes that follow
+    uint8_t  op;
+    uint8_t  status;          // responses only
+    uint16_t reserved;
+    uint32_t session;
+    uint32_t tag;
+} SessionHeader;
+
+typedef struct SessionStep {
+    uint32_t frames;          // 1..SESSION_MAX_STEP_FRAMES
+    uint8_t  port1;           // input bits held for these frames (as in MovieFrame)
+    uint8_t  port2;
+    uint16_t reserved;
+} SessionStep;
+
+typedef struct SessionStepResult {
+    uint64_t frame;           // frames completed since the session booted
+    uint64_t cycles;
+} SessionStepResult;
+
+typedef struct SessionRange {
+    uint16_t address;
+    uint16_t size;            // 0 reads all 65536 bytes
+} SessionRange;
+
+typedef struct SessionObserve {
+    uint16_t x;               // crop of the 224x256 screen, top left at 0,0
+    uint16_t y;
+    uint16_t width;
+    uint16_t height;
+    uint8_t  out_width;       // at most the crop's; a box spans at most 64 pixels a side
+    uint8_t  out_height;
+    uint8_t  depth;           // images stacked, 1..16
+    uint8_t  reserved;
+} SessionObserve;
+
+_Static_assert(sizeof(SessionHeader) == 16, "SessionHeader is a wire format");
+_Static_assert(sizeof(SessionStep) == 8, "SessionStep is a wire format");
+_Static_assert(sizeof(SessionStepResult) == 16, "SessionStepResult is a wire format");
+_Static_assert(sizeof(SessionObserve) == 12, "SessionObserve is a wire format");
+
+#endif // SESSION_PROTOCOL_H
@@ -0,0 +1,467 @@
+// In src/machine/statestore.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "statestore.h"
+#include "lz4block.h"
+
+#define GROUP_PAGES     16                          // page IDs per group (4KB of memory)
+#define GROUPS          (MEM_PAGES / GROUP_PAGES)   // groups per snapshot
+#define CHUNK_RECORDS   256                         // records per arena chunk
+#define CHUNK_BYTES     (CHUNK_RECORDS * MEM_PAGE_SIZE)
+#define CACHE_SLOTS     8                           // decompressed spill chunks kept
+#define SPILL_RESERVE   (1ULL << 38)                // address space reserved for the spill map
+#define SPILL_GROW      (64u << 20)                 // spill file is extended in these steps
+#define MIN_SLOTS       1024
+
+// One snapshot. Zeroed before it is filled so padding hashes consistently.
+typedef struct SnapshotRecord {
+    uint32_t group[GROUPS];
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t frame;
+    uint16_t pc, sp;
+    uint16_t shift_register;
+    uint8_t  a, b, c, d, e, h, l, f;
+    uint8_t  int_enable;
+    uint8_t  port1, port2;
+    uint8_t  shift_offset;
+} SnapshotRecord;
+
+typedef struct HashSlot {
+    uint64_t h0, h1;
+    uint32_t id;            // record ID + 1; 0 = empty
+} HashSlot;
+
+typedef struct Chunk {
+    uint8_t* data;          // NULL once spilled
+    uint64_t spill_offset;
+    uint32_t spill_size;
+} Chunk;
+
+// Fixed-size records stored once each, found by content hash.
+typedef struct Pool {
+    size_t    record_size;
+    uint32_t  count;
+    Chunk*    chunks;
+    uint32_t  chunk_count;
+    uint32_t  chunk_capacity;
+    HashSlot* slots;
+    size_t    slot_mask;    // slot count - 1 (a power of two)
+    size_t    used_slots;
+} Pool;
+
+struct StateStore {
+    Pool     pages;
+    Pool     groups;
+    Pool     snapshots;
+    uint64_t saves;
+
+    // spill state (page pool only)
+    int      spill_fd;
+    uint8_t* spill_map;
+    uint64_t spill_used;
+    uint64_t spill_size;
+    uint32_t spill_next;            // oldest chunk still resident
+    uint64_t spilled_chunks;
+    size_t   memory_budget;
+    uint8_t* spill_scratch;         // compression output
+    uint8_t* cache[CACHE_SLOTS];    // decompressed chunks, direct mapped
+    int64_t  cache_chunk[CACHE_SLOTS];
+};
+
+// ---------------------------------------------------------------------------
+// Hashing
+// ---------------------------------------------------------------------------
+
+static inline uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint64_t hash_round(uint64_t lane, const uint8_t* p) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return rotl64(lane ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+}
+
+// 128-bit hash of size bytes (a multiple of 8). Four independent lanes
+// take every fourth word so the multiplies overlap; not cryptographic, but
+// collisions between distinct pages are not a practical concern at these
+// counts.
+static void hash128(const void* data, size_t size, uint64_t* h0_out, uint64_t* h1_out) {
+    const uint8_t* p = data;
+    uint64_t l0 = 0x9e3779b97f4a7c15ULL ^ size, l1 = 0xc2b2ae3d27d4eb4fULL;
+    uint64_t l2 = 0x165667b19e3779f9ULL,        l3 = 0x27d4eb2f165667c5ULL;
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        l0 = hash_round(l0, p + i);
+        l1 = hash_round(l1, p + i + 8);
+        l2 = hash_round(l2, p + i + 16);
+        l3 = hash_round(l3, p + i + 24);
+    }
+    for (; i < size; i += 8) {
+        l0 = hash_round(l0, p + i);
+    }
+    *h0_out = mix64(l0 ^ rotl64(l1, 23) ^ rotl64(l2, 41) ^ rotl64(l3, 7));
+    *h1_out = mix64(l1 + mix64(l3 + *h0_out) + rotl64(l2, 17) + l0);
+}
+
+// ---------------------------------------------------------------------------
+// Spill file
+// ---------------------------------------------------------------------------
+
+static bool spill_open(StateStore* store, const char* path) {
+    store->spill_fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0600);
+    if (store->spill_fd < 0) {
+        perror(path);
+        return false;
+    }
+    unlink(path);
+
+    // Reserve address space once; the file grows underneath the mapping.
+    store->spill_map = mmap(NULL, SPILL_RESERVE, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_NORESERVE, store->spill_fd, 0);
+    if (store->spill_map == MAP_FAILED) {
+        perror("mmap spill file");
+        store->spill_map = NULL;
+        return false;
+    }
+    store->spill_scratch = malloc(LZ4_BOUND(CHUNK_BYTES));
+    return store->spill_scratch != NULL;
+}
+
+// Compresses one resident chunk into the spill file and frees it.
+static bool spill_chunk(StateStore* store, Chunk* chunk) {
+    int packed = lz4_compress(chunk->data, CHUNK_BYTES, store->spill_scratch,
+                              LZ4_BOUND(CHUNK_BYTES));
+    if (packed <= 0) {
+        return false;
+    }
+    if (store->spill_used + packed > store->spill_size) {
+        uint64_t size = store->spill_size + SPILL_GROW;
+        if (size > SPILL_RESERVE || ftruncate(store->spill_fd, size) != 0) {
+            return false;
+        }
+        store->spill_size = size;
+    }
+    memcpy(store->spill_map + store->spill_used, store->spill_scratch, packed);
+    chunk->spill_offset = store->spill_used;
+    chunk->spill_size = packed;
+    store->spill_used += packed;
+    store->spilled_chunks++;
+
+    free(chunk->data);
+    chunk->data = NULL;
+    return true;
+}
+
+// Spills the oldest page chunks until the resident ones fit the budget. The
+// chunk being filled always stays resident.
+static void spill_if_needed(StateStore* store) {
+    Pool* pool = &store->pages;
+    while (store->spill_map != NULL && store->spill_next + 1 < pool->chunk_count &&
+           (uint64_t)(pool->chunk_count - store->spill_next) * CHUNK_BYTES > store->memory_budget) {
+        if (!spill_chunk(store, &pool->chunks[store->spill_next])) {
+            return;   // keep it resident; the store still works, just larger
+        }
+        store->spill_next++;
+    }
+}
+
+// Returns the data of a spilled chunk, decompressing it into the cache.
+static const uint8_t* spilled_chunk(StateStore* store, uint32_t index) {
+    int slot = index % CACHE_SLOTS;
+    if (store->cache_chunk[slot] == index) {
+        return store->cache[slot];
+    }
+    if (store->cache[slot] == NULL && (store->cache[slot] = malloc(CHUNK_BYTES)) == NULL) {
+        return NULL;
+    }
+    const Chunk* chunk = &store->pages.chunks[index];
+    if (lz4_decompress(store->spill_map + chunk->spill_offset, chunk->spill_size,
+                       store->cache[slot], CHUNK_BYTES) != CHUNK_BYTES) {
+        store->cache_chunk[slot] = -1;
+        return NULL;
+    }
+    store->cache_chunk[slot] = index;
+    return store->cache[slot];
+}
+
+// ---------------------------------------------------------------------------
+// Pools
+// ---------------------------------------------------------------------------
+
+static bool pool_init(Pool* pool, size_t record_size) {
+    memset(pool, 0, sizeof(*pool));
+    pool->record_size = record_size;
+    pool->slots = calloc(MIN_SLOTS, sizeof(HashSlot));
+    pool->slot_mask = MIN_SLOTS - 1;
+    return pool->slots != NULL;
+}
+
+static void pool_free(Pool* pool) {
+    for (uint32_t i = 0; i < pool->chunk_count; i++) {
+        free(pool->chunks[i].data);
+    }
+    free(pool->chunks);
+    free(pool->slots);
+}
+
+// Resident record, or NULL if its chunk has been spilled.
+static inline const uint8_t* pool_resident(const Pool* pool, uint32_t id) {
+    const uint8_t* data = pool->chunks[id / CHUNK_RECORDS].data;
+    return data ? data + (size_t)(id % CHUNK_RECORDS) * pool->record_size : NULL;
+}
+
+static const uint8_t* pool_record(StateStore* store, Pool* pool, uint32_t id) {
+    const uint8_t* record = pool_resident(pool, id);
+    if (record == NULL) {
+        const uint8_t* chunk = spilled_chunk(store, id / CHUNK_RECORDS);
+        record = chunk ? chunk + (size_t)(id % CHUNK_RECORDS) * pool->record_size : NULL;
+    }
+    return record;
+}
+
+static bool pool_grow_index(Pool* pool) {
+    size_t capacity = (pool->slot_mask + 1) * 2;
+    HashSlot* slots = calloc(capacity, sizeof(HashSlot));
+    if (slots == NULL) {
+        return false;
+    }
+    for (size_t i = 0; i <= pool->slot_mask; i++) {
+        const HashSlot* old = &pool->slots[i];
+        if (old->id != 0) {
+            size_t j = old->h0 & (capacity - 1);
+            while (slots[j].id != 0) {
+                j = (j + 1) & (capacity - 1);
+            }
+            slots[j] = *old;
+        }
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_mask = capacity - 1;
+    return true;
+}
+
+// Appends a record to the arena and returns its ID, or UINT32_MAX.
+static uint32_t pool_append(Pool* pool, const void* record) {
+    if (pool->count % CHUNK_RECORDS == 0) {
+        if (pool->count == UINT32_MAX - CHUNK_RECORDS) {
+            return UINT32_MAX;
+        }
+        if (pool->chunk_count == pool->chunk_capacity) {
+            uint32_t capacity = pool->chunk_capacity ? pool->chunk_capacity * 2 : 64;
+            Chunk* chunks = realloc(pool->chunks, capacity * sizeof(Chunk));
+            if (chunks == NULL) {
+                return UINT32_MAX;
+            }
+            pool->chunks = chunks;
+            pool->chunk_capacity = capacity;
+        }
+        uint8_t* data = malloc(CHUNK_RECORDS * pool->record_size);
+        if (data == NULL) {
+            return UINT32_MAX;
+        }
+        pool->chunks[pool->chunk_count++] = (Chunk){ .data = data };
+    }
+    uint32_t id = pool->count++;
+    memcpy(pool->chunks[id / CHUNK_RECORDS].data + (size_t)(id % CHUNK_RECORDS) * pool->record_size,
+           record, pool->record_size);
+    return id;
+}
+
+// Returns the ID of a record with these contents, adding it if it is new.
+// Returns UINT32_MAX if it had to be added and memory ran out.
+static uint32_t pool_intern(Pool* pool, const void* record) {
+    uint64_t h0, h1;
+    hash128(record, pool->record_size, &h0, &h1);
+
+    size_t i = h0 & pool->slot_mask;
+    for (; pool->slots[i].id != 0; i = (i + 1) & pool->slot_mask) {
+        const HashSlot* slot = &pool->slots[i];
+        if (slot->h0 == h0 && slot->h1 == h1) {
+            uint32_t id = slot->id - 1;
+            const uint8_t* stored = pool_resident(pool, id);
+            if (stored == NULL || memcmp(stored, record, pool->record_size) == 0) {
+                return id;
+            }
+        }
+    }
+
+    uint32_t id = pool_append(pool, record);
+    if (id == UINT32_MAX) {
+        return UINT32_MAX;
+    }
+    pool->slots[i] = (HashSlot){ .h0 = h0, .h1 = h1, .id = id + 1 };
+    if (++pool->used_slots * 2 > pool->slot_mask + 1) {
+        pool_grow_index(pool);   // on failure the table just runs fuller
+    }
+    return id;
+}
+
+static uint64_t pool_resident_bytes(const Pool* pool, uint32_t spilled) {
+    return (uint64_t)(pool->chunk_count - spilled) * CHUNK_RECORDS * pool->record_size +
+           (pool->slot_mask + 1) * sizeof(HashSlot) + pool->chunk_capacity * sizeof(Chunk);
+}
+
+// ---------------------------------------------------------------------------
+// Store
+// ---------------------------------------------------------------------------
+
+StateStore* statestore_create(const char* spill_path, size_t memory_budget) {
+    StateStore* store = calloc(1, sizeof(StateStore));
+    if (store == NULL) {
+        return NULL;
+    }
+    store->spill_fd = -1;
+    store->memory_budget = memory_budget;
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        store->cache_chunk[i] = -1;
+    }
+
+    if (!pool_init(&store->pages, MEM_PAGE_SIZE) ||
+        !pool_init(&store->groups, GROUP_PAGES * sizeof(uint32_t)) ||
+        !pool_init(&store->snapshots, sizeof(SnapshotRecord)) ||
+        (spill_path != NULL && !spill_open(store, spill_path))) {
+        statestore_destroy(store);
+        return NULL;
+    }
+    return store;
+}
+
+void statestore_destroy(StateStore* store) {
+    if (store == NULL) {
+        return;
+    }
+    pool_free(&store->pages);
+    pool_free(&store->groups);
+    pool_free(&store->snapshots);
+    if (store->spill_map != NULL) {
+        munmap(store->spill_map, SPILL_RESERVE);
+    }
+    if (store->spill_fd >= 0) {
+        close(store->spill_fd);
+    }
+    free(store->spill_scratch);
+    for (int i = 0; i < CACHE_SLOTS; i++) {
+        free(store->cache[i]);
+    }
+    free(store);
+}
+
+SnapshotId statestore_save(StateStore* store, const Machine* m) {
+    const State8080* cpu = &m->cpu;
+    SnapshotRecord snap;
+    memset(&snap, 0, sizeof(snap));
+
+    for (int g = 0; g < GROUPS; g++) {
+        uint32_t group[GROUP_PAGES];
+        for (int p = 0; p < GROUP_PAGES; p++) {
+            group[p] = pool_intern(&store->pages, cpu->read_map[g * GROUP_PAGES + p]);
+            if (group[p] == UINT32_MAX) {
+                return STATESTORE_NONE;
+            }
+        }
+        snap.group[g] = pool_intern(&store->groups, group);
+        if (snap.group[g] == UINT32_MAX) {
+            return STATESTORE_NONE;
+        }
+    }
+    spill_if_needed(store);
+
+    snap.cycles = m->cycles;
+    snap.instructions = m->instructions;
+    snap.frame = m->frame;
+    snap.pc = cpu->pc;
+    snap.sp = cpu->sp;
+    snap.a = cpu->a;
+    snap.b = cpu->b;
+    snap.c = cpu->c;
+    snap.d = cpu->d;
+    snap.e = cpu->e;
+    snap.h = cpu->h;
+    snap.l = cpu->l;
+    snap.f = cpu_flags_byte(&cpu->cc);
+    snap.int_enable = cpu->int_enable;
+    snap.port1 = m->io.port1;
+    snap.port2 = m->io.port2;
+    snap.shift_register = m->io.shift_register;
+    snap.shift_offset = m->io.shift_offset;
+
+    uint32_t id = pool_intern(&store->snapshots, &snap);
+    if (id != UINT32_MAX) {
+        store->saves++;
+    }
+    return id;
+}
+
+bool statestore_load(StateStore* store, SnapshotId id, Machine* m) {
+    if (id >= store->snapshots.count) {
+        return false;
+    }
+    SnapshotRecord snap;
+    memcpy(&snap, pool_record(store, &store->snapshots, id), sizeof(snap));
+
+    State8080* cpu = &m->cpu;
+    for (int g = 0; g < GROUPS; g++) {
+        uint32_t group[GROUP_PAGES];
+        memcpy(group, pool_record(store, &store->groups, snap.group[g]), sizeof(group));
+        for (int p = 0; p < GROUP_PAGES; p++) {
+            int index = g * GROUP_PAGES + p;
+            const uint8_t* data = pool_record(store, &store->pages, group[p]);
+            if (data == NULL) {
+                return false;
+            }
+            // leave equal pages alone so a forked machine keeps sharing them
+            if (memcmp(cpu->read_map[index], data, MEM_PAGE_SIZE) != 0) {
+                machine_write_memory(m, (uint16_t)(index << MEM_PAGE_SHIFT), data, MEM_PAGE_SIZE);
+            }
+        }
+    }
+
+    cpu->pc = snap.pc;
+    cpu->sp = snap.sp;
+    cpu->a = snap.a;
+    cpu->b = snap.b;
+    cpu->c = snap.c;
+    cpu->d = snap.d;
+    cpu->e = snap.e;
+    cpu->h = snap.h;
+    cpu->l = snap.l;
+    cpu_set_flags_byte(&cpu->cc, snap.f);
+    cpu->int_enable = snap.int_enable;
+    m->io.port1 = snap.port1;
+    m->io.port2 = snap.port2;
+    m->io.shift_register = snap.shift_register;
+    m->io.shift_offset = snap.shift_offset;
+    m->cycles = snap.cycles;
+    m->instructions = snap.instructions;
+    m->frame = snap.frame;
+    return true;
+}
+
+void statestore_stats(const StateStore* store, StateStoreStats* stats) {
+    stats->saves = store->saves;
+    stats->snapshots = store->snapshots.count;
+    stats->unique_pages = store->pages.count;
+    stats->unique_groups = store->groups.count;
+    stats->resident_bytes = pool_resident_bytes(&store->pages, store->spill_next) +
+                            pool_resident_bytes(&store->groups, 0) +
+                            pool_resident_bytes(&store->snapshots, 0);
+    stats->spilled_chunks = store->spilled_chunks;
+    stats->spilled_bytes = store->spill_used;
+}
@@ -0,0 +1,69 @@
+// In src/machine/statestore.h
+
+#ifndef STATESTORE_H
+#define STATESTORE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "machine.h"
+
+// Content-addressed, deduplicating save-state store.
+//
+// Memory is split into 256-byte pages and each distinct page is kept once.
+// Sixteen page IDs form a group (one 4KB region), and groups are
+// deduplicated the same way. A snapshot is then its registers, ports and
+// counters plus sixteen group IDs, so identical regions such as the ROM,
+// unchanged parts of the screen or untouched RAM cost nothing per snapshot.
+// Snapshots are deduplicated too: saving a state that is already stored
+// returns the existing ID.
+//
+// Records are identified by a 128-bit hash of their contents. While a page
+// is resident a hash match is confirmed with memcmp; pages that have been
+// spilled are trusted to the hash.
+//
+// When a spill file is given and the page arena grows past the memory
+// budget, the oldest 64KB chunks of pages are LZ4-compressed into the
+// mmap'd file and freed. Restoring from a spilled chunk decompresses it
+// into a small cache.
+//
+// A store is not thread-safe; give each worker its own or lock around it.
+
+typedef uint32_t SnapshotId;
+
+#define STATESTORE_NONE UINT32_MAX   // returned when a save fails
+
+typedef struct StateStore StateStore;
+
+typedef struct StateStoreStats {
+  uint64_t saves;            // statestore_save calls that succeeded
+  uint64_t snapshots;        // distinct snapshots
+  uint64_t unique_pages;
+  uint64_t unique_groups;
+  uint64_t resident_bytes;   // heap used by records and hash indexes
+  uint64_t spilled_chunks;
+  uint64_t spilled_bytes;    // compressed bytes in the spill file
+} StateStoreStats;
+
+// Creates a store. spill_path may be NULL to keep everything in memory;
+// otherwise the file is created, unlinked at once (so it disappears with the
+// process), and used once page chunks exceed memory_budget bytes.
+// Returns NULL on failure.
+StateStore* statestore_create(const char* spill_path, size_t memory_budget);
+
+void statestore_destroy(StateStore* store);
+
+// Saves the machine's registers, ports, counters and memory. Returns the
+// snapshot's ID (an existing one if the state is already stored), or
+// STATESTORE_NONE if memory or the spill file ran out.
+SnapshotId statestore_save(StateStore* store, const Machine* m);
+
+// Restores a snapshot into m. Only pages that differ from m's current
+// contents are written, which keeps shared (forked) pages shared.
+// Returns false for an unknown ID or an unreadable spill chunk.
+bool statestore_load(StateStore* store, SnapshotId id, Machine* m);
+
+void statestore_stats(const StateStore* store, StateStoreStats* stats);
+
+#endif // STATESTORE_H
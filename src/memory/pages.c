@@ -0,0 +1,192 @@
+// In src/memory/pages.c
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "pages.h"
+
+// Shared by every table for pages nobody has written. Its reference that
+// is never dropped keeps it from being freed (or written in place).
+static Page zero_page = { .refs = 1, .read_only = false };
+
+static void page_release(Page* page) {
+  if (atomic_fetch_sub_explicit(&page->refs, 1, memory_order_acq_rel) == 1) {
+    free(page);
+  }
+}
+
+static void table_release(PageTable* table) {
+  if (atomic_fetch_sub_explicit(&table->refs, 1, memory_order_acq_rel) != 1) {
+    return;
+  }
+  for (int i = 0; i < MEM_PAGES; i++) {
+    if (table->page[i] != NULL) {
+      page_release(table->page[i]);
+    }
+  }
+  free(table);
+}
+
+void pages_map_flat(State8080* state, uint8_t* memory) {
+  state->memory = memory;
+  state->pages = NULL;
+  for (int i = 0; i < MEM_PAGES; i++) {
+    state->read_map[i] = memory + (i << MEM_PAGE_SHIFT);
+    state->write_map[i] = state->read_map[i];
+  }
+}
+
+void pages_protect(State8080* state, size_t size) {
+  size_t count = (size + MEM_PAGE_SIZE - 1) >> MEM_PAGE_SHIFT;
+  for (size_t i = 0; i < count && i < MEM_PAGES; i++) {
+    state->write_map[i] = NULL;
+  }
+}
+
+bool pages_create(State8080* state) {
+  PageTable* table = malloc(sizeof(PageTable));
+  if (table == NULL) {
+    return false;
+  }
+  atomic_init(&table->refs, 1);
+  atomic_fetch_add_explicit(&zero_page.refs, MEM_PAGES, memory_order_relaxed);
+
+  state->memory = NULL;
+  state->pages = table;
+  for (int i = 0; i < MEM_PAGES; i++) {
+    table->page[i] = &zero_page;
+    state->read_map[i] = zero_page.data;
+    state->write_map[i] = NULL;
+  }
+  return true;
+}
+
+// A shared table is never modified, so a machine about to change an entry
+// takes a private copy first. Its pages gain a reference and are copied
+// individually when written.
+static PageTable* private_table(State8080* state) {
+  PageTable* table = state->pages;
+  if (atomic_load_explicit(&table->refs, memory_order_acquire) == 1) {
+    return table;
+  }
+  PageTable* copy = malloc(sizeof(PageTable));
+  if (copy == NULL) {
+    return NULL;
+  }
+  atomic_init(&copy->refs, 1);
+  for (int i = 0; i < MEM_PAGES; i++) {
+    copy->page[i] = table->page[i];
+    atomic_fetch_add_explicit(&copy->page[i]->refs, 1, memory_order_relaxed);
+  }
+  table_release(table);
+  state->pages = copy;
+  return copy;
+}
+
+bool pages_map_rom(State8080* state, const void* image, size_t size) {
+  PageTable* table = private_table(state);
+  if (table == NULL) {
+    return false;
+  }
+  const uint8_t* in = image;
+  for (unsigned i = 0; i < MEM_PAGES && size > 0; i++) {
+    size_t chunk = size < MEM_PAGE_SIZE ? size : MEM_PAGE_SIZE;
+    Page* page = calloc(1, sizeof(Page));
+    if (page == NULL) {
+      return false;
+    }
+    atomic_init(&page->refs, 1);
+    page->read_only = true;
+    memcpy(page->data, in, chunk);
+    page_release(table->page[i]);
+    table->page[i] = page;
+    state->read_map[i] = page->data;
+    state->write_map[i] = NULL;
+    in += chunk;
+    size -= chunk;
+  }
+  return true;
+}
+
+void pages_fork(State8080* parent, State8080* child) {
+  atomic_fetch_add_explicit(&parent->pages->refs, 1, memory_order_relaxed);
+  child->memory = NULL;
+  child->pages = parent->pages;
+  memcpy(child->read_map, parent->read_map, sizeof(child->read_map));
+  memset(child->write_map, 0, sizeof(child->write_map));
+  memset(parent->write_map, 0, sizeof(parent->write_map));
+}
+
+void pages_release(State8080* state) {
+  if (state->pages != NULL) {
+    table_release(state->pages);
+  }
+  state->pages = NULL;
+  state->memory = NULL;
+  memset(state->read_map, 0, sizeof(state->read_map));
+  memset(state->write_map, 0, sizeof(state->write_map));
+}
+
+uint8_t* pages_write_fault(State8080* state, unsigned index) {
+  if (state->pages == NULL || state->pages->page[index]->read_only) {
+    return NULL;   // ROM (flat memory only leaves read-only pages unmapped)
+  }
+  PageTable* table = private_table(state);
+  if (table == NULL) {
+    return NULL;
+  }
+
+  Page* page = table->page[index];
+  if (atomic_load_explicit(&page->refs, memory_order_acquire) > 1) {
+    Page* copy = malloc(sizeof(Page));
+    if (copy == NULL) {
+      return NULL;
+    }
+    atomic_init(&copy->refs, 1);
+    copy->read_only = false;
+    memcpy(copy->data, page->data, MEM_PAGE_SIZE);
+    page_release(page);
+    table->page[index] = page = copy;
+    state->read_map[index] = page->data;
+  }
+
+  state->write_map[index] = page->data;
+  return page->data;
+}
+
+void pages_read(const State8080* state, uint16_t address, void* dst, size_t size) {
+  uint8_t* out = dst;
+  while (size > 0) {
+    size_t offset = address & MEM_PAGE_MASK;
+    size_t chunk = MEM_PAGE_SIZE - offset;
+    if (chunk > size) {
+      chunk = size;
+    }
+    memcpy(out, state->read_map[address >> MEM_PAGE_SHIFT] + offset, chunk);
+    out += chunk;
+    size -= chunk;
+    address = (uint16_t)(address + chunk);
+  }
+}
+
+void pages_write(State8080* state, uint16_t address, const void* src, size_t size) {
+  const uint8_t* in = src;
+  while (size > 0) {
+    unsigned index = address >> MEM_PAGE_SHIFT;
+    size_t offset = address & MEM_PAGE_MASK;
+    size_t chunk = MEM_PAGE_SIZE - offset;
+    if (chunk > size) {
+      chunk = size;
+    }
+    uint8_t* page = state->write_map[index];
+    if (page == NULL) {
+      page = pages_write_fault(state, index);
+    }
+    if (page != NULL) {
+      memcpy(page + offset, in, chunk);
+    }
+    in += chunk;
+    size -= chunk;
+    address = (uint16_t)(address + chunk);
+  }
+}
@@ -0,0 +1,74 @@
+// In src/memory/pages.h
+
+#ifndef PAGES_H
+#define PAGES_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "cpu8080.h"
+
+// Copy-on-write guest memory.
+//
+// A machine's 64KB are MEM_PAGES pages of MEM_PAGE_SIZE bytes, each with a
+// reference count, listed in a PageTable that is itself reference counted.
+// Forking a machine shares the parent's table: both sides keep reading the
+// same pages and have every write_map entry cleared. The first store to a
+// page then faults into pages_write_fault(), which un-shares the table if
+// needed and copies just that page. A child therefore costs one table plus
+// the pages it has dirtied.
+//
+// Counts are atomic so forks of one machine may run on different threads.
+//
+// A new table lists one shared zero page everywhere, so a machine only
+// pays for the pages it writes: the 8KB of Space Invaders RAM, not 64KB.
+// ROM pages are read-only (pages_map_rom): stores to them are dropped, as
+// on the cabinet, and forks share them for good.
+//
+// Machines that never fork can instead map one flat buffer with
+// pages_map_flat(); state->memory then stays valid for direct access.
+
+typedef struct Page {
+  atomic_uint refs;                  // page tables listing this page
+  bool        read_only;             // ROM: stores are dropped
+  uint8_t     data[MEM_PAGE_SIZE];
+} Page;
+
+typedef struct PageTable {
+  atomic_uint refs;                  // machines using this table
+  Page*       page[MEM_PAGES];
+} PageTable;
+
+// Maps a flat MEMORY_SIZE buffer as private, writable pages.
+void pages_map_flat(State8080* state, uint8_t* memory);
+
+// Makes the first size bytes (whole pages) of flat memory read-only.
+void pages_protect(State8080* state, size_t size);
+
+// Gives state a table of zeroed pages, allocated as they are first written.
+// Returns false if allocation fails.
+bool pages_create(State8080* state);
+
+// Maps image at address 0 as read-only pages (the last one zero-padded).
+// Returns false if allocation fails.
+bool pages_map_rom(State8080* state, const void* image, size_t size);
+
+// Makes child share parent's pages. Both become copy-on-write; the caller
+// copies registers. Never allocates.
+void pages_fork(State8080* parent, State8080* child);
+
+// Drops state's references, freeing pages and the table when unused.
+void pages_release(State8080* state);
+
+// Store slow path: makes page index writable for state and returns it, or
+// NULL if the store must be dropped (out of memory, or a read-only page).
+uint8_t* pages_write_fault(State8080* state, unsigned index);
+
+// Copy between guest memory and a buffer. Writes go through the fault path,
+// so they are safe on shared pages. Addresses wrap at 64KB.
+void pages_read(const State8080* state, uint16_t address, void* dst, size_t size);
+void pages_write(State8080* state, uint16_t address, const void* src, size_t size);
+
+#endif // PAGES_H
@@ -0,0 +1,645 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+#include <err.h>
+#include <time.h>
+#include <sched.h>
+#include <unistd.h>
+
+#include "crt_filter.h"
+#include "machine.h"
+#include "observe.h"
+#include "png.h"
+#include "render.h"
+#include "statestore.h"
+#include "json_stream.h"
+
+/*
+ * End-to-End Benchmark Runner
+ *
+ * Runs fixed headless workloads with warm-up and repeated measurement,
+ * pinned to one CPU, and reports the median and median absolute deviation
+ * (MAD) of each workload's throughput metric. Every metric is "higher is
+ * better".
+ *
+ * Workloads:
+ *   invaders_attract - Space Invaders attract mode, frames/s (needs --rom)
+ *   cpu_exm          - 8080EXM instruction exerciser under a minimal CP/M
+ *                      BDOS, MIPS (needs --exm and a core that implements
+ *                      every opcode the exerciser uses)
+ *   copy_loop        - synthetic block copy loop, MIPS
+ *   render           - vram to ARGB expansion only, frames/s
+ *   render_index8    - vram to 8bpp overlay palette indices (the first
+ *                      half of the display path), frames/s
+ *   observe          - the screen box-filtered to an 84x84 grayscale
+ *                      observation and pushed onto a 4-deep stack, frames/s
+ *   screenshot_png   - 1-bit PNG encoding of the screen (the screenshot
+ *                      thread's work), frames/s
+ *   crt_filter       - the --crt display filter on one thread, 1120x1280
+ *                      frames/s
+ *   audio_ports      - guest loop driving the sound ports (OUT 3/OUT 5)
+ *                      through the core's sound dispatch, MIPS
+ *   machine_fork     - copy-on-write fork and destroy of a running machine,
+ *                      millions of forks/s
+ *   snapshot_save    - deduplicating snapshots of a running machine into a
+ *                      state store, thousands of saves/s
+ *   hook_vblank      - a typical vblank hook script run directly, millions
+ *                      of calls/s
+ *
+ * Usage: ./bench [options]
+ *   --rom FILE          Space Invaders ROM (default roms/space_invaders/invaders)
+ *   --exm FILE          8080EXM.COM; the workload is skipped without it
+ *   --reps N            measured repetitions (default 10)
+ *   --warmup N          unmeasured repetitions before measuring (default 2)
+ *   --cpu N             CPU to pin to (default: the CPU we start on)
+ *   --only NAME         run a single workload
+ *   --json FILE         write results as JSON
+ *   --compare FILE      compare against a baseline JSON written by --json
+ *   --threshold PCT     allowed regression of the median (default 5)
+ *
+ * Return Values:
+ *   0 - success (and no regression when comparing)
+ *   1 - bad arguments or I/O error
+ *   2 - a metric regressed beyond the threshold
+ */
+
+#define DEFAULT_REPS      10
+#define DEFAULT_WARMUP    2
+#define DEFAULT_THRESHOLD 5.0
+#define MAX_REPS          1000
+#define MAX_WORKLOADS     16
+
+typedef struct BenchContext {
+  const char* rom_path;
+  const char* exm_path;
+  Machine*    machine;
+  uint8_t*    image;          // pristine 64KB memory image restored before each rep
+  uint32_t*   pixels;         // render target
+  uint8_t*    indices;        // 8bpp render target
+} BenchContext;
+
+typedef struct Workload {
+  const char* name;
+  const char* unit;
+  bool   (*setup)(BenchContext* ctx);     // returns false to skip the workload
+  double (*run)(BenchContext* ctx);       // one repetition, returns work done in units
+} Workload;
+
+typedef struct Result {
+  const char* name;
+  const char* unit;
+  int    count;
+  double samples[MAX_REPS];
+  double median;
+  double mad;
+} Result;
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void* a, const void* b) {
+  double x = *(const double*)a, y = *(const double*)b;
+  return (x > y) - (x < y);
+}
+
+static double median_of(const double* values, int count) {
+  double sorted[MAX_REPS];
+  memcpy(sorted, values, count * sizeof(double));
+  qsort(sorted, count, sizeof(double), compare_doubles);
+  return (count % 2) ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+static double mad_of(const double* values, int count, double median) {
+  double deviations[MAX_REPS];
+  for (int i = 0; i < count; i++) {
+    deviations[i] = fabs(values[i] - median);
+  }
+  return median_of(deviations, count);
+}
+
+// Restores the machine to the state captured in ctx->image. Stores to
+// read-only (ROM) pages are dropped, so the image is read back: a workload
+// that kept an earlier ROM would otherwise measure the wrong program.
+static void reset_machine(BenchContext* ctx) {
+  static uint8_t loaded[MEMORY_SIZE];
+  machine_write_memory(ctx->machine, 0, ctx->image, MEMORY_SIZE);
+  machine_reset(ctx->machine);
+  machine_read_memory(ctx->machine, 0, loaded, MEMORY_SIZE);
+  if (memcmp(loaded, ctx->image, MEMORY_SIZE) != 0) {
+    errx(1, "the workload's memory image did not load");
+  }
+}
+
+// Loads a program into a fresh image and resets the machine from it.
+static void load_image(BenchContext* ctx, const uint8_t* code, size_t size, uint16_t at) {
+  memset(ctx->image, 0, MEMORY_SIZE);
+  memcpy(ctx->image + at, code, size);
+  reset_machine(ctx);
+}
+
+// ---------------------------------------------------------------------------
+// Workloads
+// ---------------------------------------------------------------------------
+
+#define ATTRACT_FRAMES 600          // ten emulated seconds
+#define LOOP_CYCLES    40000000     // twenty emulated seconds
+#define EXM_CYCLES     40000000
+#define RENDER_FRAMES  2000
+
+static bool setup_invaders(BenchContext* ctx) {
+  memset(ctx->image, 0, MEMORY_SIZE);
+  reset_machine(ctx);
+  if (!machine_load_rom(ctx->machine, ctx->rom_path)) {
+    return false;
+  }
+  machine_read_memory(ctx->machine, 0, ctx->image, MEMORY_SIZE);
+  return true;
+}
+
+static double run_invaders(BenchContext* ctx) {
+  reset_machine(ctx);
+  for (int i = 0; i < ATTRACT_FRAMES; i++) {
+    machine_run_frame(ctx->machine);
+  }
+  return ATTRACT_FRAMES;
+}
+
+// CP/M programs start at 0x100 and call the BDOS at 0x0005. A RET at 0x0005
+// lets the harness handle the call and return; reaching 0x0000 means the
+// program warm-booted, i.e. finished.
+static bool setup_exm(BenchContext* ctx) {
+  if (ctx->exm_path == NULL) {
+    return false;
+  }
+  FILE* fp = fopen(ctx->exm_path, "rb");
+  if (fp == NULL) {
+    warn("%s", ctx->exm_path);
+    return false;
+  }
+  memset(ctx->image, 0, MEMORY_SIZE);
+  size_t n = fread(ctx->image + 0x100, 1, MEMORY_SIZE - 0x100, fp);
+  fclose(fp);
+  if (n == 0) {
+    return false;
+  }
+  ctx->image[0x0005] = 0xc9;   // RET
+  return true;
+}
+
+static double run_exm(BenchContext* ctx) {
+  reset_machine(ctx);
+  Machine* m = ctx->machine;
+  m->cpu.pc = 0x100;
+  m->cpu.sp = 0xf000;
+
+  while (m->cycles < EXM_CYCLES) {
+    if (m->cpu.pc == 0x0000) {
+      break;
+    }
+    // BDOS output functions are accepted and discarded; the exerciser's
+    // console text is not part of the measurement.
+    m->cycles += Emulate8080Op(&m->cpu, &m->io);
+    m->instructions++;
+  }
+  return m->instructions / 1e6;
+}
+
+// LXI SP,2400 / loop: LXI H,0100 / LXI D,3000 / LXI B,1000
+// copy: MOV A,M / STAX D / INX H / INX D / DCX B / MOV A,C / ORA B / JNZ copy
+//       JMP loop
+static const uint8_t copy_loop_program[] = {
+  0x31, 0x00, 0x24,
+  0x21, 0x00, 0x01,
+  0x11, 0x00, 0x30,
+  0x01, 0x00, 0x10,
+  0x7e, 0x12, 0x23, 0x13, 0x0b, 0x79, 0xb0, 0xc2, 0x0c, 0x00,
+  0xc3, 0x03, 0x00,
+};
+
+static bool setup_copy_loop(BenchContext* ctx) {
+  load_image(ctx, copy_loop_program, sizeof(copy_loop_program), 0);
+  return true;
+}
+
+// LXI SP,2400 / MVI B,00
+// loop: MOV A,B / OUT 3 / OUT 5 / INR B / JMP loop
+static const uint8_t audio_ports_program[] = {
+  0x31, 0x00, 0x24,
+  0x06, 0x00,
+  0x78, 0xd3, 0x03, 0xd3, 0x05, 0x04, 0xc3, 0x05, 0x00,
+};
+
+static bool setup_audio_ports(BenchContext* ctx) {
+  load_image(ctx, audio_ports_program, sizeof(audio_ports_program), 0);
+  return true;
+}
+
+// shared by the two synthetic cpu loops
+static double run_program(BenchContext* ctx) {
+  reset_machine(ctx);
+  machine_run_cycles(ctx->machine, LOOP_CYCLES);
+  return ctx->machine->instructions / 1e6;
+}
+
+static bool setup_render(BenchContext* ctx) {
+  // a fixed pseudo-random screen so every bit pattern is exercised
+  uint32_t seed = 12345;
+  memset(ctx->image, 0, MEMORY_SIZE);
+  for (int i = 0; i < VRAM_BYTES; i++) {
+    seed = seed * 1103515245 + 12345;
+    ctx->image[VRAM_BASE + i] = (uint8_t)(seed >> 16);
+  }
+  reset_machine(ctx);
+  return true;
+}
+
+static double run_render(BenchContext* ctx) {
+  const uint8_t* vram = ctx->image + VRAM_BASE;
+  for (int i = 0; i < RENDER_FRAMES; i++) {
+    render_vram_argb(vram, ctx->pixels);
+  }
+  return RENDER_FRAMES;
+}
+
+static double run_render_index8(BenchContext* ctx) {
+  const uint8_t* vram = ctx->image + VRAM_BASE;
+  for (int i = 0; i < RENDER_FRAMES; i++) {
+    render_vram_index8(vram, ctx->indices);
+  }
+  return RENDER_FRAMES;
+}
+
+// What the session server does after each step of an agent learning from
+// pixels. The 8bpp render target doubles as the ring's memory.
+static double run_observe(BenchContext* ctx) {
+  const uint8_t* vram = ctx->image + VRAM_BASE;
+  ObservePlan plan;
+  ObserveRing ring;
+  observe_plan(&plan, 0, 0, RENDER_WIDTH, RENDER_HEIGHT, OBSERVE_WIDTH, OBSERVE_HEIGHT);
+  observe_ring_init(&ring, ctx->indices, OBSERVE_WIDTH * OBSERVE_HEIGHT, OBSERVE_DEPTH);
+  for (int i = 0; i < RENDER_FRAMES; i++) {
+    observe_push(&ring, &plan, vram);
+  }
+  return RENDER_FRAMES;
+}
+
+// The random screen compresses worse than a game's, so this is the slow
+// end. Rows are vram rows (the screen unrotated): the same bytes to encode.
+#define PNG_FRAMES 200
+
+static double run_screenshot_png(BenchContext* ctx) {
+  static uint8_t scanlines[PNG_SCANLINE_BYTES(RENDER_HEIGHT, RENDER_WIDTH, 1)];
+  static uint8_t file[PNG_BOUND(RENDER_HEIGHT, RENDER_WIDTH, 1)];
+  PngImage image = { .width = RENDER_HEIGHT, .height = RENDER_WIDTH, .bit_depth = 1, .scanlines = scanlines };
+  for (int i = 0; i < PNG_FRAMES; i++) {
+    for (int y = 0; y < RENDER_WIDTH; y++) {
+      memcpy(png_row(&image, y), ctx->image + VRAM_BASE + y * 32, 32);
+    }
+    if (png_encode(&image, file, sizeof(file)) == 0) {
+      return 0;
+    }
+  }
+  return PNG_FRAMES;
+}
+
+// The display filter of --crt on a single thread (the bench is pinned to
+// one CPU); the kiosk's threads divide this time.
+#define CRT_FRAMES 200
+
+static double run_crt_filter(BenchContext* ctx) {
+  CrtFilter filter;
+  uint32_t* pixels = malloc((size_t)CRT_WIDTH * CRT_HEIGHT * sizeof(uint32_t));
+  if (pixels == NULL || !crt_open(&filter, 1)) {
+    errx(1, "out of memory");
+  }
+  render_vram_index8(ctx->image + VRAM_BASE, ctx->indices);
+  for (int i = 0; i < CRT_FRAMES; i++) {
+    crt_filter(&filter, ctx->indices, pixels, CRT_WIDTH);
+  }
+  crt_close(&filter);
+  free(pixels);
+  return CRT_FRAMES;
+}
+
+// Forks a machine that is running the copy loop and frees the child again,
+// which is what a search does for every branch it abandons.
+#define FORKS 1000000
+
+static bool setup_fork(BenchContext* ctx) {
+  load_image(ctx, copy_loop_program, sizeof(copy_loop_program), 0);
+  machine_run_cycles(ctx->machine, CYCLES_PER_FRAME);
+  return true;
+}
+
+static double run_fork(BenchContext* ctx) {
+  for (int i = 0; i < FORKS; i++) {
+    Machine* child = machine_fork(ctx->machine);
+    if (child == NULL) {
+      errx(1, "out of memory");
+    }
+    machine_destroy(child);
+  }
+  return FORKS / 1e6;
+}
+
+// Saves the copy loop's state every 1000 cycles, so each snapshot has a
+// few new pages and shares the rest with earlier ones.
+#define SNAPSHOTS 20000
+
+static double run_snapshot(BenchContext* ctx) {
+  StateStore* store = statestore_create(NULL, 0);
+  if (store == NULL) {
+    errx(1, "out of memory");
+  }
+  reset_machine(ctx);
+  for (int i = 0; i < SNAPSHOTS; i++) {
+    machine_run_cycles(ctx->machine, 1000);
+    if (statestore_save(store, ctx->machine) == STATESTORE_NONE) {
+      errx(1, "out of memory");
+    }
+  }
+  statestore_destroy(store);
+  return SNAPSHOTS / 1e3;
+}
+
+// Calls a typical vblank hook (input toggling, a score check, a counter)
+// directly, to measure the per-frame cost a script adds to a run.
+#define HOOK_CALLS 10000000
+
+static const char hook_script[] =
+  "var presses\n"
+  "on vblank\n"
+  "  if frame % 8 == 0 then press fire\n"
+  "  if frame % 8 == 4 then release fire\n"
+  "  if bcd[0x20f8] >= 1000 then stop\n"
+  "  presses = presses + ((port1 & 0x10) != 0)\n";
+
+static double run_hook(BenchContext* ctx) {
+  HookProgram* prog = malloc(sizeof(HookProgram));
+  char error[128];
+  if (prog == NULL || !hook_compile(prog, hook_script, error, sizeof(error))) {
+    errx(1, "hook script: %s", prog == NULL ? "out of memory" : error);
+  }
+  reset_machine(ctx);
+  HookEnv env = { .cpu = &ctx->machine->cpu, .io = &ctx->machine->io };
+  for (int i = 0; i < HOOK_CALLS; i++) {
+    env.frame = i;
+    hook_run_vblank(prog, &env);
+  }
+  free(prog);
+  return HOOK_CALLS / 1e6;
+}
+
+static const Workload workloads[] = {
+  { "invaders_attract", "frames/s", setup_invaders,    run_invaders },
+  { "cpu_exm",          "MIPS",     setup_exm,         run_exm },
+  { "copy_loop",        "MIPS",     setup_copy_loop,   run_program },
+  { "render",           "frames/s", setup_render,      run_render },
+  { "render_index8",    "frames/s", setup_render,      run_render_index8 },
+  { "observe",          "frames/s", setup_render,      run_observe },
+  { "screenshot_png",   "frames/s", setup_render,      run_screenshot_png },
+  { "crt_filter",       "frames/s", setup_render,      run_crt_filter },
+  { "audio_ports",      "MIPS",     setup_audio_ports, run_program },
+  { "machine_fork",     "Mforks/s", setup_fork,        run_fork },
+  { "snapshot_save",    "ksaves/s", setup_copy_loop,   run_snapshot },
+  { "hook_vblank",      "Mcalls/s", setup_copy_loop,   run_hook },
+};
+#define WORKLOAD_COUNT (int)(sizeof(workloads) / sizeof(workloads[0]))
+
+// ---------------------------------------------------------------------------
+// Reporting
+// ---------------------------------------------------------------------------
+
+static bool write_json(const char* path, const Result* results, int count, int cpu, int reps, int warmup) {
+  FILE* fp = fopen(path, "w");
+  if (fp == NULL) {
+    warn("%s", path);
+    return false;
+  }
+
+  char host[64] = "unknown";
+  gethostname(host, sizeof(host) - 1);
+
+  fprintf(fp, "{\n  \"version\": 1,\n  \"host\": \"%s\",\n  \"cpu\": %d,\n", host, cpu);
+  fprintf(fp, "  \"repetitions\": %d,\n  \"warmup\": %d,\n  \"workloads\": [\n", reps, warmup);
+  for (int i = 0; i < count; i++) {
+    const Result* r = &results[i];
+    fprintf(fp, "    { \"name\": \"%s\", \"unit\": \"%s\", \"median\": %.6f, \"mad\": %.6f, \"samples\": [",
+            r->name, r->unit, r->median, r->mad);
+    for (int j = 0; j < r->count; j++) {
+      fprintf(fp, "%s%.6f", j ? ", " : "", r->samples[j]);
+    }
+    fprintf(fp, "] }%s\n", i + 1 < count ? "," : "");
+  }
+  fprintf(fp, "  ]\n}\n");
+  fclose(fp);
+  return true;
+}
+
+// Reads the name and median of every workload in a baseline file.
+static int read_baseline(const char* path, char names[][32], double* medians, int max) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    warn("%s", path);
+    return -1;
+  }
+  JsonStream* js = malloc(sizeof(JsonStream));
+  if (js == NULL) {
+    fclose(fp);
+    return -1;
+  }
+  json_open(js, fp);
+
+  int count = 0;
+  char key[32] = "";
+  char name[32] = "";
+  double median = NAN;
+  JsonToken token;
+  while ((token = json_next(js)) != JSON_EOF && token != JSON_ERROR) {
+    if (token == JSON_KEY) {
+      snprintf(key, sizeof(key), "%.31s", js->str);
+    } else if (token == JSON_STRING && strcmp(key, "name") == 0) {
+      snprintf(name, sizeof(name), "%.31s", js->str);
+    } else if (token == JSON_NUMBER && strcmp(key, "median") == 0) {
+      median = js->number;
+    } else if (token == JSON_OBJECT_END && name[0] != '\0' && !isnan(median)) {
+      if (count < max) {
+        snprintf(names[count], 32, "%s", name);
+        medians[count] = median;
+        count++;
+      }
+      name[0] = '\0';
+      median = NAN;
+    }
+  }
+  if (token == JSON_ERROR) {
+    warnx("%s: %s", path, js->error);
+  }
+
+  free(js);
+  fclose(fp);
+  return count;
+}
+
+// Prints a comparison table; returns the number of regressed workloads.
+static int compare(const char* path, const Result* results, int count, double threshold) {
+  char names[MAX_WORKLOADS * 2][32];
+  double medians[MAX_WORKLOADS * 2];
+  int baseline_count = read_baseline(path, names, medians, MAX_WORKLOADS * 2);
+  if (baseline_count < 0) {
+    return -1;
+  }
+
+  int regressions = 0;
+  printf("\nComparison against %s (threshold %.1f%%)\n", path, threshold);
+  for (int i = 0; i < count; i++) {
+    const Result* r = &results[i];
+    int j = 0;
+    while (j < baseline_count && strcmp(names[j], r->name) != 0) {
+      j++;
+    }
+    if (j == baseline_count) {
+      printf("  %-18s no baseline\n", r->name);
+      continue;
+    }
+
+    double change = (r->median - medians[j]) / medians[j] * 100.0;
+    bool regressed = change < -threshold;
+    printf("  %-18s %12.3f -> %12.3f %-9s %+7.2f%%%s\n", r->name, medians[j], r->median, r->unit,
+           change, regressed ? "  REGRESSION" : "");
+    regressions += regressed;
+  }
+  return regressions;
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [--rom FILE] [--exm FILE] [--reps N] [--warmup N] [--cpu N]\n"
+                  "       [--only NAME] [--json FILE] [--compare FILE] [--threshold PCT]\n", prog);
+}
+
+int main(int argc, char** argv) {
+  BenchContext ctx = { .rom_path = "roms/space_invaders/invaders" };
+  int reps = DEFAULT_REPS;
+  int warmup = DEFAULT_WARMUP;
+  int cpu = sched_getcpu();
+  const char* only = NULL;
+  const char* json_path = NULL;
+  const char* baseline_path = NULL;
+  double threshold = DEFAULT_THRESHOLD;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    const char* value = (i + 1 < argc) ? argv[i + 1] : NULL;
+    if (value == NULL) {
+      usage(argv[0]);
+      return 1;
+    }
+    if      (strcmp(arg, "--rom") == 0)       ctx.rom_path = value;
+    else if (strcmp(arg, "--exm") == 0)       ctx.exm_path = value;
+    else if (strcmp(arg, "--reps") == 0)      reps = atoi(value);
+    else if (strcmp(arg, "--warmup") == 0)    warmup = atoi(value);
+    else if (strcmp(arg, "--cpu") == 0)       cpu = atoi(value);
+    else if (strcmp(arg, "--only") == 0)      only = value;
+    else if (strcmp(arg, "--json") == 0)      json_path = value;
+    else if (strcmp(arg, "--compare") == 0)   baseline_path = value;
+    else if (strcmp(arg, "--threshold") == 0) threshold = atof(value);
+    else {
+      usage(argv[0]);
+      return 1;
+    }
+    i++;
+  }
+  if (reps < 1 || reps > MAX_REPS || warmup < 0) {
+    errx(1, "--reps must be 1..%d and --warmup non-negative", MAX_REPS);
+  }
+
+  // pin to one CPU so migrations do not show up as noise
+  if (cpu >= 0) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (sched_setaffinity(0, sizeof(set), &set) != 0) {
+      warn("could not pin to cpu %d", cpu);
+    }
+  }
+
+  ctx.image = calloc(MEMORY_SIZE, 1);
+  ctx.pixels = calloc(RENDER_WIDTH * RENDER_HEIGHT, sizeof(uint32_t));
+  _Static_assert(OBSERVE_RING_BYTES(OBSERVE_WIDTH * OBSERVE_HEIGHT, OBSERVE_DEPTH) <= RENDER_WIDTH * RENDER_HEIGHT,
+                 "the observe workload's ring fits in the 8bpp render target");
+  ctx.indices = calloc(RENDER_WIDTH * RENDER_HEIGHT, 1);
+  if (ctx.image == NULL || ctx.pixels == NULL || ctx.indices == NULL) {
+    errx(1, "out of memory");
+  }
+
+  static Result results[MAX_WORKLOADS];
+  int result_count = 0;
+
+  printf("%-18s %12s %10s %-9s\n", "workload", "median", "MAD", "unit");
+  for (int w = 0; w < WORKLOAD_COUNT; w++) {
+    const Workload* wl = &workloads[w];
+    if (only != NULL && strcmp(only, wl->name) != 0) {
+      continue;
+    }
+    // every workload starts on a fresh machine with writable memory; a
+    // ROM loaded for an earlier one would keep its pages read-only
+    machine_destroy(ctx.machine);
+    if ((ctx.machine = machine_create()) == NULL) {
+      errx(1, "out of memory");
+    }
+    if (!wl->setup(&ctx)) {
+      printf("%-18s %12s\n", wl->name, "skipped");
+      continue;
+    }
+
+    Result* r = &results[result_count++];
+    r->name = wl->name;
+    r->unit = wl->unit;
+    for (int i = 0; i < warmup + reps; i++) {
+      double start = now_seconds();
+      double units = wl->run(&ctx);
+      double elapsed = now_seconds() - start;
+      if (i >= warmup) {
+        r->samples[r->count++] = units / elapsed;
+      }
+    }
+    r->median = median_of(r->samples, r->count);
+    r->mad = mad_of(r->samples, r->count, r->median);
+    printf("%-18s %12.3f %10.3f %-9s\n", r->name, r->median, r->mad, r->unit);
+  }
+
+  int status = 0;
+  if (json_path != NULL && !write_json(json_path, results, result_count, cpu, reps, warmup)) {
+    status = 1;
+  }
+  if (baseline_path != NULL) {
+    int regressions = compare(baseline_path, results, result_count, threshold);
+    if (regressions < 0) {
+      status = 1;
+    } else if (regressions > 0) {
+      printf("%d workload(s) regressed\n", regressions);
+      status = 2;
+    }
+  }
+
+  free(ctx.pixels);
+  free(ctx.indices);
+  free(ctx.image);
+  machine_destroy(ctx.machine);
+  return status;
+}
@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <err.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "crc32.h"
+#include "machine.h"
+#include "pages.h"
+#include "replay.h"
+
+/*
+ * Replay Verify - check that a recorded run still replays identically
+ *
+ * Reads a recording made with the emulator's --record option and replays
+ * it against the current core. Every keyframe starts an independent
+ * segment: a copy-on-write fork of a machine holding the recording's ROM
+ * is set to the keyframe's state, runs the recorded inputs up to the next
+ * keyframe and compares the state hash after every frame. Segments run on
+ * a thread pool, so an hour-long recording checks in about an hour divided
+ * by the number of cores. The end of each segment must match the next
+ * keyframe's hash, so together the segments cover the whole run.
+ *
+ * Prints the first frame whose state differs from the recording.
+ *
+ * Usage: ./replay_verify [-j N] [--all] <recording>
+ *   -j N      worker threads (default: online CPUs)
+ *   --all     report every diverging segment, not just the first
+ *
+ * Return Values:
+ *   0 - every frame replayed identically
+ *   1 - the replay diverged, or a keyframe is damaged
+ *   2 - bad arguments or unreadable / invalid recording
+ */
+
+#define NO_DIVERGENCE UINT64_MAX
+
+typedef struct Segment {
+  uint64_t bad_frame;    // first frame that differs, or NO_DIVERGENCE
+  uint64_t expected;     // recorded hash at bad_frame
+  uint64_t actual;
+  const char* problem;   // why the segment could not be checked, or NULL
+} Segment;
+
+typedef struct Verifier {
+  const Replay* replay;
+  Machine*      base;        // holds the ROM; segments fork it
+  pthread_mutex_t fork_lock; // forking writes the base's page maps
+  Segment*      segments;
+  atomic_uint   next;        // next segment to claim
+  atomic_ullong frames;      // frames replayed
+} Verifier;
+
+static void run_to(Machine* m, uint64_t cycle) {
+  if (m->cycles < cycle) {
+    machine_run_cycles(m, cycle - m->cycles);
+  }
+}
+
+// One recorded frame, the way the emulator shell ran it: on its interrupt
+// schedule, with the ports latched at each interrupt in effect when it is
+// raised.
+static void run_frame(Machine* m, const ReplayFrame* f) {
+  run_to(m, machine_interrupt_cycle(m->frame, 0));
+  m->io.port1 = f->port1[0];
+  m->io.port2 = f->port2[0];
+  generateInterrupt(&m->cpu, 1);
+
+  run_to(m, machine_interrupt_cycle(m->frame, 1));
+  m->io.port1 = f->port1[1];
+  m->io.port2 = f->port2[1];
+  generateInterrupt(&m->cpu, 2);
+  m->frame++;
+}
+
+static void verify_segment(Verifier* v, uint32_t index, uint8_t* image) {
+  const Replay* r = v->replay;
+  const ReplayKeyframeRef* k = &r->keyframes[index];
+  Segment* seg = &v->segments[index];
+  *seg = (Segment){ .bad_frame = NO_DIVERGENCE };
+
+  if (!replay_keyframe_memory(r, index, image)) {
+    seg->problem = "keyframe is corrupt";
+    return;
+  }
+  pthread_mutex_lock(&v->fork_lock);
+  Machine* m = machine_fork(v->base);
+  pthread_mutex_unlock(&v->fork_lock);
+  if (m == NULL) {
+    errx(2, "out of memory");
+  }
+  ReplayCounters counters;
+  replay_restore(r, index, image, &m->cpu, &m->io, &counters);
+  m->cycles = counters.cycles;
+  m->instructions = counters.instructions;
+  m->frame = counters.frame;
+  if (replay_hash(&m->cpu, &m->io) != k->record.hash) {
+    seg->problem = "keyframe does not match its hash";
+    machine_destroy(m);
+    return;
+  }
+
+  // Up to the next keyframe. A resync keyframe's frame had outside help,
+  // so that one is not compared.
+  bool last = index + 1 == r->keyframe_count;
+  uint64_t end = last ? r->frame_count : r->keyframes[index + 1].first_frame;
+  uint64_t checked_end = !last && r->keyframes[index + 1].record.resync ? end - 1 : end;
+  for (uint64_t i = k->first_frame; i < end; i++) {
+    run_frame(m, &r->frames[i]);
+    uint64_t hash = replay_hash(&m->cpu, &m->io);
+    if (i < checked_end && hash != r->frames[i].hash) {
+      seg->bad_frame = m->frame;
+      seg->expected = r->frames[i].hash;
+      seg->actual = hash;
+      break;
+    }
+  }
+  atomic_fetch_add_explicit(&v->frames, m->frame - counters.frame, memory_order_relaxed);
+  machine_destroy(m);
+}
+
+static void* worker_main(void* arg) {
+  Verifier* v = arg;
+  uint8_t* image = malloc(MEMORY_SIZE);
+  if (image == NULL) {
+    errx(2, "out of memory");
+  }
+  unsigned i;
+  while ((i = atomic_fetch_add(&v->next, 1)) < v->replay->keyframe_count) {
+    verify_segment(v, i, image);
+  }
+  free(image);
+  return NULL;
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [-j N] [--all] <recording>\n", prog);
+}
+
+int main(int argc, char** argv) {
+  static const struct option long_options[] = {
+    { "all",  no_argument, NULL, 'a' },
+    { "help", no_argument, NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+  int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  bool all = false;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'j': threads = atoi(optarg); break;
+      case 'a': all = true; break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (optind + 1 != argc) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+
+  Replay replay;
+  char error[256];
+  if (!replay_load(&replay, argv[optind], error, sizeof(error))) {
+    warnx("%s", error);
+    return 2;
+  }
+  if (replay.truncated) {
+    warnx("%s: recording ends inside a record; checking up to the last whole one", argv[optind]);
+  }
+
+  // The ROM comes from the first keyframe and is mapped read-only, as the
+  // shell protected it, so every segment shares one copy.
+  uint8_t* image = malloc(MEMORY_SIZE);
+  Machine* base = machine_create();
+  if (image == NULL || base == NULL) {
+    errx(2, "out of memory");
+  }
+  if (!replay_keyframe_memory(&replay, 0, image)) {
+    errx(2, "%s: first keyframe is corrupt", argv[optind]);
+  }
+  if (crc32(image, replay.header.rom_size) != replay.header.rom_crc) {
+    errx(2, "%s: ROM in the first keyframe does not match the header", argv[optind]);
+  }
+  if (!pages_map_rom(&base->cpu, image, replay.header.rom_size)) {
+    errx(2, "out of memory");
+  }
+  free(image);
+
+  Verifier v = { .replay = &replay, .base = base };
+  pthread_mutex_init(&v.fork_lock, NULL);
+  if ((uint32_t)threads > replay.keyframe_count) {
+    threads = (int)replay.keyframe_count;
+  }
+  v.segments = calloc(replay.keyframe_count, sizeof(Segment));
+  pthread_t* workers = calloc(threads, sizeof(pthread_t));
+  if (v.segments == NULL || workers == NULL) {
+    errx(2, "out of memory");
+  }
+
+  printf("Verifying %llu frames in %u segments on %d threads\n",
+         (unsigned long long)replay.frame_count, replay.keyframe_count, threads);
+  double start = now_seconds();
+  for (int i = 0; i < threads; i++) {
+    if (pthread_create(&workers[i], NULL, worker_main, &v) != 0) {
+      errx(2, "cannot start worker threads");
+    }
+  }
+  for (int i = 0; i < threads; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  double elapsed = now_seconds() - start;
+  uint64_t frames = atomic_load(&v.frames);
+  printf("Replayed %llu frames in %.2f s (%.0f frames/s)\n",
+         (unsigned long long)frames, elapsed, frames / elapsed);
+
+  // Segments are in recording order, so the first bad one holds the first
+  // divergence.
+  int bad = 0;
+  for (uint32_t i = 0; i < replay.keyframe_count; i++) {
+    const Segment* seg = &v.segments[i];
+    uint64_t key_frame = replay.keyframes[i].record.frame;
+    if (seg->problem != NULL) {
+      printf("Segment %u (frame %llu): %s\n", i, (unsigned long long)key_frame, seg->problem);
+    } else if (seg->bad_frame != NO_DIVERGENCE) {
+      printf("Diverged at frame %llu (segment %u, from keyframe at frame %llu): "
+             "expected hash %016llx, got %016llx\n",
+             (unsigned long long)seg->bad_frame, i, (unsigned long long)key_frame,
+             (unsigned long long)seg->expected, (unsigned long long)seg->actual);
+    } else {
+      continue;
+    }
+    bad++;
+    if (!all) {
+      break;
+    }
+  }
+  if (bad == 0) {
+    printf("Replay identical\n");
+  }
+
+  machine_destroy(base);
+  replay_free(&replay);
+  pthread_mutex_destroy(&v.fork_lock);
+  free(v.segments);
+  free(workers);
+  return bad == 0 ? 0 : 1;
+}
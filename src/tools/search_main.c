@@ -0,0 +1,759 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <err.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "machine.h"
+#include "movie.h"
+#include "ramexpr.h"
+#include "statestore.h"
+
+/*
+ * Input Search - beam search over per-frame inputs maximizing a RAM objective
+ *
+ * Starts from power-on (plus a coin/start sequence or a prefix movie) and
+ * grows the run one segment of frames at a time. Every state in the beam is
+ * forked once per action, each child holds that action for the segment, and
+ * the children are scored with a RAM expression (a child whose guest
+ * stopped at HLT or an unimplemented opcode scores lowest and is not run
+ * further). The best --beam children, with duplicate states removed, form
+ * the next beam. Children run on a
+ * thread pool; forks share memory copy-on-write, so a branch costs only the
+ * pages it dirties. Workers are pinned to CPUs across the NUMA nodes, each
+ * child runs (and is forked) on the worker that ran its parent unless an
+ * idle worker steals it, and the run ends with throughput per node.
+ *
+ * The winning input sequence is written as a movie and replayed from
+ * power-on to check that it reproduces the score.
+ *
+ * Usage: ./search [options]
+ *   --rom FILE          ROM image (default roms/space_invaders/invaders)
+ *   --score EXPR        objective, a RAM expression (default "bcd[0x20f8]",
+ *                       the player 1 score)
+ *   --frames N          frames to search after the start (default 3600)
+ *   --segment N         frames each action is held (default 15)
+ *   --beam K            states kept per segment (default 32)
+ *   --actions LIST      comma-separated actions; an action is "none" or
+ *                       inputs joined with '+': left right fire coin start1
+ *                       start2 p2left p2right p2fire
+ *                       (default none,left,right,fire,left+fire,right+fire)
+ *   --start-frame N     frame at which the built-in coin/start sequence begins
+ *                       (default 120)
+ *   --prefix FILE       play this movie first instead of the coin/start sequence
+ *   --no-dedupe         keep duplicate states in the beam
+ *   -j N                worker threads (default: online CPUs)
+ *   --no-pin            let the scheduler place worker threads
+ *   --out FILE          winning movie (default search.mov)
+ *
+ * Return Values:
+ *   0 - success
+ *   1 - bad arguments, I/O error, or the replay did not reproduce the score
+ */
+
+#define DEFAULT_FRAMES      3600
+#define DEFAULT_SEGMENT     15
+#define DEFAULT_BEAM        32
+#define DEFAULT_START_FRAME 120
+#define MAX_ACTIONS         16
+#define COIN_FRAMES         4     // frames the coin/start inputs are held
+#define START_DELAY         40    // frames between coin and start
+#define SETTLE_FRAMES       60    // idle frames after start before the search
+
+typedef struct SearchOptions {
+  const char* rom_path;
+  const char* score_text;
+  const char* actions_text;
+  const char* prefix_path;
+  const char* out_path;
+  int         frames;
+  int         segment;
+  int         beam;
+  int         start_frame;
+  int         threads;
+  bool        dedupe;
+  bool        pin;
+} SearchOptions;
+
+// One step of a branch's history: the action held for some frames.
+typedef struct Step {
+  uint32_t parent;    // previous step, or NO_STEP for the first
+  uint16_t action;
+  uint16_t frames;
+} Step;
+#define NO_STEP UINT32_MAX
+
+typedef struct Node {
+  Machine* m;
+  int64_t  score;
+  uint32_t step;      // last step of this branch's history
+  uint32_t parent;    // beam index the node was forked from (candidates only)
+  uint16_t action;
+  uint32_t order;     // tie-breaker that keeps the search deterministic
+  uint16_t home;      // worker that ran it, and runs its children
+} Node;
+
+typedef struct Search {
+  SearchOptions opts;
+  RamExpr       score;
+  MovieFrame    actions[MAX_ACTIONS];
+  const char*   action_names[MAX_ACTIONS];
+  int           action_count;
+  Movie         prefix;
+  Step*         steps;
+  uint32_t      step_count;
+  uint32_t      step_capacity;
+  Node*         beam;
+  pthread_mutex_t* fork_locks;    // one per beam slot
+  Node*         candidates;
+  int           candidate_count;
+  int           segment_frames;   // frames in the segment being run
+} Search;
+
+// ---------------------------------------------------------------------------
+// Thread pool: workers run every candidate of one segment, then wait.
+//
+// Workers are pinned one per CPU, taking a CPU from each NUMA node in turn.
+// A candidate is queued on its parent's home worker, the one that ran the
+// parent, so the pages it shares with the parent are usually on the local
+// node. The worker forks the candidate itself, which puts the new Machine
+// and every page it dirties in memory first touched on that node. A worker
+// whose queue is empty steals from others, same node first.
+// ---------------------------------------------------------------------------
+
+#define MAX_NODES 64
+
+typedef struct Worker {
+  _Alignas(64) atomic_int next;  // next queue slot to claim, by owner or thief
+  int             queued;        // candidates in queue this segment
+  int*            queue;         // candidate indices homed on this worker
+  struct WorkerPool* pool;
+  pthread_t       thread;
+  int             index;
+  int             cpu;           // pinned CPU, or -1
+  int             node;          // NUMA node of cpu
+  uint64_t        runs;          // candidates run, stolen ones included
+  uint64_t        stolen;
+  uint64_t        frames;
+} Worker;
+
+typedef struct WorkerPool {
+  Search*         search;
+  Worker*         workers;
+  int             count;
+  pthread_mutex_t lock;
+  pthread_cond_t  start;
+  pthread_cond_t  done;
+  uint64_t        generation;    // bumped to start a segment
+  int             finished;      // workers done with the current generation
+  bool            quit;
+} WorkerPool;
+
+// A branch whose guest stopped (HLT or an unimplemented opcode) is dead:
+// it scores below every live one and is not run any further.
+static int64_t score_machine(const Search* s, const Machine* m) {
+  return m->cpu.fault ? INT64_MIN : ramexpr_eval(&s->score, m);
+}
+
+static void run_candidate(Search* s, Worker* w, Node* n) {
+  // Siblings may be forked at once on other workers, and forking writes
+  // the parent's page maps.
+  Node* parent = &s->beam[n->parent];
+  pthread_mutex_lock(&s->fork_locks[n->parent]);
+  n->m = machine_fork(parent->m);
+  pthread_mutex_unlock(&s->fork_locks[n->parent]);
+  if (n->m == NULL) {
+    errx(1, "out of memory");
+  }
+
+  MovieFrame input = s->actions[n->action];
+  for (int f = 0; f < s->segment_frames && !n->m->cpu.fault; f++) {
+    movie_apply(&n->m->io, input);
+    machine_run_frame(n->m);
+  }
+  n->score = score_machine(s, n->m);
+  n->home = (uint16_t)w->index;
+  w->runs++;
+  w->frames += s->segment_frames;
+}
+
+// Claims the next unclaimed candidate in w's queue, or returns -1.
+static int claim(Worker* w) {
+  if (atomic_load_explicit(&w->next, memory_order_relaxed) >= w->queued) {
+    return -1;
+  }
+  int slot = atomic_fetch_add_explicit(&w->next, 1, memory_order_relaxed);
+  return slot < w->queued ? w->queue[slot] : -1;
+}
+
+// Takes a candidate from another worker: one on the same node if any has
+// work left, otherwise the first one that has.
+static int steal(WorkerPool* pool, Worker* self) {
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 1; k < pool->count; k++) {
+      Worker* victim = &pool->workers[(self->index + k) % pool->count];
+      if ((victim->node == self->node) != (pass == 0)) {
+        continue;
+      }
+      int i = claim(victim);
+      if (i >= 0) {
+        return i;
+      }
+    }
+  }
+  return -1;
+}
+
+static void* worker_main(void* arg) {
+  Worker* self = arg;
+  WorkerPool* pool = self->pool;
+  uint64_t seen = 0;
+  for (;;) {
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit && pool->generation == seen) {
+      pthread_cond_wait(&pool->start, &pool->lock);
+    }
+    if (pool->quit) {
+      pthread_mutex_unlock(&pool->lock);
+      return NULL;
+    }
+    seen = pool->generation;
+    pthread_mutex_unlock(&pool->lock);
+
+    Search* s = pool->search;
+    int i;
+    while ((i = claim(self)) >= 0) {
+      run_candidate(s, self, &s->candidates[i]);
+    }
+    while ((i = steal(pool, self)) >= 0) {
+      run_candidate(s, self, &s->candidates[i]);
+      self->stolen++;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    if (++pool->finished == pool->count) {
+      pthread_cond_signal(&pool->done);
+    }
+    pthread_mutex_unlock(&pool->lock);
+  }
+}
+
+// Parses a sysfs CPU list such as "0-3,8-11", marking each CPU's node.
+static void mark_cpulist(const char* list, int node, int* cpu_node) {
+  const char* p = list;
+  while (*p != '\0' && *p != '\n') {
+    char* end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p) {
+      return;
+    }
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+    }
+    for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) {
+      if (cpu >= 0) {
+        cpu_node[cpu] = node;
+      }
+    }
+    p = *end == ',' ? end + 1 : end;
+  }
+}
+
+// Fills cpus and nodes with the CPUs this process may use, ordered one per
+// NUMA node in turn, and returns how many there are. Without sysfs node
+// information every CPU counts as node 0.
+static int load_topology(int* cpus, int* nodes) {
+  cpu_set_t allowed;
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    return 0;
+  }
+  static int cpu_node[CPU_SETSIZE];
+  for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+    cpu_node[cpu] = 0;
+  }
+  for (int node = 0; node < MAX_NODES; node++) {
+    char path[64];
+    char list[1024];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) {
+      continue;
+    }
+    if (fgets(list, sizeof(list), fp) != NULL) {
+      mark_cpulist(list, node, cpu_node);
+    }
+    fclose(fp);
+  }
+
+  int count = 0;
+  int remaining = CPU_COUNT(&allowed);
+  while (count < remaining) {
+    for (int node = 0; node < MAX_NODES; node++) {
+      for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed) && cpu_node[cpu] == node) {
+          CPU_CLR(cpu, &allowed);
+          cpus[count] = cpu;
+          nodes[count] = node;
+          count++;
+          break;
+        }
+      }
+    }
+  }
+  return count;
+}
+
+static void pool_start(WorkerPool* pool, Search* s, int count, int queue_capacity, bool pin) {
+  pool->search = s;
+  pool->count = count;
+  pool->workers = aligned_alloc(_Alignof(Worker), count * sizeof(Worker));
+  if (pool->workers == NULL) {
+    errx(1, "out of memory");
+  }
+  static int cpus[CPU_SETSIZE];
+  static int nodes[CPU_SETSIZE];
+  int cpu_count = pin ? load_topology(cpus, nodes) : 0;
+
+  pthread_mutex_init(&pool->lock, NULL);
+  pthread_cond_init(&pool->start, NULL);
+  pthread_cond_init(&pool->done, NULL);
+  for (int i = 0; i < count; i++) {
+    Worker* w = &pool->workers[i];
+    *w = (Worker){
+      .pool = pool, .index = i,
+      .cpu = cpu_count > 0 ? cpus[i % cpu_count] : -1,
+      .node = cpu_count > 0 ? nodes[i % cpu_count] : 0,
+      .queue = malloc(queue_capacity * sizeof(int)),
+    };
+    atomic_init(&w->next, 0);
+    if (w->queue == NULL) {
+      errx(1, "out of memory");
+    }
+
+    // Pin before the thread starts so its stack is allocated locally too.
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    if (w->cpu >= 0) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(w->cpu, &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    }
+    if (pthread_create(&w->thread, &attr, worker_main, w) != 0) {
+      errx(1, "cannot start worker threads");
+    }
+    pthread_attr_destroy(&attr);
+  }
+}
+
+// Runs every candidate and returns when all are scored. Each candidate
+// must have its home set.
+static void pool_run(WorkerPool* pool) {
+  Search* s = pool->search;
+  pthread_mutex_lock(&pool->lock);
+  for (int i = 0; i < pool->count; i++) {
+    pool->workers[i].queued = 0;
+    atomic_store_explicit(&pool->workers[i].next, 0, memory_order_relaxed);
+  }
+  for (int i = 0; i < s->candidate_count; i++) {
+    Worker* home = &pool->workers[s->candidates[i].home % pool->count];
+    home->queue[home->queued++] = i;
+  }
+  pool->finished = 0;
+  pool->generation++;
+  pthread_cond_broadcast(&pool->start);
+  while (pool->finished < pool->count) {
+    pthread_cond_wait(&pool->done, &pool->lock);
+  }
+  pthread_mutex_unlock(&pool->lock);
+}
+
+static void pool_stop(WorkerPool* pool) {
+  pthread_mutex_lock(&pool->lock);
+  pool->quit = true;
+  pthread_cond_broadcast(&pool->start);
+  pthread_mutex_unlock(&pool->lock);
+  for (int i = 0; i < pool->count; i++) {
+    pthread_join(pool->workers[i].thread, NULL);
+  }
+}
+
+// Per-node throughput: a node falling behind the others points at remote
+// memory traffic or a busy CPU.
+static void pool_report(const WorkerPool* pool, double elapsed) {
+  for (int node = 0; node < MAX_NODES; node++) {
+    int workers = 0;
+    uint64_t runs = 0;
+    uint64_t stolen = 0;
+    uint64_t frames = 0;
+    char cpus[256] = "";
+    size_t used = 0;
+    for (int i = 0; i < pool->count; i++) {
+      const Worker* w = &pool->workers[i];
+      if (w->node != node) {
+        continue;
+      }
+      workers++;
+      runs += w->runs;
+      stolen += w->stolen;
+      frames += w->frames;
+      if (w->cpu >= 0 && used < sizeof(cpus)) {
+        used += snprintf(cpus + used, sizeof(cpus) - used, "%s%d", used ? "," : "", w->cpu);
+      }
+    }
+    if (workers == 0) {
+      continue;
+    }
+    printf("  node %d: %d workers (cpus %s): %llu runs, %llu stolen, %.0f frames/s\n",
+           node, workers, used ? cpus : "unpinned", (unsigned long long)runs,
+           (unsigned long long)stolen, frames / elapsed);
+  }
+}
+
+static void pool_free(WorkerPool* pool) {
+  for (int i = 0; i < pool->count; i++) {
+    free(pool->workers[i].queue);
+  }
+  free(pool->workers);
+}
+
+// ---------------------------------------------------------------------------
+// Helpers
+// ---------------------------------------------------------------------------
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void parse_actions(Search* s, char* list) {
+  for (char* tok = strtok(list, ","); tok != NULL; tok = strtok(NULL, ",")) {
+    if (s->action_count == MAX_ACTIONS) {
+      errx(1, "at most %d actions", MAX_ACTIONS);
+    }
+    if (!movie_parse_inputs(tok, strlen(tok), &s->actions[s->action_count])) {
+      errx(1, "unknown action '%s'", tok);
+    }
+    s->action_names[s->action_count++] = tok;
+  }
+  if (s->action_count == 0) {
+    errx(1, "no actions given");
+  }
+}
+
+// Coin, then player 1 start, then a short wait for the game to begin.
+static void build_start_sequence(Movie* movie, int start_frame) {
+  int total = start_frame + START_DELAY + COIN_FRAMES + SETTLE_FRAMES;
+  for (int f = 0; f < total; f++) {
+    MovieFrame frame = { 0, 0 };
+    if (f >= start_frame && f < start_frame + COIN_FRAMES) {
+      frame.port1 = 0x01;
+    } else if (f >= start_frame + START_DELAY && f < start_frame + START_DELAY + COIN_FRAMES) {
+      frame.port1 = 0x04;
+    }
+    if (!movie_append(movie, frame)) {
+      errx(1, "out of memory");
+    }
+  }
+}
+
+static uint32_t add_step(Search* s, uint32_t parent, uint16_t action, uint16_t frames) {
+  if (s->step_count == s->step_capacity) {
+    s->step_capacity = s->step_capacity ? s->step_capacity * 2 : 4096;
+    s->steps = realloc(s->steps, s->step_capacity * sizeof(Step));
+    if (s->steps == NULL) {
+      errx(1, "out of memory");
+    }
+  }
+  s->steps[s->step_count] = (Step){ .parent = parent, .action = action, .frames = frames };
+  return s->step_count++;
+}
+
+// Higher score first; equal scores keep their expansion order.
+static int compare_nodes(const void* a, const void* b) {
+  const Node* x = a;
+  const Node* y = b;
+  if (x->score != y->score) {
+    return x->score > y->score ? -1 : 1;
+  }
+  return (x->order > y->order) - (x->order < y->order);
+}
+
+static Machine* power_on(const char* rom_path) {
+  Machine* m = machine_create();
+  if (m == NULL) {
+    errx(1, "out of memory");
+  }
+  if (!machine_load_rom(m, rom_path)) {
+    err(1, "%s", rom_path);
+  }
+  return m;
+}
+
+// Builds the full movie for a branch: prefix, then each step's action.
+static void build_movie(const Search* s, uint32_t last, Movie* movie) {
+  uint32_t count = 0;
+  for (uint32_t i = last; i != NO_STEP; i = s->steps[i].parent) {
+    count++;
+  }
+  uint32_t* path = malloc((count ? count : 1) * sizeof(uint32_t));
+  if (path == NULL) {
+    errx(1, "out of memory");
+  }
+  uint32_t n = count;
+  for (uint32_t i = last; i != NO_STEP; i = s->steps[i].parent) {
+    path[--n] = i;
+  }
+
+  for (uint32_t i = 0; i < s->prefix.count; i++) {
+    movie_append(movie, s->prefix.frames[i]);
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    const Step* step = &s->steps[path[i]];
+    for (int f = 0; f < step->frames; f++) {
+      if (!movie_append(movie, s->actions[step->action])) {
+        errx(1, "out of memory");
+      }
+    }
+  }
+  free(path);
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [--rom FILE] [--score EXPR] [--frames N] [--segment N] [--beam K]\n"
+                  "       [--actions LIST] [--start-frame N | --prefix FILE] [--no-dedupe]\n"
+                  "       [-j N] [--no-pin] [--out FILE]\n", prog);
+}
+
+static void parse_options(SearchOptions* o, int argc, char** argv) {
+  static const struct option long_options[] = {
+    { "rom",         required_argument, NULL, 'r' },
+    { "score",       required_argument, NULL, 's' },
+    { "frames",      required_argument, NULL, 'f' },
+    { "segment",     required_argument, NULL, 'g' },
+    { "beam",        required_argument, NULL, 'b' },
+    { "actions",     required_argument, NULL, 'a' },
+    { "start-frame", required_argument, NULL, 'S' },
+    { "prefix",      required_argument, NULL, 'p' },
+    { "no-dedupe",   no_argument,       NULL, 'D' },
+    { "no-pin",      no_argument,       NULL, 'P' },
+    { "out",         required_argument, NULL, 'o' },
+    { "help",        no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  *o = (SearchOptions){
+    .rom_path = "roms/space_invaders/invaders",
+    .score_text = "bcd[0x20f8]",
+    .actions_text = "none,left,right,fire,left+fire,right+fire",
+    .out_path = "search.mov",
+    .frames = DEFAULT_FRAMES,
+    .segment = DEFAULT_SEGMENT,
+    .beam = DEFAULT_BEAM,
+    .start_frame = DEFAULT_START_FRAME,
+    .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+    .dedupe = true,
+    .pin = true,
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'r': o->rom_path = optarg; break;
+      case 's': o->score_text = optarg; break;
+      case 'f': o->frames = atoi(optarg); break;
+      case 'g': o->segment = atoi(optarg); break;
+      case 'b': o->beam = atoi(optarg); break;
+      case 'a': o->actions_text = optarg; break;
+      case 'S': o->start_frame = atoi(optarg); break;
+      case 'p': o->prefix_path = optarg; break;
+      case 'D': o->dedupe = false; break;
+      case 'P': o->pin = false; break;
+      case 'j': o->threads = atoi(optarg); break;
+      case 'o': o->out_path = optarg; break;
+      default:
+        usage(argv[0]);
+        exit(1);
+    }
+  }
+  if (optind != argc || o->frames < 1 || o->segment < 1 || o->segment > UINT16_MAX ||
+      o->beam < 1 || o->start_frame < 0) {
+    usage(argv[0]);
+    exit(1);
+  }
+  if (o->threads < 1) {
+    o->threads = 1;
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Search
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv) {
+  Search s = { 0 };
+  parse_options(&s.opts, argc, argv);
+
+  char error[128];
+  if (!ramexpr_compile(&s.score, s.opts.score_text, error, sizeof(error))) {
+    errx(1, "--score: %s", error);
+  }
+  char* actions = strdup(s.opts.actions_text);
+  parse_actions(&s, actions);
+
+  if (s.opts.prefix_path != NULL) {
+    if (!movie_load(&s.prefix, s.opts.prefix_path)) {
+      err(1, "%s", s.opts.prefix_path);
+    }
+  } else {
+    build_start_sequence(&s.prefix, s.opts.start_frame);
+  }
+
+  // root: power-on plus the prefix
+  Machine* root = power_on(s.opts.rom_path);
+  for (uint32_t i = 0; i < s.prefix.count; i++) {
+    movie_apply(&root->io, s.prefix.frames[i]);
+    machine_run_frame(root);
+  }
+  if (root->cpu.fault) {
+    errx(1, "the guest stopped at 0x%04x before the search started", root->cpu.pc);
+  }
+
+  int beam_capacity = s.opts.beam;
+  Node* beam = calloc(beam_capacity, sizeof(Node));
+  Node* next = calloc(beam_capacity, sizeof(Node));
+  s.candidates = calloc((size_t)beam_capacity * s.action_count, sizeof(Node));
+  SnapshotId* kept_ids = calloc(beam_capacity, sizeof(SnapshotId));
+  s.fork_locks = calloc(beam_capacity, sizeof(pthread_mutex_t));
+  StateStore* store = s.opts.dedupe ? statestore_create(NULL, 0) : NULL;
+  if (beam == NULL || next == NULL || s.candidates == NULL || kept_ids == NULL ||
+      s.fork_locks == NULL || (s.opts.dedupe && store == NULL)) {
+    errx(1, "out of memory");
+  }
+  for (int b = 0; b < beam_capacity; b++) {
+    pthread_mutex_init(&s.fork_locks[b], NULL);
+  }
+  beam[0] = (Node){ .m = root, .score = score_machine(&s, root), .step = NO_STEP };
+  int beam_count = 1;
+  s.beam = beam;
+
+  WorkerPool pool = { 0 };
+  pool_start(&pool, &s, s.opts.threads, beam_capacity * s.action_count, s.opts.pin);
+
+  printf("Searching %d frames in %d-frame segments: beam %d, %d actions, %d threads\n",
+         s.opts.frames, s.opts.segment, s.opts.beam, s.action_count, s.opts.threads);
+
+  uint64_t nodes = 0;
+  uint64_t frames_run = 0;
+  uint64_t duplicates = 0;
+  double start = now_seconds();
+  for (int done = 0; done < s.opts.frames; done += s.segment_frames) {
+    s.segment_frames = s.opts.segment < s.opts.frames - done ? s.opts.segment : s.opts.frames - done;
+
+    // Expand: the workers fork each child from its parent.
+    s.candidate_count = 0;
+    for (int b = 0; b < beam_count; b++) {
+      for (int a = 0; a < s.action_count; a++) {
+        s.candidates[s.candidate_count] = (Node){
+          .parent = b, .action = a, .order = s.candidate_count, .home = beam[b].home,
+        };
+        s.candidate_count++;
+      }
+    }
+    pool_run(&pool);
+    nodes += s.candidate_count;
+    frames_run += (uint64_t)s.candidate_count * s.segment_frames;
+
+    // Select the best distinct states.
+    qsort(s.candidates, s.candidate_count, sizeof(Node), compare_nodes);
+    int kept = 0;
+    for (int i = 0; i < s.candidate_count; i++) {
+      Node* c = &s.candidates[i];
+      bool keep = kept < s.opts.beam;
+      if (keep && store != NULL) {
+        SnapshotId id = statestore_save(store, c->m);
+        for (int k = 0; k < kept && keep; k++) {
+          keep = id == STATESTORE_NONE || kept_ids[k] != id;
+        }
+        duplicates += !keep;
+        kept_ids[kept] = id;
+      }
+      if (keep) {
+        c->step = add_step(&s, beam[c->parent].step, c->action, s.segment_frames);
+        next[kept++] = *c;
+      } else {
+        machine_destroy(c->m);
+      }
+    }
+    for (int b = 0; b < beam_count; b++) {
+      machine_destroy(beam[b].m);
+    }
+    memcpy(beam, next, kept * sizeof(Node));
+    beam_count = kept;
+  }
+  double elapsed = now_seconds() - start;
+  pool_stop(&pool);
+
+  // beam is sorted, so the first node is the best
+  const Node* best = &beam[0];
+  Movie movie = { 0 };
+  build_movie(&s, best->step, &movie);
+  if (!movie_save(&movie, s.opts.out_path)) {
+    err(1, "%s", s.opts.out_path);
+  }
+
+  if (best->m->cpu.fault) {
+    warnx("every branch stopped (HLT or an unimplemented opcode)");
+  }
+  printf("Best score %lld after %u frames; movie written to %s\n",
+         (long long)best->score, movie.count, s.opts.out_path);
+  printf("%llu nodes in %.2f s: %.0f nodes/s, %.0f frames/s",
+         (unsigned long long)nodes, elapsed, nodes / elapsed, frames_run / elapsed);
+  if (store != NULL) {
+    printf(", %llu duplicate states dropped", (unsigned long long)duplicates);
+  }
+  printf("\n");
+  pool_report(&pool, elapsed);
+  pool_free(&pool);
+
+  // The machine is deterministic, so replaying the movie from power-on
+  // must give the same score.
+  Machine* replay = power_on(s.opts.rom_path);
+  for (uint32_t i = 0; i < movie.count; i++) {
+    movie_apply(&replay->io, movie.frames[i]);
+    machine_run_frame(replay);
+  }
+  int64_t replay_score = score_machine(&s, replay);
+  bool reproduced = replay_score == best->score;
+  printf("Replay score %lld: %s\n", (long long)replay_score, reproduced ? "reproduced" : "MISMATCH");
+
+  machine_destroy(replay);
+  for (int b = 0; b < beam_count; b++) {
+    machine_destroy(beam[b].m);
+  }
+  statestore_destroy(store);
+  movie_free(&movie);
+  movie_free(&s.prefix);
+  free(s.steps);
+  free(s.candidates);
+  for (int b = 0; b < beam_capacity; b++) {
+    pthread_mutex_destroy(&s.fork_locks[b]);
+  }
+  free(s.fork_locks);
+  free(kept_ids);
+  free(beam);
+  free(next);
+  free(actions);
+  return reproduced ? 0 : 1;
+}
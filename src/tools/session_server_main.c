@@ -0,0 +1,804 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <err.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "machine.h"
+#include "movie.h"
+#include "observe.h"
+#include "session_protocol.h"
+#include "statestore.h"
+
+/*
+ * Session Server - many emulator sessions behind one Unix socket
+ *
+ * Keeps a booted machine as a template and serves create/step/read/write/
+ * save/load/destroy requests over the binary protocol in
+ * session_protocol.h, so short jobs skip process startup and ROM loading.
+ * Sessions are copy-on-write forks of the template (or of each other), so
+ * a new one costs a page table and the pages it goes on to dirty.
+ *
+ * Agents that learn from pixels ask for observations instead of raw
+ * frames: the server box-filters a crop of the 1bpp screen down to a small
+ * grayscale image after every step, straight from VRAM, and keeps the last
+ * few stacked per session (src/graphics/observe.c).
+ *
+ * The main thread accepts connections and hands each one to a worker
+ * thread. Every worker runs its own epoll loop and executes requests on the
+ * thread that read them, so a request never waits for a thread handoff;
+ * sessions have their own locks, so any connection can drive any session.
+ *
+ * Usage: ./session_server [options]
+ *   --socket PATH       socket to listen on (default invaders.sock; an
+ *                       existing file at PATH is replaced)
+ *   --rom FILE          ROM image (default roms/space_invaders/invaders)
+ *   --max-sessions N    live sessions allowed at once (default 1024, max 65535)
+ *   -j N                worker threads (default: online CPUs)
+ *
+ * Runs until SIGINT or SIGTERM, then removes the socket.
+ *
+ * Return Values:
+ *   0 - clean shutdown
+ *   1 - bad arguments or startup failure
+ */
+
+#define DEFAULT_MAX_SESSIONS 1024
+#define MAX_MESSAGE          (sizeof(SessionHeader) + SESSION_MAX_PAYLOAD)
+#define IN_BUFFER            (2 * MAX_MESSAGE)
+#define OUT_BUFFER           (4 * MAX_MESSAGE)
+#define MAX_EVENTS           64
+
+typedef struct ServerOptions {
+  const char* socket_path;
+  const char* rom_path;
+  int         max_sessions;
+  int         threads;
+} ServerOptions;
+
+// ---------------------------------------------------------------------------
+// Sessions
+// ---------------------------------------------------------------------------
+
+// A session's observation stack, set up by its first OBSERVE.
+typedef struct Observer {
+  SessionObserve request;     // the crop, size and depth it was set up for
+  ObservePlan    plan;
+  ObserveRing    ring;
+  uint8_t        buffer[];    // the ring's images
+} Observer;
+
+typedef struct Session {
+  pthread_mutex_t lock;       // serializes requests on this session
+  atomic_int      refs;       // the table's reference plus requests in flight
+  Machine*        machine;
+  Observer*       observer;   // NULL until the first OBSERVE
+} Session;
+
+// Session IDs are slot index | generation << 16, so a destroyed session's ID
+// stays invalid after its slot is reused. Generation 0 is never used, so 0
+// is never a valid ID.
+typedef struct SessionTable {
+  pthread_mutex_t lock;
+  Session**       slots;
+  uint16_t*       generation;
+  uint32_t*       free_slots;
+  int             free_count;
+  int             capacity;
+} SessionTable;
+
+static SessionTable table;
+
+// Template every session is forked from; forking writes the parent's page
+// maps, so template forks are serialized.
+static Machine* boot_machine;
+static pthread_mutex_t boot_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Snapshots of all sessions share one store.
+static StateStore* store;
+static pthread_mutex_t store_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool table_init(int capacity) {
+  pthread_mutex_init(&table.lock, NULL);
+  table.slots = calloc(capacity, sizeof(Session*));
+  table.generation = calloc(capacity, sizeof(uint16_t));
+  table.free_slots = malloc(capacity * sizeof(uint32_t));
+  if (table.slots == NULL || table.generation == NULL || table.free_slots == NULL) {
+    return false;
+  }
+  // hand out low slots first
+  for (int i = 0; i < capacity; i++) {
+    table.free_slots[i] = capacity - 1 - i;
+    table.generation[i] = 1;
+  }
+  table.free_count = capacity;
+  table.capacity = capacity;
+  return true;
+}
+
+static void session_release(Session* s) {
+  if (atomic_fetch_sub(&s->refs, 1) == 1) {
+    machine_destroy(s->machine);
+    free(s->observer);
+    pthread_mutex_destroy(&s->lock);
+    free(s);
+  }
+}
+
+// Adds a machine (and its observer, which may be NULL) as a new session.
+// On failure both are freed and the status returned.
+static int table_insert(Machine* m, Observer* o, uint32_t* id) {
+  Session* s = malloc(sizeof(Session));
+  if (s == NULL) {
+    machine_destroy(m);
+    free(o);
+    return SESSION_NO_MEMORY;
+  }
+  pthread_mutex_init(&s->lock, NULL);
+  atomic_init(&s->refs, 1);
+  s->machine = m;
+  s->observer = o;
+
+  pthread_mutex_lock(&table.lock);
+  if (table.free_count == 0) {
+    pthread_mutex_unlock(&table.lock);
+    session_release(s);
+    return SESSION_LIMIT;
+  }
+  uint32_t slot = table.free_slots[--table.free_count];
+  table.slots[slot] = s;
+  *id = slot | (uint32_t)table.generation[slot] << 16;
+  pthread_mutex_unlock(&table.lock);
+  return SESSION_OK;
+}
+
+// Returns the session with a reference taken, or NULL.
+static Session* table_acquire(uint32_t id) {
+  uint32_t slot = id & 0xffff;
+  if (slot >= (uint32_t)table.capacity) {
+    return NULL;
+  }
+  pthread_mutex_lock(&table.lock);
+  Session* s = table.slots[slot];
+  if (s != NULL && table.generation[slot] == id >> 16) {
+    atomic_fetch_add(&s->refs, 1);
+  } else {
+    s = NULL;
+  }
+  pthread_mutex_unlock(&table.lock);
+  return s;
+}
+
+// Unlists a session; it is freed once requests in flight finish.
+static bool table_remove(uint32_t id) {
+  uint32_t slot = id & 0xffff;
+  if (slot >= (uint32_t)table.capacity) {
+    return false;
+  }
+  pthread_mutex_lock(&table.lock);
+  Session* s = table.slots[slot];
+  if (s == NULL || table.generation[slot] != id >> 16) {
+    pthread_mutex_unlock(&table.lock);
+    return false;
+  }
+  table.slots[slot] = NULL;
+  table.generation[slot] = table.generation[slot] == UINT16_MAX ? 1 : table.generation[slot] + 1;
+  table.free_slots[table.free_count++] = slot;
+  pthread_mutex_unlock(&table.lock);
+  session_release(s);
+  return true;
+}
+
+// ---------------------------------------------------------------------------
+// Observations
+// ---------------------------------------------------------------------------
+
+static size_t observer_size(const Observer* o) {
+  return sizeof(Observer) + OBSERVE_RING_BYTES(o->ring.image_bytes, o->ring.depth);
+}
+
+// Plans an observer for req; NULL if the request is invalid, or (with
+// *status set to SESSION_NO_MEMORY) if it cannot be allocated.
+static Observer* observer_create(const SessionObserve* req, int* status) {
+  *status = SESSION_BAD_REQUEST;
+  uint32_t image_bytes = (uint32_t)req->out_width * req->out_height;
+  if (req->depth == 0 || req->depth > OBSERVE_MAX_DEPTH || image_bytes * req->depth > SESSION_MAX_PAYLOAD) {
+    return NULL;
+  }
+  ObservePlan plan;
+  if (!observe_plan(&plan, req->x, req->y, req->width, req->height, req->out_width, req->out_height)) {
+    return NULL;
+  }
+  Observer* o = malloc(sizeof(Observer) + OBSERVE_RING_BYTES(image_bytes, req->depth));
+  if (o == NULL) {
+    *status = SESSION_NO_MEMORY;
+    return NULL;
+  }
+  o->request = *req;
+  o->plan = plan;
+  observe_ring_init(&o->ring, o->buffer, image_bytes, req->depth);
+  return o;
+}
+
+// Adds the machine's current screen to the stack.
+static void observer_push(Observer* o, const Machine* m) {
+  uint8_t vram[SESSION_FRAME_BYTES];
+  machine_read_memory(m, 0x2400, vram, SESSION_FRAME_BYTES);
+  observe_push(&o->ring, &o->plan, vram);
+}
+
+// Starts the stack again from the machine's current screen.
+static void observer_restart(Observer* o, const Machine* m) {
+  o->ring.count = 0;
+  observer_push(o, m);
+}
+
+static Observer* observer_copy(const Observer* o) {
+  Observer* copy = malloc(observer_size(o));
+  if (copy != NULL) {
+    memcpy(copy, o, observer_size(o));
+    copy->ring.buffer = copy->buffer;
+  }
+  return copy;
+}
+
+// ---------------------------------------------------------------------------
+// Connections
+// ---------------------------------------------------------------------------
+
+typedef struct Connection {
+  int                fd;
+  struct Connection* prev;      // worker's connection list
+  struct Connection* next;
+  size_t             in_used;
+  size_t             out_used;
+  size_t             out_sent;
+  bool               writing;   // waiting for EPOLLOUT; reading is paused
+  uint8_t            in[IN_BUFFER];
+  uint8_t            out[OUT_BUFFER];
+} Connection;
+
+typedef struct Worker {
+  pthread_t       thread;
+  int             epoll_fd;
+  int             wake_fd;      // eventfd: shut down
+  pthread_mutex_t lock;         // guards the connection list
+  Connection*     connections;
+  uint64_t        requests;
+} Worker;
+
+static uint8_t* begin_response(Connection* c) {
+  return c->out + c->out_used + sizeof(SessionHeader);
+}
+
+static void end_response(Connection* c, const SessionHeader* req, uint8_t status, uint32_t session,
+                         uint32_t length) {
+  SessionHeader res = {
+    .length = status == SESSION_OK ? length : 0,
+    .op = req->op, .status = status, .session = session, .tag = req->tag,
+  };
+  memcpy(c->out + c->out_used, &res, sizeof(res));
+  c->out_used += sizeof(res) + res.length;
+}
+
+// Looks up and locks the request's session. If there is none, answers
+// the request with SESSION_NO_SESSION and returns NULL.
+static Session* lock_session(Connection* c, const SessionHeader* req) {
+  Session* s = table_acquire(req->session);
+  if (s == NULL) {
+    end_response(c, req, SESSION_NO_SESSION, req->session, 0);
+    return NULL;
+  }
+  pthread_mutex_lock(&s->lock);
+  return s;
+}
+
+static void unlock_session(Session* s) {
+  pthread_mutex_unlock(&s->lock);
+  session_release(s);
+}
+
+static void handle_request(Connection* c, const SessionHeader* req, const uint8_t* payload) {
+  uint8_t* out = begin_response(c);
+  uint32_t id;
+  int status;
+
+  switch (req->op) {
+    case SESSION_OP_CREATE: {
+      pthread_mutex_lock(&boot_lock);
+      Machine* m = machine_fork(boot_machine);
+      pthread_mutex_unlock(&boot_lock);
+      status = m != NULL ? table_insert(m, NULL, &id) : SESSION_NO_MEMORY;
+      end_response(c, req, status, status == SESSION_OK ? id : 0, 0);
+      return;
+    }
+
+    case SESSION_OP_DESTROY:
+      end_response(c, req, table_remove(req->session) ? SESSION_OK : SESSION_NO_SESSION, req->session, 0);
+      return;
+
+    case SESSION_OP_FORK: {
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      Machine* m = machine_fork(s->machine);
+      Observer* o = NULL;
+      if (m != NULL && s->observer != NULL && (o = observer_copy(s->observer)) == NULL) {
+        machine_destroy(m);
+        m = NULL;
+      }
+      unlock_session(s);
+      status = m != NULL ? table_insert(m, o, &id) : SESSION_NO_MEMORY;
+      end_response(c, req, status, status == SESSION_OK ? id : 0, 0);
+      return;
+    }
+
+    case SESSION_OP_STEP: {
+      SessionStep step;
+      if (req->length != sizeof(step)) {
+        break;
+      }
+      memcpy(&step, payload, sizeof(step));
+      if (step.frames == 0 || step.frames > SESSION_MAX_STEP_FRAMES) {
+        break;
+      }
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      Machine* m = s->machine;
+      movie_apply(&m->io, (MovieFrame){ step.port1, step.port2 });
+      uint32_t ran = 0;
+      while (ran < step.frames && !m->cpu.fault) {
+        machine_run_frame(m);
+        ran++;
+      }
+      if (s->observer != NULL && ran > 0) {
+        observer_push(s->observer, m);
+      }
+      SessionStepResult result = { .frame = m->frame, .cycles = m->cycles };
+      status = m->cpu.fault ? SESSION_HALTED : SESSION_OK;
+      unlock_session(s);
+      memcpy(out, &result, sizeof(result));
+      end_response(c, req, status, req->session, sizeof(result));
+      return;
+    }
+
+    case SESSION_OP_READ_RAM: {
+      SessionRange range;
+      if (req->length != sizeof(range)) {
+        break;
+      }
+      memcpy(&range, payload, sizeof(range));
+      uint32_t size = range.size ? range.size : MEMORY_SIZE;
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      machine_read_memory(s->machine, range.address, out, size);
+      unlock_session(s);
+      end_response(c, req, SESSION_OK, req->session, size);
+      return;
+    }
+
+    case SESSION_OP_WRITE_RAM: {
+      uint16_t address;
+      if (req->length < sizeof(address) || req->length > sizeof(address) + MEMORY_SIZE) {
+        break;
+      }
+      memcpy(&address, payload, sizeof(address));
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      machine_write_memory(s->machine, address, payload + sizeof(address), req->length - sizeof(address));
+      unlock_session(s);
+      end_response(c, req, SESSION_OK, req->session, 0);
+      return;
+    }
+
+    case SESSION_OP_READ_FRAME: {
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      machine_read_memory(s->machine, 0x2400, out, SESSION_FRAME_BYTES);
+      unlock_session(s);
+      end_response(c, req, SESSION_OK, req->session, SESSION_FRAME_BYTES);
+      return;
+    }
+
+    case SESSION_OP_SAVE_STATE: {
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      pthread_mutex_lock(&store_lock);
+      SnapshotId snapshot = statestore_save(store, s->machine);
+      pthread_mutex_unlock(&store_lock);
+      unlock_session(s);
+      if (snapshot == STATESTORE_NONE) {
+        end_response(c, req, SESSION_NO_MEMORY, req->session, 0);
+      } else {
+        memcpy(out, &snapshot, sizeof(snapshot));
+        end_response(c, req, SESSION_OK, req->session, sizeof(snapshot));
+      }
+      return;
+    }
+
+    case SESSION_OP_LOAD_STATE: {
+      SnapshotId snapshot;
+      if (req->length != sizeof(snapshot)) {
+        break;
+      }
+      memcpy(&snapshot, payload, sizeof(snapshot));
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      pthread_mutex_lock(&store_lock);
+      bool loaded = statestore_load(store, snapshot, s->machine);
+      pthread_mutex_unlock(&store_lock);
+      if (loaded && s->observer != NULL) {
+        observer_restart(s->observer, s->machine);
+      }
+      unlock_session(s);
+      end_response(c, req, loaded ? SESSION_OK : SESSION_NO_STATE, req->session, 0);
+      return;
+    }
+
+    case SESSION_OP_OBSERVE: {
+      SessionObserve observe;
+      if (req->length != sizeof(observe)) {
+        break;
+      }
+      memcpy(&observe, payload, sizeof(observe));
+      observe.reserved = 0;
+      Session* s = lock_session(c, req);
+      if (s == NULL) {
+        return;
+      }
+      if (s->observer == NULL || memcmp(&s->observer->request, &observe, sizeof(observe)) != 0) {
+        Observer* o = observer_create(&observe, &status);
+        if (o == NULL) {
+          unlock_session(s);
+          end_response(c, req, status, req->session, 0);
+          return;
+        }
+        free(s->observer);
+        s->observer = o;
+        observer_restart(o, s->machine);
+      }
+      const ObserveRing* ring = &s->observer->ring;
+      uint32_t size = ring->image_bytes * ring->depth;
+      memcpy(out, observe_stack(ring), size);
+      unlock_session(s);
+      end_response(c, req, SESSION_OK, req->session, size);
+      return;
+    }
+  }
+  end_response(c, req, SESSION_BAD_REQUEST, req->session, 0);
+}
+
+// Executes every complete request in the input buffer while the output
+// buffer has room for a worst-case response. Returns false if a request is
+// too large to ever fit.
+static bool process_input(Worker* w, Connection* c) {
+  size_t offset = 0;
+  while (c->in_used - offset >= sizeof(SessionHeader) && OUT_BUFFER - c->out_used >= MAX_MESSAGE) {
+    SessionHeader req;
+    memcpy(&req, c->in + offset, sizeof(req));
+    if (req.length > SESSION_MAX_PAYLOAD) {
+      return false;
+    }
+    if (c->in_used - offset < sizeof(req) + req.length) {
+      break;
+    }
+    handle_request(c, &req, c->in + offset + sizeof(req));
+    offset += sizeof(req) + req.length;
+    w->requests++;
+  }
+  memmove(c->in, c->in + offset, c->in_used - offset);
+  c->in_used -= offset;
+  return true;
+}
+
+// Sends buffered responses. Returns false if the peer is gone.
+static bool flush_output(Connection* c) {
+  while (c->out_sent < c->out_used) {
+    ssize_t n = send(c->fd, c->out + c->out_sent, c->out_used - c->out_sent, MSG_NOSIGNAL);
+    if (n < 0) {
+      return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+    c->out_sent += n;
+  }
+  c->out_used = c->out_sent = 0;
+  return true;
+}
+
+static void close_connection(Worker* w, Connection* c) {
+  epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, c->fd, NULL);
+  close(c->fd);
+  pthread_mutex_lock(&w->lock);
+  if (c->prev != NULL) {
+    c->prev->next = c->next;
+  } else {
+    w->connections = c->next;
+  }
+  if (c->next != NULL) {
+    c->next->prev = c->prev;
+  }
+  pthread_mutex_unlock(&w->lock);
+  free(c);
+}
+
+// Reads what is available, answers it, and switches between waiting for
+// input and waiting for the socket to drain. Returns false to close.
+static bool service_connection(Worker* w, Connection* c, uint32_t events) {
+  if (events & (EPOLLERR | EPOLLHUP)) {
+    return false;
+  }
+  if (!c->writing) {
+    ssize_t n = recv(c->fd, c->in + c->in_used, IN_BUFFER - c->in_used, 0);
+    if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+      return false;
+    }
+    if (n > 0) {
+      c->in_used += n;
+    }
+  }
+  // answer, send, and repeat while sending frees room for more answers
+  for (;;) {
+    if (!process_input(w, c) || !flush_output(c)) {
+      return false;
+    }
+    if (c->out_used != 0 || c->in_used < sizeof(SessionHeader)) {
+      break;
+    }
+    SessionHeader next;
+    memcpy(&next, c->in, sizeof(next));
+    if (c->in_used < sizeof(next) + next.length) {
+      break;
+    }
+  }
+
+  bool writing = c->out_used != 0;
+  if (writing != c->writing) {
+    struct epoll_event ev = { .events = writing ? EPOLLOUT : EPOLLIN, .data.ptr = c };
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_MOD, c->fd, &ev);
+    c->writing = writing;
+  }
+  return true;
+}
+
+static void* worker_main(void* arg) {
+  Worker* w = arg;
+  struct epoll_event events[MAX_EVENTS];
+  for (;;) {
+    int n = epoll_wait(w->epoll_fd, events, MAX_EVENTS, -1);
+    if (n < 0 && errno != EINTR) {
+      warn("epoll_wait");
+      return NULL;
+    }
+    for (int i = 0; i < n; i++) {
+      Connection* c = events[i].data.ptr;
+      if (c == NULL) {
+        return NULL;    // wake_fd: shutting down
+      }
+      if (!service_connection(w, c, events[i].events)) {
+        close_connection(w, c);
+      }
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Main
+// ---------------------------------------------------------------------------
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [--socket PATH] [--rom FILE] [--max-sessions N] [-j N]\n", prog);
+}
+
+static void parse_options(ServerOptions* o, int argc, char** argv) {
+  static const struct option long_options[] = {
+    { "socket",       required_argument, NULL, 's' },
+    { "rom",          required_argument, NULL, 'r' },
+    { "max-sessions", required_argument, NULL, 'm' },
+    { "help",         no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  *o = (ServerOptions){
+    .socket_path = "invaders.sock",
+    .rom_path = "roms/space_invaders/invaders",
+    .max_sessions = DEFAULT_MAX_SESSIONS,
+    .threads = (int)sysconf(_SC_NPROCESSORS_ONLN),
+  };
+
+  int opt;
+  while ((opt = getopt_long(argc, argv, "j:h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 's': o->socket_path = optarg; break;
+      case 'r': o->rom_path = optarg; break;
+      case 'm': o->max_sessions = atoi(optarg); break;
+      case 'j': o->threads = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        exit(1);
+    }
+  }
+  if (optind != argc || o->max_sessions < 1 || o->max_sessions > 0xffff) {
+    usage(argv[0]);
+    exit(1);
+  }
+  if (o->threads < 1) {
+    o->threads = 1;
+  }
+}
+
+static int open_listener(const char* path) {
+  struct sockaddr_un addr = { .sun_family = AF_UNIX };
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errx(1, "socket path too long: %s", path);
+  }
+  strcpy(addr.sun_path, path);
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    err(1, "socket");
+  }
+  unlink(path);
+  if (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) < 0 || listen(fd, 128) < 0) {
+    err(1, "%s", path);
+  }
+  return fd;
+}
+
+int main(int argc, char** argv) {
+  ServerOptions opts;
+  parse_options(&opts, argc, argv);
+
+  boot_machine = machine_create();
+  store = statestore_create(NULL, 0);
+  if (boot_machine == NULL || store == NULL || !table_init(opts.max_sessions)) {
+    errx(1, "out of memory");
+  }
+  if (!machine_load_rom(boot_machine, opts.rom_path)) {
+    err(1, "%s", opts.rom_path);
+  }
+
+  // SIGINT/SIGTERM arrive through a signalfd in the accept loop; block them
+  // before starting threads so the workers inherit the mask.
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_sigmask(SIG_BLOCK, &signals, NULL);
+  int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+  int listen_fd = open_listener(opts.socket_path);
+  int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+  if (signal_fd < 0 || epoll_fd < 0) {
+    err(1, "epoll");
+  }
+  struct epoll_event ev = { .events = EPOLLIN, .data.fd = listen_fd };
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listen_fd, &ev);
+  ev.data.fd = signal_fd;
+  epoll_ctl(epoll_fd, EPOLL_CTL_ADD, signal_fd, &ev);
+
+  Worker* workers = calloc(opts.threads, sizeof(Worker));
+  if (workers == NULL) {
+    errx(1, "out of memory");
+  }
+  for (int i = 0; i < opts.threads; i++) {
+    Worker* w = &workers[i];
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    w->wake_fd = eventfd(0, EFD_CLOEXEC);
+    if (w->epoll_fd < 0 || w->wake_fd < 0) {
+      err(1, "epoll");
+    }
+    pthread_mutex_init(&w->lock, NULL);
+    struct epoll_event wake = { .events = EPOLLIN, .data.ptr = NULL };
+    epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, w->wake_fd, &wake);
+    if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+      errx(1, "cannot start worker threads");
+    }
+  }
+
+  printf("Serving %s on %s: %d workers, up to %d sessions\n",
+         opts.rom_path, opts.socket_path, opts.threads, opts.max_sessions);
+  fflush(stdout);
+
+  int next_worker = 0;
+  bool running = true;
+  while (running) {
+    struct epoll_event events[2];
+    int n = epoll_wait(epoll_fd, events, 2, -1);
+    if (n < 0 && errno != EINTR) {
+      err(1, "epoll_wait");
+    }
+    for (int i = 0; i < n; i++) {
+      if (events[i].data.fd == signal_fd) {
+        running = false;
+        continue;
+      }
+      int fd;
+      while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+        Connection* c = malloc(sizeof(Connection));
+        if (c == NULL) {
+          close(fd);
+          continue;
+        }
+        c->fd = fd;
+        c->in_used = c->out_used = c->out_sent = 0;
+        c->writing = false;
+        c->prev = NULL;
+
+        Worker* w = &workers[next_worker];
+        next_worker = (next_worker + 1) % opts.threads;
+        pthread_mutex_lock(&w->lock);
+        c->next = w->connections;
+        if (c->next != NULL) {
+          c->next->prev = c;
+        }
+        w->connections = c;
+        pthread_mutex_unlock(&w->lock);
+
+        struct epoll_event cev = { .events = EPOLLIN, .data.ptr = c };
+        epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, fd, &cev);
+      }
+    }
+  }
+
+  // shut down: stop the workers, then free what they owned
+  uint64_t requests = 0;
+  for (int i = 0; i < opts.threads; i++) {
+    uint64_t one = 1;
+    if (write(workers[i].wake_fd, &one, sizeof(one)) != sizeof(one)) {
+      warn("eventfd");
+    }
+  }
+  for (int i = 0; i < opts.threads; i++) {
+    Worker* w = &workers[i];
+    pthread_join(w->thread, NULL);
+    while (w->connections != NULL) {
+      close_connection(w, w->connections);
+    }
+    close(w->epoll_fd);
+    close(w->wake_fd);
+    requests += w->requests;
+  }
+  int live = 0;
+  for (int i = 0; i < table.capacity; i++) {
+    if (table.slots[i] != NULL) {
+      session_release(table.slots[i]);
+      live++;
+    }
+  }
+  close(listen_fd);
+  unlink(opts.socket_path);
+  printf("Served %llu requests; %d sessions were still open\n", (unsigned long long)requests, live);
+
+  machine_destroy(boot_machine);
+  statestore_destroy(store);
+  free(table.slots);
+  free(table.generation);
+  free(table.free_slots);
+  free(workers);
+  return 0;
+}
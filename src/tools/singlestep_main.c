@@ -0,0 +1,504 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "cpu8080.h"
+#include "pages.h"
+#include "machine_io.h"
+#include "json_stream.h"
+
+/*
+ * Single-Step Test-Vector Runner
+ *
+ * Runs per-opcode JSON test vectors in the style of the public SingleStepTests
+ * suites against Emulate8080Op. Each file is an array of cases:
+ *
+ *   { "name": "...",
+ *     "initial": { "pc": n, "sp": n, "a": n, ... "f": n, "h": n, "l": n,
+ *                  "ram": [[addr, value], ...] },
+ *     "final":   { same layout as initial },
+ *     "cycles":  [ one entry per clock cycle ] }
+ *
+ * Files are streamed with json_stream, so memory use does not depend on file
+ * size. Each file runs in its own child process, up to -j at a time; an
+ * instruction that brings the core down only takes out the file that
+ * exercised it. Unimplemented opcodes set the core's fault flag and fail
+ * their vectors like any other mismatch.
+ *
+ * Opcodes the core is known to get wrong are listed in known_gaps with the
+ * reason. Their failures are printed as expected and do not fail the run;
+ * a listed opcode whose file passes does, so the list cannot go stale.
+ *
+ * Usage: ./singlestep [-j jobs] [-n reports] <file.json | directory>...
+ *
+ * Return Values:
+ *   0 - every vector passed, apart from the known gaps
+ *   1 - a vector failed, a file crashed, a known gap passed, or bad arguments
+ */
+
+#define MAX_RAM_ENTRIES 64       // 8080 instructions touch at most a handful of bytes
+#define DEFAULT_REPORTS 3        // failures printed per file
+
+// Register file and memory contents for one side of a test case.
+typedef struct CaseState {
+  uint16_t pc;
+  uint16_t sp;
+  uint8_t  a, b, c, d, e, f, h, l;
+  int      ram_count;
+  uint16_t ram_addr[MAX_RAM_ENTRIES];
+  uint8_t  ram_value[MAX_RAM_ENTRIES];
+} CaseState;
+
+typedef struct TestCase {
+  char      name[64];
+  CaseState initial;
+  CaseState expected;
+  int       cycles;              // number of entries in "cycles", 0 if absent
+} TestCase;
+
+// Per-file result, kept in memory shared with the child that runs the file.
+typedef struct FileResult {
+  long passed;
+  long failed;
+  bool skipped;
+  bool finished;                 // false if the child died before the end
+} FileResult;
+
+// Opcodes whose behaviour depends on the Space Invaders machine rather than
+// the CPU: IN reads our cabinet ports.
+static bool skip_opcode(int opcode) {
+  return opcode == 0xdb;
+}
+
+// Where the core departs from the Intel manual, by opcode.
+#define GAP_MISSING "not implemented"
+#define GAP_SUB_AC  "AC is the borrow into bit 4, not the carry of the complement add"
+#define GAP_ANI_AC  "AC is cleared instead of set from bit 3 of the operands"
+#define GAP_DAA_AC  "AC is not the carry out of bit 3 of the correction"
+#define GAP_HLT     "pc stays on the HLT so a stopped CPU shows where it stopped"
+
+static const char* const known_gaps[256] = {
+  [0x05] = GAP_SUB_AC,  [0x0d] = GAP_SUB_AC,  [0x15] = GAP_SUB_AC,  [0x17] = GAP_MISSING,
+  [0x1d] = GAP_SUB_AC,  [0x25] = GAP_SUB_AC,  [0x27] = GAP_DAA_AC,  [0x2d] = GAP_MISSING,
+  [0x33] = GAP_MISSING, [0x35] = GAP_SUB_AC,  [0x3b] = GAP_MISSING, [0x3d] = GAP_SUB_AC,
+  [0x43] = GAP_MISSING, [0x52] = GAP_MISSING, [0x53] = GAP_MISSING, [0x55] = GAP_MISSING,
+  [0x58] = GAP_MISSING, [0x5a] = GAP_MISSING, [0x5c] = GAP_MISSING, [0x5d] = GAP_MISSING,
+  [0x6a] = GAP_MISSING, [0x6b] = GAP_MISSING, [0x75] = GAP_MISSING, [0x76] = GAP_HLT,
+  [0x87] = GAP_MISSING, [0x89] = GAP_MISSING, [0x8c] = GAP_MISSING, [0x8d] = GAP_MISSING,
+  [0x8f] = GAP_MISSING, [0x90] = GAP_SUB_AC,  [0x91] = GAP_MISSING, [0x92] = GAP_MISSING,
+  [0x93] = GAP_MISSING, [0x94] = GAP_SUB_AC,  [0x95] = GAP_MISSING, [0x96] = GAP_MISSING,
+  [0x97] = GAP_SUB_AC,  [0x98] = GAP_SUB_AC,  [0x99] = GAP_SUB_AC,  [0x9a] = GAP_SUB_AC,
+  [0x9b] = GAP_SUB_AC,  [0x9c] = GAP_MISSING, [0x9d] = GAP_SUB_AC,  [0x9e] = GAP_SUB_AC,
+  [0x9f] = GAP_MISSING, [0xa1] = GAP_MISSING, [0xa2] = GAP_MISSING, [0xa4] = GAP_MISSING,
+  [0xa5] = GAP_MISSING, [0xa9] = GAP_MISSING, [0xab] = GAP_MISSING, [0xac] = GAP_MISSING,
+  [0xad] = GAP_MISSING, [0xae] = GAP_MISSING, [0xb1] = GAP_MISSING, [0xb2] = GAP_MISSING,
+  [0xb5] = GAP_MISSING, [0xb7] = GAP_MISSING, [0xb8] = GAP_SUB_AC,  [0xb9] = GAP_MISSING,
+  [0xba] = GAP_MISSING, [0xbb] = GAP_SUB_AC,  [0xbc] = GAP_SUB_AC,  [0xbd] = GAP_MISSING,
+  [0xbe] = GAP_SUB_AC,  [0xbf] = GAP_MISSING, [0xc7] = GAP_MISSING, [0xcb] = GAP_MISSING,
+  [0xce] = GAP_MISSING, [0xcf] = GAP_MISSING, [0xd6] = GAP_SUB_AC,  [0xd7] = GAP_MISSING,
+  [0xd9] = GAP_MISSING, [0xdc] = GAP_MISSING, [0xdd] = GAP_MISSING, [0xde] = GAP_SUB_AC,
+  [0xdf] = GAP_MISSING, [0xe4] = GAP_MISSING, [0xe6] = GAP_ANI_AC,  [0xe7] = GAP_MISSING,
+  [0xe8] = GAP_MISSING, [0xea] = GAP_MISSING, [0xed] = GAP_MISSING, [0xef] = GAP_MISSING,
+  [0xf2] = GAP_MISSING, [0xf3] = GAP_MISSING, [0xf4] = GAP_MISSING, [0xf7] = GAP_MISSING,
+  [0xf9] = GAP_MISSING, [0xfd] = GAP_MISSING, [0xfe] = GAP_SUB_AC,
+};
+
+// Returns the recorded gap for an opcode (-1 for a file that names none),
+// or NULL if the core should pass its vectors.
+static const char* known_gap(int opcode) {
+  return opcode >= 0 ? known_gaps[opcode] : NULL;
+}
+
+// ---------------------------------------------------------------------------
+// Parsing
+// ---------------------------------------------------------------------------
+
+static bool parse_state(JsonStream* js, CaseState* cs) {
+  if (json_next(js) != JSON_OBJECT_BEGIN) {
+    return false;
+  }
+  cs->ram_count = 0;
+
+  for (;;) {
+    JsonToken token = json_next(js);
+    if (token == JSON_OBJECT_END) {
+      return true;
+    }
+    if (token != JSON_KEY) {
+      return false;
+    }
+
+    if (strcmp(js->str, "ram") == 0) {
+      if (json_next(js) != JSON_ARRAY_BEGIN) {
+        return false;
+      }
+      while ((token = json_next(js)) == JSON_ARRAY_BEGIN) {
+        if (json_next(js) != JSON_NUMBER) return false;
+        long long addr = js->integer;
+        if (json_next(js) != JSON_NUMBER) return false;
+        long long value = js->integer;
+        if (json_next(js) != JSON_ARRAY_END) return false;
+
+        if (cs->ram_count == MAX_RAM_ENTRIES) {
+          return false;
+        }
+        cs->ram_addr[cs->ram_count] = (uint16_t)addr;
+        cs->ram_value[cs->ram_count] = (uint8_t)value;
+        cs->ram_count++;
+      }
+      if (token != JSON_ARRAY_END) {
+        return false;
+      }
+      continue;
+    }
+
+    // every other member we care about is a plain register number
+    char key[8];
+    snprintf(key, sizeof(key), "%.7s", js->str);
+    token = json_next(js);
+    if (token != JSON_NUMBER) {
+      if (!json_skip(js, token)) return false;
+      continue;
+    }
+    long long v = js->integer;
+    if      (strcmp(key, "pc") == 0) cs->pc = (uint16_t)v;
+    else if (strcmp(key, "sp") == 0) cs->sp = (uint16_t)v;
+    else if (strcmp(key, "a") == 0)  cs->a = (uint8_t)v;
+    else if (strcmp(key, "b") == 0)  cs->b = (uint8_t)v;
+    else if (strcmp(key, "c") == 0)  cs->c = (uint8_t)v;
+    else if (strcmp(key, "d") == 0)  cs->d = (uint8_t)v;
+    else if (strcmp(key, "e") == 0)  cs->e = (uint8_t)v;
+    else if (strcmp(key, "f") == 0)  cs->f = (uint8_t)v;
+    else if (strcmp(key, "h") == 0)  cs->h = (uint8_t)v;
+    else if (strcmp(key, "l") == 0)  cs->l = (uint8_t)v;
+  }
+}
+
+// Reads the next case from the top-level array.
+// Returns 1 on success, 0 at the end of the array, -1 on a parse error.
+static int parse_case(JsonStream* js, TestCase* tc) {
+  JsonToken token = json_next(js);
+  if (token == JSON_ARRAY_END) {
+    return 0;
+  }
+  if (token != JSON_OBJECT_BEGIN) {
+    return -1;
+  }
+
+  memset(tc, 0, sizeof(*tc));
+  for (;;) {
+    token = json_next(js);
+    if (token == JSON_OBJECT_END) {
+      return 1;
+    }
+    if (token != JSON_KEY) {
+      return -1;
+    }
+
+    if (strcmp(js->str, "name") == 0) {
+      if (json_next(js) != JSON_STRING) return -1;
+      snprintf(tc->name, sizeof(tc->name), "%.63s", js->str);
+    } else if (strcmp(js->str, "initial") == 0) {
+      if (!parse_state(js, &tc->initial)) return -1;
+    } else if (strcmp(js->str, "final") == 0) {
+      if (!parse_state(js, &tc->expected)) return -1;
+    } else if (strcmp(js->str, "cycles") == 0) {
+      if (json_next(js) != JSON_ARRAY_BEGIN) return -1;
+      while ((token = json_next(js)) != JSON_ARRAY_END) {
+        if (!json_skip(js, token)) return -1;
+        tc->cycles++;
+      }
+    } else {
+      if (!json_skip(js, json_next(js))) return -1;
+    }
+  }
+}
+
+// ---------------------------------------------------------------------------
+// Execution
+// ---------------------------------------------------------------------------
+
+// Appends one "name: expected X, got Y" line to the report buffer.
+static void report(char* buf, size_t size, const char* what, unsigned expected, unsigned got) {
+  size_t used = strlen(buf);
+  snprintf(buf + used, size - used, "    %-6s expected %04x, got %04x\n", what, expected, got);
+}
+
+// Runs one case. Returns true if the final state matches.
+// On mismatch the differences are written to diff.
+static bool run_case(State8080* state, MachineState* machine, const TestCase* tc,
+                     char* diff, size_t diff_size) {
+  const CaseState* in = &tc->initial;
+  const CaseState* out = &tc->expected;
+
+  state->pc = in->pc;
+  state->sp = in->sp;
+  state->a = in->a; state->b = in->b; state->c = in->c; state->d = in->d;
+  state->e = in->e; state->h = in->h; state->l = in->l;
+  cpu_set_flags_byte(&state->cc, in->f);
+  state->int_enable = 0;
+  machine->port1 = 0x08;
+  machine->port2 = 0x00;
+  for (int i = 0; i < in->ram_count; i++) {
+    state->memory[in->ram_addr[i]] = in->ram_value[i];
+  }
+
+  int cycles = Emulate8080Op(state, machine);
+
+  diff[0] = '\0';
+  if (state->pc != out->pc) report(diff, diff_size, "pc", out->pc, state->pc);
+  if (state->sp != out->sp) report(diff, diff_size, "sp", out->sp, state->sp);
+  if (state->a != out->a) report(diff, diff_size, "a", out->a, state->a);
+  if (state->b != out->b) report(diff, diff_size, "b", out->b, state->b);
+  if (state->c != out->c) report(diff, diff_size, "c", out->c, state->c);
+  if (state->d != out->d) report(diff, diff_size, "d", out->d, state->d);
+  if (state->e != out->e) report(diff, diff_size, "e", out->e, state->e);
+  if (state->h != out->h) report(diff, diff_size, "h", out->h, state->h);
+  if (state->l != out->l) report(diff, diff_size, "l", out->l, state->l);
+  uint8_t f = cpu_flags_byte(&state->cc);
+  if (f != out->f) report(diff, diff_size, "f", out->f, f);
+  for (int i = 0; i < out->ram_count; i++) {
+    uint8_t got = state->memory[out->ram_addr[i]];
+    if (got != out->ram_value[i]) {
+      char what[16];
+      snprintf(what, sizeof(what), "[%04x]", out->ram_addr[i]);
+      report(diff, diff_size, what, out->ram_value[i], got);
+    }
+  }
+  if (tc->cycles != 0 && cycles != tc->cycles) report(diff, diff_size, "cycles", tc->cycles, cycles);
+
+  // Only the listed addresses can have changed; clear them for the next case
+  // instead of wiping all 64KB.
+  for (int i = 0; i < in->ram_count; i++) state->memory[in->ram_addr[i]] = 0;
+  for (int i = 0; i < out->ram_count; i++) state->memory[out->ram_addr[i]] = 0;
+
+  return diff[0] == '\0';
+}
+
+// Runs every case in one file, printing up to max_reports failures.
+// Called in a child process.
+static void run_file(const char* path, int max_reports, FileResult* result) {
+  FILE* fp = fopen(path, "rb");
+  if (fp == NULL) {
+    warn("%s", path);
+    return;
+  }
+
+  State8080* state = calloc(1, sizeof(State8080));
+  MachineState* machine = calloc(1, sizeof(MachineState));
+  JsonStream* js = malloc(sizeof(JsonStream));
+  TestCase* tc = malloc(sizeof(TestCase));
+  if (state == NULL || machine == NULL || js == NULL || tc == NULL ||
+      (state->memory = calloc(MEMORY_SIZE, 1)) == NULL) {
+    errx(1, "out of memory");
+  }
+  pages_map_flat(state, state->memory);
+
+  json_open(js, fp);
+  if (json_next(js) != JSON_ARRAY_BEGIN) {
+    warnx("%s: expected an array of test cases", path);
+    fclose(fp);
+    return;
+  }
+
+  char diff[1024];
+  int status;
+  while ((status = parse_case(js, tc)) == 1) {
+    if (run_case(state, machine, tc, diff, sizeof(diff))) {
+      result->passed++;
+    } else {
+      if (result->failed < max_reports) {
+        printf("%s: FAIL \"%s\"\n%s", path, tc->name, diff);
+        fflush(stdout);
+      }
+      result->failed++;
+    }
+  }
+  if (status < 0) {
+    warnx("%s: parse error %s", path, js->error);
+    result->failed++;
+  }
+
+  fclose(fp);
+  result->finished = true;
+}
+
+// ---------------------------------------------------------------------------
+// Driver
+// ---------------------------------------------------------------------------
+
+// Returns the opcode encoded in a file name such as "3e.json", or -1.
+static int opcode_from_path(const char* path) {
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  if (isxdigit((unsigned char)base[0]) && isxdigit((unsigned char)base[1]) &&
+      !isxdigit((unsigned char)base[2])) {
+    return (int)strtol((char[]){base[0], base[1], '\0'}, NULL, 16);
+  }
+  return -1;
+}
+
+static int has_json_suffix(const struct dirent* entry) {
+  size_t len = strlen(entry->d_name);
+  return len > 5 && strcmp(entry->d_name + len - 5, ".json") == 0;
+}
+
+// Expands the command line into a list of files; directories contribute
+// their *.json entries in sorted order.
+static char** collect_files(int argc, char** argv, int* count) {
+  char** files = NULL;
+  int n = 0;
+
+  for (int i = 0; i < argc; i++) {
+    struct stat st;
+    if (stat(argv[i], &st) != 0) {
+      err(1, "%s", argv[i]);
+    }
+
+    if (!S_ISDIR(st.st_mode)) {
+      files = realloc(files, (n + 1) * sizeof(char*));
+      files[n++] = strdup(argv[i]);
+      continue;
+    }
+
+    struct dirent** entries;
+    int found = scandir(argv[i], &entries, has_json_suffix, alphasort);
+    if (found < 0) {
+      err(1, "%s", argv[i]);
+    }
+    files = realloc(files, (n + found) * sizeof(char*));
+    for (int j = 0; j < found; j++) {
+      size_t len = strlen(argv[i]) + strlen(entries[j]->d_name) + 2;
+      files[n] = malloc(len);
+      snprintf(files[n], len, "%s/%s", argv[i], entries[j]->d_name);
+      n++;
+      free(entries[j]);
+    }
+    free(entries);
+  }
+
+  *count = n;
+  return files;
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [-j jobs] [-n reports] <file.json | directory>...\n", prog);
+  fprintf(stderr, "  -j jobs     files to run in parallel (default: online CPUs)\n");
+  fprintf(stderr, "  -n reports  failing cases to print per file (default: %d)\n", DEFAULT_REPORTS);
+}
+
+int main(int argc, char** argv) {
+  int jobs = (int)sysconf(_SC_NPROCESSORS_ONLN);
+  int max_reports = DEFAULT_REPORTS;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "j:n:h")) != -1) {
+    switch (opt) {
+      case 'j': jobs = atoi(optarg); break;
+      case 'n': max_reports = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return 1;
+    }
+  }
+  if (optind == argc || jobs < 1) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  int file_count;
+  char** files = collect_files(argc - optind, argv + optind, &file_count);
+
+  // results live in a shared mapping so each child can fill in its own slot
+  FileResult* results = mmap(NULL, file_count * sizeof(FileResult) + 1,
+                             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) {
+    err(1, "mmap");
+  }
+  memset(results, 0, file_count * sizeof(FileResult));
+
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  int running = 0;
+  for (int i = 0; i < file_count || running > 0; ) {
+    if (i < file_count && running < jobs) {
+      if (skip_opcode(opcode_from_path(files[i]))) {
+        results[i].skipped = true;
+        i++;
+        continue;
+      }
+
+      fflush(stdout);
+      pid_t pid = fork();
+      if (pid < 0) {
+        err(1, "fork");
+      }
+      if (pid == 0) {
+        // the summary gives the reason for a known gap; its cases are not news
+        int reports = known_gap(opcode_from_path(files[i])) != NULL ? 0 : max_reports;
+        run_file(files[i], reports, &results[i]);
+        fflush(stdout);
+        _exit(0);
+      }
+      running++;
+      i++;
+      continue;
+    }
+
+    if (wait(NULL) > 0) {
+      running--;
+    }
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+  // summary
+  long passed = 0, failed = 0, expected = 0;
+  int crashed = 0, skipped = 0, gaps = 0, stale = 0;
+  for (int i = 0; i < file_count; i++) {
+    FileResult* r = &results[i];
+    const char* gap = known_gap(opcode_from_path(files[i]));
+    if (r->skipped) {
+      printf("%-40s skipped (machine-specific opcode)\n", files[i]);
+      skipped++;
+    } else if (!r->finished) {
+      printf("%-40s CRASHED after %ld passed\n", files[i], r->passed);
+      crashed++;
+    } else if (gap != NULL && r->failed > 0) {
+      printf("%-40s %ld passed, %ld failed: known gap, %s\n", files[i], r->passed, r->failed, gap);
+      expected += r->failed;
+      gaps++;
+    } else if (gap != NULL) {
+      printf("%-40s PASSED but is listed as a known gap (%s)\n", files[i], gap);
+      stale++;
+    } else if (r->failed > 0) {
+      printf("%-40s %ld passed, %ld failed\n", files[i], r->passed, r->failed);
+    }
+    passed += r->passed;
+    failed += r->failed;
+  }
+
+  printf("\n%d files (%d skipped, %d crashed, %d known gaps): %ld passed, %ld failed "
+         "(%ld expected) in %.2f s (%.0f vectors/s)\n",
+         file_count, skipped, crashed, gaps, passed, failed, expected, seconds,
+         seconds > 0 ? (passed + failed) / seconds : 0.0);
+
+  for (int i = 0; i < file_count; i++) {
+    free(files[i]);
+  }
+  free(files);
+
+  return (failed == expected && crashed == 0 && stale == 0) ? 0 : 1;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "trace.h"
+
+/*
+ * Trace Diff - find the first divergence between two execution traces
+ *
+ * Maps two binary traces written with --trace and compares their 16-byte
+ * records, four at a time with SSE2 where available. Reports the first
+ * record that differs, which fields differ, and the instructions leading
+ * up to it from both traces.
+ *
+ * Usage: ./tracediff [-c context] <trace_a> <trace_b>
+ *
+ * Return Values:
+ *   0 - traces are identical
+ *   1 - traces diverge (or one is a prefix of the other)
+ *   2 - bad arguments or unreadable / invalid trace file
+ */
+
+#define DEFAULT_CONTEXT 8   // instructions shown before the divergence
+
+typedef struct MappedTrace {
+  const char*        path;
+  void*              base;
+  size_t             size;
+  const TraceRecord* records;
+  uint64_t           count;
+} MappedTrace;
+
+static bool map_trace(MappedTrace* t, const char* path) {
+  t->path = path;
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    warn("%s", path);
+    return false;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(TraceHeader)) {
+    warnx("%s: not a trace file", path);
+    close(fd);
+    return false;
+  }
+  t->size = st.st_size;
+  t->base = mmap(NULL, t->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (t->base == MAP_FAILED) {
+    warn("%s: mmap", path);
+    return false;
+  }
+  madvise(t->base, t->size, MADV_SEQUENTIAL);
+
+  if (!trace_header_valid(t->base)) {
+    warnx("%s: bad trace header", path);
+    return false;
+  }
+  if (((const TraceHeader*)t->base)->version != TRACE_VERSION) {
+    warnx("%s: compressed trace; re-record without --trace-compress", path);
+    return false;
+  }
+  t->records = (const TraceRecord*)((const char*)t->base + sizeof(TraceHeader));
+  t->count = (t->size - sizeof(TraceHeader)) / sizeof(TraceRecord);
+  return true;
+}
+
+// Returns the index of the first record that differs, or count if the
+// first count records are identical.
+static uint64_t first_difference(const TraceRecord* a, const TraceRecord* b, uint64_t count) {
+  uint64_t i = 0;
+
+#ifdef __SSE2__
+  // 4 records (64 bytes) per iteration; records are 16 bytes, so each one
+  // is exactly one 128-bit lane
+  const __m128i* va = (const __m128i*)a;
+  const __m128i* vb = (const __m128i*)b;
+  for (; i + 4 <= count; i += 4) {
+    __m128i e0 = _mm_cmpeq_epi8(_mm_loadu_si128(va + i),     _mm_loadu_si128(vb + i));
+    __m128i e1 = _mm_cmpeq_epi8(_mm_loadu_si128(va + i + 1), _mm_loadu_si128(vb + i + 1));
+    __m128i e2 = _mm_cmpeq_epi8(_mm_loadu_si128(va + i + 2), _mm_loadu_si128(vb + i + 2));
+    __m128i e3 = _mm_cmpeq_epi8(_mm_loadu_si128(va + i + 3), _mm_loadu_si128(vb + i + 3));
+    __m128i all = _mm_and_si128(_mm_and_si128(e0, e1), _mm_and_si128(e2, e3));
+    if (_mm_movemask_epi8(all) != 0xffff) {
+      break;  // one of these four differs; find which below
+    }
+  }
+#endif
+
+  for (; i < count; i++) {
+    if (memcmp(&a[i], &b[i], sizeof(TraceRecord)) != 0) {
+      return i;
+    }
+  }
+  return count;
+}
+
+// Lists the fields that differ between two records.
+static void print_field_differences(const TraceRecord* a, const TraceRecord* b) {
+  struct { const char* name; unsigned x, y; } fields[] = {
+    { "PC", a->pc, b->pc }, { "SP", a->sp, b->sp },
+    { "A", a->a, b->a }, { "F", a->f, b->f },
+    { "B", a->b, b->b }, { "C", a->c, b->c }, { "D", a->d, b->d },
+    { "E", a->e, b->e }, { "H", a->h, b->h }, { "L", a->l, b->l },
+    { "opcode", a->opcode[0], b->opcode[0] },
+    { "operand1", a->opcode[1], b->opcode[1] },
+    { "operand2", a->opcode[2], b->opcode[2] },
+    { "INTE", a->int_enable, b->int_enable },
+  };
+
+  printf("Differing fields:\n");
+  for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+    if (fields[i].x != fields[i].y) {
+      printf("  %-9s %04x vs %04x\n", fields[i].name, fields[i].x, fields[i].y);
+    }
+  }
+}
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [-c context] <trace_a> <trace_b>\n", prog);
+}
+
+int main(int argc, char** argv) {
+  int context = DEFAULT_CONTEXT;
+  int opt;
+  while ((opt = getopt(argc, argv, "c:h")) != -1) {
+    switch (opt) {
+      case 'c': context = atoi(optarg); break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (argc - optind != 2 || context < 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  MappedTrace a, b;
+  if (!map_trace(&a, argv[optind]) || !map_trace(&b, argv[optind + 1])) {
+    return 2;
+  }
+
+  uint64_t common = a.count < b.count ? a.count : b.count;
+  uint64_t index = first_difference(a.records, b.records, common);
+
+  if (index == common) {
+    if (a.count == b.count) {
+      printf("Traces are identical (%llu instructions)\n", (unsigned long long)common);
+      return 0;
+    }
+    const MappedTrace* longer = a.count > b.count ? &a : &b;
+    printf("Traces agree for %llu instructions; %s continues for %llu more\n",
+           (unsigned long long)common, longer->path, (unsigned long long)(longer->count - common));
+    return 1;
+  }
+
+  printf("First divergence at instruction %llu\n\n", (unsigned long long)index);
+
+  // shared history before the divergence (identical in both traces)
+  uint64_t start = index > (uint64_t)context ? index - context : 0;
+  if (start < index) {
+    printf("Common history:\n");
+    for (uint64_t i = start; i < index; i++) {
+      printf("  ");
+      trace_print_record(stdout, i, &a.records[i]);
+    }
+    printf("\n");
+  }
+
+  printf("%s:\n  ", a.path);
+  trace_print_record(stdout, index, &a.records[index]);
+  if (index + 1 < a.count) {
+    printf("  ");
+    trace_print_record(stdout, index + 1, &a.records[index + 1]);
+  }
+  printf("%s:\n  ", b.path);
+  trace_print_record(stdout, index, &b.records[index]);
+  if (index + 1 < b.count) {
+    printf("  ");
+    trace_print_record(stdout, index + 1, &b.records[index + 1]);
+  }
+  printf("\n");
+
+  // the state differs, so the previous instruction computed it differently
+  if (index > 0) {
+    printf("Instruction that produced the divergent state:\n  ");
+    trace_print_record(stdout, index - 1, &a.records[index - 1]);
+  }
+  print_field_differences(&a.records[index], &b.records[index]);
+
+  munmap(a.base, a.size);
+  munmap(b.base, b.size);
+  return 1;
+}
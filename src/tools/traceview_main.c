@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <getopt.h>
+
+#include "trace.h"
+
+/*
+ * Trace View - print part of an execution trace without reading all of it
+ *
+ * Uses the block index written next to every trace (<trace>.idx) to seek
+ * straight to a frame, cycle or record number and decodes only the blocks
+ * it prints. Works on raw and --trace-compress traces.
+ *
+ * Usage: ./traceview [--frame N | --cycle N | --record N] [--count K] <trace>
+ *        ./traceview --info <trace>
+ *
+ * Return Values:
+ *   0 - records printed
+ *   1 - the requested position is not in the trace
+ *   2 - bad arguments or unreadable / invalid trace file
+ */
+
+#define DEFAULT_COUNT 20   // records printed when --count is not given
+
+typedef enum { SEEK_RECORD, SEEK_CYCLE, SEEK_FRAME } SeekMode;
+
+static void usage(const char* prog) {
+  fprintf(stderr, "Usage: %s [options] <trace>\n", prog);
+  fprintf(stderr, "  --frame N    start at the first instruction of frame N\n");
+  fprintf(stderr, "  --cycle N    start at the instruction executing at cycle N\n");
+  fprintf(stderr, "  --record N   start at record N (default 0)\n");
+  fprintf(stderr, "  --count K    print K records (default %d)\n", DEFAULT_COUNT);
+  fprintf(stderr, "  --info       print trace summary and exit\n");
+}
+
+static void print_info(const TraceReader* tr, const char* path) {
+  uint64_t stored = 0;
+  for (uint64_t i = 0; i < tr->blocks; i++) {
+    stored += tr->index[i].stored_size;
+  }
+  printf("%s\n", path);
+  printf("  format:   %s\n", tr->header.version == TRACE_VERSION_LZ4 ? "lz4 blocks" : "raw");
+  printf("  records:  %llu in %llu blocks\n",
+         (unsigned long long)tr->records, (unsigned long long)tr->blocks);
+  if (tr->blocks > 0) {
+    const TraceIndexEntry* first = &tr->index[0];
+    const TraceIndexEntry* last = &tr->index[tr->blocks - 1];
+    printf("  frames:   %llu - %llu\n",
+           (unsigned long long)first->frame, (unsigned long long)last->frame);
+    printf("  cycles:   %llu - %llu+\n",
+           (unsigned long long)first->cycle, (unsigned long long)last->cycle);
+  }
+  uint64_t raw = tr->records * sizeof(TraceRecord);
+  printf("  stored:   %llu bytes (%.1f%% of %llu raw)\n", (unsigned long long)stored,
+         raw ? 100.0 * stored / raw : 0.0, (unsigned long long)raw);
+}
+
+// Finds the record within a block executing at the given cycle, using the
+// per-record instruction timing. Returns the last record if cycle lies past
+// the block (the next block then starts after it).
+static uint32_t record_at_cycle(const TraceIndexEntry* e, const TraceRecord* records,
+                                uint64_t cycle) {
+  uint64_t at = e->cycle;
+  for (uint32_t i = 0; i + 1 < e->records; i++) {
+    at += trace_record_cycles(&records[i], &records[i + 1]);
+    if (at > cycle) {
+      return i;
+    }
+  }
+  return e->records - 1;
+}
+
+int main(int argc, char** argv) {
+  static const struct option long_options[] = {
+    { "frame",  required_argument, NULL, 'f' },
+    { "cycle",  required_argument, NULL, 'y' },
+    { "record", required_argument, NULL, 'r' },
+    { "count",  required_argument, NULL, 'n' },
+    { "info",   no_argument,       NULL, 'i' },
+    { "help",   no_argument,       NULL, 'h' },
+    { NULL, 0, NULL, 0 }
+  };
+
+  SeekMode mode = SEEK_RECORD;
+  uint64_t position = 0;
+  long long count = DEFAULT_COUNT;
+  bool info = false;
+  int opt;
+  while ((opt = getopt_long(argc, argv, "h", long_options, NULL)) != -1) {
+    switch (opt) {
+      case 'f': mode = SEEK_FRAME;  position = strtoull(optarg, NULL, 0); break;
+      case 'y': mode = SEEK_CYCLE;  position = strtoull(optarg, NULL, 0); break;
+      case 'r': mode = SEEK_RECORD; position = strtoull(optarg, NULL, 0); break;
+      case 'n': count = atoll(optarg); break;
+      case 'i': info = true; break;
+      default:
+        usage(argv[0]);
+        return 2;
+    }
+  }
+  if (argc - optind != 1 || count < 0) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  const char* path = argv[optind];
+  TraceReader* tr = trace_reader_open(path);
+  if (tr == NULL) {
+    return 2;
+  }
+  if (info) {
+    print_info(tr, path);
+    trace_reader_close(tr);
+    return 0;
+  }
+
+  int64_t block;
+  switch (mode) {
+    case SEEK_FRAME:  block = trace_reader_find_frame(tr, position); break;
+    case SEEK_CYCLE:  block = trace_reader_find_cycle(tr, position); break;
+    default:          block = trace_reader_find_record(tr, position); break;
+  }
+  if (block < 0) {
+    fprintf(stderr, "%s: position %llu is not in the trace\n", path, (unsigned long long)position);
+    trace_reader_close(tr);
+    return 1;
+  }
+
+  const TraceRecord* records = trace_reader_block(tr, block);
+  if (records == NULL) {
+    fprintf(stderr, "%s: block %lld is unreadable\n", path, (long long)block);
+    trace_reader_close(tr);
+    return 2;
+  }
+
+  const TraceIndexEntry* e = &tr->index[block];
+  uint32_t i = 0;
+  if (mode == SEEK_RECORD) {
+    i = (uint32_t)(position - e->first_record);
+  } else if (mode == SEEK_CYCLE) {
+    i = record_at_cycle(e, records, position);
+  }
+
+  int status = 0;
+  printf("frame %llu, block %lld (cycle %llu)\n", (unsigned long long)e->frame,
+         (long long)block, (unsigned long long)e->cycle);
+  while (count-- > 0) {
+    if (i == e->records) {
+      if ((uint64_t)++block >= tr->blocks) {
+        break;
+      }
+      records = trace_reader_block(tr, block);
+      if (records == NULL) {
+        fprintf(stderr, "%s: block %lld is unreadable\n", path, (long long)block);
+        status = 2;
+        break;
+      }
+      e = &tr->index[block];
+      i = 0;
+      printf("frame %llu, block %lld (cycle %llu)\n", (unsigned long long)e->frame,
+             (long long)block, (unsigned long long)e->cycle);
+    }
+    trace_print_record(stdout, e->first_record + i, &records[i]);
+    i++;
+  }
+
+  trace_reader_close(tr);
+  return status;
+}
@@ -0,0 +1,17 @@
+// In src/util/crc32.h
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// CRC-32 as used by zlib, PNG and Ethernet. Chain calls by passing the
+// previous result; start from 0.
+uint32_t crc32_update(uint32_t crc, const void* data, size_t size);
+
+static inline uint32_t crc32(const void* data, size_t size) {
+    return crc32_update(0, data, size);
+}
+
+#endif // CRC32_H
@@ -0,0 +1,206 @@
+// In src/util/json_stream.c
+
+#include <stdlib.h>
+#include <string.h>
+#include "json_stream.h"
+
+void json_open(JsonStream* js, FILE* fp) {
+    js->fp = fp;
+    js->pos = 0;
+    js->len = 0;
+    js->depth = 0;
+    js->expect_key = false;
+    js->line = 1;
+    js->str[0] = '\0';
+    js->number = 0;
+    js->integer = 0;
+    js->error[0] = '\0';
+}
+
+// Returns the next byte without consuming it, refilling the buffer as needed.
+static int peek_byte(JsonStream* js) {
+    if (js->pos == js->len) {
+        js->len = fread(js->buf, 1, sizeof(js->buf), js->fp);
+        js->pos = 0;
+        if (js->len == 0) {
+            return EOF;
+        }
+    }
+    return (unsigned char)js->buf[js->pos];
+}
+
+static int next_byte(JsonStream* js) {
+    int ch = peek_byte(js);
+    if (ch != EOF) {
+        js->pos++;
+    }
+    return ch;
+}
+
+static JsonToken fail(JsonStream* js, const char* message) {
+    snprintf(js->error, sizeof(js->error), "line %ld: %s", js->line, message);
+    return JSON_ERROR;
+}
+
+// After a complete value, a string inside an object is a key again.
+static JsonToken value_done(JsonStream* js, JsonToken token) {
+    js->expect_key = (js->depth > 0 && js->stack[js->depth - 1] == '{');
+    return token;
+}
+
+static JsonToken read_string(JsonStream* js) {
+    size_t n = 0;
+    for (;;) {
+        int ch = next_byte(js);
+        if (ch == EOF) {
+            return fail(js, "unterminated string");
+        }
+        if (ch == '"') {
+            break;
+        }
+        if (ch == '\\') {
+            ch = next_byte(js);
+            switch (ch) {
+                case 'n': ch = '\n'; break;
+                case 't': ch = '\t'; break;
+                case 'r': ch = '\r'; break;
+                case 'b': ch = '\b'; break;
+                case 'f': ch = '\f'; break;
+                case 'u':
+                    // Non-ASCII escapes are not needed by any of our inputs.
+                    for (int i = 0; i < 4; i++) {
+                        next_byte(js);
+                    }
+                    ch = '?';
+                    break;
+                case EOF:
+                    return fail(js, "unterminated escape");
+                default:
+                    break;  // \" \\ \/ map to themselves
+            }
+        }
+        if (n + 1 < sizeof(js->str)) {
+            js->str[n++] = (char)ch;
+        }
+    }
+    js->str[n] = '\0';
+
+    if (js->expect_key) {
+        js->expect_key = false;
+        return JSON_KEY;
+    }
+    return value_done(js, JSON_STRING);
+}
+
+static JsonToken read_number(JsonStream* js, int first) {
+    char text[64];
+    size_t n = 0;
+    bool integral = true;
+    int ch = first;
+
+    for (;;) {
+        if (n + 1 < sizeof(text)) {
+            text[n++] = (char)ch;
+        }
+        ch = peek_byte(js);
+        if ((ch >= '0' && ch <= '9') || ch == '-' || ch == '+') {
+            next_byte(js);
+        } else if (ch == '.' || ch == 'e' || ch == 'E') {
+            integral = false;
+            next_byte(js);
+        } else {
+            break;
+        }
+    }
+    text[n] = '\0';
+
+    // Test vectors are almost entirely small integers; avoid strtod for those.
+    if (integral) {
+        js->integer = strtoll(text, NULL, 10);
+        js->number = (double)js->integer;
+    } else {
+        js->number = strtod(text, NULL);
+        js->integer = (long long)js->number;
+    }
+    return value_done(js, JSON_NUMBER);
+}
+
+static JsonToken read_literal(JsonStream* js, const char* rest, JsonToken token) {
+    for (const char* p = rest; *p; p++) {
+        if (next_byte(js) != *p) {
+            return fail(js, "invalid literal");
+        }
+    }
+    return value_done(js, token);
+}
+
+JsonToken json_next(JsonStream* js) {
+    int ch;
+
+    // skip whitespace and separators
+    for (;;) {
+        ch = next_byte(js);
+        if (ch == '\n') {
+            js->line++;
+        } else if (ch != ' ' && ch != '\t' && ch != '\r' && ch != ',' && ch != ':') {
+            break;
+        }
+    }
+
+    switch (ch) {
+        case EOF:
+            return js->depth == 0 ? JSON_EOF : fail(js, "unexpected end of file");
+
+        case '{':
+        case '[':
+            if (js->depth == JSON_MAX_DEPTH) {
+                return fail(js, "nesting too deep");
+            }
+            js->stack[js->depth++] = (char)ch;
+            js->expect_key = (ch == '{');
+            return ch == '{' ? JSON_OBJECT_BEGIN : JSON_ARRAY_BEGIN;
+
+        case '}':
+        case ']':
+            if (js->depth == 0 || js->stack[js->depth - 1] != (ch == '}' ? '{' : '[')) {
+                return fail(js, "mismatched bracket");
+            }
+            js->depth--;
+            return value_done(js, ch == '}' ? JSON_OBJECT_END : JSON_ARRAY_END);
+
+        case '"':
+            return read_string(js);
+
+        case 't':
+            return read_literal(js, "rue", JSON_TRUE);
+        case 'f':
+            return read_literal(js, "alse", JSON_FALSE);
+        case 'n':
+            return read_literal(js, "ull", JSON_NULL);
+
+        default:
+            if ((ch >= '0' && ch <= '9') || ch == '-') {
+                return read_number(js, ch);
+            }
+            return fail(js, "unexpected character");
+    }
+}
+
+bool json_skip(JsonStream* js, JsonToken first) {
+    if (first == JSON_ERROR || first == JSON_EOF) {
+        return false;
+    }
+    if (first != JSON_OBJECT_BEGIN && first != JSON_ARRAY_BEGIN) {
+        return true;
+    }
+
+    // consume tokens until the container that was just opened is closed
+    int target = js->depth - 1;
+    while (js->depth > target) {
+        JsonToken token = json_next(js);
+        if (token == JSON_ERROR || token == JSON_EOF) {
+            return false;
+        }
+    }
+    return true;
+}
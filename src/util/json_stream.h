@@ -0,0 +1,58 @@
+// In src/util/json_stream.h
+
+#ifndef JSON_STREAM_H
+#define JSON_STREAM_H
+
+#include <stdio.h>
+#include <stdbool.h>
+
+// Pull-style JSON tokenizer. Reads the file through a fixed buffer and hands
+// back one token at a time, so arbitrarily large files (e.g. test-vector
+// suites) can be processed without building a document tree in memory.
+// Commas and colons are consumed internally.
+
+#define JSON_MAX_DEPTH  64
+#define JSON_MAX_STRING 256   // longer strings are truncated
+#define JSON_BUFFER_SIZE (1 << 16)
+
+typedef enum {
+    JSON_ERROR = -1,
+    JSON_EOF = 0,
+    JSON_OBJECT_BEGIN,
+    JSON_OBJECT_END,
+    JSON_ARRAY_BEGIN,
+    JSON_ARRAY_END,
+    JSON_KEY,       // object member name, text in js->str
+    JSON_STRING,    // text in js->str
+    JSON_NUMBER,    // value in js->number (and js->integer when integral)
+    JSON_TRUE,
+    JSON_FALSE,
+    JSON_NULL
+} JsonToken;
+
+typedef struct JsonStream {
+    FILE*  fp;
+    size_t pos;                       // read position in buf
+    size_t len;                       // bytes currently in buf
+    int    depth;                     // nesting level
+    char   stack[JSON_MAX_DEPTH];     // '{' or '[' for each open container
+    bool   expect_key;                // next string inside an object is a key
+    long   line;                      // current line, for error messages
+    char   str[JSON_MAX_STRING];      // last key or string value
+    double number;                    // last number value
+    long long integer;                // last number value, truncated
+    char   error[128];                // set when JSON_ERROR is returned
+    char   buf[JSON_BUFFER_SIZE];
+} JsonStream;
+
+// Prepares a stream for reading from an already opened file.
+void json_open(JsonStream* js, FILE* fp);
+
+// Returns the next token in the stream.
+JsonToken json_next(JsonStream* js);
+
+// Skips the rest of a value whose first token has already been read.
+// Returns false on a syntax error or premature end of file.
+bool json_skip(JsonStream* js, JsonToken first);
+
+#endif // JSON_STREAM_H
@@ -0,0 +1,200 @@
+// In src/util/log.c
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+
+#include "log.h"
+
+#define RING_MASK      (LOG_RING_SLOTS - 1)
+#define REFILL_NS      (1000000000 / LOG_SITE_RATE)
+#define IDLE_SLEEP_NS  2000000      // writer poll interval when the ring is empty
+
+_Static_assert((LOG_RING_SLOTS & RING_MASK) == 0, "LOG_RING_SLOTS must be a power of two");
+
+// Bounded multi-producer ring (Vyukov): a slot is free for position p when
+// its sequence is p and holds a message for the reader when it is p + 1.
+typedef struct LogSlot {
+    _Atomic size_t sequence;
+    char           text[LOG_MESSAGE_BYTES];
+} LogSlot;
+
+static LogSlot         ring[LOG_RING_SLOTS];
+static _Atomic size_t  ring_head;            // next position to claim
+static size_t          ring_tail;            // next position to read (writer thread only)
+static _Atomic uint64_t lost;
+
+static pthread_t       writer;
+static _Atomic bool    running;
+static _Atomic bool    stopping;
+static FILE*           output;
+
+_Atomic int log_level = LOG_WARN;
+
+static const char* const level_names[] = { "error", "warn", "info", "debug" };
+
+static int64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+bool log_parse_level(const char* name, LogLevel* level) {
+    for (int i = 0; i <= LOG_DEBUG; i++) {
+        if (strcmp(name, level_names[i]) == 0) {
+            *level = (LogLevel)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+void log_set_level(LogLevel level) {
+    atomic_store_explicit(&log_level, (int)level, memory_order_relaxed);
+}
+
+uint64_t log_lost(void) {
+    return atomic_load_explicit(&lost, memory_order_relaxed);
+}
+
+// Takes a token from the site's bucket, topping it up first.
+static bool site_allow(LogSite* site) {
+    int64_t now = now_ns();
+    int64_t last = atomic_load_explicit(&site->refill_ns, memory_order_relaxed);
+    if ((last == 0 || now - last >= REFILL_NS) &&
+        atomic_compare_exchange_strong_explicit(&site->refill_ns, &last, now,
+                                                memory_order_relaxed, memory_order_relaxed)) {
+        int64_t add = last == 0 ? 0 : (now - last) / REFILL_NS;
+        int32_t tokens = atomic_load_explicit(&site->tokens, memory_order_relaxed);
+        int32_t topped;
+        do {
+            topped = tokens + add > LOG_SITE_BURST ? LOG_SITE_BURST : (int32_t)(tokens + add);
+        } while (!atomic_compare_exchange_weak_explicit(&site->tokens, &tokens, topped,
+                                                        memory_order_relaxed, memory_order_relaxed));
+    }
+
+    int32_t tokens = atomic_load_explicit(&site->tokens, memory_order_relaxed);
+    while (tokens > 0) {
+        if (atomic_compare_exchange_weak_explicit(&site->tokens, &tokens, tokens - 1,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static void format_message(char* text, LogLevel level, uint32_t suppressed,
+                           const char* format, va_list args) {
+    int n = snprintf(text, LOG_MESSAGE_BYTES, "%s: ", level_names[level]);
+    n += vsnprintf(text + n, LOG_MESSAGE_BYTES - n, format, args);
+    if (suppressed != 0 && n < LOG_MESSAGE_BYTES) {
+        snprintf(text + n, LOG_MESSAGE_BYTES - n, " (%u similar messages suppressed)", suppressed);
+    }
+}
+
+void log_write(LogSite* site, LogLevel level, const char* format, ...) {
+    if (!site_allow(site)) {
+        atomic_fetch_add_explicit(&site->suppressed, 1, memory_order_relaxed);
+        return;
+    }
+    uint32_t suppressed = atomic_exchange_explicit(&site->suppressed, 0, memory_order_relaxed);
+
+    va_list args;
+    va_start(args, format);
+    if (!atomic_load_explicit(&running, memory_order_acquire)) {
+        char text[LOG_MESSAGE_BYTES];
+        format_message(text, level, suppressed, format, args);
+        va_end(args);
+        fprintf(stderr, "%s\n", text);
+        return;
+    }
+
+    // Claim a slot, or give up if the writer is a full ring behind.
+    size_t pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+    LogSlot* slot;
+    for (;;) {
+        slot = &ring[pos & RING_MASK];
+        size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+        if (diff == 0) {
+            if (atomic_compare_exchange_weak_explicit(&ring_head, &pos, pos + 1,
+                                                      memory_order_relaxed, memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            va_end(args);
+            atomic_fetch_add_explicit(&lost, 1, memory_order_relaxed);
+            return;
+        } else {
+            pos = atomic_load_explicit(&ring_head, memory_order_relaxed);
+        }
+    }
+    format_message(slot->text, level, suppressed, format, args);
+    va_end(args);
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+}
+
+// Writes every message that is ready. Returns how many there were.
+static int drain(void) {
+    int count = 0;
+    for (;;) {
+        LogSlot* slot = &ring[ring_tail & RING_MASK];
+        if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != ring_tail + 1) {
+            break;
+        }
+        fprintf(output, "%s\n", slot->text);
+        atomic_store_explicit(&slot->sequence, ring_tail + LOG_RING_SLOTS, memory_order_release);
+        ring_tail++;
+        count++;
+    }
+    if (count > 0) {
+        fflush(output);
+    }
+    return count;
+}
+
+static void* writer_main(void* arg) {
+    (void)arg;
+    const struct timespec idle = { 0, IDLE_SLEEP_NS };
+    for (;;) {
+        if (drain() > 0) {
+            continue;
+        }
+        if (atomic_load_explicit(&stopping, memory_order_acquire)) {
+            drain();
+            return NULL;
+        }
+        nanosleep(&idle, NULL);
+    }
+}
+
+bool log_start(FILE* out) {
+    if (atomic_load(&running)) {
+        return true;
+    }
+    output = out != NULL ? out : stderr;
+    for (size_t i = 0; i < LOG_RING_SLOTS; i++) {
+        atomic_store_explicit(&ring[i].sequence, i, memory_order_relaxed);
+    }
+    atomic_store(&ring_head, 0);
+    ring_tail = 0;
+    atomic_store(&stopping, false);
+    if (pthread_create(&writer, NULL, writer_main, NULL) != 0) {
+        return false;
+    }
+    atomic_store_explicit(&running, true, memory_order_release);
+    return true;
+}
+
+void log_stop(void) {
+    if (!atomic_load(&running)) {
+        return;
+    }
+    atomic_store_explicit(&running, false, memory_order_release);
+    atomic_store_explicit(&stopping, true, memory_order_release);
+    pthread_join(writer, NULL);
+    if (log_lost() != 0) {
+        fprintf(output, "warn: %llu log messages lost (ring full)\n", (unsigned long long)log_lost());
+    }
+}
@@ -0,0 +1,75 @@
+// In src/util/log.h
+
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Leveled logging for code that runs inside the emulation loop.
+//
+// LOG() costs one compare against the current level when its level is off.
+// When it is on, each call site passes a token bucket (LOG_SITE_BURST
+// messages, refilled at LOG_SITE_RATE per second), so a message triggered
+// every frame cannot flood the output; the next message that gets through
+// says how many were dropped. Accepted messages are formatted into a
+// lock-free multi-producer ring and written by a background thread, so the
+// emulation thread never waits on stdio. If the ring is full the message
+// is counted as lost rather than blocking. Without log_start, messages are
+// written directly (useful for short-lived tools).
+
+typedef enum {
+    LOG_ERROR,
+    LOG_WARN,
+    LOG_INFO,
+    LOG_DEBUG,
+} LogLevel;
+
+#define LOG_SITE_BURST 10
+#define LOG_SITE_RATE  1        // messages per second once the burst is spent
+#define LOG_RING_SLOTS 256      // power of two
+#define LOG_MESSAGE_BYTES 200
+
+// Rate-limit state of one LOG() call site.
+typedef struct LogSite {
+    const char*      file;
+    int              line;
+    _Atomic int64_t  refill_ns;     // when the bucket was last topped up
+    _Atomic int32_t  tokens;
+    _Atomic uint32_t suppressed;    // dropped since the last message
+} LogSite;
+
+extern _Atomic int log_level;       // messages above this level are skipped
+
+#define LOG_ENABLED(level) ((int)(level) <= atomic_load_explicit(&log_level, memory_order_relaxed))
+
+#define LOG(level, ...)                                                        \
+    do {                                                                       \
+        if (LOG_ENABLED(level)) {                                              \
+            static LogSite log_site_ = { __FILE__, __LINE__, 0, LOG_SITE_BURST, 0 }; \
+            log_write(&log_site_, (level), __VA_ARGS__);                       \
+        }                                                                      \
+    } while (0)
+
+// Parses "error", "warn", "info" or "debug". Returns false if unknown.
+bool log_parse_level(const char* name, LogLevel* level);
+
+void log_set_level(LogLevel level);
+
+// Starts the writer thread; messages go to out (stderr when NULL).
+// Returns false if the thread cannot be started (logging stays direct).
+bool log_start(FILE* out);
+
+// Writes out everything queued and stops the writer thread.
+void log_stop(void);
+
+// Messages lost because the ring was full.
+uint64_t log_lost(void);
+
+// Used by LOG(); applies the site's rate limit, then queues the message.
+void log_write(LogSite* site, LogLevel level, const char* format, ...)
+    __attribute__((format(printf, 3, 4)));
+
+#endif // LOG_H
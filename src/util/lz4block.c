@@ -0,0 +1,164 @@
+// In src/util/lz4block.c
+
+// Format reference: https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+
+#include <string.h>
+#include "lz4block.h"
+
+#define MIN_MATCH     4
+#define LAST_LITERALS 5     // the last 5 bytes are always literals
+#define MF_LIMIT      12    // no match may start in the last 12 bytes
+#define MAX_OFFSET    65535
+#define HASH_BITS     12
+
+static uint32_t read32(const uint8_t* p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t hash32(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// Writes a length continuation (values >= 15 spill into 255-valued bytes).
+static uint8_t* write_length(uint8_t* op, int length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (uint8_t)length;
+    return op;
+}
+
+int lz4_compress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity) {
+    if (dst_capacity < LZ4_BOUND(src_size)) {
+        return 0;
+    }
+
+    int32_t table[1 << HASH_BITS];
+    memset(table, 0xff, sizeof(table));   // -1 = empty slot
+
+    const int match_limit = src_size - LAST_LITERALS;
+    uint8_t* op = dst;
+    int anchor = 0;
+    int ip = 0;
+
+    while (ip < src_size - MF_LIMIT) {
+        uint32_t sequence = read32(src + ip);
+        uint32_t h = hash32(sequence);
+        int ref = table[h];
+        table[h] = ip;
+
+        if (ref < 0 || ip - ref > MAX_OFFSET || read32(src + ref) != sequence) {
+            ip++;
+            continue;
+        }
+
+        int length = MIN_MATCH;
+        while (ip + length < match_limit && src[ref + length] == src[ip + length]) {
+            length++;
+        }
+
+        // token, literal run, offset, match length
+        int literals = ip - anchor;
+        int match = length - MIN_MATCH;
+        uint8_t* token = op++;
+        *token = (uint8_t)(((literals >= 15 ? 15 : literals) << 4) | (match >= 15 ? 15 : match));
+        if (literals >= 15) {
+            op = write_length(op, literals - 15);
+        }
+        memcpy(op, src + anchor, literals);
+        op += literals;
+        *op++ = (uint8_t)(ip - ref);
+        *op++ = (uint8_t)((ip - ref) >> 8);
+        if (match >= 15) {
+            op = write_length(op, match - 15);
+        }
+
+        ip += length;
+        anchor = ip;
+    }
+
+    // final literal-only sequence
+    int literals = src_size - anchor;
+    *op++ = (uint8_t)((literals >= 15 ? 15 : literals) << 4);
+    if (literals >= 15) {
+        op = write_length(op, literals - 15);
+    }
+    memcpy(op, src + anchor, literals);
+    op += literals;
+
+    return (int)(op - dst);
+}
+
+// Reads a length continuation; returns -1 if it runs past the input.
+static int read_length(const uint8_t** ip, const uint8_t* end) {
+    int length = 0;
+    uint8_t b;
+    do {
+        if (*ip >= end) {
+            return -1;
+        }
+        b = *(*ip)++;
+        length += b;
+    } while (b == 255);
+    return length;
+}
+
+int lz4_decompress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity) {
+    const uint8_t* ip = src;
+    const uint8_t* end = src + src_size;
+    uint8_t* op = dst;
+    uint8_t* op_end = dst + dst_capacity;
+
+    while (ip < end) {
+        uint8_t token = *ip++;
+
+        int literals = token >> 4;
+        if (literals == 15) {
+            int extra = read_length(&ip, end);
+            if (extra < 0) return -1;
+            literals += extra;
+        }
+        if (literals > end - ip || literals > op_end - op) {
+            return -1;
+        }
+        memcpy(op, ip, literals);
+        ip += literals;
+        op += literals;
+
+        if (ip == end) {
+            break;  // last sequence has no match
+        }
+
+        if (end - ip < 2) {
+            return -1;
+        }
+        int offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > op - dst) {
+            return -1;
+        }
+
+        int length = token & 15;
+        if (length == 15) {
+            int extra = read_length(&ip, end);
+            if (extra < 0) return -1;
+            length += extra;
+        }
+        length += MIN_MATCH;
+        if (length > op_end - op) {
+            return -1;
+        }
+
+        // byte copy: source and destination may overlap (repeating patterns)
+        const uint8_t* match = op - offset;
+        for (int i = 0; i < length; i++) {
+            op[i] = match[i];
+        }
+        op += length;
+    }
+
+    return (int)(op - dst);
+}
@@ -0,0 +1,23 @@
+// In src/util/lz4block.h
+
+#ifndef LZ4BLOCK_H
+#define LZ4BLOCK_H
+
+#include <stdint.h>
+
+// Minimal codec for the LZ4 *block* format (no frame header or checksums).
+// Output is readable by the reference LZ4_decompress_safe and vice versa.
+// Greedy single-probe matching: fast, modest ratio, no allocations.
+
+// Worst-case compressed size for an input of n bytes.
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)
+
+// Compresses src into dst. Returns the compressed size, or 0 if dst_capacity
+// is too small (use LZ4_BOUND to size dst).
+int lz4_compress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity);
+
+// Decompresses src into dst. Returns the decompressed size, or -1 if the
+// input is malformed or would overflow dst.
+int lz4_decompress(const uint8_t* src, int src_size, uint8_t* dst, int dst_capacity);
+
+#endif // LZ4BLOCK_H
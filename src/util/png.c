@@ -0,0 +1,236 @@
+// In src/util/png.c
+
+// Format references: PNG (https://www.w3.org/TR/png/), zlib (RFC 1950),
+// deflate (RFC 1951).
+
+#include <pthread.h>
+#include <string.h>
+
+#include "crc32.h"
+#include "png.h"
+
+#define MIN_MATCH   3
+#define MAX_MATCH   258
+#define MAX_OFFSET  32768
+#define HASH_BITS   13
+
+// ---------------------------------------------------------------------------
+// Deflate with the fixed Huffman codes
+// ---------------------------------------------------------------------------
+
+// Huffman codes go out most significant bit first, everything else least
+// significant bit first, so the codes are stored bit-reversed.
+static uint16_t literal_code[288];
+static uint8_t  literal_bits[288];
+static uint8_t  distance_code[30];
+static pthread_once_t codes_once = PTHREAD_ONCE_INIT;
+
+static uint32_t reverse_bits(uint32_t code, int bits) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < bits; i++) {
+        reversed = reversed << 1 | ((code >> i) & 1);
+    }
+    return reversed;
+}
+
+static void init_codes(void) {
+    for (int symbol = 0; symbol < 288; symbol++) {
+        uint32_t code;
+        int bits;
+        if (symbol < 144) {
+            code = 0x30 + symbol, bits = 8;
+        } else if (symbol < 256) {
+            code = 0x190 + symbol - 144, bits = 9;
+        } else if (symbol < 280) {
+            code = symbol - 256, bits = 7;
+        } else {
+            code = 0xc0 + symbol - 280, bits = 8;
+        }
+        literal_code[symbol] = (uint16_t)reverse_bits(code, bits);
+        literal_bits[symbol] = (uint8_t)bits;
+    }
+    for (int symbol = 0; symbol < 30; symbol++) {
+        distance_code[symbol] = (uint8_t)reverse_bits(symbol, 5);
+    }
+}
+
+typedef struct BitWriter {
+    uint8_t* p;
+    uint64_t bits;
+    int      count;
+} BitWriter;
+
+static void put_bits(BitWriter* w, uint32_t value, int count) {
+    w->bits |= (uint64_t)value << w->count;
+    w->count += count;
+    while (w->count >= 8) {
+        *w->p++ = (uint8_t)w->bits;
+        w->bits >>= 8;
+        w->count -= 8;
+    }
+}
+
+static void put_literal(BitWriter* w, int symbol) {
+    put_bits(w, literal_code[symbol], literal_bits[symbol]);
+}
+
+// Length 3..258 as symbol 257..285 and extra bits.
+static void put_length(BitWriter* w, int length) {
+    int v = length - MIN_MATCH;
+    if (v < 8) {
+        put_literal(w, 257 + v);
+    } else if (v == MAX_MATCH - MIN_MATCH) {
+        put_literal(w, 285);
+    } else {
+        int top = 31 - __builtin_clz(v);        // 3..7
+        int extra = top - 2;
+        put_literal(w, 257 + 4 * (top - 1) + ((v >> extra) & 3));
+        put_bits(w, v & ((1u << extra) - 1), extra);
+    }
+}
+
+// Distance 1..32768 as symbol 0..29 and extra bits.
+static void put_distance(BitWriter* w, int distance) {
+    int v = distance - 1;
+    if (v < 4) {
+        put_bits(w, distance_code[v], 5);
+    } else {
+        int top = 31 - __builtin_clz(v);        // 2..14
+        int extra = top - 1;
+        put_bits(w, distance_code[2 * top + ((v >> extra) & 1)], 5);
+        put_bits(w, v & ((1u << extra) - 1), extra);
+    }
+}
+
+static uint32_t read24(const uint8_t* p) {
+    return p[0] | p[1] << 8 | p[2] << 16;
+}
+
+static uint32_t hash24(uint32_t v) {
+    return (v * 2654435761u) >> (32 - HASH_BITS);
+}
+
+// One final fixed-Huffman block holding src.
+static uint8_t* deflate_fixed(const uint8_t* src, size_t size, uint8_t* dst) {
+    int32_t table[1 << HASH_BITS];
+    memset(table, 0xff, sizeof(table));   // -1 = empty slot
+
+    BitWriter w = { .p = dst };
+    put_bits(&w, 1, 1);                   // BFINAL
+    put_bits(&w, 1, 2);                   // BTYPE 01: fixed codes
+    size_t ip = 0;
+    while (ip + MIN_MATCH < size) {
+        uint32_t sequence = read24(src + ip);
+        uint32_t h = hash24(sequence);
+        int32_t ref = table[h];
+        table[h] = (int32_t)ip;
+
+        if (ref < 0 || ip - ref > MAX_OFFSET || read24(src + ref) != sequence) {
+            put_literal(&w, src[ip++]);
+            continue;
+        }
+        size_t limit = size - ip < MAX_MATCH ? size - ip : MAX_MATCH;
+        size_t length = MIN_MATCH;
+        while (length < limit && src[ref + length] == src[ip + length]) {
+            length++;
+        }
+        put_length(&w, (int)length);
+        put_distance(&w, (int)(ip - ref));
+        ip += length;
+    }
+    while (ip < size) {
+        put_literal(&w, src[ip++]);
+    }
+    put_literal(&w, 256);                 // end of block
+    if (w.count > 0) {
+        *w.p++ = (uint8_t)w.bits;
+    }
+    return w.p;
+}
+
+static uint32_t adler32(const uint8_t* data, size_t size) {
+    uint32_t a = 1, b = 0;
+    while (size > 0) {
+        size_t n = size < 5552 ? size : 5552;   // largest run that cannot overflow b
+        size -= n;
+        while (n-- > 0) {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+// ---------------------------------------------------------------------------
+// PNG container
+// ---------------------------------------------------------------------------
+
+static uint8_t* put32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24);
+    p[1] = (uint8_t)(v >> 16);
+    p[2] = (uint8_t)(v >> 8);
+    p[3] = (uint8_t)v;
+    return p + 4;
+}
+
+// Completes the chunk whose length field is at start now that its data
+// ends at end: fills in the length and appends the CRC.
+static uint8_t* end_chunk(uint8_t* start, uint8_t* end) {
+    put32(start, (uint32_t)(end - start - 8));
+    return put32(end, crc32(start + 4, end - start - 4));
+}
+
+size_t png_encode(const PngImage* image, uint8_t* dst, size_t capacity) {
+    if (capacity < PNG_BOUND(image->width, image->height, image->bit_depth)) {
+        return 0;
+    }
+    pthread_once(&codes_once, init_codes);
+
+    size_t row_bytes = PNG_ROW_BYTES(image->width, image->bit_depth);
+    size_t raw_bytes = PNG_SCANLINE_BYTES(image->width, image->height, image->bit_depth);
+    for (int y = 0; y < image->height; y++) {
+        image->scanlines[y * row_bytes] = 0;   // filter: none
+    }
+
+    uint8_t* p = dst;
+    static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+    memcpy(p, signature, sizeof(signature));
+    p += sizeof(signature);
+
+    uint8_t* chunk = p;
+    p = put32(p + 4, 0x49484452);              // IHDR
+    p = put32(p, (uint32_t)image->width);
+    p = put32(p, (uint32_t)image->height);
+    *p++ = (uint8_t)image->bit_depth;
+    *p++ = image->palette != NULL ? 3 : 0;     // colour type: palette or grayscale
+    *p++ = 0;                                  // deflate
+    *p++ = 0;                                  // adaptive filtering
+    *p++ = 0;                                  // no interlace
+    p = end_chunk(chunk, p);
+
+    if (image->palette != NULL) {
+        chunk = p;
+        p = put32(p + 4, 0x504c5445);          // PLTE
+        for (int i = 0; i < image->colors; i++) {
+            *p++ = (uint8_t)(image->palette[i] >> 16);
+            *p++ = (uint8_t)(image->palette[i] >> 8);
+            *p++ = (uint8_t)image->palette[i];
+        }
+        p = end_chunk(chunk, p);
+    }
+
+    chunk = p;
+    p = put32(p + 4, 0x49444154);              // IDAT: a zlib stream
+    *p++ = 0x78;                               // deflate, 32 KB window
+    *p++ = 0x01;                               // fastest; header check bits
+    p = deflate_fixed(image->scanlines, raw_bytes, p);
+    p = put32(p, adler32(image->scanlines, raw_bytes));
+    p = end_chunk(chunk, p);
+
+    chunk = p;
+    p = put32(p + 4, 0x49454e44);              // IEND
+    p = end_chunk(chunk, p);
+    return p - dst;
+}
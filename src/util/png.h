@@ -0,0 +1,41 @@
+// In src/util/png.h
+
+#ifndef PNG_H
+#define PNG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Minimal PNG writer for low-bit-depth screenshots: grayscale or palette
+// images of 1, 2, 4 or 8 bits per pixel, one IDAT chunk, no filtering.
+// The deflate stream uses the fixed Huffman codes and greedy single-probe
+// LZ77 matching (as in lz4block.c): fast, a modest ratio, no allocations.
+// Readable by any PNG decoder.
+
+typedef struct PngImage {
+    int             width;
+    int             height;
+    int             bit_depth;     // 1, 2, 4 or 8
+    const uint32_t* palette;       // 0xRRGGBB colours (top byte ignored), or NULL for grayscale
+    int             colors;
+    uint8_t*        scanlines;     // PNG_SCANLINE_BYTES: a filter byte, then packed pixels, per row
+} PngImage;
+
+#define PNG_ROW_BYTES(width, depth)           (1 + ((size_t)(width) * (depth) + 7) / 8)
+#define PNG_SCANLINE_BYTES(width, height, depth) ((size_t)(height) * PNG_ROW_BYTES(width, depth))
+
+// Worst-case file size (every byte a 9-bit literal, plus chunks and palette).
+#define PNG_BOUND(width, height, depth) \
+    (PNG_SCANLINE_BYTES(width, height, depth) * 9 / 8 + 16 + 3 * 256 + 128)
+
+// Packed pixels of row y, most significant bits leftmost. The filter
+// bytes are png_encode's to set.
+static inline uint8_t* png_row(const PngImage* image, int y) {
+    return image->scanlines + (size_t)y * PNG_ROW_BYTES(image->width, image->bit_depth) + 1;
+}
+
+// Encodes image into dst. Returns the file size, or 0 if capacity is
+// below PNG_BOUND.
+size_t png_encode(const PngImage* image, uint8_t* dst, size_t capacity);
+
+#endif // PNG_H
@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "machine.h"
+#include "pages.h"
+#include "test.h"
+
+/*
+ * Fork Test - copy-on-write isolation of forked machines
+ *
+ * Forks a machine and checks that writes on either side, through
+ * machine_write_memory or through CPU stores, stay on that side. It also
+ * checks that only the written page stops being shared, that ROM stores
+ * are dropped everywhere, that the fault flag is inherited and reset, and
+ * that a child outlives its parent.
+ *
+ * Usage: ./fork_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define RAM 0x2000
+
+// MVI A,5Ah; STA 2300h; STA 0010h (a ROM byte); JMP 0008h
+static const uint8_t test_rom[] = {
+  0x3E, 0x5A,
+  0x32, 0x00, 0x23,
+  0x32, 0x10, 0x00,
+  0xC3, 0x08, 0x00,
+  [0x10] = 0x77,
+};
+
+static uint8_t peek(const Machine* m, uint16_t address) {
+  uint8_t value;
+  machine_read_memory(m, address, &value, 1);
+  return value;
+}
+
+static void poke(Machine* m, uint16_t address, uint8_t value) {
+  machine_write_memory(m, address, &value, 1);
+}
+
+static bool shared(const Machine* a, const Machine* b, uint16_t address) {
+  return a->cpu.read_map[address >> MEM_PAGE_SHIFT] == b->cpu.read_map[address >> MEM_PAGE_SHIFT];
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  char rom_path[4096];
+  snprintf(rom_path, sizeof(rom_path), "%s/fork.rom", argv[1]);
+  FILE* fp = fopen(rom_path, "wb");
+  if (fp == NULL || fwrite(test_rom, sizeof(test_rom), 1, fp) != 1 || fclose(fp) != 0) {
+    err(1, "%s", rom_path);
+  }
+
+  Machine* parent = machine_create();
+  if (parent == NULL || !machine_load_rom(parent, rom_path)) {
+    errx(1, "unable to set up a machine with %s", rom_path);
+  }
+  for (int i = 0; i < 0x400; i++) {
+    poke(parent, (uint16_t)(RAM + i), (uint8_t)i);
+  }
+
+  // the fork shares every page and copies none
+  Machine* child = machine_fork(parent);
+  CHECK(child != NULL);
+  if (child == NULL) {
+    return test_result("fork_test");
+  }
+  CHECK(child->cpu.pages == parent->cpu.pages);
+  CHECK(child->cpu.irq_profile == NULL && child->cpu.coverage == NULL);
+  for (unsigned p = 0; p < MEM_PAGES; p++) {
+    CHECK(child->cpu.read_map[p] == parent->cpu.read_map[p]);
+  }
+  CHECK(peek(child, RAM + 0x42) == 0x42);
+
+  // writes on either side stay there; only the written page is copied
+  poke(child, RAM, 0xAA);
+  CHECK(peek(child, RAM) == 0xAA);
+  CHECK(peek(parent, RAM) == 0x00);
+  CHECK(!shared(parent, child, RAM));
+  CHECK(peek(child, RAM + 1) == 0x01);
+  CHECK(shared(parent, child, RAM + MEM_PAGE_SIZE));
+
+  poke(parent, RAM + MEM_PAGE_SIZE, 0xBB);
+  CHECK(peek(parent, RAM + MEM_PAGE_SIZE) == 0xBB);
+  CHECK(peek(child, RAM + MEM_PAGE_SIZE) == (uint8_t)MEM_PAGE_SIZE);
+  CHECK(!shared(parent, child, RAM + MEM_PAGE_SIZE));
+  CHECK(shared(parent, child, RAM + 2 * MEM_PAGE_SIZE));
+
+  // CPU stores go through the same path; ROM stores are dropped
+  machine_run_cycles(child, 100);
+  CHECK(!child->cpu.fault);
+  CHECK(peek(child, 0x2300) == 0x5A);
+  CHECK(peek(parent, 0x2300) == 0x00);
+  CHECK(peek(child, 0x0010) == 0x77);
+  CHECK(peek(parent, 0x0010) == 0x77);
+  CHECK(shared(parent, child, 0x0000));
+  CHECK(parent->cpu.pc == 0 && parent->cycles == 0);
+
+  // forks of forks are isolated too
+  Machine* grandchild = machine_fork(child);
+  CHECK(grandchild != NULL);
+  if (grandchild != NULL) {
+    poke(grandchild, 0x2300, 0x11);
+    CHECK(peek(grandchild, 0x2300) == 0x11);
+    CHECK(peek(child, 0x2300) == 0x5A);
+    CHECK(peek(grandchild, RAM) == 0xAA);
+    machine_destroy(grandchild);
+  }
+
+  // a fault carries over to a fork and is cleared by a reset
+  child->cpu.fault = 1;
+  Machine* faulted = machine_fork(child);
+  CHECK(faulted != NULL && faulted->cpu.fault);
+  if (faulted != NULL) {
+    machine_reset(faulted);
+    CHECK(!faulted->cpu.fault && faulted->cpu.pc == 0);
+    machine_destroy(faulted);
+  }
+  child->cpu.fault = 0;
+
+  // the child keeps its pages, shared or not, after the parent is gone
+  machine_destroy(parent);
+  CHECK(peek(child, RAM) == 0xAA);
+  CHECK(peek(child, RAM + 0x3FF) == 0xFF);
+  CHECK(peek(child, 0x0010) == 0x77);
+  poke(child, RAM + 0x3FF, 0x01);
+  CHECK(peek(child, RAM + 0x3FF) == 0x01);
+  machine_destroy(child);
+
+  return test_result("fork_test");
+}
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "hook.h"
+#include "machine.h"
+#include "test.h"
+
+/*
+ * Hook Test - compiling and running hook scripts
+ *
+ * Checks that bad scripts are rejected with the right line number and
+ * message, that one-line and block ifs (with else) take the right branch,
+ * that an if on a comparison compiles to a single compare-and-branch for
+ * each of the six operators, that variables keep their values across calls
+ * until hook_reset, and that stop, press, release, stores, PC hooks and log
+ * do what the script says.
+ *
+ * Usage: ./hook_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define RAM 0x2000
+
+typedef struct BadScript {
+  const char* text;
+  const char* error;
+} BadScript;
+
+static const BadScript bad_scripts[] = {
+  { "x = 1\n", "line 1: statement outside a hook (add 'on vblank' or 'on pc ADDRESS')" },
+  { "var n\non vblank\n  n = (1 + 2\n", "line 3: expected ')'" },
+  { "on vblank\n  stop\nvar late\n", "line 3: 'var' must come before the first hook" },
+  { "var frame\n", "line 1: 'frame' is already defined" },
+  { "on vblank\n  # fine\n  else\n", "line 3: 'else' without 'if'" },
+  { "on vblank\n  end\n", "line 2: 'end' without 'if'" },
+  { "on vblank\n  if 1 then if 2 then stop\n", "line 2: 'if' after 'then'" },
+  { "on vblank\n  if 1 stop\n", "line 2: expected 'then' or end of line" },
+  { "on vblank\n  press jump\n", "line 2: unknown inputs 'jump'" },
+  { "on vblank\n\n  log \"x 1\n", "line 3: unterminated label" },
+  { "on vblank\n  stop now\n", "line 2: unexpected text 'now'" },
+  { "on vblank\n  n = 1\n", "line 2: unknown statement or variable 'n'" },
+  { "on pc 0x10\n  stop\non pc 16\n", "line 3: second hook at 0x0010" },
+  { "on vblank\n  stop\non vblank\n", "line 3: second 'on vblank'" },
+  { "on vblank\n  if 1\n    stop\non pc 0\n", "line 4: missing 'end'" },
+  { "# nothing but a comment\n", "line 2: no hooks defined" },
+};
+
+// Compiles text into prog, reporting the compiler's message if it fails.
+static bool compile(HookProgram* prog, const char* text) {
+  char error[128];
+  if (!hook_compile(prog, text, error, sizeof(error))) {
+    fprintf(stderr, "unexpected compile error: %s\n", error);
+    return false;
+  }
+  return true;
+}
+
+static void vblank(HookProgram* prog, Machine* m, uint64_t frame) {
+  HookEnv env = { .cpu = &m->cpu, .io = &m->io, .frame = frame, .cycles = 0 };
+  hook_run_vblank(prog, &env);
+}
+
+static uint8_t peek(const Machine* m, uint16_t address) {
+  uint8_t value;
+  machine_read_memory(m, address, &value, 1);
+  return value;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  HookProgram* prog = malloc(sizeof(HookProgram));
+  Machine* m = machine_create();
+  if (prog == NULL || m == NULL) {
+    errx(1, "out of memory");
+  }
+
+  // errors name the line the compiler stopped on
+  for (size_t i = 0; i < sizeof(bad_scripts) / sizeof(bad_scripts[0]); i++) {
+    char error[128] = "";
+    CHECK(!hook_compile(prog, bad_scripts[i].text, error, sizeof(error)));
+    if (strcmp(error, bad_scripts[i].error) != 0) {
+      fprintf(stderr, "script %zu: expected \"%s\", got \"%s\"\n", i, bad_scripts[i].error, error);
+      CHECK(strcmp(error, bad_scripts[i].error) == 0);
+    }
+  }
+
+  // one-line and block ifs, with and without else, nested
+  const char* branches =
+    "var odd, even, big, small\n"
+    "on vblank\n"
+    "  if frame % 2 then odd = odd + 1\n"
+    "  if frame % 2 == 0\n"
+    "    even = even + 1\n"
+    "  end\n"
+    "  if frame >= 3\n"
+    "    big = big + 1\n"
+    "  else\n"
+    "    if frame == 0 then small = small + 10\n"
+    "    small = small + 1\n"
+    "  end\n";
+  if (compile(prog, branches)) {
+    for (uint64_t f = 0; f < 6; f++) {
+      vblank(prog, m, f);
+    }
+    CHECK(prog->regs[0] == 3);      // odd: frames 1, 3, 5
+    CHECK(prog->regs[1] == 3);      // even: frames 0, 2, 4
+    CHECK(prog->regs[2] == 3);      // big: frames 3, 4, 5
+    CHECK(prog->regs[3] == 13);     // small: frames 0, 1, 2, plus 10 at frame 0
+  }
+
+  // an if on a comparison is one inverted compare-and-branch: FRAME, Jcc, STOP, RET
+  static const struct { const char* op; bool stops[5]; } comparisons[] = {
+    { "<",  { true, true, false, false, false } },
+    { "<=", { true, true, true, false, false } },
+    { ">",  { false, false, false, true, true } },
+    { ">=", { false, false, true, true, true } },
+    { "==", { false, false, true, false, false } },
+    { "!=", { true, true, false, true, true } },
+  };
+  for (size_t i = 0; i < sizeof(comparisons) / sizeof(comparisons[0]); i++) {
+    char script[64];
+    snprintf(script, sizeof(script), "on vblank\n  if frame %s 2 then stop\n", comparisons[i].op);
+    if (!compile(prog, script)) {
+      CHECK(false);
+      continue;
+    }
+    CHECK(prog->code_count == 4);
+    for (uint64_t f = 0; f < 5; f++) {
+      hook_reset(prog);
+      vblank(prog, m, f);
+      if (prog->stopped != comparisons[i].stops[f]) {
+        fprintf(stderr, "frame %s 2 at frame %llu\n", comparisons[i].op, (unsigned long long)f);
+        CHECK(prog->stopped == comparisons[i].stops[f]);
+      }
+    }
+  }
+  // anything else tests for zero
+  if (compile(prog, "var x\non vblank\n  if x then stop\n")) {
+    CHECK(prog->code_count == 3);
+    vblank(prog, m, 0);
+    CHECK(!prog->stopped);
+    prog->regs[0] = -1;
+    vblank(prog, m, 0);
+    CHECK(prog->stopped);
+  }
+
+  // variables start from their initial values and keep them across calls
+  if (compile(prog, "var n = 5, step = -2\non vblank\n  n = n + step\n  if n < 0 then stop\n")) {
+    CHECK(prog->regs[0] == 5 && prog->regs[1] == -2);
+    vblank(prog, m, 0);
+    vblank(prog, m, 1);
+    CHECK(prog->regs[0] == 1 && !prog->stopped);
+    vblank(prog, m, 2);
+    CHECK(prog->regs[0] == -1 && prog->stopped);
+    vblank(prog, m, 3);
+    CHECK(prog->regs[0] == -3 && prog->stopped);
+    hook_reset(prog);
+    CHECK(prog->regs[0] == 5 && !prog->stopped);
+  }
+
+  // press and release touch only the input bits; stores reach guest RAM
+  const char* io =
+    "var v\n"
+    "on vblank\n"
+    "  if frame == 0 then press left+fire+p2right\n"
+    "  if frame == 1 then release fire\n"
+    "  if frame == 2 then release left+p2right\n"
+    "  [0x2400 + frame] = 0x5a + frame\n"
+    "  v = w[0x2400] + bcd[0x2410]\n";
+  if (compile(prog, io)) {
+    m->io.port1 = 0x08;
+    m->io.port2 = 0x03;
+    machine_write_memory(m, RAM + 0x410, (const uint8_t[]){ 0x34, 0x12 }, 2);
+    vblank(prog, m, 0);
+    CHECK(m->io.port1 == 0x38 && m->io.port2 == 0x43);
+    CHECK(peek(m, RAM + 0x400) == 0x5a);
+    CHECK(prog->regs[0] == 0x5a + 1234);
+    vblank(prog, m, 1);
+    CHECK(m->io.port1 == 0x28 && m->io.port2 == 0x43);
+    CHECK(peek(m, RAM + 0x401) == 0x5b);
+    CHECK(prog->regs[0] == 0x5b5a + 1234);
+    vblank(prog, m, 2);
+    CHECK(m->io.port1 == 0x08 && m->io.port2 == 0x03);
+    CHECK(peek(m, RAM + 0x402) == 0x5c);
+  }
+
+  // PC hooks run only at their address; log writes "frame N: LABEL VALUE"
+  char log_path[4096];
+  snprintf(log_path, sizeof(log_path), "%s/hook.log", argv[1]);
+  FILE* log = fopen(log_path, "w+");
+  if (log == NULL) {
+    err(1, "%s", log_path);
+  }
+  if (compile(prog, "var hits\non pc 0x1234\n  hits = hits + 1\n  log \"hits\" hits\n  screenshot \"here\"\n")) {
+    prog->log = log;
+    CHECK(prog->vblank_entry < 0 && prog->pc_count == 1);
+    CHECK(hook_breakpoint(prog, 0x1234));
+    CHECK(!hook_breakpoint(prog, 0x1235) && !hook_breakpoint(prog, 0x1233));
+    vblank(prog, m, 0);
+    CHECK(prog->regs[0] == 0 && prog->screenshot == NULL);
+    m->cpu.pc = 0x1234;
+    HookEnv env = { .cpu = &m->cpu, .io = &m->io, .frame = 7, .cycles = 0 };
+    hook_run_pc(prog, &env);
+    env.frame = 8;
+    hook_run_pc(prog, &env);
+    CHECK(prog->regs[0] == 2);
+    CHECK(prog->screenshot != NULL && strcmp(prog->screenshot, "here") == 0);
+    char text[64] = "";
+    rewind(log);
+    size_t n = fread(text, 1, sizeof(text) - 1, log);
+    text[n] = '\0';
+    CHECK(strcmp(text, "frame 7: hits 1\nframe 8: hits 2\n") == 0);
+  }
+  fclose(log);
+
+  machine_destroy(m);
+  free(prog);
+  return test_result("hook_test");
+}
@@ -0,0 +1,169 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "machine.h"
+#include "nvram.h"
+#include "test.h"
+
+/*
+ * NVRAM Test - two-slot battery-backed RAM file
+ *
+ * Commits a value twice and reopens the file to check that the newest copy
+ * is restored. It then corrupts the newest slot's CRC and checks that the
+ * previous value comes back, and that the next commit still goes to the
+ * right slot. Sequence numbers are run across 2^32 to check that the slot
+ * written after the wrap still counts as the newest. Also covers unchanged
+ * commits, commits before restore, foreign ranges and invalid ranges.
+ *
+ * Usage: ./nvram_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define ADDRESS NVRAM_DEFAULT_ADDRESS
+#define SLOT_CRC_OFFSET 12      // after the magic, sequence, address and size
+
+static char path[4096];
+
+static void open_nvram(Nvram* nv) {
+  char error[256];
+  if (!nvram_open(nv, path, ADDRESS, NVRAM_DEFAULT_SIZE, error, sizeof(error))) {
+    errx(1, "%s", error);
+  }
+}
+
+static void set_score(Machine* m, uint8_t low, uint8_t high) {
+  machine_write_memory(m, ADDRESS, (const uint8_t[]){ low, high }, 2);
+}
+
+// Restores the file into a fresh machine and returns the two bytes.
+static uint16_t restored_score(Nvram* nv) {
+  Machine* m = machine_create();
+  if (m == NULL) {
+    errx(1, "out of memory");
+  }
+  set_score(m, 0xee, 0xee);
+  nvram_restore(nv, &m->cpu);
+  uint8_t bytes[2];
+  machine_read_memory(m, ADDRESS, bytes, 2);
+  machine_destroy(m);
+  return (uint16_t)(bytes[0] | bytes[1] << 8);
+}
+
+// Flips one bit of the CRC stored in slot.
+static void corrupt_crc(const Nvram* nv, int slot) {
+  int fd = open(path, O_RDWR);
+  uint8_t byte;
+  off_t offset = (off_t)(slot * nv->slot_bytes + SLOT_CRC_OFFSET);
+  if (fd < 0 || pread(fd, &byte, 1, offset) != 1) {
+    err(1, "%s", path);
+  }
+  byte ^= 0x01;
+  if (pwrite(fd, &byte, 1, offset) != 1 || close(fd) != 0) {
+    err(1, "%s", path);
+  }
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  snprintf(path, sizeof(path), "%s/nvram.bin", argv[1]);
+  unlink(path);
+  Machine* m = machine_create();
+  if (m == NULL) {
+    errx(1, "out of memory");
+  }
+
+  // a new file has nothing to restore, and nothing is saved before a restore
+  Nvram nv;
+  open_nvram(&nv);
+  CHECK(nv.current == -1);
+  set_score(m, 0x10, 0x00);
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.commits == 0 && nv.current == -1);
+  nvram_restore(&nv, &m->cpu);
+  uint8_t bytes[2];
+  machine_read_memory(m, ADDRESS, bytes, 2);
+  CHECK(bytes[0] == 0x10 && bytes[1] == 0x00);
+
+  // two commits fill both slots; an unchanged range is not written again
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.commits == 1 && nv.sequence == 1);
+  int first_slot = nv.current;
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.commits == 1);
+  set_score(m, 0x50, 0x12);
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.commits == 2 && nv.sequence == 2 && nv.current == 1 - first_slot);
+  int newest_slot = nv.current;
+  nvram_close(&nv);
+
+  open_nvram(&nv);
+  CHECK(nv.current == newest_slot && nv.sequence == 2);
+  CHECK(restored_score(&nv) == 0x1250);
+  nvram_close(&nv);
+
+  // with the newest slot's CRC broken, the previous value comes back
+  corrupt_crc(&nv, newest_slot);
+  open_nvram(&nv);
+  CHECK(nv.current == first_slot && nv.sequence == 1);
+  CHECK(restored_score(&nv) == 0x0010);
+
+  // the next commit overwrites the broken slot, not the good one
+  set_score(m, 0x75, 0x00);
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.current == newest_slot && nv.sequence == 2);
+  nvram_close(&nv);
+  open_nvram(&nv);
+  CHECK(nv.current == newest_slot && restored_score(&nv) == 0x0075);
+
+  // sequence numbers wrap: 0 comes after 0xffffffff
+  nv.sequence = UINT32_MAX - 1;
+  set_score(m, 0x00, 0x01);
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.sequence == UINT32_MAX);
+  set_score(m, 0x00, 0x02);
+  CHECK(nvram_commit(&nv, &m->cpu));
+  CHECK(nv.sequence == 0);
+  int wrapped_slot = nv.current;
+  nvram_close(&nv);
+  open_nvram(&nv);
+  CHECK(nv.current == wrapped_slot && nv.sequence == 0);
+  CHECK(restored_score(&nv) == 0x0200);
+  nvram_close(&nv);
+
+  // ... and with the post-wrap slot broken, the one before the wrap wins
+  corrupt_crc(&nv, wrapped_slot);
+  open_nvram(&nv);
+  CHECK(nv.current == 1 - wrapped_slot && nv.sequence == UINT32_MAX);
+  CHECK(restored_score(&nv) == 0x0100);
+  nvram_close(&nv);
+
+  // slots saved for another range are ignored
+  char error[256];
+  CHECK(nvram_open(&nv, path, ADDRESS, NVRAM_DEFAULT_SIZE + 1, error, sizeof(error)));
+  CHECK(nv.current == -1);
+  nvram_close(&nv);
+  CHECK(nvram_open(&nv, path, ADDRESS + 1, NVRAM_DEFAULT_SIZE, error, sizeof(error)));
+  CHECK(nv.current == -1);
+  nvram_close(&nv);
+
+  // ranges that are empty, too long or past the end of memory are refused
+  CHECK(!nvram_open(&nv, path, ADDRESS, 0, error, sizeof(error)));
+  CHECK(!nvram_open(&nv, path, ADDRESS, NVRAM_MAX_SIZE + 1, error, sizeof(error)));
+  CHECK(!nvram_open(&nv, path, 0xffff, 2, error, sizeof(error)));
+  CHECK(strcmp(error, "invalid range 0xffff:2") == 0);
+
+  machine_destroy(m);
+  return test_result("nvram_test");
+}
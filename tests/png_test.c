@@ -0,0 +1,416 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "png.h"
+#include "test.h"
+
+/*
+ * PNG Test - screenshot encoding checked by an independent decoder
+ *
+ * Encodes screen-sized images the way screenshots are written (1bpp
+ * grayscale and 2bpp palette overlay, at scale 1 and 2) and reads every
+ * file back with the reference code here: chunk order, lengths and CRCs,
+ * the IHDR and PLTE fields, the zlib header and Adler-32, and an inflate
+ * of the fixed-Huffman IDAT that must give back the scanlines. A crafted
+ * image then makes the encoder emit a match of every length from 3 to 258
+ * and every distance code, each of which must decode to the same bytes.
+ *
+ * Usage: ./png_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define SCREEN_WIDTH  224
+#define SCREEN_HEIGHT 256
+
+static const uint32_t overlay_palette[4] = { 0x000000, 0xffffff, 0x20ff20, 0xff2020 };
+
+// ---------------------------------------------------------------------------
+// Reference decoder
+// ---------------------------------------------------------------------------
+
+static uint32_t reference_crc(const uint8_t* data, size_t size) {
+  uint32_t crc = 0xffffffff;
+  for (size_t i = 0; i < size; i++) {
+    crc ^= data[i];
+    for (int k = 0; k < 8; k++) {
+      crc = (crc >> 1) ^ (0xedb88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+static uint32_t reference_adler(const uint8_t* data, size_t size) {
+  uint32_t a = 1, b = 0;
+  for (size_t i = 0; i < size; i++) {
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return b << 16 | a;
+}
+
+static uint32_t get32(const uint8_t* p) {
+  return (uint32_t)p[0] << 24 | p[1] << 16 | p[2] << 8 | p[3];
+}
+
+typedef struct Inflate {
+  const uint8_t* p;
+  const uint8_t* end;
+  uint32_t       bit;             // next bit of *p
+  bool           overrun;
+  bool           lengths[259];    // match lengths seen
+  bool           distance_codes[30];
+} Inflate;
+
+static unsigned get_bit(Inflate* in) {
+  if (in->p == in->end) {
+    in->overrun = true;
+    return 0;
+  }
+  unsigned b = (*in->p >> in->bit) & 1;
+  if (++in->bit == 8) {
+    in->bit = 0;
+    in->p++;
+  }
+  return b;
+}
+
+// count bits, least significant first (extra bits and block header)
+static unsigned get_bits(Inflate* in, int count) {
+  unsigned v = 0;
+  for (int i = 0; i < count; i++) {
+    v |= get_bit(in) << i;
+  }
+  return v;
+}
+
+// count bits, most significant first (Huffman codes)
+static unsigned get_code(Inflate* in, int count) {
+  unsigned v = 0;
+  for (int i = 0; i < count; i++) {
+    v = v << 1 | get_bit(in);
+  }
+  return v;
+}
+
+// RFC 1951 3.2.6: the fixed literal/length code.
+static int fixed_symbol(Inflate* in) {
+  unsigned code = get_code(in, 7);
+  if (code <= 0x17) {
+    return 256 + code;
+  }
+  code = code << 1 | get_bit(in);
+  if (code >= 0x30 && code <= 0xbf) {
+    return code - 0x30;
+  }
+  if (code >= 0xc0 && code <= 0xc7) {
+    return 280 + code - 0xc0;
+  }
+  code = code << 1 | get_bit(in);
+  return 144 + code - 0x190;
+}
+
+// Inflates one final fixed-Huffman block into out. Returns the number of
+// bytes written, or -1 if the stream is not what the encoder should make.
+static long inflate_fixed(Inflate* in, uint8_t* out, size_t capacity) {
+  static const uint16_t length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258,
+  };
+  static const uint8_t length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0,
+  };
+  static const uint16_t distance_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577,
+  };
+
+  if (get_bits(in, 1) != 1 || get_bits(in, 2) != 1) {
+    return -1;                    // the encoder writes one final fixed block
+  }
+  size_t n = 0;
+  for (;;) {
+    int symbol = fixed_symbol(in);
+    if (in->overrun || symbol > 285) {
+      return -1;
+    }
+    if (symbol < 256) {
+      if (n == capacity) {
+        return -1;
+      }
+      out[n++] = (uint8_t)symbol;
+      continue;
+    }
+    if (symbol == 256) {
+      return (long)n;
+    }
+    int length = length_base[symbol - 257] + get_bits(in, length_extra[symbol - 257]);
+    int code = get_code(in, 5);
+    if (code >= 30) {
+      return -1;
+    }
+    int extra = code < 4 ? 0 : code / 2 - 1;
+    size_t distance = distance_base[code] + get_bits(in, extra);
+    if (in->overrun || distance > n || n + length > capacity) {
+      return -1;
+    }
+    in->lengths[length] = true;
+    in->distance_codes[code] = true;
+    for (int i = 0; i < length; i++, n++) {
+      out[n] = out[n - distance];
+    }
+  }
+}
+
+// Checks a whole PNG file against the image it was made from. With in
+// non-NULL, leaves the match statistics of the IDAT there.
+static void check_png(const uint8_t* file, size_t size, const PngImage* image, Inflate* in) {
+  static const uint8_t signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  CHECK(size > sizeof(signature) && memcmp(file, signature, sizeof(signature)) == 0);
+
+  size_t raw_bytes = PNG_SCANLINE_BYTES(image->width, image->height, image->bit_depth);
+  uint8_t* raw = malloc(raw_bytes + 1);
+  Inflate local;
+  if (in == NULL) {
+    in = &local;
+  }
+  memset(in, 0, sizeof(*in));
+
+  const char* expected_order = image->palette != NULL ? "IHDR PLTE IDAT IEND " : "IHDR IDAT IEND ";
+  char order[64] = "";
+  size_t pos = sizeof(signature);
+  while (pos + 12 <= size && strlen(order) + 5 < sizeof(order)) {
+    uint32_t length = get32(file + pos);
+    if (pos + 12 + length > size) {
+      break;
+    }
+    const uint8_t* type = file + pos + 4;
+    const uint8_t* data = type + 4;
+    CHECK(get32(data + length) == reference_crc(type, length + 4));
+    snprintf(order + strlen(order), sizeof(order) - strlen(order), "%.4s ", (const char*)type);
+
+    if (memcmp(type, "IHDR", 4) == 0) {
+      CHECK(length == 13);
+      CHECK(get32(data) == (uint32_t)image->width && get32(data + 4) == (uint32_t)image->height);
+      CHECK(data[8] == image->bit_depth);
+      CHECK(data[9] == (image->palette != NULL ? 3 : 0));
+      CHECK(data[10] == 0 && data[11] == 0 && data[12] == 0);
+    } else if (memcmp(type, "PLTE", 4) == 0) {
+      CHECK(image->palette != NULL && length == 3u * image->colors);
+      for (int i = 0; image->palette != NULL && i < image->colors && 3u * i + 2 < length; i++) {
+        CHECK(data[3 * i] == (uint8_t)(image->palette[i] >> 16));
+        CHECK(data[3 * i + 1] == (uint8_t)(image->palette[i] >> 8));
+        CHECK(data[3 * i + 2] == (uint8_t)image->palette[i]);
+      }
+    } else if (memcmp(type, "IDAT", 4) == 0) {
+      // zlib: CM 8, a 32 KB window, no dictionary, header a multiple of 31
+      CHECK(length >= 6 && data[0] == 0x78 && (data[1] & 0x20) == 0 && (data[0] << 8 | data[1]) % 31 == 0);
+      in->p = data + 2;
+      in->end = data + length - 4;
+      long n = inflate_fixed(in, raw, raw_bytes + 1);
+      CHECK(n == (long)raw_bytes);
+      CHECK(in->p + (in->bit != 0) == in->end);     // the Adler-32 follows the last byte
+      if (n == (long)raw_bytes) {
+        CHECK(memcmp(raw, image->scanlines, raw_bytes) == 0);
+        CHECK(get32(data + length - 4) == reference_adler(raw, raw_bytes));
+      }
+      for (int y = 0; y < image->height; y++) {
+        CHECK(image->scanlines[y * PNG_ROW_BYTES(image->width, image->bit_depth)] == 0);
+      }
+    } else if (memcmp(type, "IEND", 4) == 0) {
+      CHECK(length == 0);
+    }
+    pos += 12 + length;
+  }
+  CHECK(pos == size);
+  if (strcmp(order, expected_order) != 0) {
+    fprintf(stderr, "chunks: expected \"%s\", got \"%s\"\n", expected_order, order);
+    CHECK(strcmp(order, expected_order) == 0);
+  }
+  free(raw);
+}
+
+// ---------------------------------------------------------------------------
+// Test images
+// ---------------------------------------------------------------------------
+
+static uint32_t random_state = 0x2400;
+
+static uint32_t next_random(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return random_state;
+}
+
+// A screen with the usual mix: empty space, repeated shapes, a noisy band.
+static void make_screen(uint8_t* indices) {
+  for (int y = 0; y < SCREEN_HEIGHT; y++) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+      uint8_t v = 0;
+      if (y >= 40 && y < 120 && (x / 16 + y / 16) % 2 == 0 && (x % 16) < 12) {
+        v = 1 + (y >= 80);                     // rows of invaders, two colours
+      } else if (y >= 180 && y < 200) {
+        v = next_random() % 4;                 // shields and shots
+      } else if (y == 239) {
+        v = 3;                                 // ground line
+      }
+      indices[y * SCREEN_WIDTH + x] = v;
+    }
+  }
+}
+
+// Packs the screen as screenshot.c does: each pixel scale x scale, MSB first.
+static void pack_screen(const uint8_t* indices, const PngImage* image, int scale) {
+  int depth = image->bit_depth;
+  size_t row_bytes = PNG_ROW_BYTES(image->width, depth) - 1;
+  for (int y = 0; y < image->height; y++) {
+    uint8_t* row = png_row(image, y);
+    memset(row, 0, row_bytes);
+    for (int x = 0; x < image->width; x++) {
+      unsigned value = indices[(y / scale) * SCREEN_WIDTH + x / scale];
+      if (depth == 1) {
+        value = value != 0;
+      }
+      int bit = x * depth;
+      row[bit / 8] |= (uint8_t)(value << (8 - depth - bit % 8));
+    }
+  }
+}
+
+static void random_bytes(uint8_t* p, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    p[i] = (uint8_t)(1 + next_random() % 255);   // never 0, the filler byte
+  }
+}
+
+// One row of bytes laid out so that greedy matching meets a repeat of
+// every length from 3 to 258 and a repeat at the base of every distance
+// code. Each is tried a few times with fresh bytes, in case a hash
+// collision hides one.
+static size_t make_match_row(uint8_t* p) {
+  static const uint16_t distances[] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577, 32768,
+  };
+  uint8_t* start = p;
+  for (int length = 3; length <= 258; length++) {
+    for (int attempt = 0; attempt < 3; attempt++) {
+      uint8_t* block = p;
+      random_bytes(p, length + 1);               // the block and a separator
+      p += length + 1;
+      memcpy(p, block, length);
+      p += length;
+      do {
+        random_bytes(p, 1);
+      } while (*p == block[length]);             // the match stops here
+      p++;
+    }
+  }
+  for (size_t i = 0; i < sizeof(distances) / sizeof(distances[0]); i++) {
+    for (int attempt = 0; attempt < 3; attempt++) {
+      if (distances[i] < 4) {
+        // a run: each byte repeats the one d back
+        random_bytes(p, distances[i]);
+        for (int k = distances[i]; k < 16; k++) {
+          p[k] = p[k - distances[i]];
+        }
+        p += 16;
+      } else {
+        random_bytes(p, 4);                      // token, zeros, token again
+        memset(p + 4, 0, distances[i] - 4);
+        memcpy(p + distances[i], p, 4);
+        p += distances[i] + 4;
+      }
+      random_bytes(p, 1);
+      p++;
+    }
+  }
+  return p - start;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  uint8_t* indices = malloc(SCREEN_WIDTH * SCREEN_HEIGHT);
+  if (indices == NULL) {
+    errx(1, "out of memory");
+  }
+  make_screen(indices);
+
+  // screenshots: 1bpp and 2bpp overlay, scale 1 and 2
+  for (int depth = 1; depth <= 2; depth++) {
+    for (int scale = 1; scale <= 2; scale++) {
+      PngImage image = {
+        .width = SCREEN_WIDTH * scale,
+        .height = SCREEN_HEIGHT * scale,
+        .bit_depth = depth,
+        .palette = depth == 2 ? overlay_palette : NULL,
+        .colors = 4,
+      };
+      size_t bound = PNG_BOUND(image.width, image.height, depth);
+      image.scanlines = malloc(PNG_SCANLINE_BYTES(image.width, image.height, depth));
+      uint8_t* file = malloc(bound);
+      if (image.scanlines == NULL || file == NULL) {
+        errx(1, "out of memory");
+      }
+      pack_screen(indices, &image, scale);
+      CHECK(png_encode(&image, file, bound - 1) == 0);
+      size_t size = png_encode(&image, file, bound);
+      CHECK(size > 0 && size < bound);
+      check_png(file, size, &image, NULL);
+
+      char path[4096];
+      snprintf(path, sizeof(path), "%s/screen-%dbpp-x%d.png", argv[1], depth, scale);
+      FILE* fp = fopen(path, "wb");
+      if (fp == NULL || fwrite(file, 1, size, fp) != size || fclose(fp) != 0) {
+        err(1, "%s", path);
+      }
+      free(file);
+      free(image.scanlines);
+    }
+  }
+
+  // every match length and distance code
+  size_t capacity = 1 << 20;
+  PngImage row = { .height = 1, .bit_depth = 8, .scanlines = malloc(capacity + 1) };
+  if (row.scanlines == NULL) {
+    errx(1, "out of memory");
+  }
+  row.width = (int)make_match_row(row.scanlines + 1);
+  CHECK((size_t)row.width <= capacity);
+  size_t bound = PNG_BOUND(row.width, 1, 8);
+  uint8_t* file = malloc(bound);
+  if (file == NULL) {
+    errx(1, "out of memory");
+  }
+  size_t size = png_encode(&row, file, bound);
+  CHECK(size > 0);
+  Inflate in;
+  check_png(file, size, &row, &in);
+  for (int length = 3; length <= 258; length++) {
+    if (!in.lengths[length]) {
+      fprintf(stderr, "no match of length %d\n", length);
+      CHECK(in.lengths[length]);
+    }
+  }
+  for (int code = 0; code < 30; code++) {
+    if (!in.distance_codes[code]) {
+      fprintf(stderr, "no match with distance code %d\n", code);
+      CHECK(in.distance_codes[code]);
+    }
+  }
+
+  free(file);
+  free(row.scanlines);
+  free(indices);
+  return test_result("png_test");
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "machine.h"
+#include "ramexpr.h"
+#include "test.h"
+
+/*
+ * RAM Expression Test - compiling and evaluating RAM expressions
+ *
+ * Evaluates a table of expressions against a machine with known RAM,
+ * registers and counters: memory reads (byte, word, BCD, wrapping
+ * addresses), precedence, division and modulo by 0 and -1, shifts and
+ * overflow. A second table checks that bad expressions fail with the right
+ * message and position, and the limits check that RAMEXPR_MAX_DEPTH and
+ * RAMEXPR_MAX_OPS are enforced exactly.
+ *
+ * Usage: ./ramexpr_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define FRAME  1234
+#define CYCLES 41152259
+
+typedef struct Case {
+  const char* text;
+  int64_t     value;
+} Case;
+
+static const Case cases[] = {
+  // constants and memory
+  { "42", 42 },
+  { "0x20F8", 0x20f8 },
+  { "[0x20f8]", 0x50 },
+  { "[0x20f0 + 8]", 0x50 },
+  { "[0x20f8 + 0x10000]", 0x50 },
+  { "w[0x20f8]", 0x1250 },
+  { "w[0xffff]", 0x1234 },
+  { "bcd[0x20f8]", 1250 },
+  { "bcd[0x20fa]", 9999 },
+  { "bcd[0x20f8] >= 1000 || frame >= 36000", 1 },
+  // registers and counters
+  { "frame", FRAME },
+  { "cycles", CYCLES },
+  { "pc + sp", 0x1a2b + 0x2400 },
+  { "a * 100 + b", 0x11 * 100 + 0x22 },
+  { "c + d + e + h + l", 0x33 + 0x44 + 0x55 + 0x66 + 0x77 },
+  // precedence and associativity
+  { "1 + 2 * 3", 7 },
+  { "(1 + 2) * 3", 9 },
+  { "3 - 2 - 1", 0 },
+  { "1 << 2 + 1", 8 },
+  { "1 | 2 ^ 3 & 1", 3 },
+  { "1 < 2 == 1", 1 },
+  { "2 && 0 || 5", 1 },
+  { "!0 + ~0", 0 },
+  { "- -5", 5 },
+  { "!7", 0 },
+  // division and modulo: by zero gives 0, by -1 wraps instead of trapping
+  { "7 / 0", 0 },
+  { "7 % 0", 0 },
+  { "-7 / 2", -3 },
+  { "-7 % 2", -1 },
+  { "5 / -1", -5 },
+  { "5 % -1", 0 },
+  { "(-9223372036854775807 - 1) / -1", INT64_MIN },
+  { "(-9223372036854775807 - 1) % -1", 0 },
+  // shifts: the count is taken mod 64, >> keeps the sign
+  { "1 << 63", INT64_MIN },
+  { "1 << 64", 1 },
+  { "1 << 65", 2 },
+  { "-16 >> 2", -4 },
+  { "0x100 >> 4", 0x10 },
+  // arithmetic wraps
+  { "9223372036854775807 + 1", INT64_MIN },
+  { "0x100000000 * 0x100000000", 0 },
+};
+
+typedef struct BadCase {
+  const char* text;
+  const char* error;
+} BadCase;
+
+static const BadCase bad_cases[] = {
+  { "", "unexpected end of expression at position 0" },
+  { "1 +", "unexpected end of expression at position 3" },
+  { "[0x2000", "expected ']' at position 7" },
+  { "w[1 + (2", "expected ')' at position 8" },
+  { "(1", "expected ')' at position 2" },
+  { "foo + 1", "unknown name at position 0" },
+  { "1 + bar", "unknown name at position 4" },
+  { "w + 1", "unknown name at position 0" },
+  { "1 $ 2", "unexpected text at position 2" },
+  { "frame 1", "unexpected text at position 6" },
+  { "#", "unexpected character at position 0" },
+};
+
+// Returns "1+(1+(...(1)...))" with n ones, which needs a stack n deep.
+static char* nested(int n) {
+  char* text = malloc(4 * n + 1);
+  char* p = text;
+  for (int i = 0; i < n - 1; i++) {
+    p += sprintf(p, "1+(");
+  }
+  p += sprintf(p, "1");
+  for (int i = 0; i < n - 1; i++) {
+    *p++ = ')';
+  }
+  *p = '\0';
+  return text;
+}
+
+// Returns "~1+1+...+1" with n ones: 2n instructions, stack depth 2.
+static char* chain(int n) {
+  char* text = malloc(2 * n + 2);
+  char* p = text;
+  p += sprintf(p, "~1");
+  for (int i = 1; i < n; i++) {
+    p += sprintf(p, "+1");
+  }
+  return text;
+}
+
+static bool fails_with(const char* text, const char* prefix) {
+  RamExpr expr;
+  char error[128] = "";
+  if (ramexpr_compile(&expr, text, error, sizeof(error))) {
+    return false;
+  }
+  return strncmp(error, prefix, strlen(prefix)) == 0;
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  Machine* m = machine_create();
+  if (m == NULL) {
+    errx(1, "out of memory");
+  }
+  machine_write_memory(m, 0x20f8, (const uint8_t[]){ 0x50, 0x12, 0x99, 0x99 }, 4);
+  machine_write_memory(m, 0xffff, (const uint8_t[]){ 0x34 }, 1);
+  machine_write_memory(m, 0x0000, (const uint8_t[]){ 0x12 }, 1);
+  State8080* cpu = &m->cpu;
+  cpu->a = 0x11; cpu->b = 0x22; cpu->c = 0x33; cpu->d = 0x44;
+  cpu->e = 0x55; cpu->h = 0x66; cpu->l = 0x77;
+  cpu->pc = 0x1a2b;
+  cpu->sp = 0x2400;
+
+  for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+    RamExpr expr;
+    char error[128];
+    if (!ramexpr_compile(&expr, cases[i].text, error, sizeof(error))) {
+      fprintf(stderr, "\"%s\": %s\n", cases[i].text, error);
+      CHECK(false);
+      continue;
+    }
+    int64_t value = ramexpr_eval_state(&expr, cpu, FRAME, CYCLES);
+    if (value != cases[i].value) {
+      fprintf(stderr, "\"%s\": expected %lld, got %lld\n", cases[i].text,
+              (long long)cases[i].value, (long long)value);
+      CHECK(value == cases[i].value);
+    }
+  }
+
+  for (size_t i = 0; i < sizeof(bad_cases) / sizeof(bad_cases[0]); i++) {
+    RamExpr expr;
+    char error[128] = "";
+    CHECK(!ramexpr_compile(&expr, bad_cases[i].text, error, sizeof(error)));
+    if (strcmp(error, bad_cases[i].error) != 0) {
+      fprintf(stderr, "\"%s\": expected \"%s\", got \"%s\"\n", bad_cases[i].text, bad_cases[i].error, error);
+      CHECK(strcmp(error, bad_cases[i].error) == 0);
+    }
+  }
+
+  // the limits hold exactly: one more level or instruction fails
+  char* deepest = nested(RAMEXPR_MAX_DEPTH);
+  char* too_deep = nested(RAMEXPR_MAX_DEPTH + 1);
+  RamExpr expr;
+  char error[128];
+  CHECK(ramexpr_compile(&expr, deepest, error, sizeof(error)));
+  CHECK(ramexpr_eval_state(&expr, cpu, 0, 0) == RAMEXPR_MAX_DEPTH);
+  CHECK(fails_with(too_deep, "expression nested too deeply at position "));
+  free(deepest);
+  free(too_deep);
+
+  char* longest = chain(RAMEXPR_MAX_OPS / 2);
+  char* too_long = chain(RAMEXPR_MAX_OPS / 2 + 1);
+  CHECK(ramexpr_compile(&expr, longest, error, sizeof(error)));
+  CHECK(expr.count == RAMEXPR_MAX_OPS);
+  CHECK(ramexpr_eval_state(&expr, cpu, 0, 0) == RAMEXPR_MAX_OPS / 2 - 3);
+  CHECK(fails_with(too_long, "expression too long at position "));
+  free(longest);
+  free(too_long);
+
+  machine_destroy(m);
+  return test_result("ramexpr_test");
+}
@@ -0,0 +1,126 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "machine.h"
+#include "replay.h"
+#include "test.h"
+
+/*
+ * Replay Test - record runs for replay_verify to check
+ *
+ * Writes a small test ROM and two recordings of it. Both are made the way
+ * the emulator shell makes them: the CPU runs to each interrupt on the
+ * machine_interrupt_cycle schedule, the ports are latched, then RST 1 or
+ * RST 2 is raised. Inputs change every frame. In the second recording the
+ * ports noted for frame TAMPER_FRAME are not the ones the machine saw, so
+ * replay_verify must report that frame. "make check" runs the verifier on
+ * both, and on a recording of the same ROM made by the shell itself.
+ *
+ * The ROM counts in HL in its main loop. RST 1 stores HL at 0x2000, RST 2
+ * stores it at 0x2002 and port 1 at 0x2004, so the RAM hashed every frame
+ * depends on the exact cycle each interrupt was raised at.
+ *
+ * Usage: ./replay_test <rom> <recording> <tampered recording>
+ *
+ * Return Values:
+ *   0 - the recordings were written and load back as expected
+ *   1 - a check failed or a file could not be written
+ */
+
+#define FRAMES             1200
+#define KEYFRAME_INTERVAL  100
+#define TAMPER_FRAME       250
+
+static const uint8_t test_rom[] = {
+  [0x00] = 0x31, 0x00, 0x24,   // LXI SP,2400h
+  [0x03] = 0xC3, 0x40, 0x00,   // JMP 0040h
+  [0x08] = 0x22, 0x00, 0x20,   // RST 1: SHLD 2000h
+           0xFB,               //        EI
+           0xC9,               //        RET
+  [0x10] = 0x22, 0x02, 0x20,   // RST 2: SHLD 2002h
+           0xDB, 0x01,         //        IN 1
+           0x32, 0x04, 0x20,   //        STA 2004h
+           0xFB,               //        EI
+           0xC9,               //        RET
+  [0x40] = 0x21, 0x00, 0x00,   // LXI H,0
+           0xFB,               // EI
+           0x23,               // loop: INX H
+           0xC3, 0x44, 0x00,   //       JMP loop
+};
+
+static void write_rom(const char* path) {
+  FILE* fp = fopen(path, "wb");
+  if (fp == NULL || fwrite(test_rom, sizeof(test_rom), 1, fp) != 1 || fclose(fp) != 0) {
+    err(1, "%s", path);
+  }
+}
+
+static void run_to(Machine* m, uint64_t cycle) {
+  if (m->cycles < cycle) {
+    machine_run_cycles(m, cycle - m->cycles);
+  }
+}
+
+// Records FRAMES frames of the ROM at rom_path to path. If tamper is set,
+// the inputs noted for TAMPER_FRAME differ from the ones applied.
+static void record(const char* rom_path, const char* path, bool tamper) {
+  Machine* m = machine_create();
+  if (m == NULL || !machine_load_rom(m, rom_path)) {
+    errx(1, "unable to set up a machine with %s", rom_path);
+  }
+
+  ReplayWriter w;
+  ReplayCounters counters = { m->cycles, m->instructions, m->frame };
+  if (!replay_open(&w, path, KEYFRAME_INTERVAL, sizeof(test_rom), &m->cpu, &m->io, &counters)) {
+    err(1, "%s", path);
+  }
+
+  uint32_t input = 1;
+  for (int frame = 0; frame < FRAMES; frame++) {
+    for (int half = 0; half < 2; half++) {
+      run_to(m, machine_interrupt_cycle(m->frame, half));
+      input = input * 1103515245 + 12345;
+      m->io.port1 = (uint8_t)(input >> 16);
+      m->io.port2 = (uint8_t)(input >> 24);
+      if (tamper && frame == TAMPER_FRAME) {
+        MachineState noted = m->io;
+        noted.port1 ^= 0x01;
+        replay_input(&w, half + 1, &noted);
+      } else {
+        replay_input(&w, half + 1, &m->io);
+      }
+      generateInterrupt(&m->cpu, half + 1);
+    }
+    m->frame++;
+    counters = (ReplayCounters){ m->cycles, m->instructions, m->frame };
+    replay_frame(&w, &m->cpu, &m->io, &counters, false);
+  }
+  CHECK(!m->cpu.fault);
+  if (!replay_close(&w)) {
+    err(1, "%s", path);
+  }
+  machine_destroy(m);
+
+  Replay r;
+  char error[256];
+  CHECK(replay_load(&r, path, error, sizeof(error)));
+  CHECK(r.frame_count == FRAMES);
+  CHECK(r.keyframe_count == FRAMES / KEYFRAME_INTERVAL + 1);
+  CHECK(!r.truncated);
+  replay_free(&r);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    fprintf(stderr, "Usage: %s <rom> <recording> <tampered recording>\n", argv[0]);
+    return 1;
+  }
+  write_rom(argv[1]);
+  record(argv[1], argv[2], false);
+  record(argv[1], argv[3], true);
+  return test_result("replay_test");
+}
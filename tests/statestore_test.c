@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+
+#include "machine.h"
+#include "pages.h"
+#include "statestore.h"
+#include "test.h"
+
+/*
+ * State Store Test - deduplication and restore of snapshots
+ *
+ * Saves machines into a StateStore and checks that identical states,
+ * pages and groups are stored once, that every snapshot restores exactly,
+ * that a restore into a fork keeps unchanged pages shared, and that
+ * snapshots whose pages were spilled to disk restore as well.
+ *
+ * Usage: ./statestore_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define RAM            0x2000
+#define SPILL_STATES   400
+#define SPILL_BUDGET   (64 * 1024)
+
+static uint8_t peek(const Machine* m, uint16_t address) {
+  uint8_t value;
+  machine_read_memory(m, address, &value, 1);
+  return value;
+}
+
+static void poke(Machine* m, uint16_t address, uint8_t value) {
+  machine_write_memory(m, address, &value, 1);
+}
+
+static bool same_memory(const Machine* a, const Machine* b) {
+  static uint8_t image_a[MEMORY_SIZE], image_b[MEMORY_SIZE];
+  machine_read_memory(a, 0, image_a, MEMORY_SIZE);
+  machine_read_memory(b, 0, image_b, MEMORY_SIZE);
+  return memcmp(image_a, image_b, MEMORY_SIZE) == 0;
+}
+
+static void test_dedup(void) {
+  StateStore* store = statestore_create(NULL, 0);
+  Machine* m = machine_create();
+  if (store == NULL || m == NULL) {
+    errx(1, "out of memory");
+  }
+  for (int i = 0; i < 0x2000; i++) {
+    poke(m, (uint16_t)(RAM + i), (uint8_t)(i * 13));
+  }
+  m->cpu.a = 0x12;
+  m->cycles = 1000;
+
+  // saving the same state twice stores it once
+  SnapshotId first = statestore_save(store, m);
+  CHECK(first != STATESTORE_NONE);
+  CHECK(statestore_save(store, m) == first);
+  StateStoreStats before;
+  statestore_stats(store, &before);
+  CHECK(before.saves == 2);
+  CHECK(before.snapshots == 1);
+
+  // one changed byte costs one page and one group
+  poke(m, RAM + 0x1234, 0xEE);
+  SnapshotId changed = statestore_save(store, m);
+  CHECK(changed != STATESTORE_NONE && changed != first);
+  StateStoreStats after;
+  statestore_stats(store, &after);
+  CHECK(after.snapshots == 2);
+  CHECK(after.unique_pages == before.unique_pages + 1);
+  CHECK(after.unique_groups == before.unique_groups + 1);
+
+  // changing it back finds the first snapshot again
+  poke(m, RAM + 0x1234, (uint8_t)(0x1234 * 13));
+  CHECK(statestore_save(store, m) == first);
+
+  // registers alone make a new snapshot and no new pages
+  m->cpu.a = 0x13;
+  SnapshotId registers = statestore_save(store, m);
+  CHECK(registers != first && registers != changed);
+  statestore_stats(store, &after);
+  CHECK(after.snapshots == 3);
+  CHECK(after.unique_pages == before.unique_pages + 1);
+
+  // restores are exact, and a restore into a fork copies only the pages
+  // that differ
+  Machine* fork = machine_fork(m);
+  CHECK(fork != NULL);
+  if (fork != NULL) {
+    CHECK(statestore_load(store, changed, fork));
+    CHECK(fork->cpu.a == 0x12 && fork->cycles == 1000);
+    CHECK(peek(fork, RAM + 0x1234) == 0xEE);
+    CHECK(peek(m, RAM + 0x1234) == (uint8_t)(0x1234 * 13));
+    int copied = 0;
+    for (unsigned p = 0; p < MEM_PAGES; p++) {
+      copied += fork->cpu.read_map[p] != m->cpu.read_map[p];
+    }
+    CHECK(copied == 1);
+    CHECK(statestore_load(store, first, fork));
+    CHECK(same_memory(fork, m));
+    machine_destroy(fork);
+  }
+  CHECK(!statestore_load(store, 1000, m));
+
+  machine_destroy(m);
+  statestore_destroy(store);
+}
+
+// Enough distinct pages to spill many chunks; every snapshot must still
+// restore.
+static void test_spill(const char* directory) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/spill.bin", directory);
+  StateStore* store = statestore_create(path, SPILL_BUDGET);
+  Machine* m = machine_create();
+  Machine* check = machine_create();
+  if (store == NULL || m == NULL || check == NULL) {
+    errx(1, "unable to create a store spilling to %s", path);
+  }
+
+  SnapshotId ids[SPILL_STATES];
+  uint8_t page[MEM_PAGE_SIZE];
+  for (int s = 0; s < SPILL_STATES; s++) {
+    for (int i = 0; i < MEM_PAGE_SIZE; i++) {
+      page[i] = (uint8_t)(s * 31 + i * (s | 1));
+    }
+    machine_write_memory(m, (uint16_t)(RAM + (s % 32) * MEM_PAGE_SIZE), page, sizeof(page));
+    m->cpu.pc = (uint16_t)s;
+    ids[s] = statestore_save(store, m);
+    CHECK(ids[s] != STATESTORE_NONE);
+  }
+  StateStoreStats stats;
+  statestore_stats(store, &stats);
+  CHECK(stats.snapshots == SPILL_STATES);
+  CHECK(stats.spilled_chunks > 0);
+
+  // replay the writes up to each snapshot and compare
+  machine_destroy(m);
+  m = machine_create();
+  if (m == NULL) {
+    errx(1, "out of memory");
+  }
+  bool all_same = true;
+  for (int s = 0; s < SPILL_STATES; s++) {
+    for (int i = 0; i < MEM_PAGE_SIZE; i++) {
+      page[i] = (uint8_t)(s * 31 + i * (s | 1));
+    }
+    machine_write_memory(m, (uint16_t)(RAM + (s % 32) * MEM_PAGE_SIZE), page, sizeof(page));
+    bool loaded = statestore_load(store, ids[s], check);
+    all_same = all_same && loaded && check->cpu.pc == s && same_memory(check, m);
+  }
+  CHECK(all_same);
+
+  machine_destroy(m);
+  machine_destroy(check);
+  statestore_destroy(store);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  test_dedup();
+  test_spill(argv[1]);
+  return test_result("statestore_test");
+}
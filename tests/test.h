@@ -0,0 +1,30 @@
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+// Assertions for the headless tests run by "make check". A failed CHECK
+// prints the file, line and condition and the test goes on, so one run
+// reports every failure; main returns test_result().
+
+static int test_failures = 0;
+
+#define CHECK(cond)                                                         \
+  do {                                                                      \
+    if (!(cond)) {                                                          \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+      test_failures++;                                                      \
+    }                                                                       \
+  } while (0)
+
+// prints a summary line and returns the process exit status
+static inline int test_result(const char* name) {
+  if (test_failures != 0) {
+    fprintf(stderr, "%s: %d check(s) failed\n", name, test_failures);
+    return 1;
+  }
+  printf("%s: ok\n", name);
+  return 0;
+}
+
+#endif  // TEST_H
@@ -0,0 +1,192 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <err.h>
+#include <unistd.h>
+
+#include "cpu8080.h"
+#include "pages.h"
+#include "trace.h"
+#include "test.h"
+
+/*
+ * Trace Test - write, index, seek and read back binary traces
+ *
+ * Writes the same run as a raw (version 1) and an LZ4 (version 2) trace
+ * and reads both back through the index: every record must come back as
+ * it was written, and seeking by record, cycle and frame must land on the
+ * right block. The run has frames of constant registers, which compress,
+ * and frames of random ones, which LZ4 cannot shrink and which must
+ * therefore be stored raw. A trace whose writes fail must be reported by
+ * trace_close.
+ *
+ * It also leaves a raw trace that differs from raw.trace at record
+ * DIVERGE_AT, for "make check" to run tracediff on.
+ *
+ * Usage: ./trace_test <directory>
+ *
+ * Return Values:
+ *   0 - every check passed
+ *   1 - a check failed
+ */
+
+#define RECORDS       30000
+#define FRAME_RECORDS 7000     // more than a block, so frames span blocks
+#define CYCLES_EACH   4
+#define DIVERGE_AT    12345    // the record diverged.trace changes
+
+static uint8_t memory[MEMORY_SIZE];
+static TraceRecord expected[RECORDS];
+
+static uint32_t seed = 1;
+static uint8_t next_random(void) {
+  seed = seed * 1103515245 + 12345;
+  return (uint8_t)(seed >> 16);
+}
+
+// Sets up record i's CPU state; odd frames get random registers.
+static void make_state(State8080* state, int i) {
+  bool noisy = (i / FRAME_RECORDS) % 2 == 1;
+  state->pc = noisy ? (uint16_t)(next_random() << 8 | next_random()) : (uint16_t)(i % 0x2000);
+  state->sp = noisy ? (uint16_t)(next_random() << 8 | next_random()) : 0x2400;
+  state->a = noisy ? next_random() : 0x12;
+  state->b = noisy ? next_random() : 0x34;
+  state->c = noisy ? next_random() : 0;
+  state->d = noisy ? next_random() : 0;
+  state->e = noisy ? next_random() : 0;
+  state->h = noisy ? next_random() : 0x20;
+  state->l = noisy ? next_random() : (uint8_t)i;
+  cpu_set_flags_byte(&state->cc, noisy ? next_random() : 0x02);
+  state->int_enable = noisy ? next_random() : 1;
+}
+
+// Writes the run; if diverge is set, record DIVERGE_AT gets a different A.
+static void write_trace(const char* path, bool compress, bool diverge) {
+  State8080 state;
+  memset(&state, 0, sizeof(state));
+  pages_map_flat(&state, memory);
+
+  TraceWriter* tw = trace_open(path, compress);
+  CHECK(tw != NULL);
+  if (tw == NULL) {
+    return;
+  }
+  seed = 1;
+  for (int i = 0; i < RECORDS; i++) {
+    make_state(&state, i);
+    if (diverge && i == DIVERGE_AT) {
+      state.a ^= 0x01;
+    }
+    trace_record(tw, &state, (uint64_t)i * CYCLES_EACH, i / FRAME_RECORDS);
+    expected[i] = (TraceRecord){
+      .pc = state.pc, .sp = state.sp, .a = state.a, .f = cpu_flags_byte(&state.cc),
+      .b = state.b, .c = state.c, .d = state.d, .e = state.e, .h = state.h, .l = state.l,
+      .opcode = { memory[state.pc], memory[(uint16_t)(state.pc + 1)], memory[(uint16_t)(state.pc + 2)] },
+      .int_enable = state.int_enable,
+    };
+  }
+  CHECK(trace_close(tw));
+}
+
+static void read_trace(const char* path, bool compress) {
+  TraceReader* tr = trace_reader_open(path);
+  CHECK(tr != NULL);
+  if (tr == NULL) {
+    return;
+  }
+  CHECK(tr->header.version == (compress ? TRACE_VERSION_LZ4 : TRACE_VERSION));
+  CHECK(tr->records == RECORDS);
+
+  // every record, block by block
+  bool same = true;
+  int raw_blocks = 0, packed_blocks = 0;
+  for (int64_t b = 0; (uint64_t)b < tr->blocks; b++) {
+    const TraceIndexEntry* e = &tr->index[b];
+    const TraceRecord* records = trace_reader_block(tr, b);
+    CHECK(records != NULL);
+    if (records == NULL) {
+      continue;
+    }
+    for (uint32_t i = 0; i < e->records; i++) {
+      same = same && memcmp(&records[i], &expected[e->first_record + i], sizeof(TraceRecord)) == 0;
+    }
+    CHECK(e->cycle == e->first_record * CYCLES_EACH);
+    CHECK(e->frame == e->first_record / FRAME_RECORDS);
+    if (e->stored_size == e->records * sizeof(TraceRecord)) {
+      raw_blocks++;
+    } else {
+      packed_blocks++;
+    }
+  }
+  CHECK(same);
+  if (compress) {
+    CHECK(raw_blocks > 0);
+    CHECK(packed_blocks > 0);
+  } else {
+    CHECK(packed_blocks == 0);
+  }
+
+  // seeks
+  for (uint64_t record = 0; record < RECORDS; record += 997) {
+    int64_t b = trace_reader_find_record(tr, record);
+    CHECK(b >= 0 && tr->index[b].first_record <= record &&
+          record < tr->index[b].first_record + tr->index[b].records);
+    CHECK(trace_reader_find_cycle(tr, record * CYCLES_EACH) == b);
+  }
+  CHECK(trace_reader_find_record(tr, RECORDS) == -1);
+  for (uint64_t frame = 0; frame <= (RECORDS - 1) / FRAME_RECORDS; frame++) {
+    int64_t b = trace_reader_find_frame(tr, frame);
+    CHECK(b >= 0 && tr->index[b].first_record == frame * FRAME_RECORDS);
+  }
+  CHECK(trace_reader_find_frame(tr, RECORDS / FRAME_RECORDS + 1) == -1);
+  trace_reader_close(tr);
+}
+
+// A trace whose file cannot be written must fail at trace_close.
+static void write_failure(const char* path) {
+  FILE* full = fopen("/dev/full", "wb");
+  if (full == NULL) {
+    return;
+  }
+  State8080 state;
+  memset(&state, 0, sizeof(state));
+  pages_map_flat(&state, memory);
+  TraceWriter* tw = trace_open(path, false);
+  CHECK(tw != NULL);
+  if (tw == NULL) {
+    fclose(full);
+    return;
+  }
+  fclose(tw->fp);
+  tw->fp = full;
+  for (int i = 0; i < 2 * TRACE_BLOCK_RECORDS; i++) {
+    trace_record(tw, &state, i, 0);
+  }
+  CHECK(tw->failed);
+  CHECK(!trace_close(tw));
+}
+
+int main(int argc, char** argv) {
+  if (argc != 2) {
+    fprintf(stderr, "Usage: %s <directory>\n", argv[0]);
+    return 1;
+  }
+  for (int i = 0; i < MEMORY_SIZE; i++) {
+    memory[i] = next_random();
+  }
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/raw.trace", argv[1]);
+  write_trace(path, false, false);
+  read_trace(path, false);
+  snprintf(path, sizeof(path), "%s/lz4.trace", argv[1]);
+  write_trace(path, true, false);
+  read_trace(path, true);
+  snprintf(path, sizeof(path), "%s/diverged.trace", argv[1]);
+  write_trace(path, false, true);
+  snprintf(path, sizeof(path), "%s/full.trace", argv[1]);
+  write_failure(path);
+  return test_result("trace_test");
+}